@@ -32,17 +32,54 @@ typedef enum {
     JPEG_IMAGE_FORMAT_RGB565,       /*!< Format RGB565 */
 } esp_jpeg_image_format_t;
 
+/**
+ * @brief Chroma subsampling of input image
+ *
+ */
+typedef enum {
+    JPEG_IMAGE_SUBSAMPLING_UNKNOWN = 0, /*!< MCU layout not recognised */
+    JPEG_IMAGE_SUBSAMPLING_444,         /*!< No subsampling (MCU 8x8) */
+    JPEG_IMAGE_SUBSAMPLING_422,         /*!< Horizontal subsampling (MCU 16x8) */
+    JPEG_IMAGE_SUBSAMPLING_420,         /*!< Horizontal and vertical subsampling (MCU 16x16) */
+} esp_jpeg_image_subsampling_t;
+
+/**
+ * @brief Read callback for streaming input
+ *
+ * Called by the decoder whenever it needs more input. Copy up to len bytes
+ * into buf and return the number copied. When buf is NULL the bytes are to be
+ * skipped instead of copied. The callback may block until data is available;
+ * returning less than len means end of stream.
+ *
+ */
+typedef uint32_t (*esp_jpeg_stream_read_cb_t)(void *arg, uint8_t *buf, uint32_t len);
+
+/**
+ * @brief Scale select callback
+ *
+ * Called once the header has been parsed, with the unscaled image size,
+ * to choose the output scale before decoding starts.
+ *
+ */
+typedef esp_jpeg_image_scale_t (*esp_jpeg_scale_cb_t)(uint16_t width, uint16_t height);
+
 /**
  * @brief JPEG Configuration Type
  *
  */
 typedef struct esp_jpeg_image_cfg_s {
-    uint8_t *indata;        /*!< Input JPEG image */
+    uint8_t *indata;        /*!< Input JPEG image (not used in streaming mode) */
     uint32_t indata_size;   /*!< Size of input image  */
     uint8_t *outbuf;        /*!< Output buffer */
     uint32_t outbuf_size;   /*!< Output buffer size */
     esp_jpeg_image_format_t out_format; /*!< Output image format */
     esp_jpeg_image_scale_t  out_scale; /*!< Output scale */
+    esp_jpeg_scale_cb_t scale_cb;   /*!< Optional, overrides out_scale once the header is parsed */
+
+    struct {
+        esp_jpeg_stream_read_cb_t read; /*!< Optional, when set input is pulled from here instead of indata */
+        void *arg;                      /*!< User argument passed to read */
+    } stream;
 
     struct {
         uint8_t swap_color_bytes: 1; /*!< Swap first and last color bytes */
@@ -60,6 +97,7 @@ typedef struct esp_jpeg_image_cfg_s {
 typedef struct esp_jpeg_image_output_s {
     uint16_t width;    /*!< Width of the output image */
     uint16_t height;   /*!< Height of the output image */
+    esp_jpeg_image_subsampling_t subsampling; /*!< Chroma subsampling of the input image */
 } esp_jpeg_image_output_t;
 
 /**
@@ -67,6 +105,10 @@ typedef struct esp_jpeg_image_output_s {
  *
  * @note This function is blocking.
  *
+ * In streaming mode (cfg->stream.read set) the input is consumed exactly once
+ * as it arrives, so decoding can overlap a download and no buffer for the
+ * whole compressed image is needed.
+ *
  * @param cfg: Configuration structure
  * @param img: Output image info
  *
@@ -77,6 +119,23 @@ typedef struct esp_jpeg_image_output_s {
  */
 esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img);
 
+/**
+ * @brief Get information about JPEG image without decoding it
+ *
+ * Only the image header is parsed (jd_prepare), so this is much cheaper than
+ * a decode. The returned width and height are of the unscaled input image.
+ * Output buffer, format and scale in cfg are not used.
+ *
+ * @param cfg: Configuration structure (indata and indata_size must be set)
+ * @param img: Input image info
+ *
+ * @return
+ *      - ESP_OK            on success
+ *      - ESP_ERR_NO_MEM    if there is no memory for allocating main structure
+ *      - ESP_FAIL          if there is an error in parsing JPEG header
+ */
+esp_err_t esp_jpeg_get_image_info(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img);
+
 #ifdef __cplusplus
 }
 #endif
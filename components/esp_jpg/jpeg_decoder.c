@@ -56,6 +56,7 @@ static const char *TAG = "JPEG";
 *******************************************************************************/
 static uint8_t jpeg_get_div_by_scale(esp_jpeg_image_scale_t scale);
 static uint8_t jpeg_get_color_bytes(esp_jpeg_image_format_t format);
+static esp_jpeg_image_subsampling_t jpeg_get_subsampling(JDEC *dec);
 
 static unsigned int jpeg_decode_in_cb(JDEC *jd, uint8_t *buff, unsigned int nbyte);
 static unsigned int jpeg_decode_out_cb(JDEC *jd, void *bitmap, JRECT *rect);
@@ -82,6 +83,11 @@ esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *im
     res = jd_prepare(&JDEC, jpeg_decode_in_cb, workbuf, JPEG_WORK_BUF_SIZE, cfg);
     ESP_GOTO_ON_FALSE((res == JDR_OK), ESP_FAIL, err, TAG, "Error in preparing JPEG image!");
 
+    /* Scale can be chosen from the header, input does not need to be read twice */
+    if (cfg->scale_cb) {
+        cfg->out_scale = cfg->scale_cb(JDEC.width, JDEC.height);
+    }
+
     uint8_t scale_div = jpeg_get_div_by_scale(cfg->out_scale);
     uint8_t out_color_bytes = jpeg_get_color_bytes(cfg->out_format);
 
@@ -92,6 +98,7 @@ esp_err_t esp_jpeg_decode(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *im
     /* Size of output image */
     img->height = JDEC.height / scale_div;
     img->width = JDEC.width / scale_div;
+    img->subsampling = jpeg_get_subsampling(&JDEC);
 
     /* Decode JPEG */
     res = jd_decomp(&JDEC, jpeg_decode_out_cb, cfg->out_scale);
@@ -105,6 +112,37 @@ err:
     return ret;
 }
 
+esp_err_t esp_jpeg_get_image_info(esp_jpeg_image_cfg_t *cfg, esp_jpeg_image_output_t *img)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t *workbuf = NULL;
+    JRESULT res;
+    JDEC JDEC;
+
+    assert(cfg != NULL);
+    assert(img != NULL);
+
+    workbuf = heap_caps_malloc(JPEG_WORK_BUF_SIZE, MALLOC_CAP_DEFAULT);
+    ESP_GOTO_ON_FALSE(workbuf, ESP_ERR_NO_MEM, err, TAG, "no mem for JPEG work buffer");
+
+    cfg->priv.read = 0;
+
+    /* Parse headers only - no jd_decomp */
+    res = jd_prepare(&JDEC, jpeg_decode_in_cb, workbuf, JPEG_WORK_BUF_SIZE, cfg);
+    ESP_GOTO_ON_FALSE((res == JDR_OK), ESP_FAIL, err, TAG, "Error in preparing JPEG image!");
+
+    img->height = JDEC.height;
+    img->width = JDEC.width;
+    img->subsampling = jpeg_get_subsampling(&JDEC);
+
+err:
+    if (workbuf) {
+        free(workbuf);
+    }
+
+    return ret;
+}
+
 /*******************************************************************************
 * Private API functions
 *******************************************************************************/
@@ -117,6 +155,13 @@ static unsigned int jpeg_decode_in_cb(JDEC *dec, uint8_t *buff, unsigned int nby
     esp_jpeg_image_cfg_t *cfg = (esp_jpeg_image_cfg_t *)dec->device;
     assert(cfg != NULL);
 
+    if (cfg->stream.read) {
+        /* Streaming mode - pull (or skip) data from the caller */
+        to_read = cfg->stream.read(cfg->stream.arg, buff, nbyte);
+        cfg->priv.read += to_read;
+        return to_read;
+    }
+
     if (buff) {
         if (cfg->priv.read + to_read > cfg->indata_size) {
             to_read = cfg->indata_size - cfg->priv.read;
@@ -220,3 +265,19 @@ static uint8_t jpeg_get_color_bytes(esp_jpeg_image_format_t format)
 
     return 1;
 }
+
+static esp_jpeg_image_subsampling_t jpeg_get_subsampling(JDEC *dec)
+{
+    /* MCU size in blocks is the luma sampling factor */
+    if (dec->msx == 1 && dec->msy == 1) {
+        return JPEG_IMAGE_SUBSAMPLING_444;
+    }
+    if (dec->msx == 2 && dec->msy == 1) {
+        return JPEG_IMAGE_SUBSAMPLING_422;
+    }
+    if (dec->msx == 2 && dec->msy == 2) {
+        return JPEG_IMAGE_SUBSAMPLING_420;
+    }
+
+    return JPEG_IMAGE_SUBSAMPLING_UNKNOWN;
+}
@@ -15,11 +15,13 @@ void* helix_malloc(int size) { return alloc.allocate(size); }
 void helix_free(void* ptr) { alloc.free(ptr); }
 */
 
-void* helix_malloc(int size) { 
+// weak so the application can count decoder memory, see main/locoBoard.c
+
+__attribute__((weak)) void* helix_malloc(int size) { 
 	return heap_caps_malloc (size,MALLOC_CAP_SPIRAM);  
 }
 
-void helix_free(void* ptr) { free(ptr); }
+__attribute__((weak)) void helix_free(void* ptr) { free(ptr); }
 
 #ifdef __cplusplus
 }
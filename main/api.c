@@ -3,13 +3,22 @@
 	
 	This module contains examples of how to perform
 	Spotify API functions with loco
+
+	Requests go through httpPool so that the connection to
+	api.spotify.com is kept open between calls
+
+	apiGet parses the whole reply with cJSON. apiExtract instead
+	feeds the reply to jsonExtract as it arrives and hands back only
+	the fields asked for, so the reply can be any size
 	
 *********************************************************/
 
 #include "cJSON.h"
 #include <esp_http_client.h>
-#include "esp_crt_bundle.h"
 #include "loco.h"
+#include "httpPool.h"
+#include "jsonExtract.h"
+#include "memTag.h"
 
 #define HTTPREPLYLEN 20000
 #define AUTHHEADERLEN 350
@@ -17,14 +26,24 @@
 int httpReplyLen = 0;
 unsigned char *httpReply = NULL;
 char *authHeader = NULL;
+jsonExtract_t *httpExtract = NULL;	// set while apiExtract runs
 
 esp_err_t httpHandler(esp_http_client_event_handle_t evt) {
 
   switch (evt->event_id) {
+  case HTTP_EVENT_HEADERS_SENT:		// once per attempt, a retry starts again
+    httpReplyLen = 0;
+    if (httpExtract)
+      jsonExtractReset(httpExtract);
+    break;
   case HTTP_EVENT_ON_DATA:
 //    locoLog ("httpHandler length %d\n", evt->data_len);
     int l = evt->data_len;
-    if (l + httpReplyLen >= HTTPREPLYLEN){
+    if (httpExtract){
+		jsonExtractFeed (httpExtract, evt->data, l);
+		httpReplyLen += l;
+	}
+    else if (l + httpReplyLen >= HTTPREPLYLEN){
 		printf ("putStateHandler overflow\n");
 	}
 	else {	
@@ -55,131 +74,111 @@ int snpfa (char *buf, int len, char *fmt, ...) {
   return 0;
 }
 
-// returns a cJSON - the caller must use cJSON_Delete afterwards 
+char *apiAuthHeader() {
+  if (!authHeader)
+    authHeader = memTagMalloc(MEMAPI, AUTHHEADERLEN, MALLOC_CAP_SPIRAM);
+  if (authHeader)
+    snpfa(authHeader, AUTHHEADERLEN, "Bearer %s", getAccessToken());
+  return authHeader;
+}
 
-cJSON *getMyPlaylists(int offset, int limit) {
+// GETs a Spotify API url and parses the reply
+// returns a cJSON - the caller must use cJSON_Delete afterwards
 
-  printf("Todo getMyPlaylists() allocate elsewhere\n");
+cJSON *apiGet(char *url, char *name) {
 
   if (!httpReply)
-    httpReply = heap_caps_malloc(HTTPREPLYLEN, MALLOC_CAP_SPIRAM);
-  if (!authHeader)
-    authHeader = heap_caps_malloc(AUTHHEADERLEN, MALLOC_CAP_SPIRAM);
+    httpReply = memTagMalloc(MEMAPI, HTTPREPLYLEN, MALLOC_CAP_SPIRAM);
+  if (!httpReply || !apiAuthHeader())
+    return NULL;
 
-  char url[200];
+  httpReplyLen = 0;
+  int status = 0;
 
-  sprintf(url, "https://api.spotify.com:443/v1/me/playlists?limit=%d&offset=%d",
-          limit, offset);
+  esp_err_t err = httpPoolGet(url, authHeader, httpHandler, &status);
 
-  lockHttps();
+  if (err != ESP_OK) {
+    printf("%s Request failed: %s\n", name, esp_err_to_name(err));
+    return NULL;
+  }
 
-  esp_http_client_config_t config = {.url = url,
-                                     .timeout_ms = 2000,
-                                     .buffer_size_tx = 2048,
-                                     .buffer_size = 10000,
-                                     .crt_bundle_attach = esp_crt_bundle_attach,
-                                     .event_handler = httpHandler};
+  printf("%s Status = %d, length = %d\n", name, status, httpReplyLen);
 
-  httpReplyLen = 0;
+  httpReply[httpReplyLen] = 0;		// httpHandler always leaves room
+  return cJSON_Parse((char *)httpReply);
+}
 
-  esp_http_client_handle_t client = esp_http_client_init(&config);
+// GETs a Spotify API url and passes the fields named by paths to cb
+// as they arrive - see jsonExtract.c. returns 0 if the reply was a
+// complete JSON document with status 200
 
-  esp_http_client_set_url(client, url);
-  esp_http_client_set_method(client, HTTP_METHOD_GET);
+int apiExtract(char *url, char *name, const char **paths, int npaths,
+               jsonExtractCb_t cb, void *arg) {
 
-	snpfa(authHeader, AUTHHEADERLEN, "Bearer %s", getAccessToken());
-  
-  esp_http_client_set_header(client, "Authorization", authHeader);
+  jsonExtract_t jx;
+  if (jsonExtractInit(&jx, paths, npaths, cb, arg) || !apiAuthHeader())
+    return -1;
 
-  esp_http_client_set_header(client, "User-agent", "okhttp/4.11.0");
+  int status = 0;
+  httpExtract = &jx;
+  esp_err_t err = httpPoolGet(url, authHeader, httpHandler, &status);
+  httpExtract = NULL;
 
-  esp_http_client_set_header(client, "Host", "api.spotify.com");
+  if (err != ESP_OK) {
+    printf("%s Request failed: %s\n", name, esp_err_to_name(err));
+    return -1;
+  }
 
-  esp_err_t err = esp_http_client_perform(client);
+  printf("%s Status = %d, length = %d\n", name, status, httpReplyLen);
 
-  if (err == ESP_OK) {
-    printf("getMyPlaylists Status = %d, content_length = %lld\n",
-           esp_http_client_get_status_code(client),
-           esp_http_client_get_content_length(client));
+  if (jsonExtractEnd(&jx)) {
+    printf("%s reply is not valid JSON\n", name);
+    return -1;
+  }
+  return (status == 200) ? 0 : -1;
+}
 
-    cJSON *response = cJSON_Parse((char *)httpReply);
-    if (response) {
-      esp_http_client_cleanup(client);
-      unlockHttps();
-      return response;
-    }
-    cJSON_Delete(response);
+// returns a cJSON - the caller must use cJSON_Delete afterwards 
 
-  } else {
-    printf("getMyPlaylists Request failed: %s\n", esp_err_to_name(err));
-  }
+cJSON *getMyPlaylists(int offset, int limit) {
 
-  esp_http_client_cleanup(client);
+  char url[200];
 
-  unlockHttps();
-  return NULL;
+  sprintf(url, "https://api.spotify.com:443/v1/me/playlists?limit=%d&offset=%d",
+          limit, offset);
+
+  return apiGet(url, "getMyPlaylists");
 }
 
 // returns a cJSON - the caller must use cJSON_Delete afterwards
 
 cJSON *getMyShows(int offset, int limit) {
 
-  printf("Todo getMySHows () allocate httpReply elsewhere\n");
-
-  if (!httpReply)
-    httpReply = heap_caps_malloc(HTTPREPLYLEN, MALLOC_CAP_SPIRAM);
-  if (!authHeader)
-    authHeader = heap_caps_malloc(AUTHHEADERLEN, MALLOC_CAP_SPIRAM);
-
   char url[200];
   sprintf(url, "https://api.spotify.com:443/v1/me/shows?limit=%d&offset=%d",
           limit, offset);
 
-  lockHttps();
-
-  esp_http_client_config_t config = {.url = url,
-                                     .timeout_ms = 2000,
-                                     .buffer_size_tx = 2048,
-                                     .buffer_size = 10000,
-                                     .crt_bundle_attach = esp_crt_bundle_attach,
-                                     .event_handler = httpHandler};
-
-  httpReplyLen = 0;
-
-  esp_http_client_handle_t client = esp_http_client_init(&config);
-
-  esp_http_client_set_url(client, url);
-  esp_http_client_set_method(client, HTTP_METHOD_GET);
-
-  snpfa(authHeader, AUTHHEADERLEN, "Bearer %s", getAccessToken());
-    
-  esp_http_client_set_header(client, "Authorization", authHeader);
+  return apiGet(url, "getMyShows");
+}
 
-  esp_http_client_set_header(client, "User-agent", "okhttp/4.11.0");
+// streaming versions - the fields named by paths are passed to cb
 
-  esp_http_client_set_header(client, "Host", "api.spotify.com");
+int getMyPlaylistsFields(int offset, int limit, const char **paths, int npaths,
+                         jsonExtractCb_t cb, void *arg) {
 
-  esp_err_t err = esp_http_client_perform(client);
+  char url[200];
+  sprintf(url, "https://api.spotify.com:443/v1/me/playlists?limit=%d&offset=%d",
+          limit, offset);
 
-  if (err == ESP_OK) {
-    printf("getMyShows Status = %d, content_length = %lld\n",
-           esp_http_client_get_status_code(client),
-           esp_http_client_get_content_length(client));
+  return apiExtract(url, "getMyPlaylistsFields", paths, npaths, cb, arg);
+}
 
-    cJSON *response = cJSON_Parse((char *)httpReply);
-    if (response) {
-      esp_http_client_cleanup(client);
-      unlockHttps();
-      return response;
-    }
-    cJSON_Delete(response);
+int getMyShowsFields(int offset, int limit, const char **paths, int npaths,
+                     jsonExtractCb_t cb, void *arg) {
 
-  } else {
-    printf("getMyShows Request failed: %s\n", esp_err_to_name(err));
-  }
+  char url[200];
+  sprintf(url, "https://api.spotify.com:443/v1/me/shows?limit=%d&offset=%d",
+          limit, offset);
 
-  esp_http_client_cleanup(client);
-  unlockHttps();
-  return NULL;
+  return apiExtract(url, "getMyShowsFields", paths, npaths, cb, arg);
 }
-
@@ -8,6 +8,8 @@
 	fetchArt (url) registers a new url and starts a fetch and decode
 	getArt (url) gets the decoded image for that url if available	
 	the decoded image is the format used by the data for lv_img_set_src
+	decoded images are kept in a small LRU cache so that going back
+	a track or returning to a station does not fetch the art again
 	
 *********************************************************/
 #include <stdio.h>
@@ -20,9 +22,17 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/ringbuf.h"
+#include <esp_http_client.h>
+#include "esp_crt_bundle.h"
+#include "esp_timer.h"
 
 
 #include "locoBoard.h"
+#include "memTag.h"
+#include "tracer.h"
+#include "artCache.h"
+#include "artStore.h"
 
 uint8_t *decodeArtPath(char *artPath);
 
@@ -33,6 +43,18 @@ static QueueHandle_t artQueue = NULL;
 
 #define ONESHOT 0
 #define IMAGESIZE 100000
+
+// the jpeg is streamed through this ring from the reader to the decoder
+// so only ARTRINGSIZE bytes of compressed image are ever held
+
+#define ARTRINGSIZE 16384
+#define ARTCHUNK 2048
+#define ARTREADERSTACK 8192
+
+// decoded station logos persist here (see artStore.c)
+
+#define ARTSTOREDIR "/spiffs/art"
+#define ARTSTOREBYTES 512000
 	
 
 int fileLength (char *path){
@@ -52,15 +74,20 @@ char downloadedArtUrl[200];
  New pipelined art mechanism
 ************************************************************************/
 
-uint8_t *imageBuffers[2];
-char *artPipelineUrls[2];
-int artInUse[2];
-int artWidth[2];
-int artHeight[2];
+// decoded images are kept in an LRU cache of ARTSLOTS entries in PSRAM
+// keyed by a hash of the url (see artCache.c)
+
+#ifndef ARTSLOTS
+#define ARTSLOTS 6
+#endif
+
+artSlot_t artSlots[ARTSLOTS];
+artCache_t artCache;
 
 char targetArtUrl[200];
 
 SemaphoreHandle_t artSemaphore;
+volatile int artReady = 0;				// set by initArtPipeline, until then there is no art
 
 int refreshOnArt = 0;
 
@@ -87,6 +114,158 @@ void unlockArtThread (){
   xSemaphoreGive(artThreadSemaphore);  
 }
 
+void printArtStats (){
+	if (!artReady){
+		printf ("no art pipeline\n");
+		return;
+	}
+	lockArt ();
+	printf ("art cache %d slots hits %d misses %d evictions %d\n",
+		ARTSLOTS,artCache.hits,artCache.misses,artCache.evictions);
+	for (int i = 0;i < ARTSLOTS;i++){
+		printf ("  %d %016llx %s refs %d %dx%d use %lu\n",i,artSlots[i].hash,
+			artSlots[i].valid ? "valid" : "empty",artSlots[i].refs,
+			artSlots[i].width,artSlots[i].height,artSlots[i].lastUse);
+	}
+	unlockArt ();
+}
+
+// choose the decode scale from the full image height
+// same thresholds as the height seen at 1/8 scale
+// called by the decoder as soon as the header has arrived
+
+int64_t artHeaderTime;
+
+esp_jpeg_image_scale_t getArtScale (uint16_t width, uint16_t height){
+	artHeaderTime = esp_timer_get_time();
+	int h = height / 8;
+	if (h <= 37) return JPEG_IMAGE_SCALE_1_2;
+	if (h <= 75) return JPEG_IMAGE_SCALE_1_4;
+	return JPEG_IMAGE_SCALE_1_8;
+}
+
+/***********************************************************************
+ Art reader - downloads the jpeg into artRing while artThread decodes
+************************************************************************/
+
+RingbufHandle_t artRing = NULL;
+uint8_t *artChunk;
+char artReaderUrl[200];
+volatile int artReaderDone = 1;		// no more data will be put in artRing
+volatile int artReaderAbort = 0;	// decoder has finished or failed
+int artReaderBytes;
+
+SemaphoreHandle_t artReaderSemaphore;		// given to start a download
+SemaphoreHandle_t artReaderIdleSemaphore;	// given when a download ends
+
+// push one chunk into the ring, waiting for the decoder to make space
+// returns 0 if the decoder has gone away
+
+int artRingPut (uint8_t *data, int len){
+	while (!artReaderAbort){
+		if (xRingbufferSend(artRing, data, len, pdMS_TO_TICKS(100)) == pdTRUE) return 1;
+	}
+	return 0;
+}
+
+void artDownload (char *url){
+
+	esp_http_client_config_t config = {.url = url,
+                                     .timeout_ms = 5000,
+                                     .buffer_size = 4096,
+                                     .crt_bundle_attach = esp_crt_bundle_attach};
+
+	esp_http_client_handle_t client = esp_http_client_init(&config);
+	if (!client) return;
+
+	int status = 0;
+
+// logo urls are often redirected
+
+	for (int redirects = 0;redirects < 4;redirects++){
+		if (esp_http_client_open(client, 0) != ESP_OK) break;
+		esp_http_client_fetch_headers(client);
+		status = esp_http_client_get_status_code(client);
+		if ((status < 301)||(status > 308)) break;
+		esp_http_client_set_redirection(client);
+		esp_http_client_close(client);
+		status = 0;
+	}
+
+	if (status != 200){
+		printf ("artDownload failed status %d %s\n",status,url);
+	}
+	else {
+		while (!artReaderAbort){
+			int n = esp_http_client_read(client, (char *)artChunk, ARTCHUNK);
+			if (n <= 0) break;
+			if (!artRingPut (artChunk,n)) break;
+			artReaderBytes += n;
+		}
+	}
+
+	esp_http_client_close(client);
+	esp_http_client_cleanup(client);
+}
+
+void artReaderThread (){
+
+  while (1){
+
+	xSemaphoreTake(artReaderSemaphore, portMAX_DELAY);
+
+	lockHttps ();
+	traceBegin (TRACEARTFETCH);
+	artDownload (artReaderUrl);
+	traceEnd (TRACEARTFETCH);
+	unlockHttps ();
+
+	artReaderDone = 1;
+	xSemaphoreGive(artReaderIdleSemaphore);
+  }
+}
+
+// jpeg decoder input - blocks until the reader has supplied len bytes
+// or the download has ended. buf NULL means skip
+
+uint32_t artStreamRead (void *arg, uint8_t *buf, uint32_t len){
+	uint32_t got = 0;
+	while (got < len){
+		int done = artReaderDone;		// sample before looking in the ring
+		size_t n;
+		uint8_t *p = xRingbufferReceiveUpTo(artRing, &n, pdMS_TO_TICKS(100), len - got);
+		if (p){
+			if (buf) memcpy (buf+got,p,n);
+			vRingbufferReturnItem(artRing, p);
+			got += n;
+		}
+		else if (done) break;
+	}
+	return got;
+}
+
+// start the reader on url - the decoder then pulls from artRing
+
+void startArtStream (char *url){
+	strcpy (artReaderUrl,url);
+	artReaderBytes = 0;
+	artReaderAbort = 0;
+	artReaderDone = 0;
+	xSemaphoreGive(artReaderSemaphore);
+}
+
+// stop the reader and empty the ring ready for the next image
+
+void endArtStream (){
+	artReaderAbort = 1;
+	xSemaphoreTake(artReaderIdleSemaphore, portMAX_DELAY);
+	size_t n;
+	uint8_t *p;
+	while ((p = xRingbufferReceiveUpTo(artRing, &n, 0, ARTRINGSIZE))){
+		vRingbufferReturnItem(artRing, p);
+	}
+}
+
 void artThread() {
 
 //	char *artPath = "/sdcard/art.jpg";
@@ -107,87 +286,84 @@ void artThread() {
 	lockArt ();
 	
     strcpy(url,targetArtUrl);
-        
-    
-    if ((strcmp (artPipelineUrls[0],url) == 0)||(strcmp (artPipelineUrls[0],url) == 0)){
+    uint64_t hash = artHash (url);
+
+    if (artCacheFind (&artCache, hash) >= 0){
 		unlockArt ();
 		continue;
 	}	
-    
-    
-// pick a free buffer
 
-	if (!artInUse[0]){
-		index = 0;
-		*artPipelineUrls[0] = 0;		// invalidate
-	}
-	else if (!artInUse[1]){
-		index = 1;
-		*artPipelineUrls[1] = 0;		// invalidate
-	}
-	else {
-		printf ("ERROR artThread both buffers in use\n");
+// pick a slot, holding a reference while it is decoded into
+
+	index = artCacheClaim (&artCache, hash);
+	if (index < 0){
+		printf ("ERROR artThread all slots in use\n");
 		unlockArt ();
 		continue;
-	}			
+	}
     
     unlockArt ();
 
-    uint8_t *jpgBuffer = heap_caps_malloc(300000, MALLOC_CAP_SPIRAM);
-	int r = streamGet(url, (char *)jpgBuffer, 300000);
-    if (!r){
-		free (jpgBuffer);
+// station logos are kept decoded on flash
+
+    int w,h;
+    if (artStoreLoad (hash, artSlots[index].image, IMAGESIZE, &w, &h)){
+		printf ("Art from store %d x %d\n", w, h);
+		lockArt ();
+		artCacheFilled (&artCache, index, w, h);
+		unlockArt ();
+		if (refreshOnArt){
+			refreshOnArt = 0;
+			refreshUI ();
+		}
 		continue;
 	}
-	int jpgSize = r;	
+
+    int64_t startTime = esp_timer_get_time();
+    artHeaderTime = startTime;
+
+    startArtStream (url);
 
     esp_jpeg_image_output_t outimg;
 
     esp_jpeg_image_cfg_t jpeg_cfg = {
-        .indata = jpgBuffer,
-        .indata_size = jpgSize,
-        .outbuf = imageBuffers[index],
+        .outbuf = artSlots[index].image,
         .outbuf_size = IMAGESIZE,
         .out_format = JPEG_IMAGE_FORMAT_RGB565,
         .out_scale = JPEG_IMAGE_SCALE_1_8,
-        //                                   .out_scale = JPEG_IMAGE_SCALE_1_2,
+        .scale_cb = getArtScale,
+        .stream = {
+            .read = artStreamRead,
+        },
         .flags = {
             .swap_color_bytes = 1,
         }};
 
-    r = esp_jpeg_decode(&jpeg_cfg, &outimg);
+// decode as the image arrives, the scale is picked from the header
+
+    traceBegin(TRACEARTDECODE);
+    int r = esp_jpeg_decode(&jpeg_cfg, &outimg);
+    traceEnd(TRACEARTDECODE);
 
-//    printf("first decode result %d\n", r);
+    endArtStream ();
 
     if (r != 0) {
-      free(jpgBuffer);
+      lockArt ();
+      artCacheRelease (&artCache, index);
+      unlockArt ();
       continue;
     }
 
-//    printf("Decoded dimensions %d x %d\n", outimg.width, outimg.height);
-
-    int height = outimg.height;
-    if (height <= 37) {
-      jpeg_cfg.out_scale = JPEG_IMAGE_SCALE_1_2;
-      esp_jpeg_decode(&jpeg_cfg, &outimg);
-      printf("Resized dimensions %d x %d\n", outimg.width, outimg.height);
-    } else if (height <= 75) {
-      jpeg_cfg.out_scale = JPEG_IMAGE_SCALE_1_4;
-      esp_jpeg_decode(&jpeg_cfg, &outimg);
-      printf("Resized dimensions %d x %d\n", outimg.width, outimg.height);
-    }
+    printf("Decoded dimensions %d x %d %d bytes header %lldms done %lldms\n",
+		outimg.width, outimg.height, artReaderBytes,
+		(artHeaderTime - startTime) / 1000, (esp_timer_get_time() - startTime) / 1000);
 
 //	printf ("art url = %s\n",url);
 
-
-    free(jpgBuffer);
+    if (isRadioSource ()) artStoreSave (hash, artSlots[index].image, outimg.width, outimg.height);
 
 	lockArt ();
-    artWidth[index] = outimg.width;
-    artHeight[index] = outimg.height;
-    
-    strcpy (artPipelineUrls[index],url);	// now valid
-    
+    artCacheFilled (&artCache, index, outimg.width, outimg.height);		// now valid
     unlockArt ();
 
 #if ONESHOT
@@ -203,22 +379,38 @@ void artThread() {
 
 
 
-void initArtPipeline (){
-    imageBuffers[0] = heap_caps_malloc(IMAGESIZE, MALLOC_CAP_SPIRAM);
-    imageBuffers[1] = heap_caps_malloc(IMAGESIZE, MALLOC_CAP_SPIRAM);
-    artPipelineUrls[0] = heap_caps_malloc(200, MALLOC_CAP_SPIRAM);
-    artPipelineUrls[1] = heap_caps_malloc(200, MALLOC_CAP_SPIRAM);
-    *artPipelineUrls[0] = 0;
-    *artPipelineUrls[1] = 0;
-    artInUse[0] = 0;
-    artInUse[1] = 0;
+// 0 when started, -1 if there was not the PSRAM for it
+
+int initArtPipeline (){
+    artStoreInit (ARTSTOREDIR, ARTSTOREBYTES);
+
+    artCacheInit (&artCache, artSlots, ARTSLOTS);
+    for (int i = 0;i < ARTSLOTS;i++){
+		memset (&artSlots[i],0,sizeof(artSlot_t));
+		artSlots[i].image = memTagMalloc(MEMART, IMAGESIZE, MALLOC_CAP_SPIRAM);
+		if (!artSlots[i].image){
+			printf ("ERROR initArtPipeline no memory for art slot %d\n",i);
+			return -1;
+		}
+	}
     
+   artRing = xRingbufferCreateWithCaps(ARTRINGSIZE, RINGBUF_TYPE_BYTEBUF, MALLOC_CAP_SPIRAM);
+   artChunk = memTagMalloc(MEMART, ARTCHUNK, MALLOC_CAP_SPIRAM);
+   if (!artRing || !artChunk){
+		printf ("ERROR initArtPipeline no memory for the art ring\n");
+		return -1;
+	}
+
    artSemaphore = xSemaphoreCreateBinary();
    unlockArt ();    
 
    artThreadSemaphore = xSemaphoreCreateBinary();
 //   lockArtThread (); 
 
+   artReaderSemaphore = xSemaphoreCreateBinary();
+   artReaderIdleSemaphore = xSemaphoreCreateBinary();
+   xTaskCreate(artReaderThread, "Art Reader", ARTREADERSTACK, NULL, 5, NULL);
+
 #if 0
 	static StaticTask_t artTaskBuffer;
 	uint8_t *artStack = 	heap_caps_malloc (STACKSIZE,MALLOC_CAP_SPIRAM);	
@@ -226,24 +418,23 @@ void initArtPipeline (){
 #else
   xTaskCreate(artThread, "Art Thread", STACKSIZE, NULL, 5, NULL);
 #endif     
-  
+  artReady = 1;
+  return 0;
 }
 
 
 void fetchArt (char *url){
 	
+	if (!artReady || !url || !url[0]) return;
+
 	lockArt ();
 			
 // do we already have it
 	
-	if (strcmp(artPipelineUrls[0],url) == 0){
+	if (artCacheFind (&artCache, artHash (url)) >= 0){
 		unlockArt ();
 		return;
 	}	
-	if (strcmp(artPipelineUrls[1],url) == 0){
-		unlockArt ();
-		return;
-	}
 	
 // tell artThread to start
 	
@@ -255,33 +446,28 @@ void fetchArt (char *url){
 	
 }
 
+// returns the image for url and makes it the displayed entry
+// the displayed entry holds a reference so it cannot be evicted
+// on a miss the previous image stays referenced as lvgl may still be using it
+
 uint8_t *getArt (char *url){
 	
 #if ONESHOT
-	if (gotArt) return imageBuffers[0];
+	if (gotArt) return artSlots[0].image;
 #endif	
 	
-	if (!url || !url[0]) return NULL;
+	if (!artReady || !url || !url[0]) return NULL;
 		
 	
 	lockArt ();
 
-	if (strcmp(artPipelineUrls[0],url) == 0){
-		artInUse[0] = 1;
-		artInUse[1] = 0;
+	int i = artCacheShow (&artCache, artHash (url));
+	if (i >= 0){
 		unlockArt ();
-		return imageBuffers[0];
+		return artSlots[i].image;
 	}	
-	if (strcmp(artPipelineUrls[1],url) == 0){
-		artInUse[1] = 1;
-		artInUse[0] = 0;
-		unlockArt ();
-		return imageBuffers[1];
-	}
 	printf ("getArt No match\n");
 	
-	artInUse[0] = 0;
-	artInUse[1] = 0;
 	unlockArt ();
 	
 	fetchArt (url);
@@ -289,7 +475,7 @@ uint8_t *getArt (char *url){
 	return NULL;	
 }	
 
-// returns the index of the entry with artInUse
+// returns the index of the displayed entry
 
 int getArtIndex (){
 	
@@ -297,24 +483,25 @@ int getArtIndex (){
 	if (gotArt) return 0;
 #endif
 	
-	if (artInUse[0]) return 0;
-	else if (artInUse[1]) return 1;
+	if (artCache.displayed >= 0) return artCache.displayed;
 	printf ("ERROR getArtIndex - nothing inUse\n");
 	return 0;
 }	
 	
 int getArtWidth (){
+	if (!artReady) return 0;
 	lockArt ();
 	int i = getArtIndex();
-	int r = artWidth[i];
+	int r = artSlots[i].width;
 	unlockArt ();
 	return r;
 }
 
 int getArtHeight (){
+	if (!artReady) return 0;
 	lockArt ();
 	int i = getArtIndex();
-	int r = artHeight[i];
+	int r = artSlots[i].height;
 	unlockArt ();
 	return r;
 }
@@ -0,0 +1,110 @@
+/********************************************************
+	artCache.c
+
+	Decoded images are kept in count slots keyed by a 64 bit hash of
+	the url, so going back a track or returning to a station does not
+	fetch the art again. refs stops a slot being reused while it is on
+	screen or being decoded into, the rest are reused least recently
+	used first.
+
+		artCacheClaim (c,hash)		a slot to decode into, referenced
+		artCacheFilled (c,i,w,h)	decoded, drops the reference
+		artCacheRelease (c,i)		the decode failed
+		artCacheShow (c,hash)		the slot to display or -1, moves
+									the screen's reference to it
+
+	Not thread safe, art.c calls these with lockArt. Only libc is used
+	so the replacement policy can be tested on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "artCache.h"
+
+// 64 bit FNV-1a
+
+uint64_t artHash (const char *url){
+	uint64_t h = 0xcbf29ce484222325ULL;
+	while (*url){
+		h ^= (uint8_t)*url++;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+// the slots' images are allocated by the caller
+
+void artCacheInit (artCache_t *c, artSlot_t *slots, int count){
+	memset (c, 0, sizeof(artCache_t));
+	c->slots = slots;
+	c->count = count;
+	c->displayed = -1;
+}
+
+// returns the slot holding a decoded image for hash or -1
+
+int artCacheFind (artCache_t *c, uint64_t hash){
+	for (int i = 0;i < c->count;i++){
+		if (c->slots[i].valid && (c->slots[i].hash == hash)) return i;
+	}
+	return -1;
+}
+
+// returns a slot to decode hash into, an empty one if possible otherwise
+// the least recently used with no references. -1 if all are referenced
+
+int artCacheClaim (artCache_t *c, uint64_t hash){
+	int lru = -1;
+	for (int i = 0;i < c->count;i++){
+		artSlot_t *s = &c->slots[i];
+		if (s->refs) continue;
+		if (!s->valid){
+			lru = i;
+			break;
+		}
+		if ((lru < 0)||(s->lastUse < c->slots[lru].lastUse)) lru = i;
+	}
+	if (lru < 0) return -1;
+
+	artSlot_t *s = &c->slots[lru];
+	if (s->valid) c->evictions++;
+	s->valid = 0;
+	s->hash = hash;
+	s->refs = 1;
+	return lru;
+}
+
+void artCacheFilled (artCache_t *c, int i, int width, int height){
+	artSlot_t *s = &c->slots[i];
+	s->width = width;
+	s->height = height;
+	s->lastUse = ++c->clock;
+	s->valid = 1;
+	s->refs--;
+}
+
+void artCacheRelease (artCache_t *c, int i){
+	c->slots[i].refs--;
+}
+
+// on a hit the slot becomes the displayed one, holding a reference so
+// it cannot be evicted. On a miss the previous image stays referenced
+// as lvgl may still be using it
+
+int artCacheShow (artCache_t *c, uint64_t hash){
+	int i = artCacheFind (c, hash);
+	if (i < 0){
+		c->misses++;
+		return -1;
+	}
+	c->hits++;
+	c->slots[i].lastUse = ++c->clock;
+	if (i != c->displayed){
+		c->slots[i].refs++;
+		if (c->displayed >= 0) c->slots[c->displayed].refs--;
+		c->displayed = i;
+	}
+	return i;
+}
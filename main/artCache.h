@@ -0,0 +1,46 @@
+/********************************************************
+	artCache.h
+
+	LRU cache of decoded art keyed by a hash of the url - see
+	artCache.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+typedef struct {
+	uint64_t hash;
+	uint8_t *image;
+	int width;
+	int height;
+	int valid;							// decode complete
+	int refs;
+	uint32_t lastUse;
+} artSlot_t;
+
+typedef struct {
+	artSlot_t *slots;
+	int count;
+	uint32_t clock;
+	int displayed;						// slot referenced by the screen
+	int hits;
+	int misses;
+	int evictions;
+} artCache_t;
+
+uint64_t artHash (const char *url);
+void artCacheInit (artCache_t *c, artSlot_t *slots, int count);
+int artCacheFind (artCache_t *c, uint64_t hash);
+int artCacheClaim (artCache_t *c, uint64_t hash);
+void artCacheFilled (artCache_t *c, int i, int width, int height);
+void artCacheRelease (artCache_t *c, int i);
+int artCacheShow (artCache_t *c, uint64_t hash);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,275 @@
+/********************************************************
+	artStore.c
+
+	Persistent store of decoded art (RGB565) so that station logos
+	survive a reboot without being fetched and decoded again
+
+	artStoreInit (dir,maxBytes) loads the index from dir
+	artStoreLoad (hash,...) copies a stored image into a buffer
+	artStoreSave (hash,...) writes an image, evicting the least
+	recently used entries to stay within maxBytes
+
+	Each image is a file named by the url hash, the index file holds
+	the size and last use of each entry. A hit only changes the last
+	use in RAM, the index is written when an image is saved or
+	removed, or by artStorePoll (ms) once it has been waiting
+	ARTSTOREFLUSHMS, so showing a logo does not cost a flash write.
+	A reboot before then loses only the order of recent hits.
+
+	Only stdio is used so dir can be any directory - /spiffs on the
+	board or a plain directory on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "artStore.h"
+
+#define MAXARTSTORE 32
+#define ARTSTOREPATHLEN 64
+#define ARTSTOREDIRLEN 32
+#define ARTSTOREMAGIC 0x41525431		// ART1
+#define ARTSTOREFLUSHMS 60000
+
+typedef struct {
+	uint64_t hash;
+	uint32_t size;
+	uint16_t width;
+	uint16_t height;
+	uint32_t lastUse;			// 0 = entry unused
+} artStoreEntry_t;
+
+artStoreEntry_t artStoreIndex[MAXARTSTORE];
+char artStoreDir[ARTSTOREDIRLEN];
+int artStoreMaxBytes = 0;
+uint32_t artStoreClock = 0;
+int artStoreDirty = 0;					// last uses not yet in the index
+uint32_t artStoreDirtyMs = 0;			// when artStorePoll first saw it
+pthread_mutex_t artStoreMutex = PTHREAD_MUTEX_INITIALIZER;
+
+int artStoreHits = 0;
+int artStoreMisses = 0;
+int artStoreEvictions = 0;
+int artStoreIndexWrites = 0;
+
+void artStorePath (char *path, char *name){
+	snprintf (path, ARTSTOREPATHLEN, "%s/%s", artStoreDir, name);
+}
+
+void artStoreImagePath (char *path, uint64_t hash){
+	snprintf (path, ARTSTOREPATHLEN, "%s/%016llx.565", artStoreDir, (unsigned long long)hash);
+}
+
+void artStoreWriteIndex (){
+	char path[ARTSTOREPATHLEN];
+	artStorePath (path, "artindex");
+	FILE *f = fopen (path, "wb");
+	if (!f){
+		printf ("ERROR artStore cannot write %s\n", path);
+		return;
+	}
+	uint32_t magic = ARTSTOREMAGIC;
+	fwrite (&magic, sizeof(magic), 1, f);
+	fwrite (artStoreIndex, sizeof(artStoreIndex), 1, f);
+	fclose (f);
+	artStoreDirty = 0;
+	artStoreIndexWrites++;
+}
+
+int artStoreUsed (){
+	int r = 0;
+	for (int i = 0;i < MAXARTSTORE;i++){
+		if (artStoreIndex[i].lastUse) r += artStoreIndex[i].size;
+	}
+	return r;
+}
+
+void artStoreRemove (int i){
+	char path[ARTSTOREPATHLEN];
+	artStoreImagePath (path, artStoreIndex[i].hash);
+	remove (path);
+	memset (&artStoreIndex[i], 0, sizeof(artStoreEntry_t));
+}
+
+// returns the index entry for hash or -1
+
+int artStoreFind (uint64_t hash){
+	for (int i = 0;i < MAXARTSTORE;i++){
+		if (artStoreIndex[i].lastUse && (artStoreIndex[i].hash == hash)) return i;
+	}
+	return -1;
+}
+
+// returns the least recently used entry or -1 if the store is empty
+
+int artStoreOldest (){
+	int r = -1;
+	for (int i = 0;i < MAXARTSTORE;i++){
+		if (!artStoreIndex[i].lastUse) continue;
+		if ((r < 0)||(artStoreIndex[i].lastUse < artStoreIndex[r].lastUse)) r = i;
+	}
+	return r;
+}
+
+void artStoreInit (char *dir, int maxBytes){
+
+	pthread_mutex_lock (&artStoreMutex);
+	snprintf (artStoreDir, ARTSTOREDIRLEN, "%s", dir);
+	artStoreMaxBytes = maxBytes;
+	memset (artStoreIndex, 0, sizeof(artStoreIndex));
+	artStoreClock = 0;
+	artStoreDirty = 0;
+
+	char path[ARTSTOREPATHLEN];
+	artStorePath (path, "artindex");
+	FILE *f = fopen (path, "rb");
+	if (!f){
+		pthread_mutex_unlock (&artStoreMutex);
+		return;
+	}
+
+	uint32_t magic = 0;
+	if ((fread (&magic, sizeof(magic), 1, f) != 1)||(magic != ARTSTOREMAGIC)||
+		(fread (artStoreIndex, sizeof(artStoreIndex), 1, f) != 1)){
+		printf ("artStore index invalid - starting empty\n");
+		memset (artStoreIndex, 0, sizeof(artStoreIndex));
+	}
+	fclose (f);
+
+	for (int i = 0;i < MAXARTSTORE;i++){
+		if (artStoreIndex[i].lastUse > artStoreClock) artStoreClock = artStoreIndex[i].lastUse;
+	}
+	printf ("artStore %s %d bytes used\n", artStoreDir, artStoreUsed());
+	pthread_mutex_unlock (&artStoreMutex);
+}
+
+// copies the image for hash into buf. returns 1 on success
+
+int artStoreLoad (uint64_t hash, uint8_t *buf, int max, int *width, int *height){
+
+	if (!artStoreMaxBytes) return 0;
+
+	pthread_mutex_lock (&artStoreMutex);
+	int i = artStoreFind (hash);
+	if ((i < 0)||(artStoreIndex[i].size > (uint32_t)max)){
+		artStoreMisses++;
+		pthread_mutex_unlock (&artStoreMutex);
+		return 0;
+	}
+
+	char path[ARTSTOREPATHLEN];
+	artStoreImagePath (path, hash);
+	FILE *f = fopen (path, "rb");
+	int ok = 0;
+	if (f){
+		ok = (fread (buf, 1, artStoreIndex[i].size, f) == artStoreIndex[i].size);
+		fclose (f);
+	}
+
+	if (!ok){
+		printf ("artStore %s missing or short - removed\n", path);
+		artStoreRemove (i);
+		artStoreWriteIndex ();
+		artStoreMisses++;
+		pthread_mutex_unlock (&artStoreMutex);
+		return 0;
+	}
+
+	*width = artStoreIndex[i].width;
+	*height = artStoreIndex[i].height;
+	artStoreIndex[i].lastUse = ++artStoreClock;
+	artStoreDirty = 1;
+	artStoreHits++;
+	pthread_mutex_unlock (&artStoreMutex);
+	return 1;
+}
+
+// stores a decoded image, evicting old entries to make room
+
+void artStoreSave (uint64_t hash, uint8_t *image, int width, int height){
+
+	if (!artStoreMaxBytes) return;
+
+	int size = width * height * 2;
+	if (size > artStoreMaxBytes) return;
+
+	pthread_mutex_lock (&artStoreMutex);
+	int i = artStoreFind (hash);
+	if (i >= 0) artStoreRemove (i);
+
+	while (1){
+		int slot = -1;
+		for (int j = 0;j < MAXARTSTORE;j++){
+			if (!artStoreIndex[j].lastUse){
+				slot = j;
+				break;
+			}
+		}
+		if ((slot >= 0)&&(artStoreUsed() + size <= artStoreMaxBytes)){
+			i = slot;
+			break;
+		}
+		int old = artStoreOldest ();
+		if (old < 0){
+			pthread_mutex_unlock (&artStoreMutex);
+			return;
+		}
+		artStoreRemove (old);
+		artStoreEvictions++;
+	}
+
+	char path[ARTSTOREPATHLEN];
+	artStoreImagePath (path, hash);
+	FILE *f = fopen (path, "wb");
+	if (!f){
+		printf ("ERROR artStore cannot write %s\n", path);
+		artStoreWriteIndex ();
+		pthread_mutex_unlock (&artStoreMutex);
+		return;
+	}
+	int ok = (fwrite (image, 1, size, f) == (size_t)size);
+	fclose (f);
+	if (!ok){
+		printf ("ERROR artStore short write %s\n", path);
+		remove (path);
+		artStoreWriteIndex ();
+		pthread_mutex_unlock (&artStoreMutex);
+		return;
+	}
+
+	artStoreIndex[i].hash = hash;
+	artStoreIndex[i].size = size;
+	artStoreIndex[i].width = width;
+	artStoreIndex[i].height = height;
+	artStoreIndex[i].lastUse = ++artStoreClock;
+	artStoreWriteIndex ();
+	pthread_mutex_unlock (&artStoreMutex);
+}
+
+// writes the last uses of recent hits once they have waited
+// ARTSTOREFLUSHMS, ms is any free running millisecond clock
+
+void artStorePoll (uint32_t ms){
+	pthread_mutex_lock (&artStoreMutex);
+	if (!artStoreDirty) artStoreDirtyMs = 0;
+	else if (!artStoreDirtyMs) artStoreDirtyMs = ms ? ms : 1;
+	else if (ms - artStoreDirtyMs >= ARTSTOREFLUSHMS){
+		artStoreWriteIndex ();
+		artStoreDirtyMs = 0;
+	}
+	pthread_mutex_unlock (&artStoreMutex);
+}
+
+void printArtStoreStats (){
+	pthread_mutex_lock (&artStoreMutex);
+	int n = 0;
+	for (int i = 0;i < MAXARTSTORE;i++){
+		if (artStoreIndex[i].lastUse) n++;
+	}
+	printf ("art store %s %d entries %d/%d bytes hits %d misses %d evictions %d index writes %d\n",
+		artStoreDir, n, artStoreUsed(), artStoreMaxBytes,
+		artStoreHits, artStoreMisses, artStoreEvictions, artStoreIndexWrites);
+	pthread_mutex_unlock (&artStoreMutex);
+}
@@ -0,0 +1,26 @@
+/********************************************************
+	artStore.h
+
+	Persistent store of decoded art - see artStore.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+void artStoreInit (char *dir, int maxBytes);
+int artStoreLoad (uint64_t hash, uint8_t *buf, int max, int *width, int *height);
+void artStoreSave (uint64_t hash, uint8_t *image, int width, int height);
+void artStorePoll (uint32_t ms);
+void printArtStoreStats ();
+
+extern int artStoreIndexWrites;
+extern int artStoreEvictions;
+
+#ifdef __cplusplus
+}
+#endif
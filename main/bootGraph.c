@@ -0,0 +1,290 @@
+/********************************************************
+	bootGraph.c
+
+	Start up as a graph of stages rather than one long list, so slow
+	stages that do not need each other (the codec's power up delay,
+	Wi-Fi, the display) run at the same time.
+
+		bootStage (b,name,fn,arg,after)	adds a stage, after is a space
+										separated list of the stages
+										that have to finish first
+		bootStageCall (b,name,call,after)	the same for a void (void)
+										init function, which is done
+										when it returns
+		bootRun (b,workers,stack)		runs them all, the caller is
+										one of the workers
+
+	A stage can only name stages added before it so there can be no
+	loops. Stages are started in the order they were added as soon as
+	what they need is done, so add the slow ones and the ones the user
+	sees first.
+
+	A stage that returns non zero has failed, the stages that need it
+	are skipped and the rest carry on. Naming a stage that does not
+	exist fails the stage when it would have run.
+
+	Each stage's start and end time and which worker ran it are kept,
+	printBootTrace shows them with a bar for each so the overlap can be
+	seen.
+
+	Workers are pthreads, which ESP-IDF provides, so this builds and
+	can be tested on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#else
+#include <time.h>
+#endif
+
+#include "bootGraph.h"
+
+#define BOOTBADDEP -1000				// result for a stage naming an unknown stage
+#define BOOTBARWIDTH 40
+
+struct bootGraph_s {
+	bootStage_t stage[BOOTMAX];
+	int n;
+	int running;
+	int64_t startUs;
+	int64_t endUs;
+	int workers;
+	pthread_mutex_t mutex;
+	pthread_cond_t condition;
+};
+
+typedef struct {
+	bootGraph_t *b;
+	int worker;
+} bootWorker_t;
+
+static int64_t bootNowUs (){
+#ifdef ESP_PLATFORM
+	return esp_timer_get_time ();
+#else
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+bootGraph_t *bootCreate (){
+	bootGraph_t *b = malloc (sizeof(bootGraph_t));
+	if (!b) return NULL;
+	memset (b, 0, sizeof(bootGraph_t));
+	pthread_mutex_init (&b->mutex, NULL);
+	pthread_cond_init (&b->condition, NULL);
+	return b;
+}
+
+void bootFree (bootGraph_t *b){
+	if (!b) return;
+	pthread_mutex_destroy (&b->mutex);
+	pthread_cond_destroy (&b->condition);
+	free (b);
+}
+
+static int findStage (bootGraph_t *b, const char *name, int len){
+	for (int i = 0;i < b->n;i++){
+		if (((int)strlen (b->stage[i].name) == len) && !strncmp (b->stage[i].name, name, len)) return i;
+	}
+	return -1;
+}
+
+// returns the stage's index, -1 if there are too many
+
+int bootStage (bootGraph_t *b, const char *name, bootFn_t fn, void *arg, const char *after){
+
+	if (b->n >= BOOTMAX) return -1;
+	bootStage_t *s = &b->stage[b->n];
+	memset (s, 0, sizeof(bootStage_t));
+	s->name = name;
+	s->fn = fn;
+	s->arg = arg;
+	s->worker = -1;
+
+	const char *p = after ? after : "";
+	while (*p){
+		while (*p == ' ') p++;
+		int len = 0;
+		while (p[len] && (p[len] != ' ')) len++;
+		if (!len) break;
+		int d = findStage (b, p, len);
+		if ((d < 0)||(s->ndeps >= BOOTDEPSMAX)){
+			printf ("boot stage %s: cannot wait for %.*s\n", name, len, p);
+			s->result = BOOTBADDEP;
+		}
+		else s->deps[s->ndeps++] = d;
+		p += len;
+	}
+	return b->n++;
+}
+
+int bootStageCall (bootGraph_t *b, const char *name, bootCall_t call, const char *after){
+	int i = bootStage (b, name, NULL, NULL, after);
+	if (i >= 0) b->stage[i].call = call;
+	return i;
+}
+
+// the stage's own work, 0 when done
+
+static int runStage (bootStage_t *s){
+	if (s->result == BOOTBADDEP) return BOOTBADDEP;
+	if (s->call){
+		s->call ();
+		return 0;
+	}
+	return s->fn (s->arg);
+}
+
+// BOOTDONE if the stage can start, BOOTWAITING if not yet, BOOTSKIPPED if never
+
+static int depsState (bootGraph_t *b, bootStage_t *s){
+	int state = BOOTDONE;
+	for (int i = 0;i < s->ndeps;i++){
+		int d = b->stage[s->deps[i]].state;
+		if ((d == BOOTFAILED)||(d == BOOTSKIPPED)) return BOOTSKIPPED;
+		if (d != BOOTDONE) state = BOOTWAITING;
+	}
+	return state;
+}
+
+static void *bootWorker (void *param){
+	bootWorker_t *w = param;
+	bootGraph_t *b = w->b;
+
+	pthread_mutex_lock (&b->mutex);
+	while (1){
+		int pick = -1;
+		int waiting = 0;
+		for (int i = 0;i < b->n;i++){
+			bootStage_t *s = &b->stage[i];
+			if (s->state != BOOTWAITING) continue;
+			int d = depsState (b, s);
+			if (d == BOOTSKIPPED){				// later stages see this in the same pass
+				s->state = BOOTSKIPPED;
+				s->startUs = s->endUs = bootNowUs () - b->startUs;
+				pthread_cond_broadcast (&b->condition);
+			}
+			else if (d == BOOTWAITING) waiting++;
+			else if (pick < 0) pick = i;
+		}
+
+		if (pick >= 0){
+			bootStage_t *s = &b->stage[pick];
+			s->state = BOOTRUNNING;
+			s->worker = w->worker;
+			s->startUs = bootNowUs () - b->startUs;
+			b->running++;
+			pthread_mutex_unlock (&b->mutex);
+
+			int r = runStage (s);
+
+			pthread_mutex_lock (&b->mutex);
+			s->result = r;
+			s->endUs = bootNowUs () - b->startUs;
+			s->state = r ? BOOTFAILED : BOOTDONE;
+			if (r) printf ("boot stage %s failed (%d)\n", s->name, r);
+			b->running--;
+			pthread_cond_broadcast (&b->condition);
+			continue;
+		}
+
+		if (!waiting) break;					// nothing left for anyone to start
+		pthread_cond_wait (&b->condition, &b->mutex);
+	}
+	pthread_mutex_unlock (&b->mutex);
+	return NULL;
+}
+
+// returns the number of stages that failed or were skipped
+
+int bootRun (bootGraph_t *b, int workers, int stackSize){
+
+	pthread_t threads[BOOTMAX];
+	bootWorker_t w[BOOTMAX];
+	if (workers < 1) workers = 1;
+	if (workers > BOOTMAX) workers = BOOTMAX;
+
+	b->startUs = bootNowUs ();
+	b->workers = workers;
+
+	pthread_attr_t attr;
+	pthread_attr_init (&attr);
+	if (stackSize) pthread_attr_setstacksize (&attr, stackSize);
+
+	int started = 1;
+	for (int i = 0;i < workers;i++){
+		w[i].b = b;
+		w[i].worker = i;
+		if (!i) continue;
+		if (pthread_create (&threads[i], &attr, bootWorker, &w[i])) break;	// carry on with fewer
+		started++;
+	}
+	pthread_attr_destroy (&attr);
+	b->workers = started;
+
+	bootWorker (&w[0]);
+	for (int i = 1;i < started;i++) pthread_join (threads[i], NULL);
+
+	b->endUs = bootNowUs () - b->startUs;
+
+	int bad = 0;
+	for (int i = 0;i < b->n;i++){
+		if (b->stage[i].state != BOOTDONE) bad++;
+	}
+	return bad;
+}
+
+int bootCount (bootGraph_t *b){
+	return b->n;
+}
+
+const bootStage_t *bootGetStage (bootGraph_t *b, int i){
+	if ((i < 0)||(i >= b->n)) return NULL;
+	return &b->stage[i];
+}
+
+int64_t bootElapsedUs (bootGraph_t *b){
+	return b->endUs;
+}
+
+static const char *stateName (int state){
+	switch (state){
+		case BOOTWAITING: return "waiting";
+		case BOOTRUNNING: return "running";
+		case BOOTDONE: return "done";
+		case BOOTFAILED: return "FAILED";
+		case BOOTSKIPPED: return "skipped";
+	}
+	return "?";
+}
+
+void printBootTrace (bootGraph_t *b){
+
+	int64_t total = b->endUs ? b->endUs : 1;
+	int64_t work = 0;
+	char bar[BOOTBARWIDTH + 1];
+
+	printf ("boot trace, %d stages on %d workers\n", b->n, b->workers);
+	printf ("  %-12s %7s %7s %7s  w  %-7s\n", "stage", "start", "end", "ms", "state");
+	for (int i = 0;i < b->n;i++){
+		bootStage_t *s = &b->stage[i];
+		int from = (s->startUs * BOOTBARWIDTH) / total;
+		int to = (s->endUs * BOOTBARWIDTH) / total;
+		if (to >= BOOTBARWIDTH) to = BOOTBARWIDTH - 1;
+		for (int c = 0;c < BOOTBARWIDTH;c++) bar[c] = ((s->worker >= 0) && (c >= from) && (c <= to)) ? '#' : '.';
+		bar[BOOTBARWIDTH] = 0;
+		work += s->endUs - s->startUs;
+		printf ("  %-12s %7d %7d %7d %2d  %-7s %s\n", s->name,
+			(int)(s->startUs / 1000), (int)(s->endUs / 1000),
+			(int)((s->endUs - s->startUs) / 1000), s->worker, stateName (s->state), bar);
+	}
+	printf ("boot took %d ms, the stages add up to %d ms\n", (int)(b->endUs / 1000), (int)(work / 1000));
+}
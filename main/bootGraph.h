@@ -0,0 +1,57 @@
+/********************************************************
+	bootGraph.h
+
+	Runs start up stages in dependency order on several threads -
+	see bootGraph.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define BOOTMAX 24
+#define BOOTDEPSMAX 6
+
+// stage states
+#define BOOTWAITING 0
+#define BOOTRUNNING 1
+#define BOOTDONE 2
+#define BOOTFAILED 3					// returned non zero, or named an unknown stage
+#define BOOTSKIPPED 4					// a stage it needs did not finish
+
+typedef int (*bootFn_t)(void *arg);		// 0 when done
+typedef void (*bootCall_t)(void);			// an init function that cannot fail
+
+typedef struct {
+	const char *name;
+	bootFn_t fn;
+	void *arg;
+	bootCall_t call;					// instead of fn
+	int deps[BOOTDEPSMAX];
+	int ndeps;
+	int state;
+	int result;
+	int worker;
+	int64_t startUs;					// from bootRun
+	int64_t endUs;
+} bootStage_t;
+
+typedef struct bootGraph_s bootGraph_t;
+
+bootGraph_t *bootCreate ();
+void bootFree (bootGraph_t *b);
+int bootStage (bootGraph_t *b, const char *name, bootFn_t fn, void *arg, const char *after);
+int bootStageCall (bootGraph_t *b, const char *name, bootCall_t call, const char *after);
+int bootRun (bootGraph_t *b, int workers, int stackSize);
+int bootCount (bootGraph_t *b);
+const bootStage_t *bootGetStage (bootGraph_t *b, int i);
+int64_t bootElapsedUs (bootGraph_t *b);
+void printBootTrace (bootGraph_t *b);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,65 @@
+/********************************************************
+	declick.c
+
+	When the PCM ring runs dry, between tracks or on an underrun, the
+	audio thread plays short blocks of silence so the next track starts
+	as soon as it is decoded. Going straight from a loud frame to zero
+	and back would click, so
+
+		declickSilence (d,frames)	fills a block of SILENCEFRAMES,
+									the first DECLICKFRAMES ramp down
+									from the last frame played
+		declickPlay (d,frames,n)	fades in the first DECLICKFRAMES
+									of a block that follows silence,
+									in place, and notes its last frame
+
+	Blocks that follow each other with no silence between them are not
+	touched, a gapless join stays sample exact. Frames are stereo 16
+	bit, left in the low half. Only libc is used so joins can be tested
+	on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "declick.h"
+
+static uint32_t frame (int l, int r){
+	return (uint16_t)l | ((uint32_t)(uint16_t)r << 16);
+}
+
+void declickInit (declick_t *d){
+	d->silent = 1;
+	d->last = 0;
+}
+
+void declickPlay (declick_t *d, uint32_t *frames, int count){
+	if (count <= 0) return;
+	if (d->silent){
+		int n = (count < DECLICKFRAMES) ? count : DECLICKFRAMES;
+		for (int i = 0;i < n;i++){
+			int l = (int16_t)(frames[i] & 0xFFFF);
+			int r = (int16_t)(frames[i] >> 16);
+			frames[i] = frame (l * i / DECLICKFRAMES, r * i / DECLICKFRAMES);
+		}
+	}
+	d->silent = 0;
+	d->last = frames[count - 1];
+}
+
+// returns the frames written, always SILENCEFRAMES
+
+int declickSilence (declick_t *d, uint32_t *frames){
+	memset (frames, 0, SILENCEFRAMES * sizeof(uint32_t));
+	if (!d->silent){
+		int l = (int16_t)(d->last & 0xFFFF);
+		int r = (int16_t)(d->last >> 16);
+		for (int i = 0;i < DECLICKFRAMES;i++){
+			int g = DECLICKFRAMES - i;
+			frames[i] = frame (l * g / DECLICKFRAMES, r * g / DECLICKFRAMES);
+		}
+	}
+	d->silent = 1;
+	return SILENCEFRAMES;
+}
@@ -0,0 +1,30 @@
+/********************************************************
+	declick.h
+
+	Ramps the edges of the silence played when the PCM ring runs dry
+	- see declick.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define SILENCEFRAMES 256				// 5.8ms
+#define DECLICKFRAMES 64
+
+typedef struct {
+	int silent;
+	uint32_t last;						// the last frame played
+} declick_t;
+
+void declickInit (declick_t *d);
+void declickPlay (declick_t *d, uint32_t *frames, int count);
+int declickSilence (declick_t *d, uint32_t *frames);
+
+#ifdef __cplusplus
+}
+#endif
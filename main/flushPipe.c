@@ -0,0 +1,196 @@
+/********************************************************
+	flushPipe.c
+
+	Keeps track of the display band buffers so LVGL can render the
+	next band while the SPI DMA sends earlier ones.
+
+	LVGL 8 only knows two buffers, buf1 and buf2, and swaps between
+	them after each flush. With more buffers than that the flush
+	callback swaps a free one into the slot LVGL will render into
+	next whenever the buffer there is still queued for the panel.
+
+		flushPipeRendered (buf)	at the start of the flush callback,
+								buf is queued for transfer
+		flushPipeNext (other)	the buffer to put in the other slot,
+								other if it is not queued, NULL if
+								every buffer is busy and the callback
+								has to wait for flushPipeDone
+		flushPipeResume ()		when the callback returns and LVGL
+								starts rendering again
+		flushPipeDone ()		the oldest queued transfer finished,
+								called from the DMA done interrupt
+
+	Transfers finish in the order they were queued so the queue is a
+	FIFO.
+
+	Times are passed in (us) so the same code runs against a stand-in
+	panel on Linux. For each frame, from flushPipeFrameStart to the
+	end of the transfer of its last band, render time is LVGL drawing,
+	wait time is the flush callback waiting for a free buffer and
+	transfer time is the DMA busy. With the pipeline working render
+	plus transfer is more than the frame time.
+
+	There is no locking, the caller serialises calls (the board uses
+	a critical section as flushPipeDone runs in an interrupt). Only
+	libc is used otherwise
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_attr.h"
+#define FLUSHPIPEISR IRAM_ATTR
+#else
+#define FLUSHPIPEISR
+#endif
+
+#include "flushPipe.h"
+
+struct flushPipe_s {
+	int n;
+	void *buf[FLUSHPIPEMAX];
+	int queued[FLUSHPIPEMAX];
+	int fifo[FLUSHPIPEMAX];				// buffer indexes in transfer order
+	int64_t queuedAt[FLUSHPIPEMAX];
+	int last[FLUSHPIPEMAX];				// the last band of a frame
+	int64_t frameStartOf[FLUSHPIPEMAX];	// and that frame's figures
+	int renderOf[FLUSHPIPEMAX];
+	int waitOf[FLUSHPIPEMAX];
+	int bandsOf[FLUSHPIPEMAX];
+	int lastSlot;						// most recently queued
+	int head;
+	int count;
+	int64_t lastDone;					// end of the previous transfer
+	int64_t frameStart;
+	int64_t renderFrom;					// when LVGL last started rendering
+	int64_t callbackAt;					// flush callback entered
+	int rendering;						// between FrameStart and the last band
+	int waited;
+	int frameRenderUs;
+	int frameWaitUs;
+	int frameTransferUs;
+	int frameBands;
+	flushPipeStats_t stats;
+};
+
+static int findBuf (flushPipe_t *fp, void *buf){
+	for (int n = 0;n < fp->n;n++){
+		if (fp->buf[n] == buf) return n;
+	}
+	return -1;
+}
+
+flushPipe_t *flushPipeCreate (void **bufs, int n){
+	if ((n < 2)||(n > FLUSHPIPEMAX)) return NULL;
+	flushPipe_t *fp = malloc (sizeof(flushPipe_t));
+	if (!fp) return NULL;
+	memset (fp, 0, sizeof(flushPipe_t));
+	fp->n = n;
+	for (int i = 0;i < n;i++) fp->buf[i] = bufs[i];
+	fp->stats.buffers = n;
+	return fp;
+}
+
+void flushPipeFrameStart (flushPipe_t *fp, int64_t now){
+	fp->frameStart = now;
+	fp->renderFrom = now;
+	fp->rendering = 1;
+	fp->frameRenderUs = 0;
+	fp->frameWaitUs = 0;
+	fp->frameBands = 0;
+}
+
+void flushPipeRendered (flushPipe_t *fp, void *buf, int last, int64_t now){
+
+	if (!fp->rendering) flushPipeFrameStart (fp, now);	// no render start seen
+	fp->frameRenderUs += now - fp->renderFrom;
+	fp->callbackAt = now;
+	fp->waited = 0;
+
+	int i = findBuf (fp, buf);
+	if ((i < 0)||fp->queued[i]) return;					// not ours, should not happen
+	fp->queued[i] = 1;
+	int slot = (fp->head + fp->count) % FLUSHPIPEMAX;
+	fp->fifo[slot] = i;
+	fp->queuedAt[slot] = now;
+	fp->last[slot] = last;
+	fp->count++;
+	if (fp->count > fp->stats.maxQueued) fp->stats.maxQueued = fp->count;
+	fp->lastSlot = slot;
+	fp->frameBands++;
+	fp->stats.bands++;
+
+// the next frame may start rendering before this one is sent so its
+// figures go with the band
+
+	if (last){
+		fp->frameStartOf[slot] = fp->frameStart;
+		fp->renderOf[slot] = fp->frameRenderUs;
+		fp->waitOf[slot] = fp->frameWaitUs;
+		fp->bandsOf[slot] = fp->frameBands;
+		fp->rendering = 0;
+	}
+}
+
+void *flushPipeNext (flushPipe_t *fp, void *other){
+	int o = findBuf (fp, other);
+	if ((o >= 0) && !fp->queued[o]) return other;
+	for (int n = 0;n < fp->n;n++){
+		if (!fp->queued[n] && (fp->buf[n] != other)) return fp->buf[n];
+	}
+	fp->waited = 1;
+	return NULL;
+}
+
+void flushPipeResume (flushPipe_t *fp, int64_t now){
+	if (fp->waited){
+		int us = now - fp->callbackAt;
+		fp->stats.waits++;
+		fp->stats.waitUs += us;
+		if (!fp->rendering && fp->count && fp->last[fp->lastSlot]) fp->waitOf[fp->lastSlot] += us;
+		else fp->frameWaitUs += us;
+	}
+	fp->renderFrom = now;
+}
+
+// returns the buffer that is free again
+
+FLUSHPIPEISR void *flushPipeDone (flushPipe_t *fp, int64_t now){
+
+	if (!fp->count) return NULL;
+	int slot = fp->head;
+	int i = fp->fifo[slot];
+	fp->head = (fp->head + 1) % FLUSHPIPEMAX;
+	fp->count--;
+	fp->queued[i] = 0;
+
+	int64_t start = fp->queuedAt[slot];
+	if (fp->lastDone > start) start = fp->lastDone;		// waited behind the one before
+	fp->frameTransferUs += now - start;
+	fp->stats.transferUs += now - start;
+	fp->lastDone = now;
+
+	if (fp->last[slot]){
+		fp->stats.frames++;
+		fp->stats.renderUs += fp->renderOf[slot];
+		fp->stats.frameUs += now - fp->frameStartOf[slot];
+		fp->stats.lastRenderUs = fp->renderOf[slot];
+		fp->stats.lastWaitUs = fp->waitOf[slot];
+		fp->stats.lastTransferUs = fp->frameTransferUs;
+		fp->stats.lastFrameUs = now - fp->frameStartOf[slot];
+		fp->stats.lastBands = fp->bandsOf[slot];
+		fp->frameTransferUs = 0;
+	}
+	return fp->buf[i];
+}
+
+int flushPipeQueued (flushPipe_t *fp){
+	return fp->count;
+}
+
+void flushPipeGetStats (flushPipe_t *fp, flushPipeStats_t *st){
+	*st = fp->stats;
+}
@@ -0,0 +1,48 @@
+/********************************************************
+	flushPipe.h
+
+	Display band buffers in flight between LVGL and the SPI DMA - see
+	flushPipe.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define FLUSHPIPEMAX 4
+
+typedef struct flushPipe_s flushPipe_t;
+
+typedef struct {
+	int buffers;
+	int frames;
+	int bands;
+	int waits;							// times rendering had to wait for a buffer
+	int maxQueued;
+	int64_t renderUs;					// totals over all frames
+	int64_t waitUs;
+	int64_t transferUs;
+	int64_t frameUs;
+	int lastRenderUs;					// the last complete frame
+	int lastWaitUs;
+	int lastTransferUs;
+	int lastFrameUs;
+	int lastBands;
+} flushPipeStats_t;
+
+flushPipe_t *flushPipeCreate (void **bufs, int n);
+void flushPipeFrameStart (flushPipe_t *fp, int64_t now);
+void flushPipeRendered (flushPipe_t *fp, void *buf, int last, int64_t now);
+void *flushPipeNext (flushPipe_t *fp, void *other);
+void flushPipeResume (flushPipe_t *fp, int64_t now);
+void *flushPipeDone (flushPipe_t *fp, int64_t now);
+int flushPipeQueued (flushPipe_t *fp);
+void flushPipeGetStats (flushPipe_t *fp, flushPipeStats_t *st);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,206 @@
+/********************************************************
+	httpPool.c
+
+	Keeps one esp_http_client per host open between requests so
+	that API calls reuse the TCP connection and TLS session rather
+	than connecting and handshaking every time
+
+	httpPoolGet (url,authorization,handler,&status) performs a GET
+	on the client for the url's host, creating it if needed. The
+	body is passed to handler as HTTP_EVENT_ON_DATA events.
+	HTTP_EVENT_HEADERS_SENT comes before every attempt so handler
+	should reset what it has collected there.
+
+	If a reused connection fails (the server may have dropped it
+	while idle) it is closed and the request tried once more on a
+	new connection.
+
+	httpPoolTidy () closes clients idle for HTTPPOOLIDLEMS to give
+	back the TLS memory, it is called from the main loop.
+
+	Requests run under lockHttps as all https traffic does, the pool
+	has its own lock so that httpPoolTidy never waits for it.
+	httpPoolInit () creates that lock and is called from setup before
+	anything can make a request.
+
+*********************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <esp_http_client.h>
+#include "esp_crt_bundle.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "loco.h"
+#include "httpPool.h"
+
+#define HTTPPOOLSIZE 2
+#define HTTPPOOLHOSTLEN 64
+#define HTTPPOOLIDLEMS 30000
+
+typedef struct {
+	char host[HTTPPOOLHOSTLEN];			// scheme://host:port
+	esp_http_client_handle_t client;
+	http_event_handle_cb handler;		// for the request in progress
+	int connected;						// a new connection was made this attempt
+	int64_t lastUse;
+	int requests;
+	int connects;
+	int retries;
+	int failures;
+	int64_t time;						// us spent in requests
+} httpPoolEntry_t;
+
+httpPoolEntry_t httpPool[HTTPPOOLSIZE];
+SemaphoreHandle_t httpPoolSemaphore = NULL;
+
+void httpPoolInit (){
+	if (!httpPoolSemaphore) httpPoolSemaphore = xSemaphoreCreateMutex ();
+}
+
+void lockHttpPool (){
+	xSemaphoreTake (httpPoolSemaphore, portMAX_DELAY);
+}
+
+void unlockHttpPool (){
+	xSemaphoreGive (httpPoolSemaphore);
+}
+
+esp_err_t httpPoolHandler (esp_http_client_event_handle_t evt){
+	httpPoolEntry_t *e = evt->user_data;
+	if (evt->event_id == HTTP_EVENT_ON_CONNECTED){
+		e->connected = 1;
+		e->connects++;
+	}
+	if (e->handler) return e->handler (evt);
+	return ESP_OK;
+}
+
+// copies the scheme://host:port part of url
+
+void httpPoolHost (char *host, char *url){
+	char *s = strstr (url, "://");
+	s = s ? s + 3 : url;
+	int len = strcspn (s, "/?") + (s - url);
+	if (len >= HTTPPOOLHOSTLEN) len = HTTPPOOLHOSTLEN - 1;
+	memcpy (host, url, len);
+	host[len] = 0;
+}
+
+void httpPoolRelease (httpPoolEntry_t *e){
+	if (e->client) esp_http_client_cleanup (e->client);
+	e->client = NULL;
+	*e->host = 0;
+}
+
+// returns the entry for host, reusing the least recently used if the pool is full
+
+httpPoolEntry_t *httpPoolEntry (char *host, char *url){
+
+	httpPoolEntry_t *e = NULL;
+	for (int n = 0;n < HTTPPOOLSIZE;n++){
+		if (httpPool[n].client && !strcmp (httpPool[n].host, host)) return &httpPool[n];
+	}
+	for (int n = 0;n < HTTPPOOLSIZE;n++){
+		if (!httpPool[n].client){
+			e = &httpPool[n];
+			break;
+		}
+		if (!e || (httpPool[n].lastUse < e->lastUse)) e = &httpPool[n];
+	}
+	httpPoolRelease (e);
+
+	esp_http_client_config_t config = {.url = url,
+                                     .timeout_ms = 2000,
+                                     .buffer_size_tx = 2048,
+                                     .buffer_size = 10000,
+                                     .crt_bundle_attach = esp_crt_bundle_attach,
+                                     .event_handler = httpPoolHandler,
+                                     .user_data = e};
+
+	e->client = esp_http_client_init (&config);
+	if (!e->client) return NULL;
+	snprintf (e->host, HTTPPOOLHOSTLEN, "%s", host);
+	return e;
+}
+
+esp_err_t httpPoolGet (char *url, char *authorization, http_event_handle_cb handler, int *status){
+
+	char host[HTTPPOOLHOSTLEN];
+	httpPoolHost (host, url);
+	int64_t t = esp_timer_get_time ();
+	esp_err_t err = ESP_FAIL;
+
+	lockHttps ();
+	lockHttpPool ();
+
+	httpPoolEntry_t *e = httpPoolEntry (host, url);
+	if (!e){
+		printf ("ERROR httpPoolGet cannot create client for %s\n", host);
+		goto hpgx;
+	}
+
+	e->handler = handler;
+	e->requests++;
+
+	for (int attempt = 0;attempt < 2;attempt++){
+		esp_http_client_set_url (e->client, url);
+		esp_http_client_set_method (e->client, HTTP_METHOD_GET);
+		if (authorization) esp_http_client_set_header (e->client, "Authorization", authorization);
+		else esp_http_client_delete_header (e->client, "Authorization");		// left by the last request
+		esp_http_client_set_header (e->client, "User-agent", "okhttp/4.11.0");
+
+		e->connected = 0;
+		err = esp_http_client_perform (e->client);
+		if ((err == ESP_OK)||e->connected) break;
+
+// the kept connection had gone, try once on a new one
+
+		printf ("httpPoolGet %s reused connection failed: %s\n", host, esp_err_to_name (err));
+		esp_http_client_close (e->client);
+		e->retries++;
+	}
+
+	if (err == ESP_OK){
+		*status = esp_http_client_get_status_code (e->client);
+		e->lastUse = esp_timer_get_time ();
+	}
+	else {
+		e->failures++;
+		httpPoolRelease (e);
+	}
+	e->handler = NULL;
+	e->time += esp_timer_get_time () - t;
+
+hpgx:
+	unlockHttpPool ();
+	unlockHttps ();
+	return err;
+}
+
+void httpPoolTidy (){
+
+	if (!httpPoolSemaphore) return;
+	if (xSemaphoreTake (httpPoolSemaphore, 0) != pdTRUE) return;
+
+	int64_t now = esp_timer_get_time ();
+	for (int n = 0;n < HTTPPOOLSIZE;n++){
+		httpPoolEntry_t *e = &httpPool[n];
+		if (e->client && (now - e->lastUse > HTTPPOOLIDLEMS * 1000LL)){
+			printf ("httpPool closing idle %s\n", e->host);
+			httpPoolRelease (e);
+		}
+	}
+	unlockHttpPool ();
+}
+
+void printHttpPoolStats (){
+	for (int n = 0;n < HTTPPOOLSIZE;n++){
+		httpPoolEntry_t *e = &httpPool[n];
+		if (!e->requests) continue;
+		printf ("httpPool %d %s requests %d connects %d retries %d failures %d avg %lld ms\n",
+			n, e->client ? e->host : "(closed)", e->requests, e->connects, e->retries,
+			e->failures, e->time / e->requests / 1000);
+	}
+}
@@ -0,0 +1,22 @@
+/********************************************************
+	httpPool.h
+
+	Keep-alive HTTPS clients shared by API calls - see httpPool.c
+
+*********************************************************/
+#pragma once
+
+#include <esp_http_client.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+void httpPoolInit ();
+esp_err_t httpPoolGet (char *url, char *authorization, http_event_handle_cb handler, int *status);
+void httpPoolTidy ();
+void printHttpPoolStats ();
+
+#ifdef __cplusplus
+}
+#endif
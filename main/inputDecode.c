@@ -0,0 +1,172 @@
+/********************************************************
+	inputDecode.c
+
+	Turns the rotary encoder and button lines into events. Nothing
+	here touches hardware, locoBoard.c calls it from the GPIO edge
+	interrupts, so it can be tested on Linux by replaying traces.
+
+	Rotary
+
+	quadratureFeed (q,level) is called with the two encoder lines
+	(a in bit 0, b in bit 1) after every edge on either. Each valid
+	gray code step counts +1 or -1, a jump of both lines counts
+	nothing.
+	Bounce on one line steps forward and back and so cancels out.
+	When the lines reach 11 (the rest position) with at least two net
+	steps one way a detent is returned, +1 for 00 01 11 and -1 for
+	00 10 11, and the count starts again. This is the same as the
+	old polled decoder which looked for those two steps.
+
+	Buttons
+
+	buttonEdge (b,level,now) takes the first edge at once so there is
+	no added latency, then treats edges for DEBOUNCEUS as bounce.
+	buttonTick (b,level,now) is called at buttonDeadline () with the
+	line's level. It picks up a change that happened during the
+	bounce time and reports a long press. A press that has gone again
+	by the end of its bounce time is a glitch and gives no event.
+
+	A press released within LONGPRESSUS gives BUTTONSHORT on release,
+	one held that long gives BUTTONLONG while still held and nothing
+	on release.
+
+	Events
+
+	inputRing_t carries the events, as UI event codes, from the
+	interrupts and the Input task to the UI in the order they
+	happened. inputRingPut (r,e,at) is the producer side - the board
+	calls it only under its input critical section so there is one
+	writer at a time - and returns 0 if the ring was full and the
+	event dropped. inputRingGet (r,&at) is the consumer side and
+	returns 0 when the ring is empty. Neither locks, the indexes are
+	free running and each is written by one side only.
+
+	Only libc is used so this can be built and tested on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "inputDecode.h"
+
+// quarter step for [previous level][new level]
+
+static const int8_t quarterStep[4][4] = {
+	{ 0,  1, -1,  0},		// from 00
+	{-1,  0,  0,  1},		// from 01
+	{ 1,  0,  0, -1},		// from 10
+	{ 0, -1,  1,  0},		// from 11
+};
+
+void quadratureInit (quadrature_t *q, int level){
+	memset (q, 0, sizeof(quadrature_t));
+	q->state = level & 3;
+}
+
+int quadratureFeed (quadrature_t *q, int level){
+
+	level &= 3;
+	if (level == q->state) return 0;
+	if ((level ^ q->state) == 3) q->invalid++;			// missed a step, direction unknown
+	q->steps += quarterStep[q->state][level];
+	q->state = level;
+
+	if (level != 3) return 0;
+	int d = 0;
+	if (q->steps >= 2) d = 1;
+	else if (q->steps <= -2) d = -1;
+	q->steps = 0;
+	if (d) q->detents++;
+	return d;
+}
+
+void buttonInit (debounce_t *b, int level){
+	memset (b, 0, sizeof(debounce_t));
+	b->state = level ? 1 : 0;
+}
+
+static int buttonChange (debounce_t *b, int level, int64_t now){
+
+	b->state = level;
+	b->lockUntil = now + DEBOUNCEUS;
+	if (level){
+		b->pressedAt = now;
+		b->longSent = 0;
+		return 0;
+	}
+	if (b->longSent) return 0;
+	return ((now - b->pressedAt) < LONGPRESSUS) ? BUTTONSHORT : 0;
+}
+
+int buttonEdge (debounce_t *b, int level, int64_t now){
+
+	level = level ? 1 : 0;
+	b->edges++;
+	if (b->lockUntil && (now < b->lockUntil)){
+		b->bounces++;
+		return 0;
+	}
+	b->lockUntil = 0;
+	if (level == b->state) return 0;
+	return buttonChange (b, level, now);
+}
+
+int buttonTick (debounce_t *b, int level, int64_t now){
+
+	int ev = 0;
+	level = level ? 1 : 0;
+	if (b->lockUntil && (now >= b->lockUntil)){
+		b->lockUntil = 0;
+		if (level != b->state){					// settled the other way
+			if (!level){						// let go within DEBOUNCEUS, a glitch
+				b->state = 0;
+				b->glitches++;
+			}
+			else ev |= buttonChange (b, level, now);
+		}
+	}
+	if (b->state && !b->longSent && ((now - b->pressedAt) >= LONGPRESSUS)){
+		b->longSent = 1;
+		ev |= BUTTONLONG;
+	}
+	return ev;
+}
+
+// when buttonTick next needs calling, 0 if it does not
+
+int64_t buttonDeadline (debounce_t *b){
+	int64_t d = b->lockUntil;
+	if (b->state && !b->longSent){
+		int64_t l = b->pressedAt + LONGPRESSUS;
+		if (!d || (l < d)) d = l;
+	}
+	return d;
+}
+
+/************************* Event ring *************************/
+
+void inputRingInit (inputRing_t *r){
+	memset (r, 0, sizeof(inputRing_t));
+}
+
+int inputRingPut (inputRing_t *r, int e, int64_t at){
+	uint32_t in = r->in;
+	if (in - __atomic_load_n (&r->out, __ATOMIC_ACQUIRE) >= INPUTRINGLEN){
+		r->dropped++;
+		return 0;
+	}
+	r->e[in % INPUTRINGLEN] = e;
+	r->at[in % INPUTRINGLEN] = at;
+	__atomic_store_n (&r->in, in + 1, __ATOMIC_RELEASE);	// the slot is filled before it is seen
+	return 1;
+}
+
+int inputRingGet (inputRing_t *r, int64_t *at){
+	uint32_t out = r->out;
+	if (out == __atomic_load_n (&r->in, __ATOMIC_ACQUIRE)) return 0;
+	int e = r->e[out % INPUTRINGLEN];
+	if (at) *at = r->at[out % INPUTRINGLEN];
+	__atomic_store_n (&r->out, out + 1, __ATOMIC_RELEASE);	// and read before it is reused
+	return e;
+}
@@ -0,0 +1,65 @@
+/********************************************************
+	inputDecode.h
+
+	Rotary encoder and button decoding - see inputDecode.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define DEBOUNCEUS 20000
+#define LONGPRESSUS 1500000
+
+// button events
+#define BUTTONSHORT 1					// released before LONGPRESSUS
+#define BUTTONLONG 2					// held for LONGPRESSUS
+
+#define INPUTRINGLEN 64					// a power of 2
+
+typedef struct {
+	int state;							// 2 bit gray code, a in bit 0
+	int steps;							// quarter steps since the last detent
+	int invalid;						// both lines changed at once
+	int detents;
+} quadrature_t;
+
+typedef struct {
+	int state;							// debounced, 1 is pressed
+	int64_t lockUntil;					// edges are bounce until then, 0 if not locked
+	int64_t pressedAt;
+	int longSent;
+	int edges;
+	int bounces;
+	int glitches;
+} debounce_t;
+
+// events from the input interrupts to the UI, one writer and one reader
+
+typedef struct {
+	uint8_t e[INPUTRINGLEN];
+	int64_t at[INPUTRINGLEN];
+	uint32_t in;						// written by the producer only
+	uint32_t out;						// written by the consumer only
+	uint32_t dropped;
+} inputRing_t;
+
+void quadratureInit (quadrature_t *q, int level);
+int quadratureFeed (quadrature_t *q, int level);
+
+void buttonInit (debounce_t *b, int level);
+int buttonEdge (debounce_t *b, int level, int64_t now);
+int buttonTick (debounce_t *b, int level, int64_t now);
+int64_t buttonDeadline (debounce_t *b);
+
+void inputRingInit (inputRing_t *r);
+int inputRingPut (inputRing_t *r, int e, int64_t at);
+int inputRingGet (inputRing_t *r, int64_t *at);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,294 @@
+/********************************************************
+	jitterBuffer.c
+
+	A single producer / single consumer byte ring between a network
+	stream and the player. Data arrives in bursts and gaps, the player
+	takes it at a steady rate, so the ring has to hold enough to cover
+	the longest gap it is going to see.
+
+	The producer measures that as it writes. Each write is stamped
+	with its arrival time and the stream time it ends at (bytes so far
+	over bytesPerSec), the difference is its transit time.
+
+		jitter		smoothed change in transit time between writes,
+					as RFC 3550 does for RTP
+		late		how much later than the earliest transit in the
+					last one or two JITTERWINDOWMS windows a write
+					arrived, the gap the buffer would have had to cover
+
+	The target fill is late + 4 x jitter, at least prebufferMs and at
+	most maxMs (or 3/4 of the ring). The consumer starts playing once
+	the fill reaches the target, and if it ever finds the ring empty
+	counts an underrun and waits for the target again. A gap then makes
+	the next start later and the estimate decays after the windows have
+	passed without one.
+
+	jitterFlush (consumer) empties the ring for a new stream and the
+	producer restarts its stream clock, the jitter and late estimates
+	carry over. So does jitterSetRate.
+
+	Writes and reads of whole frames stay whole frames. The size must
+	be a power of two, head and tail run freely and are masked on use.
+	Only C11 atomics are used so this can be built and simulated on
+	Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "jitterBuffer.h"
+
+#define JITTERWINDOWMS 30000
+#define JITTERDEFAULTRATE (44100 * 4)
+
+typedef struct jitter_s {
+	uint8_t *buffer;
+	uint32_t size;
+	uint32_t mask;
+	int maxMs;
+	_Atomic int prebufferMs;
+	_Atomic int rate;					// bytes per second
+	_Atomic int targetMs;
+	_Atomic int jitterMs;
+	_Atomic int lateMs;
+	_Atomic uint32_t head;				// written by the producer
+	_Atomic uint32_t tail;				// written by the consumer
+	_Atomic uint32_t epoch;				// the stream clock restarts when this moves
+
+// producer only
+
+	uint32_t seenEpoch;
+	int arrivals;						// since the clock restarted
+	int64_t baseUs;
+	int64_t media;						// bytes since baseUs
+	int64_t lastTransit;
+	int64_t jitter16;					// us x 16
+	int64_t windowStart;
+	int64_t curMin;						// earliest transit in this window
+	int64_t prevMin;					// and the one before
+	int64_t curLate;
+	int64_t prevLate;
+	int64_t bytesIn;
+
+// consumer only
+
+	int state;
+	int64_t waitStart;					// 0 until there is data to wait on
+	int startupMs;
+	uint32_t underruns;
+	uint32_t starts;
+	int64_t bytesOut;
+} jitter_t;
+
+// buffer must hold size bytes and size must be a power of two
+
+jitter_t *jitterCreate (uint8_t *buffer, int size, int prebufferMs, int maxMs){
+
+	if (size & (size - 1)){
+		printf ("ERROR jitterCreate size %d not a power of two\n", size);
+		return NULL;
+	}
+
+	jitter_t *j = malloc (sizeof(jitter_t));
+	if (!j) return NULL;
+	memset (j, 0, sizeof(jitter_t));
+
+	j->buffer = buffer;
+	j->size = size;
+	j->mask = size - 1;
+	j->maxMs = maxMs;
+	atomic_init (&j->prebufferMs, prebufferMs);
+	atomic_init (&j->rate, JITTERDEFAULTRATE);
+	atomic_init (&j->targetMs, prebufferMs);
+	atomic_init (&j->jitterMs, 0);
+	atomic_init (&j->lateMs, 0);
+	atomic_init (&j->head, 0);
+	atomic_init (&j->tail, 0);
+	atomic_init (&j->epoch, 0);
+	j->state = JITTERPREBUFFER;
+	return j;
+}
+
+void jitterSetRate (jitter_t *j, int bytesPerSec){
+	if (bytesPerSec <= 0) bytesPerSec = JITTERDEFAULTRATE;
+	if (atomic_exchange (&j->rate, bytesPerSec) != bytesPerSec) atomic_fetch_add (&j->epoch, 1);
+}
+
+void jitterSetPrebuffer (jitter_t *j, int ms){
+	if (ms < 0) ms = 0;
+	atomic_store (&j->prebufferMs, ms);
+	if (atomic_load (&j->targetMs) < ms) atomic_store (&j->targetMs, ms);
+}
+
+static int64_t max64 (int64_t a, int64_t b){
+	return (a > b) ? a : b;
+}
+
+static int64_t min64 (int64_t a, int64_t b){
+	return (a < b) ? a : b;
+}
+
+// producer, the target from the estimates
+
+static void updateTarget (jitter_t *j, int rate){
+	int64_t us = max64 (j->curLate, j->prevLate) + 4 * (j->jitter16 / 16);
+	int64_t ms = (us + 999) / 1000;
+	int prebufferMs = atomic_load (&j->prebufferMs);
+	int64_t capMs = ((int64_t)j->size * 3 / 4) * 1000 / rate;
+	if (ms < prebufferMs) ms = prebufferMs;
+	if (ms > j->maxMs) ms = j->maxMs;
+	if (ms > capMs) ms = capMs;
+	atomic_store (&j->targetMs, (int)ms);
+	atomic_store (&j->jitterMs, (int)(j->jitter16 / 16000));
+	atomic_store (&j->lateMs, (int)(max64 (j->curLate, j->prevLate) / 1000));
+}
+
+// producer, counts len bytes that arrived at nowUs
+
+static void arrived (jitter_t *j, int len, int64_t nowUs){
+	int rate = atomic_load (&j->rate);
+	uint32_t epoch = atomic_load (&j->epoch);
+
+	if ((epoch != j->seenEpoch)||!j->arrivals){
+		j->seenEpoch = epoch;
+		j->arrivals = 0;
+		j->baseUs = nowUs;
+		j->media = 0;
+		j->curMin = INT64_MAX;
+		j->prevMin = INT64_MAX;
+		if (!j->windowStart) j->windowStart = nowUs;
+	}
+
+	j->media += len;
+	int64_t transit = (nowUs - j->baseUs) - (j->media * 1000000) / rate;
+	if (j->arrivals){
+		int64_t d = transit - j->lastTransit;
+		if (d < 0) d = -d;
+		j->jitter16 += d - (j->jitter16 + 8) / 16;
+	}
+	j->lastTransit = transit;
+	j->arrivals++;
+
+	if (nowUs - j->windowStart >= JITTERWINDOWMS * 1000LL){
+		j->prevMin = j->curMin;
+		j->prevLate = j->curLate;
+		j->curMin = INT64_MAX;
+		j->curLate = 0;
+		j->windowStart = nowUs;
+	}
+	j->curMin = min64 (j->curMin, transit);
+	int64_t late = transit - min64 (j->curMin, j->prevMin);
+	j->curLate = max64 (j->curLate, late);
+
+	updateTarget (j, rate);
+}
+
+// loans up to max bytes of the ring to write in place, returns how
+// many, 0 if it is full
+
+int jitterWriteBegin (jitter_t *j, uint8_t **p, int max){
+	uint32_t head = atomic_load_explicit (&j->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit (&j->tail, memory_order_acquire);
+	uint32_t space = j->size - (head - tail);
+	uint32_t run = j->size - (head & j->mask);
+	uint32_t n = (space < run) ? space : run;
+	if (n > (uint32_t)max) n = max;
+	*p = j->buffer + (head & j->mask);
+	return n;
+}
+
+void jitterWriteEnd (jitter_t *j, int len, int64_t nowUs){
+	if (len <= 0) return;
+	arrived (j, len, nowUs);
+	j->bytesIn += len;
+	atomic_fetch_add_explicit (&j->head, len, memory_order_release);
+}
+
+// returns the bytes written, less than len if the ring is full
+
+int jitterWrite (jitter_t *j, const uint8_t *data, int len, int64_t nowUs){
+	int done = 0;
+	while (done < len){
+		uint8_t *p;
+		int n = jitterWriteBegin (j, &p, len - done);
+		if (!n) break;
+		memcpy (p, data + done, n);
+		atomic_fetch_add_explicit (&j->head, n, memory_order_release);
+		done += n;
+	}
+	if (done){
+		arrived (j, done, nowUs);
+		j->bytesIn += done;
+	}
+	return done;
+}
+
+// returns the bytes read, 0 while filling
+
+int jitterRead (jitter_t *j, uint8_t *buf, int len, int64_t nowUs){
+	uint32_t tail = atomic_load_explicit (&j->tail, memory_order_relaxed);
+	uint32_t head = atomic_load_explicit (&j->head, memory_order_acquire);
+	uint32_t fill = head - tail;
+
+	if (j->state != JITTERPLAYING){
+		if (fill && !j->waitStart) j->waitStart = nowUs;
+		int64_t target = (int64_t)atomic_load (&j->targetMs) * atomic_load (&j->rate) / 1000;
+		if (!fill || (fill < target)) return 0;
+		j->startupMs = (int)((nowUs - j->waitStart) / 1000);
+		j->waitStart = 0;
+		j->state = JITTERPLAYING;
+		j->starts++;
+	}
+	else if (!fill){
+		j->state = JITTERREBUFFER;
+		j->waitStart = nowUs;
+		j->underruns++;
+		return 0;
+	}
+
+	uint32_t n = ((uint32_t)len < fill) ? (uint32_t)len : fill;
+	uint32_t at = tail & j->mask;
+	uint32_t first = (n < j->size - at) ? n : j->size - at;
+	memcpy (buf, j->buffer + at, first);
+	memcpy (buf + first, j->buffer, n - first);
+	j->bytesOut += n;
+	atomic_store_explicit (&j->tail, tail + n, memory_order_release);
+	return n;
+}
+
+// consumer, empties the ring for a new stream
+
+void jitterFlush (jitter_t *j){
+	atomic_store (&j->tail, atomic_load (&j->head));
+	atomic_fetch_add (&j->epoch, 1);
+	j->state = JITTERPREBUFFER;
+	j->waitStart = 0;
+}
+
+void jitterGetStats (jitter_t *j, jitterStats_t *s){
+	uint32_t head = atomic_load (&j->head);
+	uint32_t tail = atomic_load (&j->tail);
+	int rate = atomic_load (&j->rate);
+	s->state = j->state;
+	s->size = j->size;
+	s->fill = head - tail;
+	s->fillMs = (int)((int64_t)s->fill * 1000 / rate);
+	s->targetMs = atomic_load (&j->targetMs);
+	s->prebufferMs = atomic_load (&j->prebufferMs);
+	s->jitterMs = atomic_load (&j->jitterMs);
+	s->lateMs = atomic_load (&j->lateMs);
+	s->startupMs = j->startupMs;
+	s->underruns = j->underruns;
+	s->starts = j->starts;
+	s->bytesIn = j->bytesIn;
+	s->bytesOut = j->bytesOut;
+}
+
+const char *jitterStateName (int state){
+	static const char *names[] = {"prebuffer", "playing", "rebuffer"};
+	if ((state < 0)||(state > JITTERREBUFFER)) return "?";
+	return names[state];
+}
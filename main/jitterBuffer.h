@@ -0,0 +1,52 @@
+/********************************************************
+	jitterBuffer.h
+
+	Adaptive buffer between a network stream and the player, sized
+	from the arrival jitter - see jitterBuffer.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// states
+#define JITTERPREBUFFER 0				// filling before the first play
+#define JITTERPLAYING 1
+#define JITTERREBUFFER 2				// ran dry, filling again
+
+typedef struct jitter_s jitter_t;
+
+typedef struct {
+	int state;
+	int size;							// bytes
+	int fill;
+	int fillMs;
+	int targetMs;						// fill needed to start
+	int prebufferMs;					// the least target
+	int jitterMs;						// smoothed arrival jitter
+	int lateMs;							// latest arrival in the recent windows
+	int startupMs;						// the last wait to start or restart
+	uint32_t underruns;
+	uint32_t starts;
+	int64_t bytesIn;
+	int64_t bytesOut;
+} jitterStats_t;
+
+jitter_t *jitterCreate (uint8_t *buffer, int size, int prebufferMs, int maxMs);
+void jitterSetRate (jitter_t *j, int bytesPerSec);
+void jitterSetPrebuffer (jitter_t *j, int ms);
+int jitterWriteBegin (jitter_t *j, uint8_t **p, int max);
+void jitterWriteEnd (jitter_t *j, int len, int64_t nowUs);
+int jitterWrite (jitter_t *j, const uint8_t *data, int len, int64_t nowUs);
+int jitterRead (jitter_t *j, uint8_t *buf, int len, int64_t nowUs);
+void jitterFlush (jitter_t *j);
+void jitterGetStats (jitter_t *j, jitterStats_t *s);
+const char *jitterStateName (int state);
+
+#ifdef __cplusplus
+}
+#endif
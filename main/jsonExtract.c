@@ -0,0 +1,494 @@
+/********************************************************
+	jsonExtract.c
+
+	Pulls selected fields out of a JSON document as it arrives,
+	without building a tree or holding the document in memory.
+	Feed it whatever the http client delivers, in pieces of any size.
+
+	Paths name the fields wanted, for example
+
+		"total"					top level member
+		"items[].name"			name in each element of items
+		"items[].show.uri"
+
+	The callback gets each matching string, number, true, false or
+	null as text with its type (JXTYPESTRING etc, null comes as ""),
+	and the element number of the first [] in its path. Everything
+	else is only tokenised, so memory use is the jsonExtract_t
+	whatever the size of the document. Numbers are checked against
+	the JSON grammar, 01, - and 1. are errors.
+
+	jsonExtractInit (jx,paths,npaths,cb,arg)
+	jsonExtractFeed (jx,data,len) as data arrives, -1 on bad JSON
+	jsonExtractEnd (jx) 0 if a complete document was seen
+
+	The path strings must stay valid while jx is used. Keys longer
+	than JXKEYLEN - 1 never match.
+
+	Only libc is used so this can be built and tested on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "jsonExtract.h"
+
+enum {
+	JXVALUE,				// expecting a value
+	JXVALUEOREND,			// after [
+	JXKEYOREND,				// after {
+	JXKEY,					// after , in an object
+	JXCOLON,
+	JXCOMMAOROBJEND,
+	JXCOMMAORARREND,
+	JXSTRING,
+	JXESCAPE,
+	JXUNICODE,
+	JXNUMBER,
+	JXLITERAL,
+	JXDONE
+};
+
+// where a number has got to, -1.5e+3 is SIGN INT DOT FRAC EXP EXPSIGN EXPDIGITS
+
+enum {
+	JXNSIGN = 1,			// after -
+	JXNZERO,				// a leading 0, only . or e may follow
+	JXNINT,
+	JXNDOT,
+	JXNFRAC,
+	JXNEXP,
+	JXNEXPSIGN,
+	JXNEXPDIGITS
+};
+
+// splits "items[].show.name" into items [] show name
+
+static int jxParsePath (jxPath_t *p, const char *s){
+	p->n = 0;
+	while (*s){
+		if (p->n >= JXMAXTOKENS) return -1;
+		if (!strncmp (s, "[]", 2)){
+			p->tok[p->n] = s;
+			p->len[p->n++] = 2;
+			s += 2;
+		}
+		else {
+			int l = strcspn (s, ".[");
+			if (!l) return -1;
+			p->tok[p->n] = s;
+			p->len[p->n++] = l;
+			s += l;
+		}
+		if (*s == '.') s++;
+	}
+	return 0;
+}
+
+void jsonExtractReset (jsonExtract_t *jx){
+	jx->state = JXVALUE;
+	jx->error = 0;
+	jx->bytes = 0;
+	jx->depth = 0;
+	jx->mask[0] = (jx->npaths >= 32) ? 0xFFFFFFFF : ((1u << jx->npaths) - 1);
+	jx->capture = 0;
+	jx->highSurrogate = 0;
+}
+
+int jsonExtractInit (jsonExtract_t *jx, const char **paths, int npaths, jsonExtractCb_t cb, void *arg){
+
+	memset (jx, 0, sizeof(jsonExtract_t));
+	if (npaths > JXMAXPATHS) return -1;
+	for (int n = 0;n < npaths;n++){
+		if (jxParsePath (&jx->paths[n], paths[n])) return -1;
+	}
+	jx->npaths = npaths;
+	jx->cb = cb;
+	jx->arg = arg;
+	jsonExtractReset (jx);
+	return 0;
+}
+
+// paths in mask whose token at depth d is the key or [] just read
+
+static uint32_t jxFilter (jsonExtract_t *jx, uint32_t mask, int d, const char *tok, int len){
+	uint32_t r = 0;
+	if (d >= JXMAXTOKENS) return 0;
+	for (int n = 0;mask;n++, mask >>= 1){
+		if (!(mask & 1)) continue;
+		jxPath_t *p = &jx->paths[n];
+		if ((d < p->n) && (p->len[d] == len) && !memcmp (p->tok[d], tok, len)) r |= 1u << n;
+	}
+	return r;
+}
+
+static void jxPut (jsonExtract_t *jx, char c){
+	if (jx->isKey){
+		if (jx->keyLen < JXKEYLEN) jx->key[jx->keyLen] = c;
+		jx->keyLen++;
+	}
+	else if (jx->capture){
+		if (jx->valueLen < JXVALUELEN - 1) jx->value[jx->valueLen++] = c;
+		else jx->truncated = 1;
+	}
+}
+
+static void jxPutCodepoint (jsonExtract_t *jx, uint32_t c){
+	if (c < 0x80) jxPut (jx, c);
+	else if (c < 0x800){
+		jxPut (jx, 0xC0 | (c >> 6));
+		jxPut (jx, 0x80 | (c & 0x3F));
+	}
+	else if (c < 0x10000){
+		jxPut (jx, 0xE0 | (c >> 12));
+		jxPut (jx, 0x80 | ((c >> 6) & 0x3F));
+		jxPut (jx, 0x80 | (c & 0x3F));
+	}
+	else {
+		jxPut (jx, 0xF0 | (c >> 18));
+		jxPut (jx, 0x80 | ((c >> 12) & 0x3F));
+		jxPut (jx, 0x80 | ((c >> 6) & 0x3F));
+		jxPut (jx, 0x80 | (c & 0x3F));
+	}
+}
+
+// a high surrogate not followed by a low one becomes U+FFFD
+
+static void jxFlushSurrogate (jsonExtract_t *jx){
+	if (jx->highSurrogate){
+		jx->highSurrogate = 0;
+		jxPutCodepoint (jx, 0xFFFD);
+	}
+}
+
+static void jxUnicode (jsonExtract_t *jx, uint32_t c){
+	if ((c >= 0xDC00) && (c <= 0xDFFF) && jx->highSurrogate){
+		c = 0x10000 + ((jx->highSurrogate - 0xD800) << 10) + (c - 0xDC00);
+		jx->highSurrogate = 0;
+		jxPutCodepoint (jx, c);
+		return;
+	}
+	jxFlushSurrogate (jx);
+	if ((c >= 0xD800) && (c <= 0xDBFF)) jx->highSurrogate = c;
+	else if ((c >= 0xDC00) && (c <= 0xDFFF)) jxPutCodepoint (jx, 0xFFFD);
+	else jxPutCodepoint (jx, c);
+}
+
+// the item number is the index in the outermost array of the path
+
+static int jxItem (jsonExtract_t *jx){
+	for (int d = 0;d < jx->depth;d++){
+		if (jx->container[d] == '[') return jx->index[d];
+	}
+	return -1;
+}
+
+static void jxAfterValue (jsonExtract_t *jx){
+	if (!jx->depth) jx->state = JXDONE;
+	else if (jx->container[jx->depth - 1] == '{') jx->state = JXCOMMAOROBJEND;
+	else jx->state = JXCOMMAORARREND;
+}
+
+// a scalar starts - capture it if a path ends here
+
+static void jxStartScalar (jsonExtract_t *jx){
+	uint32_t m = jx->mask[jx->depth];
+	jx->capture = 0;
+	for (int n = 0;m;n++, m >>= 1){
+		if ((m & 1) && (jx->paths[n].n == jx->depth)) jx->capture |= 1u << n;
+	}
+	jx->valueLen = 0;
+	jx->truncated = 0;
+}
+
+static void jxEndScalar (jsonExtract_t *jx){
+	if (jx->capture){
+		int l = jx->valueLen;
+		if (jx->truncated){
+			// drop a UTF-8 sequence that was cut short
+			int s = l;
+			while ((s > 0) && ((jx->value[s - 1] & 0xC0) == 0x80)) s--;
+			if ((s > 0) && (jx->value[s - 1] & 0x80)){
+				unsigned char lead = jx->value[s - 1];
+				int need = (lead >= 0xF0) ? 4 : (lead >= 0xE0) ? 3 : 2;
+				if (l - (s - 1) < need) l = s - 1;
+			}
+		}
+		jx->value[l] = 0;
+		if (jx->valueType == JXTYPENULL) jx->value[0] = 0;
+		uint32_t c = jx->capture;
+		int item = jxItem (jx);
+		for (int n = 0;c;n++, c >>= 1){
+			if (c & 1) jx->cb (jx->arg, n, item, jx->valueType, jx->value);
+		}
+	}
+	jx->capture = 0;
+	jxAfterValue (jx);
+}
+
+static int jxPush (jsonExtract_t *jx, char c){
+	if (jx->depth >= JXMAXDEPTH) return -1;
+	jx->container[jx->depth] = c;
+	jx->index[jx->depth] = 0;
+	jx->depth++;
+	if (c == '[') jx->mask[jx->depth] = jxFilter (jx, jx->mask[jx->depth - 1], jx->depth - 1, "[]", 2);
+	else jx->mask[jx->depth] = 0;
+	return 0;
+}
+
+static int jxPop (jsonExtract_t *jx, char c){
+	if (!jx->depth || (jx->container[jx->depth - 1] != c)) return -1;
+	jx->depth--;
+	jxAfterValue (jx);
+	return 0;
+}
+
+static int jxIsSpace (char c){
+	return (c == ' ')||(c == '\t')||(c == '\n')||(c == '\r');
+}
+
+static int jxDigit (char c){
+	return (c >= '0') && (c <= '9');
+}
+
+// the next character of a number, 1 if it is part of it, 0 if the
+// number has ended before it, -1 if the number is bad
+
+static int jxNumber (jsonExtract_t *jx, char c){
+	int s = jx->numState;
+	int e = (c == 'e')||(c == 'E');
+	switch (s){
+	case JXNSIGN:		s = (c == '0') ? JXNZERO : jxDigit (c) ? JXNINT : -1; break;
+	case JXNZERO:		s = (c == '.') ? JXNDOT : e ? JXNEXP : jxDigit (c) ? -1 : 0; break;
+	case JXNINT:		s = jxDigit (c) ? JXNINT : (c == '.') ? JXNDOT : e ? JXNEXP : 0; break;
+	case JXNDOT:		s = jxDigit (c) ? JXNFRAC : -1; break;
+	case JXNFRAC:		s = jxDigit (c) ? JXNFRAC : e ? JXNEXP : 0; break;
+	case JXNEXP:		s = ((c == '+')||(c == '-')) ? JXNEXPSIGN : jxDigit (c) ? JXNEXPDIGITS : -1; break;
+	case JXNEXPSIGN:	s = jxDigit (c) ? JXNEXPDIGITS : -1; break;
+	case JXNEXPDIGITS:	s = jxDigit (c) ? JXNEXPDIGITS : 0; break;
+	}
+	if (s <= 0) return s;
+	jx->numState = s;
+	return 1;
+}
+
+// a number may end in these states only
+
+static int jxNumberComplete (jsonExtract_t *jx){
+	int s = jx->numState;
+	return (s == JXNZERO)||(s == JXNINT)||(s == JXNFRAC)||(s == JXNEXPDIGITS);
+}
+
+static int jxValue (jsonExtract_t *jx, char c){
+	if (c == '{') return jxPush (jx, '{') ? -1 : (jx->state = JXKEYOREND, 0);
+	if (c == '[') return jxPush (jx, '[') ? -1 : (jx->state = JXVALUEOREND, 0);
+	if (c == '\"'){
+		jx->isKey = 0;
+		jxStartScalar (jx);
+		jx->valueType = JXTYPESTRING;
+		jx->state = JXSTRING;
+		return 0;
+	}
+	if ((c == '-')||jxDigit (c)){
+		jx->isKey = 0;
+		jxStartScalar (jx);
+		jx->valueType = JXTYPENUMBER;
+		jx->numState = JXNSIGN;
+		if (c != '-') jxNumber (jx, c);
+		jxPut (jx, c);
+		jx->state = JXNUMBER;
+		return 0;
+	}
+	if ((c == 't')||(c == 'f')||(c == 'n')){
+		jx->isKey = 0;
+		jxStartScalar (jx);
+		jxPut (jx, c);
+		jx->literal[0] = c;
+		jx->literalLen = 1;
+		jx->state = JXLITERAL;
+		return 0;
+	}
+	return -1;
+}
+
+static void jxStartKey (jsonExtract_t *jx){
+	jx->isKey = 1;
+	jx->keyLen = 0;
+	jx->state = JXSTRING;
+}
+
+static void jxEndKey (jsonExtract_t *jx){
+	int d = jx->depth;
+	uint32_t m = jx->mask[d - 1];
+	if (m && (jx->keyLen < JXKEYLEN)) jx->mask[d] = jxFilter (jx, m, d - 1, jx->key, jx->keyLen);
+	else jx->mask[d] = 0;
+	jx->isKey = 0;
+	jx->state = JXCOLON;
+}
+
+static int jxEndLiteral (jsonExtract_t *jx){
+	jx->literal[jx->literalLen] = 0;
+	if (!strcmp (jx->literal, "null")) jx->valueType = JXTYPENULL;
+	else if (!strcmp (jx->literal, "true")||!strcmp (jx->literal, "false")) jx->valueType = JXTYPEBOOL;
+	else return -1;
+	jxEndScalar (jx);
+	return 0;
+}
+
+int jsonExtractFeed (jsonExtract_t *jx, const char *data, int len){
+
+	if (jx->error) return -1;
+
+	for (int i = 0;i < len;i++){
+		char c = data[i];
+		int r = 0;
+
+		switch (jx->state){
+
+		case JXVALUE:
+			if (!jxIsSpace (c)) r = jxValue (jx, c);
+			break;
+
+		case JXVALUEOREND:
+			if (jxIsSpace (c)) break;
+			if (c == ']') r = jxPop (jx, '[');
+			else r = jxValue (jx, c);
+			break;
+
+		case JXKEYOREND:
+			if (jxIsSpace (c)) break;
+			if (c == '}') r = jxPop (jx, '{');
+			else if (c == '\"') jxStartKey (jx);
+			else r = -1;
+			break;
+
+		case JXKEY:
+			if (jxIsSpace (c)) break;
+			if (c == '\"') jxStartKey (jx);
+			else r = -1;
+			break;
+
+		case JXCOLON:
+			if (jxIsSpace (c)) break;
+			if (c == ':') jx->state = JXVALUE;
+			else r = -1;
+			break;
+
+		case JXCOMMAOROBJEND:
+			if (jxIsSpace (c)) break;
+			if (c == ',') jx->state = JXKEY;
+			else if (c == '}') r = jxPop (jx, '{');
+			else r = -1;
+			break;
+
+		case JXCOMMAORARREND:
+			if (jxIsSpace (c)) break;
+			if (c == ','){
+				jx->index[jx->depth - 1]++;
+				jx->state = JXVALUE;
+			}
+			else if (c == ']') r = jxPop (jx, '[');
+			else r = -1;
+			break;
+
+		case JXSTRING:
+			if (c == '\\'){
+				jx->state = JXESCAPE;
+				break;
+			}
+			jxFlushSurrogate (jx);
+			if (c == '\"'){
+				if (jx->isKey) jxEndKey (jx);
+				else jxEndScalar (jx);
+			}
+			else if ((unsigned char)c < 0x20) r = -1;
+			else jxPut (jx, c);
+			break;
+
+		case JXESCAPE:
+			jx->state = JXSTRING;
+			if (c == 'u'){
+				jx->u = 0;
+				jx->uDigits = 0;
+				jx->state = JXUNICODE;
+				break;
+			}
+			jxFlushSurrogate (jx);
+			if ((c == '\"')||(c == '\\')||(c == '/')) jxPut (jx, c);
+			else if (c == 'b') jxPut (jx, '\b');
+			else if (c == 'f') jxPut (jx, '\f');
+			else if (c == 'n') jxPut (jx, '\n');
+			else if (c == 'r') jxPut (jx, '\r');
+			else if (c == 't') jxPut (jx, '\t');
+			else r = -1;
+			break;
+
+		case JXUNICODE: {
+			int h;
+			if ((c >= '0') && (c <= '9')) h = c - '0';
+			else if ((c >= 'a') && (c <= 'f')) h = c - 'a' + 10;
+			else if ((c >= 'A') && (c <= 'F')) h = c - 'A' + 10;
+			else {
+				r = -1;
+				break;
+			}
+			jx->u = (jx->u << 4) | h;
+			if (++jx->uDigits == 4){
+				jxUnicode (jx, jx->u);
+				jx->state = JXSTRING;
+			}
+			break;
+		}
+
+		case JXNUMBER:
+			r = jxNumber (jx, c);
+			if (r > 0){
+				jxPut (jx, c);
+				r = 0;
+				break;
+			}
+			if (r || !jxNumberComplete (jx)){
+				r = -1;
+				break;
+			}
+			jxEndScalar (jx);
+			i--;				// the character after the number is seen again
+			break;
+
+		case JXLITERAL:
+			if ((c >= 'a') && (c <= 'z')){
+				if (jx->literalLen >= 5) r = -1;
+				else {
+					jx->literal[jx->literalLen++] = c;
+					jxPut (jx, c);
+				}
+				break;
+			}
+			r = jxEndLiteral (jx);
+			i--;
+			break;
+
+		case JXDONE:
+			if (!jxIsSpace (c)) r = -1;
+			break;
+		}
+
+		if (r){
+			jx->error = 1;
+			return -1;
+		}
+	}
+	jx->bytes += len;
+	return 0;
+}
+
+int jsonExtractEnd (jsonExtract_t *jx){
+	if (jx->error) return -1;
+	if (!jx->depth && (jx->state == JXNUMBER)){
+		if (!jxNumberComplete (jx)) return -1;
+		jxEndScalar (jx);
+	}
+	if (!jx->depth && (jx->state == JXLITERAL) && jxEndLiteral (jx)) return -1;
+	return (jx->state == JXDONE) ? 0 : -1;
+}
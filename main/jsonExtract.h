@@ -0,0 +1,75 @@
+/********************************************************
+	jsonExtract.h
+
+	Streaming extraction of selected JSON fields - see jsonExtract.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define JXMAXPATHS 8
+#define JXMAXTOKENS 8			// per path
+#define JXMAXDEPTH 32			// document nesting
+#define JXKEYLEN 32
+#define JXVALUELEN 128
+
+// value types
+#define JXTYPESTRING 0
+#define JXTYPENUMBER 1
+#define JXTYPEBOOL 2				// value is "true" or "false"
+#define JXTYPENULL 3				// value is ""
+
+// path is the index into the paths given to jsonExtractInit, item the
+// index in the first array of the path or -1. value is null terminated
+// and cut to JXVALUELEN - 1 bytes on a UTF-8 boundary
+typedef void (*jsonExtractCb_t) (void *arg, int path, int item, int type, const char *value);
+
+typedef struct {
+	const char *tok[JXMAXTOKENS];
+	uint8_t len[JXMAXTOKENS];
+	int n;
+} jxPath_t;
+
+typedef struct {
+	jxPath_t paths[JXMAXPATHS];
+	int npaths;
+	jsonExtractCb_t cb;
+	void *arg;
+
+	int state;
+	int error;
+	int bytes;
+	int depth;
+	uint8_t container[JXMAXDEPTH];
+	int index[JXMAXDEPTH];
+	uint32_t mask[JXMAXDEPTH + 1];
+	uint32_t capture;			// paths matched by the current scalar
+
+	int isKey;
+	char key[JXKEYLEN];
+	int keyLen;
+	char value[JXVALUELEN];
+	int valueLen;
+	int valueType;
+	int truncated;
+	int numState;
+	char literal[6];
+	int literalLen;
+	uint32_t u;
+	int uDigits;
+	uint32_t highSurrogate;
+} jsonExtract_t;
+
+int jsonExtractInit (jsonExtract_t *jx, const char **paths, int npaths, jsonExtractCb_t cb, void *arg);
+void jsonExtractReset (jsonExtract_t *jx);
+int jsonExtractFeed (jsonExtract_t *jx, const char *data, int len);
+int jsonExtractEnd (jsonExtract_t *jx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,183 @@
+/********************************************************
+	jsonWriter.c
+
+	Writes JSON straight to a flush callback, typically
+	httpd_resp_send_chunk, through a small caller supplied buffer.
+	Nothing is allocated so the memory used by a response is the
+	buffer whatever its length.
+
+	jsonInit (w,buf,size,flush,arg)
+	jsonObjectStart (w,key) ... jsonObjectEnd (w)
+	jsonString (w,key,value) etc
+	jsonEnd (w) flushes what is left and returns non zero if any
+	flush failed or the nesting was wrong
+
+	Once a flush fails the rest of the output is dropped. Strings are
+	escaped as cJSON does, UTF-8 passes through unchanged. The output
+	is compact, like cJSON_PrintUnformatted.
+
+	Only libc is used so this can be built and tested on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsonWriter.h"
+
+void jsonInit (jsonWriter_t *w, char *buf, int size, jsonFlush_t flush, void *arg){
+	memset (w, 0, sizeof(jsonWriter_t));
+	w->buf = buf;
+	w->size = size;
+	w->flush = flush;
+	w->arg = arg;
+}
+
+static void jsonFlush (jsonWriter_t *w){
+	if (w->len && !w->error){
+		if (w->flush (w->arg, w->buf, w->len)) w->error = 1;
+		w->flushes++;
+	}
+	w->len = 0;
+}
+
+static void jsonPut (jsonWriter_t *w, const char *s, int n){
+	w->total += n;
+	while (n){
+		if (w->len == w->size) jsonFlush (w);
+		int c = w->size - w->len;
+		if (c > n) c = n;
+		memcpy (w->buf + w->len, s, c);
+		w->len += c;
+		s += c;
+		n -= c;
+	}
+}
+
+static void jsonPutc (jsonWriter_t *w, char c){
+	if (w->len == w->size) jsonFlush (w);
+	w->buf[w->len++] = c;
+	w->total++;
+}
+
+static void jsonQuoted (jsonWriter_t *w, const char *s){
+
+	jsonPutc (w, '\"');
+	if (s){
+		const char *run = s;
+		for (;*s;s++){
+			unsigned char c = *s;
+			char esc = 0;
+			if (c == '\"') esc = '\"';
+			else if (c == '\\') esc = '\\';
+			else if (c == '\b') esc = 'b';
+			else if (c == '\f') esc = 'f';
+			else if (c == '\n') esc = 'n';
+			else if (c == '\r') esc = 'r';
+			else if (c == '\t') esc = 't';
+			else if (c >= 0x20) continue;
+
+			jsonPut (w, run, s - run);
+			run = s + 1;
+			if (esc){
+				char e[2] = {'\\', esc};
+				jsonPut (w, e, 2);
+			}
+			else {
+				char e[8];
+				snprintf (e, sizeof(e), "\\u%04x", c);
+				jsonPut (w, e, 6);
+			}
+		}
+		jsonPut (w, run, s - run);
+	}
+	jsonPutc (w, '\"');
+}
+
+// comma and key before a value
+
+static void jsonValue (jsonWriter_t *w, const char *key){
+	uint32_t bit = 1u << w->depth;
+	if (w->started & bit) jsonPutc (w, ',');
+	w->started |= bit;
+	if (key){
+		jsonQuoted (w, key);
+		jsonPutc (w, ':');
+	}
+}
+
+static void jsonOpen (jsonWriter_t *w, const char *key, char c){
+	jsonValue (w, key);
+	jsonPutc (w, c);
+	if (w->depth >= JSONMAXDEPTH - 1){
+		w->error = 1;
+		return;
+	}
+	w->depth++;
+	w->started &= ~(1u << w->depth);
+}
+
+static void jsonClose (jsonWriter_t *w, char c){
+	if (w->depth <= 0){
+		w->error = 1;
+		return;
+	}
+	w->depth--;
+	jsonPutc (w, c);
+}
+
+void jsonObjectStart (jsonWriter_t *w, const char *key){
+	jsonOpen (w, key, '{');
+}
+
+void jsonObjectEnd (jsonWriter_t *w){
+	jsonClose (w, '}');
+}
+
+void jsonArrayStart (jsonWriter_t *w, const char *key){
+	jsonOpen (w, key, '[');
+}
+
+void jsonArrayEnd (jsonWriter_t *w){
+	jsonClose (w, ']');
+}
+
+void jsonString (jsonWriter_t *w, const char *key, const char *value){
+	jsonValue (w, key);
+	if (value) jsonQuoted (w, value);
+	else jsonPut (w, "null", 4);
+}
+
+// integers are written without a fraction and nan or inf as null, as cJSON does
+
+void jsonNumber (jsonWriter_t *w, const char *key, double value){
+	char s[32];
+	int n;
+	jsonValue (w, key);
+	if ((value - value) != 0) n = snprintf (s, sizeof(s), "null");		// nan or inf
+	else if ((value >= -1e15) && (value <= 1e15) && (value == (double)(long long)value))
+		n = snprintf (s, sizeof(s), "%lld", (long long)value);
+	else {
+		n = snprintf (s, sizeof(s), "%1.15g", value);
+		if (strtod (s, NULL) != value) n = snprintf (s, sizeof(s), "%1.17g", value);
+	}
+	jsonPut (w, s, n);
+}
+
+void jsonBool (jsonWriter_t *w, const char *key, int value){
+	jsonValue (w, key);
+	if (value) jsonPut (w, "true", 4);
+	else jsonPut (w, "false", 5);
+}
+
+void jsonNull (jsonWriter_t *w, const char *key){
+	jsonValue (w, key);
+	jsonPut (w, "null", 4);
+}
+
+int jsonEnd (jsonWriter_t *w){
+	jsonFlush (w);
+	if (w->depth) w->error = 1;
+	return w->error;
+}
@@ -0,0 +1,49 @@
+/********************************************************
+	jsonWriter.h
+
+	Streaming JSON writer through a fixed buffer - see jsonWriter.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define JSONMAXDEPTH 16
+
+// called with each full buffer, returns 0 on success
+typedef int (*jsonFlush_t) (void *arg, const char *buf, int len);
+
+typedef struct {
+	char *buf;
+	int size;
+	int len;
+	jsonFlush_t flush;
+	void *arg;
+	int depth;
+	uint32_t started;			// bit per depth - a value has been written
+	int error;
+	int total;					// bytes written
+	int flushes;
+} jsonWriter_t;
+
+void jsonInit (jsonWriter_t *w, char *buf, int size, jsonFlush_t flush, void *arg);
+int jsonEnd (jsonWriter_t *w);
+
+// key is NULL inside arrays and at the top level
+
+void jsonObjectStart (jsonWriter_t *w, const char *key);
+void jsonObjectEnd (jsonWriter_t *w);
+void jsonArrayStart (jsonWriter_t *w, const char *key);
+void jsonArrayEnd (jsonWriter_t *w);
+void jsonString (jsonWriter_t *w, const char *key, const char *value);
+void jsonNumber (jsonWriter_t *w, const char *key, double value);
+void jsonBool (jsonWriter_t *w, const char *key, int value);
+void jsonNull (jsonWriter_t *w, const char *key);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,189 @@
+/********************************************************
+	kvFlash.c
+
+	The flash under kvStore. It behaves like NOR flash: a sector
+	erases to 0xFF and a write can only clear bits, so kvStore only
+	ever writes to erased space.
+
+	kvFlashPartition (label) uses a raw data partition on the board.
+
+	kvFlashFile (path,sectorSize,sectors) emulates the same thing in
+	a file. It is how kvStore is tested on Linux and, on spiffs, what
+	the board uses while partitions.csv has no settings partition.
+
+	Erases are counted per sector so the wear a change causes can be
+	measured.
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kvFlash.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_partition.h"
+#endif
+
+int kvFlashRead (kvFlash_t *f, int offset, void *buf, int len){
+	if ((offset < 0)||(offset + len > f->sectorSize * f->sectors)) return -1;
+	return f->read (f, offset, buf, len);
+}
+
+int kvFlashWrite (kvFlash_t *f, int offset, const void *buf, int len){
+	if ((offset < 0)||(offset + len > f->sectorSize * f->sectors)) return -1;
+	f->writes++;
+	f->bytesWritten += len;
+	return f->write (f, offset, buf, len);
+}
+
+int kvFlashErase (kvFlash_t *f, int sector){
+	if ((sector < 0)||(sector >= f->sectors)) return -1;
+	f->erases++;
+	f->eraseCount[sector]++;
+	return f->erase (f, sector);
+}
+
+int kvFlashMaxErases (kvFlash_t *f){
+	int max = 0;
+	for (int n = 0;n < f->sectors;n++){
+		if (f->eraseCount[n] > max) max = f->eraseCount[n];
+	}
+	return max;
+}
+
+void kvFlashClose (kvFlash_t *f){
+	if (!f) return;
+	if (f->close) f->close (f);
+	free (f->eraseCount);
+	free (f);
+}
+
+kvFlash_t *kvFlashNew (int sectorSize, int sectors){
+	kvFlash_t *f = malloc (sizeof(kvFlash_t));
+	if (!f) return NULL;
+	memset (f, 0, sizeof(kvFlash_t));
+	f->sectorSize = sectorSize;
+	f->sectors = sectors;
+	f->eraseCount = calloc (sectors, sizeof(int));
+	if (!f->eraseCount){
+		free (f);
+		return NULL;
+	}
+	return f;
+}
+
+/************************* File emulation *************************/
+
+int fileRead (kvFlash_t *f, int offset, void *buf, int len){
+	FILE *fp = f->arg;
+	if (fseek (fp, offset, SEEK_SET)) return -1;
+	if ((int)fread (buf, 1, len, fp) != len) return -1;
+	return 0;
+}
+
+// ANDs with what is there as NOR flash would
+
+int fileWrite (kvFlash_t *f, int offset, const void *buf, int len){
+	FILE *fp = f->arg;
+	uint8_t old[256];
+	const uint8_t *src = buf;
+	while (len > 0){
+		int n = (len > (int)sizeof(old)) ? (int)sizeof(old) : len;
+		if (fseek (fp, offset, SEEK_SET)) return -1;
+		if ((int)fread (old, 1, n, fp) != n) return -1;
+		for (int i = 0;i < n;i++) old[i] &= src[i];
+		if (fseek (fp, offset, SEEK_SET)) return -1;
+		if ((int)fwrite (old, 1, n, fp) != n) return -1;
+		offset += n;
+		src += n;
+		len -= n;
+	}
+	return fflush (fp) ? -1 : 0;
+}
+
+int fileErase (kvFlash_t *f, int sector){
+	FILE *fp = f->arg;
+	uint8_t ff[256];
+	memset (ff, 0xFF, sizeof(ff));
+	if (fseek (fp, sector * f->sectorSize, SEEK_SET)) return -1;
+	for (int n = 0;n < f->sectorSize;n += sizeof(ff)){
+		if (fwrite (ff, 1, sizeof(ff), fp) != sizeof(ff)) return -1;
+	}
+	return fflush (fp) ? -1 : 0;
+}
+
+void fileClose (kvFlash_t *f){
+	fclose (f->arg);
+}
+
+kvFlash_t *kvFlashFile (char *path, int sectorSize, int sectors){
+
+	if ((sectorSize <= 0)||(sectorSize % 256)||(sectors <= 0)) return NULL;
+	kvFlash_t *f = kvFlashNew (sectorSize, sectors);
+	if (!f) return NULL;
+	f->read = fileRead;
+	f->write = fileWrite;
+	f->erase = fileErase;
+	f->close = fileClose;
+
+	long size = (long)sectorSize * sectors;
+	FILE *fp = fopen (path, "r+b");
+	if (fp){
+		fseek (fp, 0, SEEK_END);
+		if (ftell (fp) != size){
+			fclose (fp);
+			fp = NULL;
+		}
+	}
+	if (!fp){										// new, or not the size asked for
+		fp = fopen (path, "w+b");
+		if (!fp){
+			kvFlashClose (f);
+			return NULL;
+		}
+		f->arg = fp;
+		for (int n = 0;n < sectors;n++){
+			if (fileErase (f, n)){
+				kvFlashClose (f);
+				return NULL;
+			}
+		}
+	}
+	f->arg = fp;
+	return f;
+}
+
+/************************* Partition *************************/
+
+#ifdef ESP_PLATFORM
+
+int partitionRead (kvFlash_t *f, int offset, void *buf, int len){
+	return (esp_partition_read (f->arg, offset, buf, len) == ESP_OK) ? 0 : -1;
+}
+
+int partitionWrite (kvFlash_t *f, int offset, const void *buf, int len){
+	return (esp_partition_write (f->arg, offset, buf, len) == ESP_OK) ? 0 : -1;
+}
+
+int partitionErase (kvFlash_t *f, int sector){
+	return (esp_partition_erase_range (f->arg, sector * f->sectorSize, f->sectorSize) == ESP_OK) ? 0 : -1;
+}
+
+kvFlash_t *kvFlashPartition (char *label){
+
+	const esp_partition_t *p = esp_partition_find_first (ESP_PARTITION_TYPE_DATA,
+		ESP_PARTITION_SUBTYPE_ANY, label);
+	if (!p) return NULL;
+	int sectorSize = p->erase_size;
+	kvFlash_t *f = kvFlashNew (sectorSize, p->size / sectorSize);
+	if (!f) return NULL;
+	f->read = partitionRead;
+	f->write = partitionWrite;
+	f->erase = partitionErase;
+	f->arg = (void *)p;
+	return f;
+}
+
+#endif
@@ -0,0 +1,44 @@
+/********************************************************
+	kvFlash.h
+
+	Sector erased flash for kvStore - see kvFlash.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+typedef struct kvFlash_s kvFlash_t;
+
+struct kvFlash_s {
+	int sectorSize;
+	int sectors;
+	int (*read) (kvFlash_t *f, int offset, void *buf, int len);
+	int (*write) (kvFlash_t *f, int offset, const void *buf, int len);
+	int (*erase) (kvFlash_t *f, int sector);
+	void (*close) (kvFlash_t *f);
+	void *arg;
+	int *eraseCount;					// per sector
+	int erases;
+	int writes;
+	int bytesWritten;
+};
+
+int kvFlashRead (kvFlash_t *f, int offset, void *buf, int len);
+int kvFlashWrite (kvFlash_t *f, int offset, const void *buf, int len);
+int kvFlashErase (kvFlash_t *f, int sector);
+int kvFlashMaxErases (kvFlash_t *f);
+void kvFlashClose (kvFlash_t *f);
+
+kvFlash_t *kvFlashFile (char *path, int sectorSize, int sectors);
+#ifdef ESP_PLATFORM
+kvFlash_t *kvFlashPartition (char *label);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,495 @@
+/********************************************************
+	kvStore.c
+
+	Small key value store for settings and favourites. Values are
+	strings, the whole store is held in RAM and changes are written
+	to flash later rather than as they happen, so turning the volume
+	knob costs one small write once it stops moving.
+
+	kvSet () only changes RAM and marks the key dirty. kvPoll (ms) is
+	called often with the time in ms and writes the dirty keys once
+	nothing has changed for KVQUIETMS, or KVMAXDELAYMS after the
+	first change, or when KVDIRTYBYTES are waiting. kvFlush () writes
+	them now. A write that fails is tried again after KVQUIETMS,
+	doubling each time up to KVRETRYMAXMS, so a flash that has gone
+	bad is not erased over and over.
+
+	On flash the store is an append only journal. The flash is split
+	into two banks, one in use. A bank starts with a header
+
+		magic, sequence
+
+	followed by records, each 4 byte aligned
+
+		uint16 keyLen, uint16 valueLen, uint32 crc32, key, value
+
+	valueLen KVDELETED removes the key. Erased flash (0xFF) ends the
+	journal. Writing a key appends a record, nothing is erased.
+
+	When the bank is full kvCompact () erases the other bank, writes
+	one record per live key to it and then its header with the next
+	sequence number. Only then is the new bank used, so losing power
+	part way leaves the old one intact. kvOpen () replays the valid
+	bank with the highest sequence. A damaged record (power lost
+	mid write) ends the replay and the store is compacted straight
+	away so new records are not written after it.
+
+	Every live key must fit in one bank, so kvSet () refuses a value
+	that would take the records of all the keys past the bank size.
+
+	Calls are locked so the store can be shared between tasks.
+	kvGet returns a copy which the caller frees.
+
+	Only libc and pthreads are used so this can be built and tested
+	on Linux with kvFlashFile
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "kvStore.h"
+
+#define KVMAGIC 0x4B564C31				// "KVL1"
+#define KVHEADER 8
+#define KVRECORD 8						// record header
+#define KVKEYMAX 64
+#define KVDELETED 0xFFFF
+#define KVQUIETMS 1000
+#define KVMAXDELAYMS 5000
+#define KVDIRTYBYTES 2048
+#define KVRETRYMAXMS 300000
+
+typedef struct {
+	char *key;
+	char *value;						// NULL once deleted until that is written
+	int dirty;
+} kvEntry_t;
+
+struct kvStore_s {
+	kvFlash_t *flash;
+	pthread_mutex_t mutex;
+	kvEntry_t *entries;
+	int count;
+	int size;
+	int bank;
+	uint32_t sequence;
+	int pos;							// next free byte in the bank
+	int bankSize;
+	int needCompact;					// a write failed part way
+	int changes;						// bumped by every set
+	int polledChanges;					// changes at the last kvPoll
+	int waiting;						// for a deferred flush
+	uint32_t firstDirty;				// ms
+	uint32_t lastChange;
+	int dirtyBytes;
+	uint32_t retryMs;					// wait after a failed write, 0 if none failed
+	uint32_t failedAt;
+	kvStats_t stats;
+};
+
+uint32_t kvCrc (uint32_t crc, const void *data, int len){
+	const uint8_t *p = data;
+	crc = ~crc;
+	while (len--){
+		crc ^= *p++;
+		for (int k = 0;k < 8;k++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static int recordSize (int keyLen, int valueLen){
+	return (KVRECORD + keyLen + valueLen + 3) & ~3;
+}
+
+static int entrySize (kvEntry_t *e){
+	return recordSize (strlen (e->key), e->value ? strlen (e->value) : 0);
+}
+
+static int bankOffset (kvStore_t *kv, int bank){
+	return bank * kv->bankSize;
+}
+
+static kvEntry_t *findEntry (kvStore_t *kv, const char *key){
+	for (int n = 0;n < kv->count;n++){
+		if (!strcmp (kv->entries[n].key, key)) return &kv->entries[n];
+	}
+	return NULL;
+}
+
+// changes the RAM copy, value NULL deletes
+
+static int setEntry (kvStore_t *kv, const char *key, const char *value, int dirty){
+
+	kvEntry_t *e = findEntry (kv, key);
+	if (!e){
+		if (!value) return 0;
+		if (kv->count == kv->size){
+			int size = kv->size ? kv->size * 2 : 16;
+			kvEntry_t *entries = realloc (kv->entries, size * sizeof(kvEntry_t));
+			if (!entries) return -1;
+			kv->entries = entries;
+			kv->size = size;
+		}
+		char *k = strdup (key);
+		if (!k) return -1;
+		e = &kv->entries[kv->count++];
+		e->key = k;
+		e->value = NULL;
+		e->dirty = 0;
+	}
+	else if (value && e->value && !strcmp (e->value, value)) return 0;	// no change
+	else if (!value && !e->value) return 0;
+
+	char *v = NULL;
+	if (value){
+		v = strdup (value);
+		if (!v) return -1;
+	}
+	free (e->value);
+	e->value = v;
+	if (dirty){
+		if (!e->dirty) kv->stats.dirty++;
+		e->dirty = 1;
+		kv->dirtyBytes += entrySize (e);
+		kv->changes++;
+	}
+	else if (!v){								// replayed delete
+		free (e->key);
+		*e = kv->entries[--kv->count];
+	}
+	return 0;
+}
+
+// bytes a compaction would write, key less the record for key
+
+static int liveBytes (kvStore_t *kv, const char *key){
+	int bytes = KVHEADER;
+	for (int n = 0;n < kv->count;n++){
+		kvEntry_t *e = &kv->entries[n];
+		if (e->value && strcmp (e->key, key)) bytes += entrySize (e);
+	}
+	return bytes;
+}
+
+// deletes that have been written are dropped from RAM
+
+static void removeDeleted (kvStore_t *kv){
+	int n = 0;
+	while (n < kv->count){
+		kvEntry_t *e = &kv->entries[n];
+		if (!e->value && !e->dirty){
+			free (e->key);
+			*e = kv->entries[--kv->count];
+		}
+		else n++;
+	}
+}
+
+static int writeRecord (kvStore_t *kv, int bank, int pos, kvEntry_t *e){
+
+	int keyLen = strlen (e->key);
+	int valueLen = e->value ? strlen (e->value) : 0;
+	int size = recordSize (keyLen, valueLen);
+	if (pos + size > kv->bankSize) return -1;
+
+	uint8_t *r = malloc (size);
+	if (!r) return -1;
+	memset (r, 0, size);
+	uint16_t lens[2] = {keyLen, e->value ? valueLen : KVDELETED};
+	memcpy (r, lens, 4);
+	memcpy (r + KVRECORD, e->key, keyLen);
+	if (valueLen) memcpy (r + KVRECORD + keyLen, e->value, valueLen);
+	uint32_t crc = kvCrc (0, r, 4);
+	crc = kvCrc (crc, r + KVRECORD, keyLen + valueLen);
+	memcpy (r + 4, &crc, 4);
+
+	int err = kvFlashWrite (kv->flash, bankOffset (kv, bank) + pos, r, size);
+	free (r);
+	if (err) return -1;
+	kv->stats.records++;
+	return size;
+}
+
+static int eraseBank (kvStore_t *kv, int bank){
+	int sectors = kv->bankSize / kv->flash->sectorSize;
+	for (int n = 0;n < sectors;n++){
+		if (kvFlashErase (kv->flash, bank * sectors + n)) return -1;
+	}
+	return 0;
+}
+
+static int writeHeader (kvStore_t *kv, int bank, uint32_t sequence){
+	uint32_t h[2] = {KVMAGIC, sequence};
+	return kvFlashWrite (kv->flash, bankOffset (kv, bank), h, KVHEADER);
+}
+
+static int compact (kvStore_t *kv){
+
+	int bank = !kv->bank;
+	if (eraseBank (kv, bank)) goto fail;
+
+	int pos = KVHEADER;
+	for (int n = 0;n < kv->count;n++){
+		kvEntry_t *e = &kv->entries[n];
+		if (!e->value) continue;
+		int size = writeRecord (kv, bank, pos, e);
+		if (size < 0) goto fail;
+		pos += size;
+	}
+	if (writeHeader (kv, bank, kv->sequence + 1)) goto fail;
+
+	kv->bank = bank;
+	kv->sequence++;
+	kv->pos = pos;
+	kv->needCompact = 0;
+	for (int n = 0;n < kv->count;n++) kv->entries[n].dirty = 0;
+	removeDeleted (kv);
+	kv->stats.dirty = 0;
+	kv->dirtyBytes = 0;
+	kv->stats.compactions++;
+	return 0;
+
+fail:
+	printf ("kvStore compaction failed\n");
+	kv->stats.failures++;
+	return -1;
+}
+
+static int flush (kvStore_t *kv){
+
+	if (!kv->stats.dirty) return 0;
+	if (kv->needCompact) return compact (kv);
+
+	for (int n = 0;n < kv->count;n++){
+		kvEntry_t *e = &kv->entries[n];
+		if (!e->dirty) continue;
+		if (kv->pos + entrySize (e) > kv->bankSize) return compact (kv);
+		int size = writeRecord (kv, kv->bank, kv->pos, e);
+		if (size < 0){
+			printf ("kvStore write failed\n");
+			kv->stats.failures++;
+			kv->needCompact = 1;			// do not append after a half written record
+			return -1;
+		}
+		kv->pos += size;
+		e->dirty = 0;
+		kv->stats.dirty--;
+	}
+	removeDeleted (kv);
+	kv->dirtyBytes = 0;
+	kv->stats.flushes++;
+	return 0;
+}
+
+// returns 0 if the bank replayed to the end, -1 if a record was damaged
+
+static int replay (kvStore_t *kv){
+
+	int base = bankOffset (kv, kv->bank);
+	int pos = KVHEADER;
+	uint8_t *buf = malloc (KVKEYMAX + 2);
+	int bufSize = buf ? KVKEYMAX + 2 : 0;
+	int err = -1;
+
+	while (1){
+		if (pos + KVRECORD > kv->bankSize){
+			err = 0;
+			break;
+		}
+		uint8_t h[KVRECORD];
+		if (kvFlashRead (kv->flash, base + pos, h, KVRECORD)) break;
+		uint16_t lens[2];
+		uint32_t crc;
+		memcpy (lens, h, 4);
+		memcpy (&crc, h + 4, 4);
+		if ((lens[0] == 0xFFFF)&&(lens[1] == 0xFFFF)&&(crc == 0xFFFFFFFF)){
+			err = 0;
+			break;
+		}
+		int keyLen = lens[0];
+		int valueLen = (lens[1] == KVDELETED) ? 0 : lens[1];
+		int size = recordSize (keyLen, valueLen);
+		if ((keyLen == 0)||(keyLen > KVKEYMAX)||(pos + size > kv->bankSize)) break;
+
+		if (keyLen + valueLen + 2 > bufSize){
+			uint8_t *b = realloc (buf, keyLen + valueLen + 2);
+			if (!b) break;
+			buf = b;
+			bufSize = keyLen + valueLen + 2;
+		}
+		if (kvFlashRead (kv->flash, base + pos + KVRECORD, buf, keyLen + valueLen)) break;
+		if (kvCrc (kvCrc (0, h, 4), buf, keyLen + valueLen) != crc) break;
+
+// key and value are stored without terminators, split them with two
+
+		memmove (buf + keyLen + 1, buf + keyLen, valueLen);
+		buf[keyLen] = 0;
+		buf[keyLen + 1 + valueLen] = 0;
+		setEntry (kv, (char *)buf, (lens[1] == KVDELETED) ? NULL : (char *)buf + keyLen + 1, 0);
+		pos += size;
+	}
+	free (buf);
+	kv->pos = pos;
+	return err;
+}
+
+kvStore_t *kvOpen (kvFlash_t *flash){
+
+	if (!flash || (flash->sectors < 2)) return NULL;
+	kvStore_t *kv = malloc (sizeof(kvStore_t));
+	if (!kv) return NULL;
+	memset (kv, 0, sizeof(kvStore_t));
+	kv->flash = flash;
+	kv->bankSize = (flash->sectors / 2) * flash->sectorSize;
+	pthread_mutex_init (&kv->mutex, NULL);
+
+// pick the bank with the newest header
+
+	int found = 0;
+	for (int bank = 0;bank < 2;bank++){
+		uint32_t h[2];
+		if (kvFlashRead (flash, bank * kv->bankSize, h, KVHEADER)) continue;
+		if (h[0] != KVMAGIC) continue;
+		if (!found || (h[1] > kv->sequence)){
+			kv->bank = bank;
+			kv->sequence = h[1];
+			found = 1;
+		}
+	}
+
+	if (!found){
+		kv->bank = 0;
+		kv->sequence = 1;
+		kv->pos = KVHEADER;
+		if (eraseBank (kv, 0) || writeHeader (kv, 0, kv->sequence)){
+			printf ("kvStore cannot format flash\n");
+			kv->stats.failures++;
+		}
+	}
+	else if (replay (kv)){
+		printf ("kvStore damaged record at %d, compacting\n", kv->pos);
+		kv->stats.recovered++;
+		compact (kv);
+	}
+	return kv;
+}
+
+void kvClose (kvStore_t *kv){
+	if (!kv) return;
+	kvFlush (kv);
+	for (int n = 0;n < kv->count;n++){
+		free (kv->entries[n].key);
+		free (kv->entries[n].value);
+	}
+	free (kv->entries);
+	pthread_mutex_destroy (&kv->mutex);
+	free (kv);
+}
+
+char *kvGet (kvStore_t *kv, const char *key){
+	char *r = NULL;
+	pthread_mutex_lock (&kv->mutex);
+	kvEntry_t *e = findEntry (kv, key);
+	if (e && e->value) r = strdup (e->value);
+	pthread_mutex_unlock (&kv->mutex);
+	return r;
+}
+
+int kvGetInt (kvStore_t *kv, const char *key, int def){
+	char *s = kvGet (kv, key);
+	if (!s) return def;
+	sscanf (s, "%d", &def);
+	free (s);
+	return def;
+}
+
+int kvSet (kvStore_t *kv, const char *key, const char *value){
+	int keyLen = strlen (key);
+	if ((keyLen == 0)||(keyLen > KVKEYMAX)) return -1;
+	if (value && (recordSize (keyLen, strlen (value)) > kv->bankSize - KVHEADER)) return -1;
+	if (value && (strlen (value) >= KVDELETED)) return -1;
+	pthread_mutex_lock (&kv->mutex);
+	int r = -1;
+	if (value && (liveBytes (kv, key) + recordSize (keyLen, strlen (value)) > kv->bankSize)) kv->stats.refused++;
+	else r = setEntry (kv, key, value, 1);
+	if (!r) kv->stats.sets++;
+	pthread_mutex_unlock (&kv->mutex);
+	return r;
+}
+
+int kvSetInt (kvStore_t *kv, const char *key, int value){
+	char s[16];
+	snprintf (s, sizeof(s), "%d", value);
+	return kvSet (kv, key, s);
+}
+
+int kvDelete (kvStore_t *kv, const char *key){
+	return kvSet (kv, key, NULL);
+}
+
+int kvFlush (kvStore_t *kv){
+	pthread_mutex_lock (&kv->mutex);
+	int r = flush (kv);
+	if (!r) kv->retryMs = 0;
+	pthread_mutex_unlock (&kv->mutex);
+	return r;
+}
+
+// returns 1 if it wrote anything
+
+int kvPoll (kvStore_t *kv, uint32_t ms){
+
+	int r = 0;
+	pthread_mutex_lock (&kv->mutex);
+	if (kv->changes != kv->polledChanges){
+		if (!kv->waiting){
+			kv->firstDirty = ms;
+			kv->waiting = 1;
+		}
+		kv->lastChange = ms;
+		kv->polledChanges = kv->changes;
+	}
+	int backingOff = kv->retryMs && ((ms - kv->failedAt) < kv->retryMs);
+	if (kv->waiting && !backingOff && (((ms - kv->lastChange) >= KVQUIETMS)||
+		((ms - kv->firstDirty) >= KVMAXDELAYMS)||
+		(kv->dirtyBytes >= KVDIRTYBYTES))){
+		flush (kv);
+		kv->waiting = 0;
+		if (kv->stats.dirty){					// failed, try again later
+			kv->waiting = 1;
+			kv->firstDirty = ms;
+			kv->lastChange = ms;
+			kv->failedAt = ms;
+			kv->retryMs = kv->retryMs ? kv->retryMs * 2 : KVQUIETMS;
+			if (kv->retryMs > KVRETRYMAXMS) kv->retryMs = KVRETRYMAXMS;
+		}
+		else kv->retryMs = 0;
+		r = 1;
+	}
+	pthread_mutex_unlock (&kv->mutex);
+	return r;
+}
+
+int kvCompact (kvStore_t *kv){
+	pthread_mutex_lock (&kv->mutex);
+	int r = compact (kv);
+	pthread_mutex_unlock (&kv->mutex);
+	return r;
+}
+
+void kvGetStats (kvStore_t *kv, kvStats_t *st){
+	pthread_mutex_lock (&kv->mutex);
+	*st = kv->stats;
+	st->keys = 0;
+	for (int n = 0;n < kv->count;n++){
+		if (kv->entries[n].value) st->keys++;
+	}
+	st->bank = kv->bank;
+	st->sequence = kv->sequence;
+	st->used = kv->pos;
+	st->bankSize = kv->bankSize;
+	pthread_mutex_unlock (&kv->mutex);
+}
@@ -0,0 +1,48 @@
+/********************************************************
+	kvStore.h
+
+	Journaled key value settings store - see kvStore.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+#include "kvFlash.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+typedef struct kvStore_s kvStore_t;
+
+typedef struct {
+	int keys;
+	int dirty;							// keys waiting to be written
+	int bank;
+	uint32_t sequence;					// bumped by every compaction
+	int used;							// bytes of the bank in use
+	int bankSize;
+	int sets;
+	int refused;						// sets that would not fit in a bank
+	int flushes;
+	int records;
+	int compactions;
+	int recovered;						// opens that found a damaged record
+	int failures;
+} kvStats_t;
+
+kvStore_t *kvOpen (kvFlash_t *flash);
+void kvClose (kvStore_t *kv);
+char *kvGet (kvStore_t *kv, const char *key);
+int kvGetInt (kvStore_t *kv, const char *key, int def);
+int kvSet (kvStore_t *kv, const char *key, const char *value);
+int kvSetInt (kvStore_t *kv, const char *key, int value);
+int kvDelete (kvStore_t *kv, const char *key);
+int kvFlush (kvStore_t *kv);
+int kvPoll (kvStore_t *kv, uint32_t ms);
+int kvCompact (kvStore_t *kv);
+void kvGetStats (kvStore_t *kv, kvStats_t *st);
+
+#ifdef __cplusplus
+}
+#endif
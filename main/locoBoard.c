@@ -4,7 +4,10 @@
 	This module contains code that relates to the board hardware
 	There are four main parts
 	
-	Buttons - this scans the buttons and rotary encoder and communicates with the ui using addEvent
+	Buttons - edge interrupts on the buttons and rotary encoder are decoded
+	by inputDecode.c and put in a ring in the order they happened, ui.c
+	takes them with takeInputEvent. The Input task only runs for edges and deadlines (long
+	press, end of bounce) and sends UITIMER every second
 	
 	DAC - Audio related functions
 	
@@ -22,10 +25,21 @@
 	TFT
 		lcdInit - this initialises the display and lvgl
 		set_backlight_brightness
+		printFlushStats - render and transfer times of the last frame
+		printLVGLStats - how often the LVGL task woke since last asked
+
+		The LVGL task only wakes when its next timer is due or another
+		task has unlocked LVGL after changing the UI, see lv_task_thread
+
+		LVGL renders bands of FLUSHLINES lines, one SPI transfer each,
+		into FLUSHBUFFERS DMA buffers. my_flush_cb hands a band to the
+		flush task and returns so LVGL draws the next band while the
+		DMA sends this one, see flushPipe.c
 		
 		NB lvgl changes a lot so a specific version has been included as 
 		a component in this project. There are some minor edits to
-		components/lvgl/src/lv_conf_internal.h (LV_COLOR_16_SWAP and fonts)
+		components/lvgl/src/lv_conf_internal.h (LV_COLOR_16_SWAP, fonts and
+		LV_TICK_CUSTOM_SYS_TIME_EXPR reading esp_timer)
 		components/lvgl/src/misc/lv_mem.c to allocate memory from SPIRAM
 
 	
@@ -38,10 +52,21 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include <pthread.h>
 
 #include <loco.h>
 #include "locoBoard.h"
+#include "pcmRing.h"
+#include "jitterBuffer.h"
+#include "timeShift.h"
+#include "resampler.h"
+#include "flushPipe.h"
+#include "inputDecode.h"
+#include "memTag.h"
+#include "tracer.h"
+#include "declick.h"
+#include <stdatomic.h>
 
 #include "driver/i2c.h"
 #include "driver/i2s_std.h"
@@ -73,15 +98,12 @@ uint64_t millis (){
 *****************************************************************/ 
 
 
-pthread_mutex_t rotaryMutex;
-
 #define COMISOROTARY 1
 
 int apTimer = 0;
 void setApTimer(int timeout) { apTimer = timeout; }
 int connectTimer = 0;
 void setConnectTimer(int timeout) { connectTimer = timeout; }
-void buttonThread(void *param);
 
 int raw;
 int voltage;
@@ -92,182 +114,162 @@ int flashTimer;
 
 int sleepTimer;
 
-volatile int rotate;
-
-void lockRotary() { pthread_mutex_lock(&rotaryMutex); }
-
-void unlockRotary() { pthread_mutex_unlock(&rotaryMutex); }
-
-const int rot_enc_table[] = {0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0};
-
-int prevNextCode = 0;
-int store = 0;
-
-// Robust Rotary encoder reading
-// Copyright John Main - best-microcontroller-projects.com
-
-static void helixTimer(void *arg) {
-
-  int v = 0;
-
-
-  if (gpio_get_level(13))
-    v += 1;
-  if (gpio_get_level(14))
-    v += 2;
+#define BUTTONS 5
+#define ROTARYA 13
+#define ROTARYB 14
+#define ROTARYINPUT BUTTONS				// isr arg for the encoder lines
+#define UITIMERUS 1000000
+#define INPUTSTACK 3072
 
-  prevNextCode <<= 2;
-  prevNextCode += v;
-  prevNextCode &= 0x0f;
+const int buttonPins[BUTTONS] = {45, 48, 47, 21, 46};	// EJECT BACK NEXT PLAY PUSH
+const int buttonShortEvents[BUTTONS] = {EJECTBUTTON, BACKBUTTON, NEXTBUTTON, PLAYSTOPBUTTON, KNOBPUSH};
+const int buttonLongEvents[BUTTONS] = {EJECTHELD, BACKBUTTONHELD, 0, 0, 0};
 
-  // If valid then store as 16 bit data.
-  if (rot_enc_table[prevNextCode]) {
-    store <<= 4;
-    store |= prevNextCode;
-#if COMISOROTARY    
-    if ((store & 0xff) == 0x17) {
-#else		
-    if ((store & 0xff) == 0x2b) {
-#endif
-      pthread_mutex_lock(&rotaryMutex);
-      rotate++;      
-      pthread_mutex_unlock(&rotaryMutex);
-//      printf("Rotate Up %d\n", rotate);
-      addEvent (ROTARYUP);
-    }
-#if COMISOROTARY    
-    if ((store & 0xff) == 0x2b) {
-#else		
-    if ((store & 0xff) == 0x17) {
-#endif    
-      pthread_mutex_lock(&rotaryMutex);
-      rotate--;     
-      pthread_mutex_unlock(&rotaryMutex);
-//      printf("Rotate Down %d\n", rotate);
-      addEvent (ROTARYDOWN);      
-    }
-  }
-   
-}
+quadrature_t rotary;
+debounce_t buttons[BUTTONS];
+portMUX_TYPE inputMux = portMUX_INITIALIZER_UNLOCKED;
+TaskHandle_t inputTask = NULL;
 
+// what the interrupts hand to the UI, written under inputMux
 
-#define BUTTONS 5
+inputRing_t inputEvents;
+atomic_int inputInterrupts;
 
 void keepAwake() {};
 
-
-int lastStates[BUTTONS] = {0, 0, 0, 0};
-unsigned long buttonPressedTimes[BUTTONS] = {0, 0, 0, 0};
-int longFlag[BUTTONS] = {0, 0, 0, 0};
-
 int backButtonPressed (){
 	return (gpio_get_level(48));
 }
 
-void doHelixButtons() {
-
-  int n;
-  int states[BUTTONS];
-
-   
-  states[0] = gpio_get_level(45);		// EJECT
-  states[1] = gpio_get_level(48);		// BACK
-  states[2] = gpio_get_level(47);		// NEXT
-  states[3] = gpio_get_level(21);		// PLAY
-  states[4] = gpio_get_level(46);		// PUSH
-
-  unsigned long time = millis();
-
-  for (n = 0; n < BUTTONS; n++) {
-    if (states[n] != lastStates[n]) {
-      lastStates[n] = states[n];
-      if (states[n]) { // pressed
-        buttonPressedTimes[n] = time;
-      } else { // release
-        longFlag[n] = 0;
-        keepAwake();
-        if ((time - buttonPressedTimes[n]) < 1500) {
-          printf("Short press %d\n", n);
-          if (n == 0) addEvent (EJECTBUTTON);
-          else if (n == 1) addEvent (BACKBUTTON);
-          else if (n == 2) addEvent (NEXTBUTTON);
-          else if (n == 3) addEvent (PLAYSTOPBUTTON);
-          else if (n == 4) {
-		  
-			  addEvent (KNOBPUSH);
-
-          }
-        } else if ((time - buttonPressedTimes[n]) < 5000) {
-          keepAwake();
-          printf("Long release %d\n", n);
-        } else {
-          keepAwake();
-          printf("Very long release %d\n", n);
-        }
-      }
-    } else if (states[n] && (time - buttonPressedTimes[n]) > 1500 &&
-               !longFlag[n]) {
-      printf("Long press %d detected\n", n);
-      longFlag[n] = 1;
-      if (n == 0) addEvent (EJECTHELD);
-      else if (n == 1) addEvent (BACKBUTTONHELD);      
-
-     }
-  }
+static int rotaryLevel (){
+	return gpio_get_level(ROTARYA) | (gpio_get_level(ROTARYB) << 1);
 }
 
+// call with inputMux held
 
+static void buttonEvents (int n, int ev, int64_t now){
+	if (ev & BUTTONSHORT) inputRingPut (&inputEvents, buttonShortEvents[n], now);
+	if ((ev & BUTTONLONG) && buttonLongEvents[n]) inputRingPut (&inputEvents, buttonLongEvents[n], now);
+}
 
-void initButtons() {
-
-
-  gpio_set_direction(45, GPIO_MODE_INPUT);			// EJECT
-  gpio_set_direction(48, GPIO_MODE_INPUT);			// BACK
-  gpio_set_direction(47, GPIO_MODE_INPUT);			// NEXT
-  gpio_set_direction(21, GPIO_MODE_INPUT);			// PLAY
-
-  gpio_set_direction(14, GPIO_MODE_INPUT);			// Q2
-  gpio_set_direction(13, GPIO_MODE_INPUT);			// Q1
-  gpio_set_direction(46, GPIO_MODE_INPUT);			// PUSH
+static void inputIsr (void *arg){
 
+	int n = (int)arg;
+	int wake;
+	int64_t now = esp_timer_get_time ();
+	atomic_fetch_add (&inputInterrupts, 1);
 
-#if 1
-	static StaticTask_t buttonTaskBuffer;
-	uint8_t *buttonStack = 	heap_caps_malloc (4096,MALLOC_CAP_SPIRAM);	
-  xTaskCreateStatic(buttonThread, "Button Code", 4096, NULL, 5, buttonStack, &buttonTaskBuffer);
-#else
-  xTaskCreate(buttonThread, "Button Code", 4096, NULL, 5, NULL);
+	taskENTER_CRITICAL_ISR (&inputMux);
+	if (n == ROTARYINPUT){
+		int d = quadratureFeed (&rotary, rotaryLevel ());
+#if !COMISOROTARY
+		d = -d;
 #endif
+		if (d) inputRingPut (&inputEvents, (d > 0) ? ROTARYUP : ROTARYDOWN, now);
+		wake = (d != 0);
+	}
+	else {
+		buttonEvents (n, buttonEdge (&buttons[n], gpio_get_level (buttonPins[n]), now), now);
+		wake = 1;										// the deadline may have moved
+	}
+	taskEXIT_CRITICAL_ISR (&inputMux);
 
-  const esp_timer_create_args_t periodic_timer_args = {
-      //            .callback = &periodic_timer_callback,
-      .callback = &helixTimer,
-      .name = "Rotary timer"};
+	if (wake && inputTask){
+		BaseType_t woken = pdFALSE;
+		vTaskNotifyGiveFromISR (inputTask, &woken);
+		portYIELD_FROM_ISR (woken);
+	}
+}
 
-  esp_timer_handle_t periodic_timer;
-  ESP_ERROR_CHECK(esp_timer_create(&periodic_timer_args, &periodic_timer));
+// the oldest input event waiting or 0, at is when it happened. The UI
+// is the only reader
 
-  ESP_ERROR_CHECK(esp_timer_start_periodic(periodic_timer, 1000));
- 
+int takeInputEvent (int64_t *at){
+	return inputRingGet (&inputEvents, at);
 }
 
+// wakes the main loop for new input, runs the button deadlines and
+// sends UITIMER, otherwise sleeps
+
+void inputThread (void *param) {
+
+	int64_t nextTimer = esp_timer_get_time () + UITIMERUS;
+
+	while (1) {
+		int64_t now = esp_timer_get_time ();
+		int64_t deadline = nextTimer;
+		taskENTER_CRITICAL (&inputMux);
+		for (int n = 0;n < BUTTONS;n++){
+			int64_t d = buttonDeadline (&buttons[n]);
+			if (d && (d < deadline)) deadline = d;
+		}
+		taskEXIT_CRITICAL (&inputMux);
+
+		TickType_t ticks = 0;
+		if (deadline > now) ticks = pdMS_TO_TICKS ((deadline - now + 999) / 1000) + 1;
+		ulTaskNotifyTake (pdTRUE, ticks);
+		traceInstant (TRACEINPUT);
+
+		now = esp_timer_get_time ();
+		taskENTER_CRITICAL (&inputMux);
+		for (int n = 0;n < BUTTONS;n++){
+			int64_t d = buttonDeadline (&buttons[n]);
+			if (d && (d <= now)) buttonEvents (n, buttonTick (&buttons[n], gpio_get_level (buttonPins[n]), now), now);
+		}
+		taskEXIT_CRITICAL (&inputMux);
+
+		if (now >= nextTimer){
+			nextTimer += UITIMERUS;
+			if (nextTimer <= now) nextTimer = now + UITIMERUS;
+			addEvent (UITIMER);
+		}
+		else wakeMainLoop ();
+	}
+}
 
-int clockTimer = 0;
+void printInputStats (){
+	taskENTER_CRITICAL (&inputMux);
+	quadrature_t q = rotary;
+	debounce_t b[BUTTONS];
+	memcpy (b, buttons, sizeof(b));
+	taskEXIT_CRITICAL (&inputMux);
+	printf ("input %d interrupts, rotary %d detents %d skipped steps, %lu events dropped\n",
+		atomic_load (&inputInterrupts), q.detents, q.invalid, inputEvents.dropped);
+	for (int n = 0;n < BUTTONS;n++){
+		printf ("button %d gpio %d: %d edges %d bounces %d glitches\n",
+			n, buttonPins[n], b[n].edges, b[n].bounces, b[n].glitches);
+	}
+}
 
-void buttonThread(void *param) {
-  while (1) {
-  
-    doHelixButtons();
-    
-    clockTimer++;
-    if (clockTimer >= 10){
-		clockTimer = 0;
-//		refreshUI ();
-		addEvent (UITIMER);
-	}		
-
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-  }
+void initButtons() {
+
+  taskENTER_CRITICAL (&inputMux);
+  inputRingInit (&inputEvents);
+  quadratureInit (&rotary, rotaryLevel ());
+  for (int n = 0; n < BUTTONS; n++)
+    buttonInit (&buttons[n], gpio_get_level (buttonPins[n]));
+  taskEXIT_CRITICAL (&inputMux);
+
+  xTaskCreate(inputThread, "Input", INPUTSTACK, NULL, 5, &inputTask);
+
+  uint64_t mask = (1ULL << ROTARYA) | (1ULL << ROTARYB);
+  for (int n = 0; n < BUTTONS; n++)
+    mask |= 1ULL << buttonPins[n];
+
+  gpio_config_t io_conf = {
+      .pin_bit_mask = mask,
+      .mode = GPIO_MODE_INPUT,
+      .intr_type = GPIO_INTR_ANYEDGE};
+  ESP_ERROR_CHECK(gpio_config(&io_conf));
+
+  esp_err_t err = gpio_install_isr_service(0);
+  if (err != ESP_ERR_INVALID_STATE)					// already installed is fine
+    ESP_ERROR_CHECK(err);
+
+  gpio_isr_handler_add(ROTARYA, inputIsr, (void *)ROTARYINPUT);
+  gpio_isr_handler_add(ROTARYB, inputIsr, (void *)ROTARYINPUT);
+  for (int n = 0; n < BUTTONS; n++)
+    gpio_isr_handler_add(buttonPins[n], inputIsr, (void *)n);
 }
 
 
@@ -862,6 +864,8 @@ void setupTXDivider(int rate) {
   int divider;
   if (rate == 44100)
 	divider = 2;
+  else if (rate == 11025)
+	divider = 8;
   else
 	divider = 4;
 
@@ -904,6 +908,17 @@ i2s_event_callbacks_t cbs = {
 	.on_send_q_ovf = i2s_tx_queue_overflow_callback,
 };
 
+// the MP3 and AAC decoders' state, these replace the weak versions in
+// components/libhelix/src/utils/helix_memory.cpp so it is counted
+
+void *helix_malloc(int size) {
+	return memTagMalloc(MEMDECODER, size, MALLOC_CAP_SPIRAM);
+}
+
+void helix_free(void *ptr) {
+	memTagFree(ptr);
+}
+
 
 void locoAudioInit(void) {
 
@@ -995,6 +1010,72 @@ int i2sRestart = 0;
 
 #define AUDIOBUFFERSIZE 4096
 int16_t audioBuffer[AUDIOBUFFERSIZE];
+
+// decoded samples pass through pcmRing from pcmThread to audioThread
+// the decoder writes straight into ring blocks and audioThread sends
+// them to i2s from the ring, the only copy is the driver's into DMA
+// sizes are in stereo frames, PCMRINGSIZE must be a power of two
+
+#define PCMRINGSIZE 4096			// 93ms in DMA capable RAM
+#define PCMLOWWATER 1024
+#define PCMHIGHWATER 3072
+#define PCMCHUNK 1024
+
+pcmRing_t *pcmRing = NULL;
+uint32_t *pcmRingBuffer;
+int i2sUnderruns = 0;
+
+// streams that are not 44.1k are either resampled on the way into
+// pcmRing or, in RATEMODE_DIVIDER, played by changing the TX divider
+// the divider can only reach rates in the 44.1k family
+
+#define DACRATE 44100
+
+resampler_t *resampler = NULL;
+uint32_t *rateBuffer;				// decoder output before resampling
+int rateBufferFrames = 0;
+int rateBufferUsed = 0;
+volatile int pendingRate = 0;
+int streamRate = DACRATE;
+int dividerRate = DACRATE;
+
+// radio goes through a jitter buffer in PSRAM ahead of pcmRing so a
+// Wi-Fi stall is covered by what is already decoded. libloco fetches
+// and decodes the stream itself so the buffer holds its PCM output,
+// radioThread keeps it filled and pcmThread plays from it. The target
+// depth adapts to the arrival jitter, see jitterBuffer.c
+
+#define RADIOBUFFERSIZE (1 << 20)	// bytes, 5.9s at 44.1k
+#define RADIOMAXMS 4000
+
+jitter_t *jitter = NULL;
+uint8_t *jitterBuffer;
+SemaphoreHandle_t decodeMutex = NULL;	// getAdfSamples from one thread at a time
+int wasRadio = 0;					// a station was playing at the last read
+
+// radio is also recorded on a tape, a ring in PSRAM that spills to a
+// file when an SD is mounted, and the jitter buffer is fed from the
+// tape. At live the tape is read as soon as it is written, paused
+// (time-shift on) the stream goes on recording and pcmThread stops
+// reading, so playing again carries on from the same frame. BACK
+// moves the tape back RADIOSKIPBACKMS. See timeShift.c
+// mountSd is disabled for now, so there is no spill and the tape only
+// goes back as far as the ring - RADIOSKIPBACKMS is kept within it and
+// a skip is clamped to it
+
+#define TIMESHIFTSIZE (3 << 20)		// bytes, 17.8s at 44.1k, 16.4s at 48k
+#define TIMESHIFTSPILL (128LL << 20)	// 12.7 minutes
+#define TIMESHIFTFILE "/sdcard/timeshift.pcm"
+
+tape_t *tape = NULL;
+uint8_t *tapeRing;
+SemaphoreHandle_t tapeMutex = NULL;
+FILE *spillFile = NULL;
+int spillTried = 0;					// once per SD
+int timeShiftOn = 1;
+volatile int radioPaused = 0;
+volatile int skipRequestMs = 0;
+int audioRateMode = RATEMODE_RESAMPLE;
 #define PI (3.14159265)
 
 // MJB 28/2/24 alternate 3f on right side an 1f on left if stereo test
@@ -1029,6 +1110,12 @@ void testWaveform() {
   }
 }
 
+// when the ring runs dry (between tracks or on an underrun) short silence
+// blocks are played so the next track starts as soon as it is decoded,
+// and the edges are ramped so the join does not click (see declick.c)
+
+declick_t declick;
+
 // void *audioThreadCode(void *param) {
 void audioThreadCode(void *param) {
 
@@ -1038,6 +1125,7 @@ void audioThreadCode(void *param) {
   long int stereoCount = 0;
 
   testWaveform();
+  declickInit(&declick);
 
   while (true) {
 
@@ -1046,7 +1134,20 @@ void audioThreadCode(void *param) {
 
     //	count = audioThreadEnable ? getAdfSamples ((unsigned char
     //*)s,AUDIOBUFFERSIZE*2) : 0;
-    count = getAdfSamples((unsigned char *)s, AUDIOBUFFERSIZE * 2);
+    uint32_t *block;
+    int frames = pcmRingReadBegin(pcmRing, &block, AUDIOBUFFERSIZE / 2);
+    count = frames * 4;
+    if (count) {
+      declickPlay(&declick, block, frames);
+      s = (int16_t *)block;
+    }
+
+    if (i2sUnderrun) {
+      i2sUnderrun = 0;
+      i2sUnderruns++;
+      traceInstant(TRACEUNDERRUN);
+    }
+    traceCounter(TRACEPCMFILL, pcmRingFill(pcmRing));
 
     //	printf ("audioThreadCode audioThreadEnable=%d\n",audioThreadEnable);
 
@@ -1059,10 +1160,11 @@ void audioThreadCode(void *param) {
           rightTestTone = !rightTestTone;
           testWaveform(); // rebuild the waveform
         }
+        count = AUDIOBUFFERSIZE * 2;
+        declick.silent = 1;
       } else
-        memset(audioBuffer, 0, AUDIOBUFFERSIZE * 2);
+        count = declickSilence(&declick, (uint32_t *)audioBuffer) * 4;
 
-      count = AUDIOBUFFERSIZE * 2;
       s = audioBuffer;
     }
 
@@ -1075,20 +1177,475 @@ void audioThreadCode(void *param) {
          portTICK_PERIOD_MS); if (r) printf ("i2s_channel_write () failed\n");
               }
       */
+      traceBegin(TRACEI2SWRITE);
       int r = i2s_channel_write(tx_handle, s, count, &len,
                                 500 / portTICK_PERIOD_MS);
+      traceEnd(TRACEI2SWRITE);
       if (r)
         printf("i2s_channel_write () failed err=%d count %d len %d\n",r,count, len);
 
       count -= len;
       s += len / 2;
     }
+
+    pcmRingReadEnd(pcmRing, frames);		// block can now be reused
+  }
+}
+
+// audio output API - the decoder is loaned a block of the ring to fill
+// in place, then queues the frames it wrote
+
+int audioLoanBlock(uint32_t **frames, int maxFrames) {
+  return pcmRingWriteBegin(pcmRing, frames, maxFrames);
+}
+
+void audioQueueBlock(int frames) {
+  pcmRingWriteEnd(pcmRing, frames);
+}
+
+// called when the stream sample rate is known, applied by pcmThread
+
+void setAudioSampleRate(int rate) {
+  pendingRate = rate;
+  if (jitter)
+    jitterSetRate(jitter, rate * 4);
+}
+
+void setAudioRateMode(int mode) {
+  audioRateMode = mode;
+  pendingRate = streamRate;
+}
+
+void applySampleRate(int rate) {
+
+  if (resampler) {
+    resamplerDelete(resampler);
+    resampler = NULL;
+  }
+  rateBufferFrames = 0;
+  rateBufferUsed = 0;
+
+  int clock = DACRATE;
+  if ((audioRateMode == RATEMODE_DIVIDER) && ((rate == 22050) || (rate == 11025)))
+    clock = rate;
+  else if (rate != DACRATE)
+    resampler = resamplerCreate(rate, DACRATE);
+
+// samples already in pcmRing will play at the new clock, this only
+// happens at a stream change
+
+  if (clock != dividerRate) {
+    setupTXDivider(clock);
+    dividerRate = clock;
+  }
+
+  streamRate = rate;
+  resetRadio();	// a new stream, drop what is left of the last
+  printf("audio rate %d clock %d %s\n", rate, clock, resampler ? "resampled" : "");
+}
+
+// resample rateBuffer into ring blocks, returns 0 when the ring is full
+
+int resampleToRing() {
+
+  while (rateBufferUsed < rateBufferFrames) {
+    uint32_t *block;
+    int frames = audioLoanBlock(&block, PCMCHUNK);
+    if (!frames)
+      return 0;
+    int used;
+    traceBegin(TRACERESAMPLE);
+    int n = resamplerProcess(resampler, rateBuffer + rateBufferUsed,
+                             rateBufferFrames - rateBufferUsed, &used, block, frames);
+    traceEnd(TRACERESAMPLE);
+    rateBufferUsed += used;
+    audioQueueBlock(n);
+    if (!n && !used)
+      break;
+  }
+  return 1;
+}
+
+// drops what is buffered of the last stream, pcmThread only. Without
+// a tape decodeMutex keeps the flush out of a write decodeRadio has
+// begun, or the old stream would be committed after it
+
+void resetRadio() {
+  if (!jitter)
+    return;
+  SemaphoreHandle_t m = tape ? tapeMutex : decodeMutex;
+  xSemaphoreTake(m, portMAX_DELAY);
+  jitterFlush(jitter);
+  if (tape)
+    tapeReset(tape);
+  radioPaused = 0;
+  xSemaphoreGive(m);
+}
+
+int streamBytesToMs(int64_t bytes) {
+  return (int)(bytes * 1000 / (streamRate * 4));
+}
+
+// moves back (or forward) from what is playing now, pcmThread only as
+// the jitter buffer is emptied
+
+void skipTape(int ms) {
+  jitterStats_t st;
+  xSemaphoreTake(tapeMutex, portMAX_DELAY);
+  jitterGetStats(jitter, &st);
+  jitterFlush(jitter);
+  int64_t behind = tapeSeek(tape, (int64_t)ms * streamRate * 4 / 1000 - st.fill);
+  xSemaphoreGive(tapeMutex);
+  printf("radio %d ms behind live\n", streamBytesToMs(behind));
+}
+
+// radio comes from the jitter buffer, 0 while it fills or is paused.
+// What is left from a station that has stopped is dropped, once as it
+// stops - a reset every pass would restart the jitter estimates and
+// the trace for as long as it stays stopped
+
+int readSamples(unsigned char *buf, int bytes) {
+
+  int radio = jitter && isRadioSource();
+  int playing = radio && isRadioPlaying();
+  if (wasRadio && !playing)
+    resetRadio();
+  wasRadio = playing;
+  if (radio) {
+    if (!playing)
+      return 0;
+    if (tape && skipRequestMs) {
+      skipTape(skipRequestMs);
+      skipRequestMs = 0;
+    }
+    if (radioPaused)
+      return 0;
+    return jitterRead(jitter, buf, bytes, esp_timer_get_time());
+  }
+
+  xSemaphoreTake(decodeMutex, portMAX_DELAY);
+  traceBegin(TRACEDECODE);
+  int count = getAdfSamples(buf, bytes);
+  traceEnd(TRACEDECODE);
+  xSemaphoreGive(decodeMutex);
+  return count;
+}
+
+int spillWrite(void *arg, int64_t offset, const uint8_t *buf, int len) {
+  if (fseek(spillFile, offset, SEEK_SET))
+    return 1;
+  return (int)fwrite(buf, 1, len, spillFile) != len;
+}
+
+int spillRead(void *arg, int64_t offset, uint8_t *buf, int len) {
+  if (fseek(spillFile, offset, SEEK_SET))
+    return 1;
+  return (int)fread(buf, 1, len, spillFile) != len;
+}
+
+// with the tape locked, opens the spill file once an SD is mounted
+
+void attachSpill() {
+  if (spillFile || spillTried || !isMounted())
+    return;
+  spillTried = 1;
+  spillFile = fopen(TIMESHIFTFILE, "w+b");
+  if (!spillFile) {
+    printf("no time-shift spill file %s\n", TIMESHIFTFILE);
+    return;
+  }
+  tapeSpill_t spill = {.write = spillWrite, .read = spillRead, .size = TIMESHIFTSPILL};
+  tapeAttachSpill(tape, &spill);
+}
+
+// before the SD is unmounted
+
+void timeShiftSdRemoved() {
+  if (!tape)
+    return;
+  xSemaphoreTake(tapeMutex, portMAX_DELAY);
+  tapeDetachSpill(tape);
+  if (spillFile)
+    fclose(spillFile);
+  spillFile = NULL;
+  spillTried = 0;
+  xSemaphoreGive(tapeMutex);
+}
+
+// decodes the next piece of radio onto the tape, or straight into the
+// jitter buffer without one, holding decodeMutex from the loan to the
+// write so resetRadio cannot flush in between. Returns the bytes decoded
+
+int decodeRadio() {
+
+  uint8_t *p;
+  int bytes;
+  if (tape) {
+    xSemaphoreTake(tapeMutex, portMAX_DELAY);
+    attachSpill();
+    bytes = tapeRecordBegin(tape, &p, PCMCHUNK * 4);	// may spill first
+    xSemaphoreGive(tapeMutex);
+    if (!bytes)
+      return 0;
+    xSemaphoreTake(decodeMutex, portMAX_DELAY);
+  } else {
+    xSemaphoreTake(decodeMutex, portMAX_DELAY);
+    bytes = jitterWriteBegin(jitter, &p, PCMCHUNK * 4) & ~3;
+    if (!bytes) {
+      xSemaphoreGive(decodeMutex);
+      return 0;
+    }
+  }
+
+  traceBegin(TRACEDECODE);
+  int count = getAdfSamples(p, bytes);
+  traceEnd(TRACEDECODE);
+
+  if (tape) {
+    xSemaphoreGive(decodeMutex);
+    xSemaphoreTake(tapeMutex, portMAX_DELAY);
+    tapeRecordEnd(tape, count);
+    xSemaphoreGive(tapeMutex);
+  } else {
+    if (count)
+      jitterWriteEnd(jitter, count, esp_timer_get_time());
+    xSemaphoreGive(decodeMutex);
   }
+  return count;
+}
+
+// moves what the tape has from the play position into the jitter
+// buffer, locked throughout so skipTape never sees half a write
+
+void playTape() {
+  while (true) {
+    uint8_t *p;
+    int bytes = jitterWriteBegin(jitter, &p, PCMCHUNK * 4) & ~3;
+    if (!bytes)
+      return;
+    xSemaphoreTake(tapeMutex, portMAX_DELAY);
+    int count = tapeRead(tape, p, bytes);
+    if (count)
+      jitterWriteEnd(jitter, count, esp_timer_get_time());
+    xSemaphoreGive(tapeMutex);
+    if (!count)
+      return;
+  }
+}
+
+// decodes radio as fast as it arrives, the tape never fills so this
+// goes on while paused
+
+void radioThreadCode(void *param) {
+
+  while (true) {
+
+    if (!isRadioSource() || !isRadioPlaying()) {
+      vTaskDelay(10 / portTICK_PERIOD_MS);
+      continue;
+    }
+
+    int count = decodeRadio();
+    if (tape)
+      playTape();
+    if (!count)
+      vTaskDelay(10 / portTICK_PERIOD_MS);
+  }
+}
+
+// Play/Stop on a station, with time-shift on the stream is paused
+// rather than stopped
+
+void radioPlayStop() {
+  if (tape && timeShiftOn && isRadioPlaying()) {
+    radioPaused = !radioPaused;
+    printf("radio %s\n", radioPaused ? "paused" : "playing");
+    return;
+  }
+  if (isRadioPlaying())
+    stopPlay();
+  else
+    restartCurrentRadio();
+}
+
+int isRadioPaused() {
+  return radioPaused;
+}
+
+// ms < 0 is back, returns 0 without a tape
+
+int skipRadio(int ms) {
+  if (!tape || !isRadioPlaying())
+    return 0;
+  int max = getTimeShiftMaxMs();
+  skipRequestMs = (ms < -max) ? -max : ms;
+  return 1;
+}
+
+void setTimeShift(int on) {
+  timeShiftOn = on;
+  if (!on)
+    radioPaused = 0;
+}
+
+// returns 0 if there is no tape, behind includes the jitter buffer
+
+int getTimeShiftStats(tapeStats_t *st, int *behindMs) {
+  if (!tape)
+    return 0;
+  jitterStats_t js;
+  jitterGetStats(jitter, &js);
+  xSemaphoreTake(tapeMutex, portMAX_DELAY);
+  tapeGetStats(tape, st);
+  xSemaphoreGive(tapeMutex);
+  *behindMs = streamBytesToMs(st->behind + js.fill);
+  return 1;
+}
+
+// the furthest back the tape can hold at the stream's rate, the ring
+// or the spill file when one is attached
+
+int getTimeShiftMaxMs() {
+  if (!tape)
+    return 0;
+  return streamBytesToMs(spillFile ? TIMESHIFTSPILL : TIMESHIFTSIZE);
+}
+
+void printTimeShiftStats() {
+  tapeStats_t st;
+  int behindMs;
+  if (!getTimeShiftStats(&st, &behindMs)) {
+    printf("no time-shift tape\n");
+    return;
+  }
+  printf("time-shift %s%s, %d ms behind live, %d ms held (%d in PSRAM) of %d, %s\n",
+         timeShiftOn ? "on" : "off", radioPaused ? " paused" : "", behindMs,
+         streamBytesToMs(st.held), streamBytesToMs(st.inRing), getTimeShiftMaxMs(),
+         st.spilling ? "spilling to " TIMESHIFTFILE : "no spill");
+  printf("spilled %lld read back %lld, %d spill errors, %lld bytes dropped\n",
+         st.spilled, st.spillReads, st.spillErrors, st.dropped);
+}
+
+void setRadioPrebuffer(int ms) {
+  if (jitter)
+    jitterSetPrebuffer(jitter, ms);
+}
+
+// returns 0 if there is no jitter buffer
+
+int getRadioBufferStats(jitterStats_t *st) {
+  if (!jitter)
+    return 0;
+  jitterGetStats(jitter, st);
+  return 1;
+}
+
+void printRadioStats() {
+  jitterStats_t st;
+  if (!getRadioBufferStats(&st)) {
+    printf("no radio buffer\n");
+    return;
+  }
+  printf("radio %s fill %d/%d ms, jitter %d ms late %d ms, prebuffer %d ms\n",
+         jitterStateName(st.state), st.fillMs, st.targetMs, st.jitterMs, st.lateMs,
+         st.prebufferMs);
+  printf("%lu starts %lu underruns, last start took %d ms, %lld bytes in %lld out\n",
+         st.starts, st.underruns, st.startupMs, st.bytesIn, st.bytesOut);
+}
+
+// fills pcmRing from the decoder, keeping it between the watermarks
+
+void pcmThreadCode(void *param) {
+
+  while (true) {
+
+    if (pendingRate) {
+      applySampleRate(pendingRate);
+      pendingRate = 0;
+    }
+
+    if (pcmRingFill(pcmRing) >= PCMHIGHWATER) {
+      vTaskDelay(1);
+      continue;
+    }
+
+    if (resampler) {
+      if (!resampleToRing()) {
+        vTaskDelay(1);
+        continue;
+      }
+      traceBegin(TRACEPCMREAD);
+      int count = readSamples((unsigned char *)rateBuffer, PCMCHUNK * 4);
+      traceEnd(TRACEPCMREAD);
+      if (!count) {
+        pcmRingDrain(pcmRing);
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+        continue;
+      }
+      rateBufferFrames = count / 4;
+      rateBufferUsed = 0;
+      resampleToRing();
+      continue;
+    }
+
+    uint32_t *block;
+    int frames = audioLoanBlock(&block, PCMCHUNK);
+    if (!frames) {
+      vTaskDelay(1);
+      continue;
+    }
+
+    traceBegin(TRACEPCMREAD);
+    int count = readSamples((unsigned char *)block, frames * 4);
+    traceEnd(TRACEPCMREAD);
+
+    if (!count) {
+      pcmRingDrain(pcmRing);
+      vTaskDelay(10 / portTICK_PERIOD_MS);
+      continue;
+    }
+
+    audioQueueBlock(count / 4);
+  }
+}
+
+void printAudioStats() {
+  pcmStats_t st;
+  pcmRingStats(pcmRing, &st);
+  printf("pcm ring fill %d/%d (min %d max %d) water %d/%d\n", st.fill, st.size,
+         st.minFill, st.maxFill, st.lowWater, st.highWater);
+  printf("pcm frames in %lu out %lu underruns %lu full %lu i2s underruns %d\n",
+         st.written, st.read, st.underruns, st.overflows, i2sUnderruns);
+  printf("stream rate %d clock %d %s\n", streamRate, dividerRate,
+         audioRateMode == RATEMODE_DIVIDER ? "divider" : "resample");
+  pcmRingResetStats(pcmRing);
+}
+
+void getAudioStats(pcmStats_t *st) {
+  pcmRingStats(pcmRing, st);
 }
 
 void startAudioThread() {
     
   printf ("startAudioThread ()\n");    
+
+  pcmRingBuffer = memTagMalloc(MEMAUDIO, PCMRINGSIZE * 4, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+  if (!pcmRingBuffer) {
+    printf("pcm ring not in DMA RAM\n");
+    pcmRingBuffer = memTagMalloc(MEMAUDIO, PCMRINGSIZE * 4, MALLOC_CAP_SPIRAM);
+  }
+  pcmRing = pcmRingCreate(pcmRingBuffer, PCMRINGSIZE, PCMLOWWATER, PCMHIGHWATER);
+  rateBuffer = memTagMalloc(MEMAUDIO, PCMCHUNK * 4, MALLOC_CAP_SPIRAM);
+  decodeMutex = xSemaphoreCreateMutex();
+  jitterBuffer = memTagMalloc(MEMAUDIO, RADIOBUFFERSIZE, MALLOC_CAP_SPIRAM);
+  if (jitterBuffer)
+    jitter = jitterCreate(jitterBuffer, RADIOBUFFERSIZE, RADIOPREBUFFERMS, RADIOMAXMS);
+  else
+    printf("no radio buffer, radio plays unbuffered\n");
+  tapeMutex = xSemaphoreCreateMutex();
+  tapeRing = jitter ? memTagMalloc(MEMAUDIO, TIMESHIFTSIZE, MALLOC_CAP_SPIRAM) : NULL;
+  if (tapeRing)
+    tape = tapeCreate(tapeRing, TIMESHIFTSIZE, 4);
     
 //  pthread_mutex_init(&queueMutex, NULL);
 
@@ -1100,6 +1657,9 @@ void startAudioThread() {
 #else
   xTaskCreate(&audioThreadCode, "audioThread", STACKSIZE, NULL, 7, NULL);
 #endif  
+  xTaskCreate(&pcmThreadCode, "pcmThread", STACKSIZE, NULL, 6, NULL);
+  if (jitter)
+    xTaskCreate(&radioThreadCode, "radioThread", STACKSIZE, NULL, 6, NULL);
   
 }
 
@@ -1269,9 +1829,11 @@ void sdPoll() {
   if (sdMounted || sdMountFail) {
     if (!getSDDetect()) {
       printf ("SD card removed\n");
-      if (sdMounted)
-        unMountSd();
+      int mounted = sdMounted;
       sdMounted = 0;
+      timeShiftSdRemoved();		// closes the spill file first
+      if (mounted)
+        unMountSd();
       sdMountFail = 0;
     }
   } else {
@@ -1343,7 +1905,6 @@ void set_backlight_brightness(int brightness_percent);
 
 #define TFTOFF 0
 
-#define TFTLOCK 1
 
 
 /*
@@ -1386,8 +1947,10 @@ I turned off scrolling text on the basis that it will reduce the rate of crashin
 #define LCDHEIGHT 170
 #define LCDWIDTH 320
 #endif
-#define PARALLEL_LINES 10
-#define LVGL_SIZE 5
+#define PARALLEL_LINES 10				// lines per SPI transfer
+#define FLUSHLINES PARALLEL_LINES		// so a band is one transfer
+#define FLUSHBUFFERS 3					// 2 to FLUSHPIPEMAX
+#define FLUSHSTACK 3072
 
 #define LCD_BK_LIGHT_OFF_LEVEL 0
 #define LCD_BK_LIGHT_ON_LEVEL 1
@@ -1395,25 +1958,27 @@ I turned off scrolling text on the basis that it will reduce the rate of crashin
 static uint16_t *myRect;
 
 esp_lcd_panel_handle_t panel_handle = NULL;
-lv_disp_drv_t *disp_drv_copy;
 
 #define LVGLMUTEX 1
 
+// the LVGL task sleeps until its next timer is due, anything that
+// changes the UI does so under lockLVGL so unlocking from another task
+// wakes it to redraw
 
-#if TFTLOCK
-
-SemaphoreHandle_t tftSemaphore;
+#define LVGLMAXSLEEPMS 1000
 
-void lockTFT (){
-  xSemaphoreTake(tftSemaphore, portMAX_DELAY);	
-}
+static TaskHandle_t lvglTask;
+static atomic_int lvglWakeups;
+static atomic_int lvglNotifies;
+static int64_t lvglStatsFrom;
 
-void unlockTFT (){
-  xSemaphoreGive(tftSemaphore);  
+static void wakeLVGL (){
+  if (lvglTask && (xTaskGetCurrentTaskHandle () != lvglTask)){
+    atomic_fetch_add (&lvglNotifies, 1);
+    xTaskNotifyGive (lvglTask);
+  }
 }
 
-#endif
-
 #if LVGLMUTEX
 pthread_mutex_t LVGLMutex;
 
@@ -1425,6 +1990,7 @@ void lockLVGL (){
 void unlockLVGL (){
   pthread_mutex_unlock(&LVGLMutex);	
 //  unlockHttps (); 
+  wakeLVGL ();
 }
 
 
@@ -1437,19 +2003,57 @@ void lockLVGL (){
 
 void unlockLVGL (){
   xSemaphoreGive(lvglSemaphore);  
+  wakeLVGL ();
 }
 #endif
 
 
-bool notifyFlush (){
+typedef struct {
+	lv_area_t area;
+	lv_color_t *buf;
+} flushBand_t;
+
+flushPipe_t *flushPipe;
+QueueHandle_t flushQueue;
+SemaphoreHandle_t flushFreeSemaphore;
+portMUX_TYPE flushMux = portMUX_INITIALIZER_UNLOCKED;
+
+// DMA done for the oldest band
 
-#if TFTLOCK
-	unlockTFT ();
+IRAM_ATTR bool notifyFlush (esp_lcd_panel_io_handle_t io, esp_lcd_panel_io_event_data_t *edata, void *ctx){
+
+	BaseType_t woken = pdFALSE;
+	taskENTER_CRITICAL_ISR (&flushMux);
+	flushPipeDone (flushPipe, esp_timer_get_time ());
+	taskEXIT_CRITICAL_ISR (&flushMux);
+	xSemaphoreGiveFromISR (flushFreeSemaphore, &woken);
+	return (woken == pdTRUE);
+}
+
+// sends bands in order, esp_lcd_panel_draw_bitmap waits for the one
+// before to finish so this blocks rather than LVGL
+
+void flushThread (void *param){
+	flushBand_t band;
+	while (1){
+		xQueueReceive (flushQueue, &band, portMAX_DELAY);
+		traceBegin (TRACEFLUSH);
+#if HELIXV2
+#define YOFF 35
+		esp_lcd_panel_draw_bitmap(panel_handle, band.area.x1, YOFF+band.area.y1, band.area.x2+1,
+		                          YOFF+band.area.y2+1, band.buf);
+#else
+		esp_lcd_panel_draw_bitmap(panel_handle, band.area.x1, band.area.y1, band.area.x2+1,
+		                          band.area.y2+1, band.buf);
 #endif
+		traceEnd (TRACEFLUSH);
+	}
+}
 
-  lv_disp_flush_ready(disp_drv_copy);	
-  
-	return false;
+void renderStart (lv_disp_drv_t *disp_drv){
+	taskENTER_CRITICAL (&flushMux);
+	flushPipeFrameStart (flushPipe, esp_timer_get_time ());
+	taskEXIT_CRITICAL (&flushMux);
 }
 
 void my_flush_cb(lv_disp_drv_t *disp_drv, const lv_area_t *area,
@@ -1457,43 +2061,87 @@ void my_flush_cb(lv_disp_drv_t *disp_drv, const lv_area_t *area,
 
 //  printf("flush %d %d %d %d\n", area->x1, area->y1, area->x2, area->y2);
 
-	disp_drv_copy = disp_drv;
-
 #if TFTOFF
-	notifyFlush ();
+	lv_disp_flush_ready (disp_drv);
 #else	
 
-#if TFTLOCK
-	lockTFT ();
-#endif
+	lv_disp_draw_buf_t *draw_buf = disp_drv->draw_buf;
 
-#if HELIXV2
-#define YOFF 35
-  esp_lcd_panel_draw_bitmap(panel_handle, area->x1, YOFF+area->y1, area->x2+1,
-                            YOFF+area->y2+1, color_p);
-#else
-  esp_lcd_panel_draw_bitmap(panel_handle, area->x1, area->y1, area->x2+1,
-                            area->y2+1, color_p);
-#endif
+	taskENTER_CRITICAL (&flushMux);
+	flushPipeRendered (flushPipe, color_p, lv_disp_flush_is_last (disp_drv), esp_timer_get_time ());
+	taskEXIT_CRITICAL (&flushMux);
 
-#endif
+	flushBand_t band = {.area = *area, .buf = color_p};
+	xQueueSend (flushQueue, &band, portMAX_DELAY);
 
+// LVGL swaps to the other buffer when this returns, if that one is
+// still queued put a free one there, waiting for one if need be
+
+	void **other = (draw_buf->buf_act == draw_buf->buf1) ? &draw_buf->buf2 : &draw_buf->buf1;
+	void *next;
+	while (1){
+		taskENTER_CRITICAL (&flushMux);
+		next = flushPipeNext (flushPipe, *other);
+		taskEXIT_CRITICAL (&flushMux);
+		if (next) break;
+		xSemaphoreTake (flushFreeSemaphore, portMAX_DELAY);
+	}
+	*other = next;
 
+	taskENTER_CRITICAL (&flushMux);
+	flushPipeResume (flushPipe, esp_timer_get_time ());
+	taskEXIT_CRITICAL (&flushMux);
+
+	lv_disp_flush_ready (disp_drv);
+#endif
 }
 
-static void onTimer(void *arg) {
-	
-	lv_tick_inc(1);
+void printFlushStats (){
+	flushPipeStats_t st;
+	taskENTER_CRITICAL (&flushMux);
+	flushPipeGetStats (flushPipe, &st);
+	taskEXIT_CRITICAL (&flushMux);
+	printf ("flush %d buffers of %d lines, %d frames %d bands %d waits, max %d queued\n",
+		st.buffers, FLUSHLINES, st.frames, st.bands, st.waits, st.maxQueued);
+	printf ("flush last frame %d us, %d bands, render %d us wait %d us transfer %d us\n",
+		st.lastFrameUs, st.lastBands, st.lastRenderUs, st.lastWaitUs, st.lastTransferUs);
+	if (st.frames){
+		printf ("flush average frame %lld us, render %lld us wait %lld us transfer %lld us\n",
+			st.frameUs / st.frames, st.renderUs / st.frames, st.waitUs / st.frames,
+			st.transferUs / st.frames);
+	}
+}
 
-}	
+// the old loop woke every 10ms and the 1ms tick timer 1000 times a
+// second, so about 1100/s whether anything changed or not
+
+void printLVGLStats(){
+	int64_t now = esp_timer_get_time ();
+	int wakeups = atomic_exchange (&lvglWakeups, 0);
+	int notifies = atomic_exchange (&lvglNotifies, 0);
+	int ms = (now - lvglStatsFrom) / 1000;
+	lvglStatsFrom = now;
+	if (ms <= 0) ms = 1;
+	printf ("lvgl %d wakeups in %d ms, %d.%02d/s (%d notifies)\n",
+		wakeups, ms, (wakeups * 1000) / ms, ((wakeups * 100000) / ms) % 100, notifies);
+}
+
+// lv_tick_get reads esp_timer (LV_TICK_CUSTOM) so there is no tick
+// interrupt, lv_timer_handler returns how long until its next timer
+// and the display refresh timer is paused until an area is invalidated
 
 void lv_task_thread (void *param) {
-	int n = 0;
 	while (1){
 	lockLVGL ();
-		lv_timer_handler();
+		traceBegin (TRACELVGL);
+		uint32_t next = lv_timer_handler();
+		traceEnd (TRACELVGL);
 	unlockLVGL ();		
-		vTaskDelay(10 / portTICK_PERIOD_MS);		
+		if (next > LVGLMAXSLEEPMS) next = LVGLMAXSLEEPMS;	// also LV_NO_TIMER_READY
+		TickType_t ticks = (next + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+		if (ticks < 1) ticks = 1;
+		ulTaskNotifyTake (pdTRUE, ticks);
+		atomic_fetch_add (&lvglWakeups, 1);
 	}
 }	
 
@@ -1505,12 +2153,6 @@ lv_grad_dsc_t backGrad;
 
 void lcdInit() {
 	
-#if TFTLOCK
-//  pthread_mutex_init(&TFTMutex, NULL);
-   tftSemaphore = xSemaphoreCreateBinary();
-   unlockTFT ();
-#endif	
-
 #if LVGLMUTEX	
   pthread_mutex_init(&LVGLMutex, NULL);
 #else
@@ -1542,7 +2184,7 @@ void lcdInit() {
                              .quadwp_io_num = -1,
                              .quadhd_io_num = -1,
                              .max_transfer_sz =
-                                 PARALLEL_LINES * LCDWIDTH * 2 + 8};
+                                 FLUSHLINES * LCDWIDTH * 2 + 8};
 
   // Initialize the SPI bus
   ESP_ERROR_CHECK(spi_bus_initialize(LCD_HOST, &buscfg, SPI_DMA_CH_AUTO));
@@ -1629,10 +2271,26 @@ void lcdInit() {
   /*A static or global variable to store the buffers*/
   static lv_disp_draw_buf_t disp_buf;
 
-  /*Static or global buffer(s). The second buffer is optional*/
-  static lv_color_t buf_1[LCDWIDTH * LVGL_SIZE];
+  // band buffers the SPI DMA can read, LVGL is given the first two and
+  // my_flush_cb swaps the others in
+
+  void *flushBufs[FLUSHBUFFERS];
+  int nbufs = 0;
+  while (nbufs < FLUSHBUFFERS) {
+    flushBufs[nbufs] = memTagMalloc(MEMUI, LCDWIDTH * FLUSHLINES * sizeof(lv_color_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!flushBufs[nbufs])
+      break;
+    nbufs++;
+  }
+  printf("%d flush buffers of %d lines\n", nbufs, FLUSHLINES);
+  if (nbufs < 2)
+    ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+  flushPipe = flushPipeCreate(flushBufs, nbufs);
+  flushQueue = xQueueCreate(FLUSHBUFFERS, sizeof(flushBand_t));
+  flushFreeSemaphore = xSemaphoreCreateBinary();
+  xTaskCreate(flushThread, "Flush", FLUSHSTACK, NULL, 2, NULL);
 
-  lv_disp_draw_buf_init(&disp_buf, buf_1, NULL, LCDWIDTH * LVGL_SIZE);
+  lv_disp_draw_buf_init(&disp_buf, flushBufs[0], flushBufs[1], LCDWIDTH * FLUSHLINES);
 
   static lv_disp_drv_t
       disp_drv; /*A variable to hold the drivers. Must be static or global.*/
@@ -1640,6 +2298,7 @@ void lcdInit() {
   disp_drv.draw_buf = &disp_buf; /*Set an initialized buffer*/
   disp_drv.flush_cb =
       my_flush_cb;        /*Set a flush callback to draw to the display*/
+  disp_drv.render_start_cb = renderStart;
   disp_drv.hor_res = LCDWIDTH; /*Set the horizontal resolution in pixels*/
   disp_drv.ver_res = LCDHEIGHT; /*Set the vertical resolution in pixels*/
   
@@ -1647,26 +2306,15 @@ void lcdInit() {
   lv_disp_drv_register(
       &disp_drv); /*Register the driver and save the created display objects*/
 
-      
-  const esp_timer_create_args_t periodic_timer_args = {
- 
-      .callback = &onTimer,
-      /* name is optional, but may help identify the timer when debugging */
-      .name = "lvgl timer"};
-
-  esp_timer_handle_t periodic_timer;
-  ESP_ERROR_CHECK(esp_timer_create(&periodic_timer_args, &periodic_timer));
-  /* The timer has been created but is not running yet */
 
-  /* Start the timers */
-  ESP_ERROR_CHECK(esp_timer_start_periodic(periodic_timer, 1000)); 
+  lvglStatsFrom = esp_timer_get_time ();
 
 #if 0
 	static StaticTask_t lvglTaskBuffer;
 	uint8_t *lvglStack = 	heap_caps_malloc (STACKSIZE,MALLOC_CAP_SPIRAM);	
-  xTaskCreateStatic(lv_task_thread, "lvgl task handler", STACKSIZE, NULL, 1, lvglStack, &lvglTaskBuffer);	
+  lvglTask = xTaskCreateStatic(lv_task_thread, "lvgl task handler", STACKSIZE, NULL, 1, lvglStack, &lvglTaskBuffer);	
 #else
-  xTaskCreate(lv_task_thread, "lvgl task handler", STACKSIZE, NULL, 1, NULL);
+  xTaskCreate(lv_task_thread, "lvgl task handler", STACKSIZE, NULL, 1, &lvglTask);
 #endif
 
 	printf ("starting backlight\n");
@@ -1,3 +1,9 @@
+#include "pcmRing.h"
+#include "jitterBuffer.h"
+#include "timeShift.h"
+#include "jsonExtract.h"
+#include "uiQueue.h"
+
 #ifdef __cplusplus
  extern "C" {
 #endif
@@ -14,6 +20,29 @@ void initSpiffs();
 
 void locoAudioInit(void);
 void startAudioThread();
+void printAudioStats();
+void getAudioStats(pcmStats_t *st);
+int audioLoanBlock(uint32_t **frames, int maxFrames);
+void audioQueueBlock(int frames);
+void setAudioSampleRate(int rate);
+void setAudioRateMode(int mode);
+void setRadioPrebuffer(int ms);
+int getRadioBufferStats(jitterStats_t *st);
+void printRadioStats();
+void resetRadio();
+void radioPlayStop();
+int isRadioPaused();
+int skipRadio(int ms);
+void setTimeShift(int on);
+int getTimeShiftStats(tapeStats_t *st, int *behindMs);
+int getTimeShiftMaxMs();
+int streamBytesToMs(int64_t bytes);
+void printTimeShiftStats();
+
+#define RATEMODE_RESAMPLE 0
+#define RATEMODE_DIVIDER 1
+#define RADIOPREBUFFERMS 500		// unless the prebuffer setting says otherwise
+#define RADIOSKIPBACKMS 15000		// BACK on a radio station, within the PSRAM tape
 void setVolume (int volume);
 void codecRestart (int volume);
 
@@ -23,43 +52,23 @@ void testToneOff();
 
 
 void initButtons();
+int takeInputEvent(int64_t *at);
+void printInputStats();
 
 void lcdInit();
 void set_backlight_brightness(int percent);
+void printFlushStats();
+void printLVGLStats();
 
 
 // ui.c
 
+void uiEventsInit ();
+void showSplash ();
 void uiInit ();
 int doUI (int e);
 void refreshUI ();
 
-// UI Events
-
-typedef enum {
-	NOTHING,					// 0
-	NEXTBUTTON,
-	PLAYSTOPBUTTON,
-	BACKBUTTON,
-	EJECTBUTTON,	
-	KNOBPUSH,
-	ROTARYUP,
-	ROTARYDOWN,
-	UITIMEOUT,
-					
-	UIREFRESH,
-	UIALERT,
-	UITIMER,
-	
-	EJECTHELD,
-	BACKBUTTONHELD,
-	
-	ENDOFTRACK,
-	INITPLAYLISTS
-	
-} uievent;
-
-
 typedef struct {
 	pthread_mutex_t mutex;
 	pthread_cond_t condition;
@@ -68,22 +77,30 @@ typedef struct {
 
 void addEvent (int e);
 int getEvent ();
+void waitEvent (int ms);
+void wakeMainLoop ();
+void printEventStats ();
 
 // web.c
 
 void startWebserver();
 void stopWebserver();
 extern httpd_handle_t server2;
+void bumpStatusVersion();
+void bumpFavouritesVersion();
+void bumpPlaylistsVersion();
+void printWebStats();
 
 
 // art.c
 
 void newArt ();
 uint8_t *getArt (char *url);
-void initArtPipeline ();
+int initArtPipeline ();
 int getArtWidth ();
 int getArtHeight ();
 void fetchArt (char *url);
+void printArtStats ();
 
 
 // main.c - TODO cleanup
@@ -117,10 +134,23 @@ uint64_t millis ();
 
 cJSON *getMyPlaylists(int offset, int limit);
 cJSON *getMyShows(int offset, int limit);
+int getMyPlaylistsFields(int offset, int limit, const char **paths, int npaths,
+                         jsonExtractCb_t cb, void *arg);
+int getMyShowsFields(int offset, int limit, const char **paths, int npaths,
+                     jsonExtractCb_t cb, void *arg);
 
 int getSettingsVolume();
 void setSettingsVolume(int volume);
+int getSettingsPrebuffer();
+void setSettingsPrebuffer(int ms);
+int getSettingsTimeShift();
+void setSettingsTimeShift(int on);
+char *getSetting(char *key);
+int setSetting(char *key, char *value);
+void flushSettings();
+char *readFile(char *path);
 void memDebugB ();
+int formatMetrics (char *buf, int len);
 void savePresets ();
 
 void locoCallback(int e);
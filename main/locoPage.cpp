@@ -4,6 +4,10 @@ it contains html, css and javascript
 Its purpose is to show how to create a single page web app
 that works with loco through endpoints defined in
 the module web.c
+
+At build time pagePack.py gzips this page and moves the <style> and
+<script> blocks into hashed css and js files which web.c serves with
+long lived caching. Keep one <style> and one <script> block
 ***********************************************************/
 
 
@@ -695,12 +699,32 @@ function submitZone (){
 
 var lastStatusText;
 var currentStatus;
+var statusVersion = 0;
+var favouritesVersion = 0;
+var playlistsVersion = 0;
+
+// favourites and playlists are only fetched when their version changes
+// the ETag lets the browser revalidate its copy with a 304
+
+function getList (name, build){
+  var req = new XMLHttpRequest();
+  req.onreadystatechange = function(){
+    if (this.readyState == 4 && this.status == 200) build (JSON.parse (this.responseText));
+  };
+  req.open("GET", name, true);
+  req.send();
+}
+
+// long poll - the server holds the request until the status moves on
+// from statusVersion and answers 304 if nothing happens for a while
 
 function doStatus (){
   var req = new XMLHttpRequest();
   req.onreadystatechange = function(){
     var n;
-    if(this.readyState == 4 && this.status == 200)
+    if (this.readyState != 4) return;
+    setTimeout (doStatus, ((this.status == 200)||(this.status == 304)) ? 0 : 1000);
+    if (this.status == 200)
     {
       var statusText = this.responseText;
       if (statusText != lastStatusText){
@@ -786,8 +810,15 @@ function doStatus (){
 			var sel = document.getElementById("searchResults");
 			removeChildren (sel);
 		}
-		if (s.favourites) buildFavourites (s.favourites);
-		if (s.playlists) buildPlaylists (s.playlists);
+		statusVersion = s.statusVersion;
+		if (s.favouritesVersion != favouritesVersion){
+			favouritesVersion = s.favouritesVersion;
+			getList ("getFavourites", buildFavourites);
+		}
+		if (s.playlistsVersion != playlistsVersion){
+			playlistsVersion = s.playlistsVersion;
+			getList ("getPlaylists", buildPlaylists);
+		}
 		
 		if (s.source == "Radio"){
 			document.getElementById("spotifyMetadata").style.display = "none";  
@@ -814,7 +845,7 @@ function doStatus (){
       }
     }
   };
-  req.open("GET", "getStatus", true);
+  req.open("GET", "getStatus?wait="+statusVersion, true);
   req.send(); 
 }
 
@@ -852,7 +883,7 @@ function getGenericSettings (){
 document.addEventListener("DOMContentLoaded",function(event){
 
 //  getGenericSettings ();
-  setInterval (doStatus,1000);
+  doStatus ();
   openTab (0);
   
   var root = document.documentElement;
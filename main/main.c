@@ -3,12 +3,23 @@
 	
 	app_main is the entry point
 	setup initialises the hardware and starts various services including loco
-	loop contains code in the main loop called every 100ms
+	loop contains code in the main loop called every 100ms, or at once when
+	a UI event is queued or a web request posts work
 		doUI is used to handle events - typically keys - UI and TFT code is in ui.c
 		doCli is used for debug - and handles commands typed on the ESP-IDF monitor - could be used for headless operation
 		sdPoll handles SD card detection and mounting
+		pollSettings writes changed settings to flash once they stop changing
+		artStorePoll writes the art store index after logos have been shown
+		pollTelemetry samples task and heap figures for stats and /metrics
+		httpPoolTidy closes API connections that have been idle for a while
 		doPostStart does work for the web UI - web server cannot do much inside the uri handler
 	
+	setup starts independent stages side by side and prints a boot trace,
+	the boot command prints it again
+
+	memtags shows heap held by art, audio, ui, web, api, json and the
+	decoder, see memTag.c
+	
 	
 *********************************************************/
 
@@ -17,6 +28,14 @@
 
 #include <loco.h>
 #include "locoBoard.h"
+#include "artStore.h"
+#include "httpPool.h"
+#include "pager.h"
+#include "kvStore.h"
+#include "bootGraph.h"
+#include "telemetry.h"
+#include "memTag.h"
+#include "tracer.h"
 #include "driver/sdmmc_host.h"
 #include "driver/gpio.h"
 #include <ctype.h>
@@ -24,6 +43,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "nvs_flash.h"
+#include "esp_timer.h"
 
 void memDebug();
 
@@ -66,23 +86,16 @@ void memDebugB () {
 }
 
 
-cJSON *settingsJson = NULL;
+// settings and favourites are in a kvStore, changes reach flash a
+// second or so after the last one rather than on every volume step
 
+kvStore_t *settings = NULL;
+kvFlash_t *settingsFlash = NULL;
 
 void savePresets (){
 	printf ("WARNING savePresets () NIY\n");
 }	
 
-void initSettings() {
-
-  settingsJson = cJSON_CreateObject();
-
-  char *vs = "50";
-
-  cJSON *vol = cJSON_CreateString(vs);
-  cJSON_AddItemToObject(settingsJson, "volume", vol);
-}
-
 int aFileExists(char *path) {
   FILE *tmp = fopen(path, "r");
   if (tmp) {
@@ -92,72 +105,148 @@ int aFileExists(char *path) {
   return 0;
 }
 
-int getSettings() {
+// reads a whole file, the caller frees it
 
-  if (!aFileExists("/spiffs/Settings"))
-    return 0;
+char *readFile(char *path) {
 
-  FILE *settingsFile = fopen("/spiffs/Settings", "r");
-  if (!settingsFile)
-    return 0;
+  if (!aFileExists(path))
+    return NULL;
 
-  fseeko(settingsFile, 0, SEEK_END);
-  int size = ftello(settingsFile);
-  fseeko(settingsFile, 0, SEEK_SET);
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return NULL;
+
+  fseeko(f, 0, SEEK_END);
+  int size = ftello(f);
+  fseeko(f, 0, SEEK_SET);
 
-  //  printf("Settings file length %d\n", size);
   char *buf = (char *) malloc(size + 1);
   if (!buf) {
-    fclose(settingsFile);
-    return 0;
+    fclose(f);
+    return NULL;
   }
   memset(buf, 0, size + 1);
-  fread(buf, 1, size, settingsFile);
-  fclose(settingsFile);
+  fread(buf, 1, size, f);
+  fclose(f);
+  return buf;
+}
 
-  printf("getSettings = %s\n", buf);
+// the volume from the /spiffs/Settings json file used before kvStore
 
-  settingsJson = cJSON_Parse(buf);
+void importSettings() {
 
+  char *buf = readFile("/spiffs/Settings");
+  if (!buf)
+    return;
+  printf("importSettings = %s\n", buf);
+  cJSON *json = cJSON_Parse(buf);
   free(buf);
-  return (int)settingsJson;
+  const cJSON *g = cJSON_GetObjectItemCaseSensitive(json, "volume");
+  if (g && g->valuestring)
+    kvSet(settings, "volume", g->valuestring);
+  cJSON_Delete(json);
 }
 
-void saveSettings() {
+// the "settings" data partition if the partition table has one, which
+// the shipped table does not - shrinking spiffs for it would reformat
+// spiffs on boards already in use and lose the Settings and Favourites
+// files before they are imported - so otherwise a file on spiffs
+// standing in for it
 
-  char *jsonString = cJSON_Print(settingsJson);
+void initSettings() {
 
-//  printf("saveSettings %s\n", jsonString);
+  settingsFlash = kvFlashPartition("settings");
+  if (!settingsFlash)
+    settingsFlash = kvFlashFile("/spiffs/Settings.kv", 4096, 8);
+  settings = kvOpen(settingsFlash);
+  if (!settings) {
+    printf("initSettings failed\n");
+    return;
+  }
+  char *v = kvGet(settings, "volume");
+  if (v)
+    free(v);
+  else
+    importSettings();
+}
 
-  FILE *settingsFile = fopen("/spiffs/Settings", "wb");
-  fprintf(settingsFile, "%s", jsonString);
-  fclose(settingsFile);
-  cJSON_free(jsonString);
+void pollSettings() {
+  if (settings)
+    kvPoll(settings, (uint32_t)millis());
 }
-	
-int getSettingsVolume() {
 
-  int r = 50;
-  const cJSON *g = cJSON_GetObjectItemCaseSensitive(settingsJson, "volume");
-  if (g && g->valuestring)
-    sscanf(g->valuestring, "%d", &r);
+void flushSettings() {
+  if (settings)
+    kvFlush(settings);
+}
+
+void printSettingsStats() {
+  if (!settings)
+    return;
+  kvStats_t st;
+  kvGetStats(settings, &st);
+  printf("settings %d keys %d dirty, bank %d seq %lu %d/%d bytes, %d sets %d refused %d flushes %d records %d compactions %d recovered %d failures\n",
+         st.keys, st.dirty, st.bank, st.sequence, st.used, st.bankSize, st.sets, st.refused,
+         st.flushes, st.records, st.compactions, st.recovered, st.failures);
+  printf("settings flash %d writes %d bytes %d erases, most erased sector %d\n",
+         settingsFlash->writes, settingsFlash->bytesWritten, settingsFlash->erases,
+         kvFlashMaxErases(settingsFlash));
+}
+
+char *getSetting(char *key) {
+  if (!settings)
+    return NULL;
+  return kvGet(settings, key);
+}
+
+// returns 0 when it is stored, a value that would not fit in a bank is
+// refused
+
+int setSetting(char *key, char *value) {
+  if (!settings)
+    return -1;
+  int r = kvSet(settings, key, value);
+  if (r)
+    printf("setSetting %s failed\n", key);
   return r;
 }
+	
+int getSettingsVolume() {
+  if (!settings)
+    return 50;
+  return kvGetInt(settings, "volume", 50);
+}
 
 void setSettingsVolume(int volume) {
+  if (settings)
+    kvSetInt(settings, "volume", volume);
+}
+
+// radio Play/Stop pauses and resumes rather than stopping, see
+// timeShift.c
 
-  char vs[10];
-  sprintf(vs, "%d", volume);
-  cJSON *newVol = cJSON_CreateString(vs);
+int getSettingsTimeShift() {
+  if (!settings)
+    return 1;
+  return kvGetInt(settings, "timeshift", 1);
+}
 
-  const cJSON *vj = cJSON_GetObjectItemCaseSensitive(settingsJson, "volume");
+void setSettingsTimeShift(int on) {
+  if (settings)
+    kvSetInt(settings, "timeshift", on);
+}
 
-  if (vj)
-    cJSON_ReplaceItemInObjectCaseSensitive(settingsJson, "volume", newVol);
-  else
-    cJSON_AddItemToObject(settingsJson, "volume", newVol);
+// the least radio buffer, the jitter buffer may choose more
 
-  saveSettings();
+int getSettingsPrebuffer() {
+  if (!settings)
+    return RADIOPREBUFFERMS;
+  return kvGetInt(settings, "prebuffer", RADIOPREBUFFERMS);
+}
+
+void setSettingsPrebuffer(int ms) {
+  if (settings)
+    kvSetInt(settings, "prebuffer", ms);
 }
 
 
@@ -199,73 +288,101 @@ void cdump(unsigned char *buf, int len) {
 }
 
 
-void setup() {
+// setup runs as a graph of stages, see bootGraph.c. The display and
+// the codec (a one second power up delay) are added first so they start
+// at once, Wi-Fi overlaps them and a splash is up as soon as LVGL is
 
-#ifdef CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
-  printf("CONFIG_MBEDTLS_CERTIFICATE_BUNDLE\n");
-#endif
+#define BOOTWORKERS 3
+#define BOOTSTACK 8192
 
-  // Initialize NVS
+bootGraph_t *boot = NULL;
+
+static int bootNvs(void *arg) {
   esp_err_t ret = nvs_flash_init();
   if (ret == ESP_ERR_NVS_NO_FREE_PAGES ||
       ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-    ESP_ERROR_CHECK(nvs_flash_erase());
+    nvs_flash_erase();
     ret = nvs_flash_init();
   }
-  ESP_ERROR_CHECK(ret);
-
-  printf("NVS done %lld\n", millis());
-
-  printf("Flashing LED setup\n");
-
-  initLed();
-
-  printf("about to call locoAudioInit()\n");
-
-  locoAudioInit();
-
-  printf("about to call startAudioThread()\n");
+  return ret;
+}
 
-  startAudioThread();
+static int bootLoco(void *arg) {
+  initLoco((PFVN)locoCallback, "Beauty");
+  return 0;
+}
 
-  printf("startAudioThread() done\n");
+static int bootArt(void *arg) {
+  return initArtPipeline();
+}
 
-  initSDDetect();
+static int bootVolume(void *arg) {
+  setVolume(getSettingsVolume());
+  return 0;
+}
 
-  initSpiffs();
+static int bootRadio(void *arg) {
+  setRadioPrebuffer(getSettingsPrebuffer());
+  setTimeShift(getSettingsTimeShift());
+  return 0;
+}
 
-  if (!getSettings()) {
-    initSettings();
-    saveSettings();
-  }
+// cJSON's allocations are counted as json, see memTag.c
 
-  int vi = getSettingsVolume();
-  setVolume(vi);
+static void *jsonMalloc(size_t size) {
+  return memTagMalloc(MEMJSON, size, MEMTAGDEFAULT);
+}
 
-  memDebugB();
+static void jsonFree(void *p) { memTagFree(p); }
 
-  initialiseWifi();
+void printBootStats() {
+  if (boot)
+    printBootTrace(boot);
+}
 
-  initArtPipeline();
+void setup() {
 
-  memDebugB();
+#ifdef CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+  printf("CONFIG_MBEDTLS_CERTIFICATE_BUNDLE\n");
+#endif
 
-  initLoco((PFVN)locoCallback, "Beauty");
+  memTagInit(MEMTAGSLOTS);
+  tracerInit(TRACERECORDS);
+  cJSON_Hooks hooks = {.malloc_fn = jsonMalloc, .free_fn = jsonFree};
+  cJSON_InitHooks(&hooks);
 
-  printf("initButtons()\n");
-  initButtons();
+  uiEventsInit();
+  httpPoolInit();
 
+  boot = bootCreate();
 #if DISPLAYENABLE
-  printf("lcdInit()\n");
-  lcdInit();
-
-  memDebugB();
-
-  printf("uiInit()\n");
-  uiInit();
+  bootStageCall(boot, "lcd", lcdInit, NULL);
+#endif
+  bootStageCall(boot, "audio", locoAudioInit, NULL);
+  bootStage(boot, "nvs", bootNvs, NULL, NULL);
+  bootStageCall(boot, "spiffs", initSpiffs, NULL);
+#if DISPLAYENABLE
+  bootStageCall(boot, "splash", showSplash, "lcd");
 #endif
+  bootStageCall(boot, "wifi", initialiseWifi, "nvs spiffs");
+  bootStageCall(boot, "settings", initSettings, "spiffs");
+  bootStageCall(boot, "audiothread", startAudioThread, "audio");
+  bootStage(boot, "volume", bootVolume, NULL, "audiothread settings");
+  bootStage(boot, "radio", bootRadio, NULL, "audiothread settings");
+  bootStage(boot, "art", bootArt, NULL, "spiffs");
+  bootStageCall(boot, "led", initLed, NULL);
+  bootStageCall(boot, "sddetect", initSDDetect, NULL);
+  // not alongside sddetect, GPIO 12 went back to an output, see initSDDetect
+  bootStageCall(boot, "buttons", initButtons, "sddetect");
+#if DISPLAYENABLE
+  bootStageCall(boot, "ui", uiInit, "splash settings");
+#endif
+  bootStage(boot, "loco", bootLoco, NULL, "wifi audiothread"); // plays without art if that failed
+
+  int bad = bootRun(boot, BOOTWORKERS, BOOTSTACK);
+  printBootTrace(boot);
 
-  printf("Setup done\n");
+  printf("Setup done%s\n", bad ? ", with stages missing" : "");
 
   memDebugB();
 }
@@ -352,6 +469,62 @@ void memDebug() {
   
 }
 
+// task CPU, stack and heap figures over the last minute or so, see
+// telemetry.c. Sampled from the main loop, read by stats and /metrics
+
+telemetry_t *telemetry = NULL;
+static telemetrySample_t telemetryNow;
+static int64_t telemetryDue = 0;
+
+void pollTelemetry() {
+  int64_t now = esp_timer_get_time();
+  if (now < telemetryDue)
+    return;
+  telemetryDue = now + TELEMPERIODMS * 1000LL;
+  if (!telemetry)
+    telemetry = telemetryCreate(TELEMWINDOW);
+  if (!telemetry)
+    return;
+  telemetrySample(&telemetryNow);
+  telemetryAdd(telemetry, &telemetryNow);
+}
+
+void printStats() {
+  if (telemetry)
+    printTelemetry(telemetry);
+  else
+    printf("no samples yet\n");
+}
+
+int stdoutFlush(void *arg, const char *buf, int len) {
+  return (int)fwrite(buf, 1, len, stdout) != len;
+}
+
+// trace as Chrome JSON on the console, the same as /trace
+
+void printTrace() {
+  traceSnapshot_t s;
+  if (traceCapture(&s)) {
+    printf("no memory for the trace\n");
+    return;
+  }
+  char buf[256];
+  jsonWriter_t w;
+  jsonInit(&w, buf, sizeof(buf), stdoutFlush, NULL);
+  int n = traceWriteJson(&s, &w);
+  jsonEnd(&w);
+  printf("\n%d records, %u lost\n", n, (unsigned)s.lost);
+  traceSnapshotFree(&s);
+}
+
+// returns the length, 0 if there is nothing yet
+
+int formatMetrics(char *buf, int len) {
+  if (!telemetry)
+    return 0;
+  return telemetryFormat(telemetry, buf, len);
+}
+
 
 
 void exCli() {
@@ -437,6 +610,73 @@ void exCli() {
 	startTrackN (track);
   } else if (!strcasecmp(arg0, "status")) {
     printf ("isActive %d StateIsPlaying %d StateIsPaused %d\n",getIsActive(),getStateIsPlaying(),getStateIsPaused());
+  } else if (!strcasecmp(arg0, "pool")) {
+    printHttpPoolStats();
+  } else if (!strcasecmp(arg0, "pager")) {
+    printPagerStats();
+  } else if (!strcasecmp(arg0, "settings")) {
+    printSettingsStats();
+  } else if (!strcasecmp(arg0, "flush")) {
+    printFlushStats();
+  } else if (!strcasecmp(arg0, "memtags")) {
+    printMemTags();
+  } else if (!strcasecmp(arg0, "stats")) {
+    printStats();
+  } else if (!strcasecmp(arg0, "trace")) {
+    if (!strcasecmp(arg1, "clear"))
+      tracerClear();
+    else if (!strcasecmp(arg1, "pause"))
+      tracerPause();
+    else if (!strcasecmp(arg1, "resume"))
+      tracerResume();
+    else
+      printTrace();
+  } else if (!strcasecmp(arg0, "boot")) {
+    printBootStats();
+  } else if (!strcasecmp(arg0, "lvgl")) {
+    printLVGLStats();
+  } else if (!strcasecmp(arg0, "input")) {
+    printInputStats();
+  } else if (!strcasecmp(arg0, "webstats")) {
+    printWebStats();
+  } else if (!strcasecmp(arg0, "events")) {
+    printEventStats();
+  } else if (!strcasecmp(arg0, "audio")) {
+    printAudioStats();
+  } else if (!strcasecmp(arg0, "rate")) {
+    int rate = 0;
+    sscanf(arg1, "%d", &rate);
+    if (rate > 0)
+      setAudioSampleRate(rate);
+  } else if (!strcasecmp(arg0, "ratemode")) {
+    setAudioRateMode(strcasecmp(arg1, "divider") ? RATEMODE_RESAMPLE : RATEMODE_DIVIDER);
+  } else if (!strcasecmp(arg0, "radio")) {
+    printRadioStats();
+  } else if (!strcasecmp(arg0, "prebuffer")) {
+    int ms = -1;
+    sscanf(arg1, "%d", &ms);
+    if (ms >= 0) {
+      setSettingsPrebuffer(ms);
+      setRadioPrebuffer(ms);
+    }
+    printf("prebuffer %d ms\n", getSettingsPrebuffer());
+  } else if (!strcasecmp(arg0, "timeshift")) {
+    if (arg1[0]) {
+      int on = !strcasecmp(arg1, "on");
+      setSettingsTimeShift(on);
+      setTimeShift(on);
+    }
+    printTimeShiftStats();
+  } else if (!strcasecmp(arg0, "skip")) {
+    int secs = -RADIOSKIPBACKMS / 1000;
+    sscanf(arg1, "%d", &secs);
+    if (!skipRadio(secs * 1000))
+      printf("no radio to skip\n");
+    else if (secs * 1000 < -getTimeShiftMaxMs())
+      printf("the tape only goes back %d ms\n", getTimeShiftMaxMs());
+  } else if (!strcasecmp(arg0, "art")) {
+    printArtStats();
+    printArtStoreStats();
   } 
   
 
@@ -452,26 +692,32 @@ int postPlayPauseFlag = 0;
 
 void postStartSearchResult (int index){
 	postStartSearchResultFlag = index+1;
+	wakeMainLoop ();
 }
 
 void postStartFavourite (int index){
 	postStartFavouriteFlag = index+1;
+	wakeMainLoop ();
 }
 
 void postNext (){
 	postNextFlag = 1;
+	wakeMainLoop ();
 }
 
 void postPrev (){
 	postPrevFlag = 1;
+	wakeMainLoop ();
 }
 
 void postPlayPause (){
 	postPlayPauseFlag = 1;
+	wakeMainLoop ();
 }
 
 void postStartPlaylist (int index){
 	postStartPlaylistFlag = index+1;
+	wakeMainLoop ();
 }
 
 
@@ -495,22 +741,21 @@ void doPostStart() {
     if (isSpotifySource() && getIsActive()) {
       startPrev();
     }
+    else if (isRadioSource())
+      skipRadio(-RADIOSKIPBACKMS);
   }
   if (postPlayPauseFlag) {
     postPlayPauseFlag = 0;
     if (isSpotifySource() && getIsActive()) {
       playPause();
     }
-    else if (isRadioSource()) {
-      if (isRadioPlaying())
-        stopPlay();
-      else
-		restartCurrentRadio();
-    }    
+    else if (isRadioSource())
+      radioPlayStop();
   }
   if (postStartPlaylistFlag) {    
     char *uri = getPlaylistUri(postStartPlaylistFlag-1);
-	playUri (uri);
+    if (uri[0]) playUri (uri);
+    else if (postStartPlaylistFlag <= getMyPlaylistsTotal()) return;	// still loading
     postStartPlaylistFlag = 0;
   }
 }
@@ -542,6 +787,8 @@ void loop() {
   int c;
   int e;
 
+  n = esp_timer_get_time() / 100000;	// 100ms ticks, loop runs early on events
+
   if (getStateIsPlaying() && !getStateIsPaused()) {
     if (n & 0x1)			// fast
       ledOn();
@@ -555,15 +802,20 @@ void loop() {
   }
 
 #if DISPLAYENABLE
-  while ((e = getEvent())) // while allows multiple volume changes per main loop
+  while ((e = getEvent())) { // while allows multiple volume changes per main loop
+    traceBegin(TRACEUI);
     doUI(e);
+    traceEnd(TRACEUI);
+  }
 #endif
 
   doCli();
   sdPoll();
+  pollSettings();
+  artStorePoll((uint32_t)millis());
+  pollTelemetry();
+  httpPoolTidy();
   doPostStart();
-
-  n = n + 1;
 }
 
 
@@ -571,7 +823,7 @@ void app_main () {
 	setup ();
 	while (1){
 		loop();
-		vTaskDelay (pdMS_TO_TICKS(100));
+		waitEvent (100);
 	}
 }
 
@@ -0,0 +1,288 @@
+/********************************************************
+	memTag.c
+
+	Counts heap use by owner - art, audio, ui, web, api, json and the
+	decoder - so it can be seen who holds memory at any moment.
+
+		memTagMalloc (tag,size,caps)	heap_caps_malloc, or malloc for
+										MEMTAGDEFAULT, counted to tag
+		memTagCalloc, memTagRealloc		the same for calloc and realloc
+		memTagFree (p)					frees and uncounts
+		printMemTags ()					bytes held and peak for each tag
+										largest first, and the largest
+										blocks held
+
+	Nothing is added to the blocks themselves. cJSON's hooks and
+	helix_malloc come here but libloco frees some of what they return
+	with plain free, so a header in front of the block would break.
+	Instead each block is in a hash table of pointer, size and tag,
+	open addressing with linear probing and entries moved back on
+	delete so there are no tombstones.
+
+	A block freed here that is not in the table is just freed (counted
+	as foreign). One freed elsewhere stays in the table until its
+	address is handed out again, it is then uncounted as stale. If the
+	table is 3/4 full new blocks are not counted (untracked).
+
+	One mutex covers the table and counts. On the board blocks come
+	from heap_caps_malloc, on Linux from malloc so the same code can
+	be tested there
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#define tagAlloc(n, caps) ((caps) ? heap_caps_malloc (n, caps) : malloc (n))
+#define tagRealloc(p, n, caps) ((caps) ? heap_caps_realloc (p, n, caps) : realloc (p, n))
+#define tableAlloc(n) heap_caps_calloc (1, n, MALLOC_CAP_SPIRAM)
+#else
+#define tagAlloc(n, caps) malloc (n)
+#define tagRealloc(p, n, caps) realloc (p, n)
+#define tableAlloc(n) calloc (1, n)
+#endif
+
+#include "memTag.h"
+
+#define MEMTAGSIZEMASK 0x00FFFFFF		// size in the low 24 bits, tag above
+#define MEMTAGSHIFT 24
+
+typedef struct {
+	uintptr_t ptr;						// 0 if empty
+	uint32_t sizeTag;
+} memTagEntry_t;
+
+static const char *tagNames[MEMTAGS] = {"other", "art", "audio", "ui", "web", "api", "json", "decoder"};
+
+static pthread_mutex_t tagMutex;
+static memTagEntry_t *table = NULL;
+static int slots = 0;
+static memTagStats_t tags[MEMTAGS];
+static memTagTableStats_t tableStats;
+
+// returns 0 if the table was allocated
+
+int memTagInit (int n){
+	if (table) return 0;
+	if (n & (n - 1)) return -1;
+	pthread_mutex_init (&tagMutex, NULL);
+	memset (tags, 0, sizeof(tags));
+	memset (&tableStats, 0, sizeof(tableStats));
+	table = tableAlloc (n * sizeof(memTagEntry_t));
+	if (!table) return -1;
+	slots = n;
+	tableStats.slots = n;
+	return 0;
+}
+
+static int home (uintptr_t p){
+	return ((uint32_t)(p >> 3) * 0x9E3779B1u) & (slots - 1);
+}
+
+static int findEntry (uintptr_t p){
+	int i = home (p);
+	while (table[i].ptr){
+		if (table[i].ptr == p) return i;
+		i = (i + 1) & (slots - 1);
+	}
+	return -1;
+}
+
+static void uncount (memTagEntry_t *e, int freed){
+	memTagStats_t *t = &tags[e->sizeTag >> MEMTAGSHIFT];
+	t->bytes -= e->sizeTag & MEMTAGSIZEMASK;
+	t->live--;
+	t->frees += freed;
+}
+
+// moves later entries of the run back into the hole so lookups still
+// find them
+
+static void removeEntry (int i){
+	int j = i;
+	tableStats.used--;
+	while (1){
+		j = (j + 1) & (slots - 1);
+		if (!table[j].ptr) break;
+		int k = home (table[j].ptr);
+		int moves = (i <= j) ? ((k <= i)||(k > j)) : ((k <= i) && (k > j));
+		if (moves){
+			table[i] = table[j];
+			i = j;
+		}
+	}
+	table[i].ptr = 0;
+}
+
+// a realloc moving a block is neither an alloc nor a free
+
+static void addEntry (int tag, void *p, size_t size, int alloc){
+	memTagStats_t *t = &tags[tag];
+	t->allocs += alloc;
+	if (!table || (size > MEMTAGSIZEMASK)||(tableStats.used >= (slots / 4) * 3)){
+		tableStats.untracked++;
+		return;
+	}
+	int i = findEntry ((uintptr_t)p);
+	if (i >= 0){									// freed elsewhere, address reused
+		uncount (&table[i], 1);
+		removeEntry (i);
+		tableStats.stale++;
+	}
+	i = home ((uintptr_t)p);
+	while (table[i].ptr) i = (i + 1) & (slots - 1);
+	table[i].ptr = (uintptr_t)p;
+	table[i].sizeTag = ((uint32_t)tag << MEMTAGSHIFT) | size;
+	tableStats.used++;
+	if (tableStats.used > tableStats.peakUsed) tableStats.peakUsed = tableStats.used;
+	t->bytes += size;
+	t->live++;
+	if (t->bytes > t->peak) t->peak = t->bytes;
+}
+
+static void dropEntry (void *p, int freed){
+	int i = table ? findEntry ((uintptr_t)p) : -1;
+	if (i < 0){
+		tableStats.foreignFrees += freed;
+		return;
+	}
+	uncount (&table[i], freed);
+	removeEntry (i);
+}
+
+static void lock (){
+	if (table) pthread_mutex_lock (&tagMutex);
+}
+
+static void unlock (){
+	if (table) pthread_mutex_unlock (&tagMutex);
+}
+
+void *memTagMalloc (int tag, size_t size, uint32_t caps){
+	if ((tag < 0)||(tag >= MEMTAGS)) tag = MEMOTHER;
+	void *p = tagAlloc (size, caps);
+	lock ();
+	if (p) addEntry (tag, p, size, 1);
+	else tags[tag].failures++;
+	unlock ();
+	return p;
+}
+
+void *memTagCalloc (int tag, size_t n, size_t size, uint32_t caps){
+	if (size && (n > SIZE_MAX / size)) return NULL;
+	void *p = memTagMalloc (tag, n * size, caps);
+	if (p) memset (p, 0, n * size);
+	return p;
+}
+
+// the block keeps its tag if it had one, else it takes tag
+
+void *memTagRealloc (int tag, void *p, size_t size, uint32_t caps){
+	if (!p) return memTagMalloc (tag, size, caps);
+	if (!size){
+		memTagFree (p);
+		return NULL;
+	}
+	if ((tag < 0)||(tag >= MEMTAGS)) tag = MEMOTHER;
+
+// held across the realloc, once p is released another task could be
+// given the same address
+
+	lock ();
+	int i = table ? findEntry ((uintptr_t)p) : -1;
+	if (i >= 0) tag = table[i].sizeTag >> MEMTAGSHIFT;
+	void *q = tagRealloc (p, size, caps);
+	if (!q) tags[tag].failures++;					// p is still held as it was
+	else {
+		if (i >= 0){
+			uncount (&table[i], 0);
+			removeEntry (i);
+		}
+		addEntry (tag, q, size, (i < 0));			// counted from now if it was not before
+	}
+	unlock ();
+	return q;
+}
+
+void memTagFree (void *p){
+	if (!p) return;
+	lock ();
+	dropEntry (p, 1);
+	unlock ();
+	free (p);
+}
+
+const char *memTagName (int tag){
+	if ((tag < 0)||(tag >= MEMTAGS)) return "?";
+	return tagNames[tag];
+}
+
+void memTagGetStats (int tag, memTagStats_t *st){
+	memset (st, 0, sizeof(memTagStats_t));
+	if ((tag < 0)||(tag >= MEMTAGS)) return;
+	lock ();
+	*st = tags[tag];
+	unlock ();
+	st->name = tagNames[tag];
+}
+
+void memTagGetTableStats (memTagTableStats_t *st){
+	lock ();
+	*st = tableStats;
+	unlock ();
+}
+
+// the n largest blocks held, returns how many were found
+
+int memTagTop (memTagBlock_t *top, int n){
+	int found = 0;
+	if (!table || (n <= 0)) return 0;
+	lock ();
+	for (int i = 0;i < slots;i++){
+		if (!table[i].ptr) continue;
+		uint32_t size = table[i].sizeTag & MEMTAGSIZEMASK;
+		int at = found;
+		while ((at > 0) && (top[at - 1].size < size)) at--;
+		if (at >= n) continue;
+		if (found < n) found++;
+		memmove (&top[at + 1], &top[at], (found - at - 1) * sizeof(memTagBlock_t));
+		top[at].ptr = (void *)table[i].ptr;
+		top[at].size = size;
+		top[at].tag = table[i].sizeTag >> MEMTAGSHIFT;
+	}
+	unlock ();
+	return found;
+}
+
+static int byBytes (const void *a, const void *b){
+	const memTagStats_t *x = a;
+	const memTagStats_t *y = b;
+	return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+#define MEMTAGTOP 8
+
+void printMemTags (){
+	memTagStats_t st[MEMTAGS];
+	memTagTableStats_t ts;
+	memTagBlock_t top[MEMTAGTOP];
+
+	for (int i = 0;i < MEMTAGS;i++) memTagGetStats (i, &st[i]);
+	qsort (st, MEMTAGS, sizeof(memTagStats_t), byBytes);
+	printf ("  %-8s %10s %10s %7s %9s %9s %5s\n", "tag", "bytes", "peak", "blocks", "allocs", "frees", "fail");
+	for (int i = 0;i < MEMTAGS;i++){
+		printf ("  %-8s %10lld %10lld %7d %9d %9d %5d\n", st[i].name, (long long)st[i].bytes,
+			(long long)st[i].peak, st[i].live, st[i].allocs, st[i].frees, st[i].failures);
+	}
+
+	int n = memTagTop (top, MEMTAGTOP);
+	for (int i = 0;i < n;i++) printf ("  %8u bytes %-8s at %p\n", (unsigned)top[i].size, tagNames[top[i].tag], top[i].ptr);
+
+	memTagGetTableStats (&ts);
+	printf ("table %d/%d (peak %d), %d untracked, %d freed elsewhere, %d foreign frees\n",
+		ts.used, ts.slots, ts.peakUsed, ts.untracked, ts.stale, ts.foreignFrees);
+}
@@ -0,0 +1,72 @@
+/********************************************************
+	memTag.h
+
+	Heap allocations counted by the part of the program that owns
+	them - see memTag.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define MEMTAGSLOTS 16384				// blocks tracked at once, a power of 2
+#define MEMTAGDEFAULT 0					// caps for plain malloc
+
+// tags
+enum {
+	MEMOTHER,
+	MEMART,
+	MEMAUDIO,
+	MEMUI,
+	MEMWEB,
+	MEMAPI,
+	MEMJSON,
+	MEMDECODER,
+	MEMTAGS
+};
+
+typedef struct {
+	const char *name;
+	int64_t bytes;						// held now
+	int64_t peak;
+	int live;							// blocks held now
+	int allocs;
+	int frees;
+	int failures;
+} memTagStats_t;
+
+typedef struct {
+	void *ptr;
+	uint32_t size;
+	int tag;
+} memTagBlock_t;
+
+typedef struct {
+	int slots;
+	int used;
+	int peakUsed;
+	int untracked;						// allocated while the table was full
+	int foreignFrees;					// freed but not in the table
+	int stale;							// in the table but freed elsewhere, found on reuse
+} memTagTableStats_t;
+
+int memTagInit (int slots);
+void *memTagMalloc (int tag, size_t size, uint32_t caps);
+void *memTagCalloc (int tag, size_t n, size_t size, uint32_t caps);
+void *memTagRealloc (int tag, void *p, size_t size, uint32_t caps);
+void memTagFree (void *p);
+
+const char *memTagName (int tag);
+void memTagGetStats (int tag, memTagStats_t *st);
+void memTagGetTableStats (memTagTableStats_t *st);
+int memTagTop (memTagBlock_t *top, int n);
+void printMemTags ();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,102 @@
+"""
+pagePack.py
+
+Build step for the web page. Run by main/CMakeLists.txt
+
+	pagePack.py locoPage.cpp webPage.c
+
+Takes the page out of the mainPage raw string in locoPage.cpp, moves the
+<style> and <script> blocks into their own files named by a hash of their
+content, gzips all three and writes them as a table of webAsset_t (see
+webPage.h) for web.c to serve.
+
+The css and js names change whenever their content does so the browser
+can cache them for ever. The html keeps its name and is revalidated with
+its ETag.
+
+locoPage.cpp stays the one place the page is edited and is still built
+as it is, web.c sends it uncompressed to clients that do not take gzip
+"""
+
+import gzip
+import hashlib
+import re
+import sys
+
+IMMUTABLE = "public, max-age=31536000, immutable"
+REVALIDATE = "no-cache"
+
+
+def contentHash(data):
+	return hashlib.sha256(data).hexdigest()[:16]
+
+
+def gz(data):
+	# mtime 0 so the output only changes when the page does
+	return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def extractPage(source):
+	m = re.search(r'R"\*\*\*\((.*)\)\*\*\*"', source, re.S)
+	if not m:
+		sys.exit("pagePack: no mainPage raw string found")
+	return m.group(1)
+
+
+def splitBlock(page, tag, makeRef):
+	m = re.search(r"<%s>(.*?)</%s>" % (tag, tag), page, re.S)
+	if not m:
+		return page, None, None
+	body = m.group(1).encode()
+	name = "/assets/loco-%s.%s" % (contentHash(body), "css" if tag == "style" else "js")
+	page = page[:m.start()] + makeRef(name) + page[m.end():]
+	return page, name, body
+
+
+def cArray(name, data):
+	lines = []
+	for i in range(0, len(data), 16):
+		lines.append("\t" + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+	return "static const uint8_t %s[%d] = {\n%s\n};\n" % (name, len(data), "\n".join(lines))
+
+
+def main():
+	if len(sys.argv) != 3:
+		sys.exit("usage: pagePack.py locoPage.cpp webPage.c")
+
+	with open(sys.argv[1], encoding="utf-8") as f:
+		page = extractPage(f.read())
+
+	page, cssName, css = splitBlock(page, "style",
+		lambda n: '<link rel="stylesheet" href="%s">' % n)
+	page, jsName, js = splitBlock(page, "script",
+		lambda n: '<script src="%s"></script>' % n)
+	html = page.encode()
+
+	assets = [("/", "text/html", REVALIDATE, html)]
+	if css is not None:
+		assets.append((cssName, "text/css", IMMUTABLE, css))
+	if js is not None:
+		assets.append((jsName, "application/javascript", IMMUTABLE, js))
+
+	out = []
+	out.append("// Generated by pagePack.py from locoPage.cpp - do not edit\n")
+	out.append("#include <stdint.h>\n#include \"webPage.h\"\n\n")
+	for i, (uri, ctype, cache, data) in enumerate(assets):
+		out.append(cArray("webAsset%d" % i, gz(data)))
+		out.append("\n")
+	out.append("const webAsset_t webAssets[] = {\n")
+	for i, (uri, ctype, cache, data) in enumerate(assets):
+		out.append('\t{"%s", "%s", "%s", "\\"%s\\"", webAsset%d, sizeof(webAsset%d), %d},\n'
+			% (uri, ctype, cache, contentHash(data), i, i, len(data)))
+	out.append("};\n\nconst int webAssetCount = %d;\n" % len(assets))
+
+	with open(sys.argv[2], "w") as f:
+		f.write("".join(out))
+
+	for uri, ctype, cache, data in assets:
+		print("pagePack %s %d bytes %d gzipped" % (uri, len(data), len(gz(data))))
+
+
+if __name__ == "__main__":
+	main()
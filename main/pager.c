@@ -0,0 +1,284 @@
+/********************************************************
+	pager.c
+
+	Background loading of paged lists such as My Playlists and
+	My Shows so the menus never wait on the network
+
+	Each pager has a fetch function (getMyPlaylistsFields etc) and
+	the jsonExtract paths for total, name and uri. Names and uris
+	go into a strArena, name at entry 2n and uri at 2n+1, so there
+	is no fixed limit on the number of items.
+
+	pagerName (p,index) returns what is loaded or "" and asks for
+	items up to PAGERAHEAD beyond index, the pager task fetches
+	pages of PAGERLIMIT until it has them. The loaded callback is
+	called after every page so the menu can repaint.
+
+	pagerCreate returns NULL when out of memory, the other calls take
+	a NULL pager as one that has nothing and never loads.
+
+	pagerReset () starts again from the first page, a page that was
+	in flight when it was called is thrown away. A failed page is
+	retried after PAGERRETRYMS rather than straight away.
+
+	One task serves all the pagers, fetches are serialised by
+	lockHttps anyway.
+
+*********************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "strArena.h"
+#include "pager.h"
+#include "memTag.h"
+
+#define PAGERMAX 4
+#define PAGERLIMIT 20					// items per request
+#define PAGERAHEAD 20					// items loaded beyond the last one asked for
+#define PAGERRETRYMS 5000
+#define PAGERBLOCK 4096					// arena block size
+#define PAGERSTACK 6144
+
+enum {PAGERTOTAL, PAGERNAME, PAGERURI};
+
+struct pager_s {
+	char *name;
+	pagerFetch_t fetch;
+	const char **paths;
+	void (*loaded) ();
+	strArena_t *arena;
+	int count;							// items loaded
+	int total;							// -1 until the first page arrives
+	int wanted;							// load until count reaches this
+	int generation;						// bumped by pagerReset
+	int64_t retryAt;					// us, after a failed page
+	int pages;
+	int failures;
+	int discarded;
+	int64_t time;						// us spent fetching
+};
+
+pager_t pagers[PAGERMAX];
+int pagerUsed = 0;
+SemaphoreHandle_t pagerSemaphore = NULL;
+SemaphoreHandle_t pagerWakeSemaphore = NULL;
+
+// one page is collected here before it goes into the arena
+
+typedef struct {
+	int count;							// items seen
+	int total;
+} pagerPage_t;
+
+char (*pagerItems)[2][JXVALUELEN];
+
+void lockPager (){
+	xSemaphoreTake (pagerSemaphore, portMAX_DELAY);
+}
+
+void unlockPager (){
+	xSemaphoreGive (pagerSemaphore);
+}
+
+void pagerField (void *arg, int path, int item, int type, const char *value){
+	pagerPage_t *pg = arg;
+	if (path == PAGERTOTAL){
+		if (type != JXTYPENUMBER) return;
+		sscanf (value, "%d", &pg->total);
+		return;
+	}
+	if ((item < 0)||(item >= PAGERLIMIT)) return;
+	while (pg->count <= item){					// an item may lack a field
+		pagerItems[pg->count][0][0] = 0;
+		pagerItems[pg->count][1][0] = 0;
+		pg->count++;
+	}
+	snprintf (pagerItems[item][path - PAGERNAME], JXVALUELEN, "%s", value);
+}
+
+// fetches the page after the items already loaded
+
+void pagerLoadPage (pager_t *p){
+
+	lockPager ();
+	int offset = p->count;
+	int generation = p->generation;
+	unlockPager ();
+
+	pagerPage_t pg = {.count = 0, .total = -1};
+	int64_t start = esp_timer_get_time ();
+	int r = p->fetch (offset, PAGERLIMIT, p->paths, 3, pagerField, &pg);
+	int64_t now = esp_timer_get_time ();
+
+	lockPager ();
+	p->time += now - start;
+	if (generation != p->generation){
+		p->discarded++;
+		unlockPager ();
+		return;
+	}
+	if (r || (pg.total < 0)){
+		printf ("pager %s page at %d failed\n", p->name, offset);
+		p->failures++;
+		p->retryAt = now + PAGERRETRYMS * 1000LL;
+		unlockPager ();
+		return;
+	}
+	int n;
+	for (n = 0;n < pg.count;n++){
+		if (strArenaAdd (p->arena, pagerItems[n][0]) < 0) break;
+		if (strArenaAdd (p->arena, pagerItems[n][1]) < 0) break;
+	}
+	p->count += n;
+	p->total = pg.total;
+	if (n < pg.count){
+		printf ("pager %s out of memory at %d items\n", p->name, p->count);
+		p->total = p->count;
+	}
+	else if (!pg.count) p->total = p->count;	// total says more but none came
+	p->pages++;
+	unlockPager ();
+
+	if (p->loaded) p->loaded ();
+}
+
+int pagerNeedsPage (pager_t *p, int64_t now){
+	if (now < p->retryAt) return 0;
+	if ((p->total >= 0)&&(p->count >= p->total)) return 0;
+	return (p->count < p->wanted);
+}
+
+void pagerThread (void *arg){
+	while (1){
+		xSemaphoreTake (pagerWakeSemaphore, pdMS_TO_TICKS (PAGERRETRYMS));
+		int busy;
+		do {
+			busy = 0;
+			for (int n = 0;n < pagerUsed;n++){
+				pager_t *p = &pagers[n];
+				lockPager ();
+				int need = pagerNeedsPage (p, esp_timer_get_time ());
+				unlockPager ();
+				if (need){
+					pagerLoadPage (p);
+					busy = 1;
+				}
+			}
+		} while (busy);
+	}
+}
+
+// called with the lock held, returns 1 if the task should wake
+
+int pagerWant (pager_t *p, int wanted){
+	if (wanted <= p->wanted) return 0;
+	p->wanted = wanted;
+	return pagerNeedsPage (p, esp_timer_get_time ());
+}
+
+pager_t *pagerCreate (char *name, pagerFetch_t fetch, const char **paths, void (*loaded) ()){
+
+	if (pagerUsed >= PAGERMAX) return NULL;
+
+	if (!pagerSemaphore){
+		pagerItems = memTagMalloc (MEMUI, PAGERLIMIT * sizeof(*pagerItems), MALLOC_CAP_SPIRAM);
+		if (!pagerItems){
+			printf ("pager no memory for a page\n");
+			return NULL;
+		}
+		pagerSemaphore = xSemaphoreCreateMutex ();
+		pagerWakeSemaphore = xSemaphoreCreateBinary ();
+		xTaskCreate (pagerThread, "Pager", PAGERSTACK, NULL, 4, NULL);
+	}
+
+	pager_t *p = &pagers[pagerUsed];
+	memset (p, 0, sizeof(pager_t));
+	p->name = name;
+	p->fetch = fetch;
+	p->paths = paths;
+	p->loaded = loaded;
+	p->arena = strArenaCreate (PAGERBLOCK);
+	if (!p->arena) return NULL;
+	p->total = -1;
+	p->count = 0;
+	p->wanted = 0;						// nothing until the first reset
+	lockPager ();
+	pagerUsed++;
+	unlockPager ();
+	return p;
+}
+
+void pagerReset (pager_t *p){
+	if (!p) return;
+	lockPager ();
+	strArenaClear (p->arena);
+	p->count = 0;
+	p->total = -1;
+	p->wanted = PAGERAHEAD;
+	p->retryAt = 0;
+	p->generation++;
+	unlockPager ();
+	xSemaphoreGive (pagerWakeSemaphore);
+	if (p->loaded) p->loaded ();
+}
+
+void pagerLoadAll (pager_t *p){
+	if (!p) return;
+	lockPager ();
+	int wake = pagerWant (p, INT_MAX);
+	unlockPager ();
+	if (wake) xSemaphoreGive (pagerWakeSemaphore);
+}
+
+// field 0 is the name and 1 the uri
+
+char *pagerGet (pager_t *p, int index, int field, int prefetch){
+	char *s = "";
+	int wake = 0;
+	if (!p || (index < 0)) return s;
+	lockPager ();
+	if (prefetch) wake = pagerWant (p, index + 1 + PAGERAHEAD);
+	if (index < p->count) s = strArenaGet (p->arena, index * 2 + field);
+	unlockPager ();
+	if (wake) xSemaphoreGive (pagerWakeSemaphore);
+	return s ? s : "";
+}
+
+char *pagerName (pager_t *p, int index){
+	return pagerGet (p, index, 0, 1);
+}
+
+char *pagerUri (pager_t *p, int index){
+	return pagerGet (p, index, 1, 1);
+}
+
+// does not load anything, for the web page which lists what the menu has
+
+char *pagerLoadedName (pager_t *p, int index){
+	return pagerGet (p, index, 0, 0);
+}
+
+int pagerTotal (pager_t *p){
+	return p ? p->total : 0;
+}
+
+int pagerCount (pager_t *p){
+	return p ? p->count : 0;
+}
+
+void printPagerStats (){
+	for (int n = 0;n < pagerUsed;n++){
+		pager_t *p = &pagers[n];
+		lockPager ();
+		printf ("pager %s %d of %d loaded, %d pages %d failed %d discarded, %lld ms fetching, %d bytes\n",
+			p->name, p->count, p->total, p->pages, p->failures, p->discarded,
+			(long long)(p->time / 1000), strArenaBytes (p->arena));
+		unlockPager ();
+	}
+}
@@ -0,0 +1,33 @@
+/********************************************************
+	pager.h
+
+	Background loading of paged API lists - see pager.c
+
+*********************************************************/
+#pragma once
+
+#include "jsonExtract.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+typedef struct pager_s pager_t;
+
+// fetches limit items from offset, passing the fields named by paths to cb
+typedef int (*pagerFetch_t) (int offset, int limit, const char **paths, int npaths,
+	jsonExtractCb_t cb, void *arg);
+
+pager_t *pagerCreate (char *name, pagerFetch_t fetch, const char **paths, void (*loaded) ());
+void pagerReset (pager_t *p);
+void pagerLoadAll (pager_t *p);
+char *pagerName (pager_t *p, int index);
+char *pagerUri (pager_t *p, int index);
+char *pagerLoadedName (pager_t *p, int index);
+int pagerTotal (pager_t *p);
+int pagerCount (pager_t *p);
+void printPagerStats ();
+
+#ifdef __cplusplus
+}
+#endif
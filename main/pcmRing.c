@@ -0,0 +1,202 @@
+/********************************************************
+	pcmRing.c
+
+	Lock-free single producer / single consumer ring of stereo
+	16 bit PCM frames. The decoder thread writes and the I2S thread
+	reads so that neither ever waits on the other.
+
+	Each frame is one uint32_t (left and right) so a frame is never
+	split. The size must be a power of two; head and tail run freely
+	and are masked on use.
+
+	lowWater	after an underrun the reader waits for this many frames
+				before playing again
+	highWater	the writer should stop filling above this
+
+	pcmRingDrain tells the reader that no more data is coming for now so
+	it should play out what is left rather than wait for lowWater.
+	Only finding the ring empty is an underrun, reading more than it
+	holds just gets less, and running empty while draining is not
+	counted.
+
+	The Begin/End calls loan ring memory directly so the decoder can
+	write into the ring and the I2S writer can send from it without
+	any intermediate copy. pcmRingWrite and pcmRingRead are copying
+	versions built on them.
+
+	Only C11 atomics are used so this can be built and tested on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "pcmRing.h"
+
+typedef struct pcmRing_s {
+	uint32_t *buffer;
+	uint32_t mask;
+	int lowWater;
+	int highWater;
+	_Atomic uint32_t head;		// written by the producer
+	_Atomic uint32_t tail;		// written by the consumer
+	_Atomic int draining;
+
+// producer only
+
+	uint32_t overflows;
+
+// consumer only
+
+	int running;
+	int minFill;
+	int maxFill;
+	uint32_t underruns;
+} pcmRing_t;
+
+// buffer must hold frames entries and frames must be a power of two
+
+pcmRing_t *pcmRingCreate (uint32_t *buffer, int frames, int lowWater, int highWater){
+
+	if (frames & (frames - 1)){
+		printf ("ERROR pcmRingCreate size %d not a power of two\n", frames);
+		return NULL;
+	}
+
+	pcmRing_t *r = malloc (sizeof(pcmRing_t));
+	if (!r) return NULL;
+	memset (r, 0, sizeof(pcmRing_t));
+
+	r->buffer = buffer;
+	r->mask = frames - 1;
+	r->lowWater = lowWater;
+	r->highWater = highWater;
+	atomic_init (&r->head, 0);
+	atomic_init (&r->tail, 0);
+	atomic_init (&r->draining, 0);
+	r->minFill = frames;
+	return r;
+}
+
+int pcmRingFill (pcmRing_t *r){
+	uint32_t head = atomic_load_explicit (&r->head, memory_order_acquire);
+	uint32_t tail = atomic_load_explicit (&r->tail, memory_order_acquire);
+	return head - tail;
+}
+
+// producer - loans the contiguous free space at head, up to count frames
+// fill it in place then pass the number of frames used to pcmRingWriteEnd
+
+int pcmRingWriteBegin (pcmRing_t *r, uint32_t **frames, int count){
+
+	uint32_t head = atomic_load_explicit (&r->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit (&r->tail, memory_order_acquire);
+	int space = (r->mask + 1) - (head - tail);
+	int contiguous = (r->mask + 1) - (head & r->mask);
+
+	if (count > space){
+		r->overflows++;
+		count = space;
+	}
+	if (count > contiguous) count = contiguous;
+
+	*frames = &r->buffer[head & r->mask];
+	return count;
+}
+
+void pcmRingWriteEnd (pcmRing_t *r, int count){
+	uint32_t head = atomic_load_explicit (&r->head, memory_order_relaxed);
+	atomic_store_explicit (&r->head, head + count, memory_order_release);
+	if (count) atomic_store_explicit (&r->draining, 0, memory_order_relaxed);
+}
+
+// producer - copying write, returns the number of frames written, fewer than count if full
+
+int pcmRingWrite (pcmRing_t *r, uint32_t *frames, int count){
+	int done = 0;
+	while (done < count){
+		uint32_t *p;
+		int n = pcmRingWriteBegin (r, &p, count - done);
+		if (!n) break;
+		memcpy (p, frames + done, n * 4);
+		pcmRingWriteEnd (r, n);
+		done += n;
+	}
+	return done;
+}
+
+// producer - nothing more to come for now, let the reader empty the ring
+
+void pcmRingDrain (pcmRing_t *r){
+	atomic_store_explicit (&r->draining, 1, memory_order_relaxed);
+}
+
+// consumer - loans up to count contiguous frames at tail, 0 while waiting for lowWater
+// the frames stay valid until pcmRingReadEnd
+
+int pcmRingReadBegin (pcmRing_t *r, uint32_t **frames, int count){
+
+	uint32_t tail = atomic_load_explicit (&r->tail, memory_order_relaxed);
+	uint32_t head = atomic_load_explicit (&r->head, memory_order_acquire);
+	int fill = head - tail;
+	int draining = atomic_load_explicit (&r->draining, memory_order_relaxed);
+	int contiguous = (r->mask + 1) - (tail & r->mask);
+
+	*frames = &r->buffer[tail & r->mask];
+
+	if (!r->running){
+		if ((fill < r->lowWater) && !(draining && fill)) return 0;
+		r->running = 1;
+	}
+
+	if (fill < r->minFill) r->minFill = fill;
+	if (fill > r->maxFill) r->maxFill = fill;
+
+	if (!fill){
+		if (!draining) r->underruns++;		// ran dry with the decoder still active
+		r->running = 0;
+		return 0;
+	}
+	if (count > fill) count = fill;			// a short read, not yet dry
+	if (count > contiguous) count = contiguous;
+	return count;
+}
+
+void pcmRingReadEnd (pcmRing_t *r, int count){
+	uint32_t tail = atomic_load_explicit (&r->tail, memory_order_relaxed);
+	atomic_store_explicit (&r->tail, tail + count, memory_order_release);
+}
+
+// consumer - copying read, returns the number of frames read
+
+int pcmRingRead (pcmRing_t *r, uint32_t *frames, int count){
+	uint32_t *p;
+	int n = pcmRingReadBegin (r, &p, count);
+	memcpy (frames, p, n * 4);
+	pcmRingReadEnd (r, n);
+	return n;
+}
+
+// stats are approximate when read from a third thread
+
+void pcmRingStats (pcmRing_t *r, pcmStats_t *s){
+	s->size = r->mask + 1;
+	s->fill = pcmRingFill (r);
+	s->minFill = r->minFill;
+	s->maxFill = r->maxFill;
+	s->lowWater = r->lowWater;
+	s->highWater = r->highWater;
+	s->written = atomic_load_explicit (&r->head, memory_order_relaxed);
+	s->read = atomic_load_explicit (&r->tail, memory_order_relaxed);
+	s->underruns = r->underruns;
+	s->overflows = r->overflows;
+}
+
+// restart the min/max fill window
+
+void pcmRingResetStats (pcmRing_t *r){
+	r->minFill = r->mask + 1;
+	r->maxFill = 0;
+}
@@ -0,0 +1,44 @@
+/********************************************************
+	pcmRing.h
+
+	Lock-free SPSC ring of stereo 16 bit frames - see pcmRing.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+typedef struct pcmRing_s pcmRing_t;
+
+typedef struct {
+	int size;				// frames
+	int fill;
+	int minFill;			// since pcmRingResetStats
+	int maxFill;
+	int lowWater;
+	int highWater;
+	uint32_t written;		// total frames, wraps
+	uint32_t read;
+	uint32_t underruns;
+	uint32_t overflows;
+} pcmStats_t;
+
+pcmRing_t *pcmRingCreate (uint32_t *buffer, int frames, int lowWater, int highWater);
+int pcmRingFill (pcmRing_t *r);
+int pcmRingWriteBegin (pcmRing_t *r, uint32_t **frames, int count);
+void pcmRingWriteEnd (pcmRing_t *r, int count);
+int pcmRingWrite (pcmRing_t *r, uint32_t *frames, int count);
+void pcmRingDrain (pcmRing_t *r);
+int pcmRingReadBegin (pcmRing_t *r, uint32_t **frames, int count);
+void pcmRingReadEnd (pcmRing_t *r, int count);
+int pcmRingRead (pcmRing_t *r, uint32_t *frames, int count);
+void pcmRingStats (pcmRing_t *r, pcmStats_t *s);
+void pcmRingResetStats (pcmRing_t *r);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,193 @@
+/********************************************************
+	resampler.c
+
+	Fixed point polyphase resampler for stereo 16 bit frames,
+	used to bring 48k, 32k etc streams to the 44.1k the DAC runs at
+
+	The filter is a Blackman windowed sinc of RSTAPS taps stored as
+	RSPHASES+1 phases in Q15. The output position is a Q32 fraction,
+	its top bits pick the phase and the next 15 bits interpolate
+	between neighbouring phases. Cutoff is just below the lower
+	of the two Nyquist rates so downsampling does not alias.
+
+	Input history is kept deinterleaved (left and right arrays) so the
+	inner loops are plain int16 x int16 -> int32 dot products which the
+	compiler can unroll and vectorise.
+
+	Only libc and libm are used so this can be built and tested on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "resampler.h"
+
+#define RSTAPS 32
+#define RSPHASEBITS 6
+#define RSPHASES (1 << RSPHASEBITS)
+#define RSHISTORY 1024				// input frames buffered per call
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+typedef struct resampler_s {
+	int inRate;
+	int outRate;
+	uint32_t step;					// input samples per output, Q32 fraction part
+	uint32_t stepInt;				// and integer part
+	uint32_t frac;
+	int used;						// frames in history
+	int pos;						// first tap of the next output
+	int16_t coef[RSPHASES + 1][RSTAPS];
+	int16_t left[RSHISTORY + RSTAPS];
+	int16_t right[RSHISTORY + RSTAPS];
+} resampler_t;
+
+static void makeFilter (resampler_t *r){
+
+	double fc = 0.5 * 0.91;			// cycles per input sample
+	if (r->outRate < r->inRate) fc = fc * r->outRate / r->inRate;
+
+	for (int p = 0;p <= RSPHASES;p++){
+		double h[RSTAPS];
+		double sum = 0;
+		for (int k = 0;k < RSTAPS;k++){
+			double d = k - (RSTAPS / 2 - 1) - (double)p / RSPHASES;
+			double x = 2 * fc * d;
+			double s = (fabs(x) < 1e-9) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+			double w = (d + RSTAPS / 2) / RSTAPS;			// 0..1 across the window
+			if (w < 0) w = 0;
+			if (w > 1) w = 1;
+			double b = 0.42 - 0.5 * cos(2 * M_PI * w) + 0.08 * cos(4 * M_PI * w);
+			h[k] = s * b;
+			sum += h[k];
+		}
+
+// unity gain at DC for every phase
+
+		int isum = 0;
+		for (int k = 0;k < RSTAPS;k++){
+			r->coef[p][k] = lrint(h[k] / sum * 32768.0);
+			isum += r->coef[p][k];
+		}
+		r->coef[p][RSTAPS / 2 - 1] += 32768 - isum;
+	}
+}
+
+resampler_t *resamplerCreate (int inRate, int outRate){
+
+	if ((inRate <= 0)||(outRate <= 0)) return NULL;
+
+	resampler_t *r = malloc (sizeof(resampler_t));
+	if (!r) return NULL;
+	memset (r, 0, sizeof(resampler_t));
+
+	r->inRate = inRate;
+	r->outRate = outRate;
+	uint64_t step = ((uint64_t)inRate << 32) / outRate;
+	r->stepInt = step >> 32;
+	r->step = (uint32_t)step;
+	makeFilter (r);
+
+// start with half a filter of silence so the first output lines up
+// with the first input frame
+
+	r->used = RSTAPS / 2 - 1;
+	return r;
+}
+
+void resamplerDelete (resampler_t *r){
+	free (r);
+}
+
+void resamplerReset (resampler_t *r){
+	memset (r->left, 0, sizeof(r->left));
+	memset (r->right, 0, sizeof(r->right));
+	r->used = RSTAPS / 2 - 1;
+	r->pos = 0;
+	r->frac = 0;
+}
+
+static inline int16_t saturate (int32_t v){
+	v = (v + 16384) >> 15;
+	if (v > 32767) return 32767;
+	if (v < -32768) return -32768;
+	return v;
+}
+
+// converts frames from in to out. returns the number of output frames
+// and sets *consumed to the input frames taken, which may be fewer than
+// inFrames when out fills up
+
+int resamplerProcess (resampler_t *r, const uint32_t *in, int inFrames, int *consumed,
+	uint32_t *out, int maxOut){
+
+	int produced = 0;
+	int taken = 0;
+
+	while (1){
+
+// top up the history
+
+		while ((taken < inFrames) && (r->used < RSHISTORY + RSTAPS)){
+			uint32_t f = in[taken++];
+			r->left[r->used] = (int16_t)(f & 0xFFFF);
+			r->right[r->used] = (int16_t)(f >> 16);
+			r->used++;
+		}
+
+// produce while a full window is available
+
+		while ((produced < maxOut) && (r->pos + RSTAPS <= r->used)){
+
+			int phase = r->frac >> (32 - RSPHASEBITS);
+			int32_t w = (r->frac >> (32 - RSPHASEBITS - 15)) & 0x7FFF;
+			const int16_t *c0 = r->coef[phase];
+			const int16_t *c1 = r->coef[phase + 1];
+			const int16_t *xl = &r->left[r->pos];
+			const int16_t *xr = &r->right[r->pos];
+
+			int16_t c[RSTAPS];
+			for (int k = 0;k < RSTAPS;k++){
+				c[k] = c0[k] + (((c1[k] - c0[k]) * w + 16384) >> 15);
+			}
+
+			int32_t al = 0;
+			int32_t ar = 0;
+			for (int k = 0;k < RSTAPS;k++){
+				al += c[k] * xl[k];
+				ar += c[k] * xr[k];
+			}
+
+			out[produced++] = (uint16_t)saturate(al) | ((uint32_t)(uint16_t)saturate(ar) << 16);
+
+			uint32_t f = r->frac + r->step;
+			r->pos += r->stepInt + (f < r->frac);
+			r->frac = f;
+		}
+
+// drop history that is no longer needed
+
+		if (r->pos > 0){
+			int drop = (r->pos < r->used) ? r->pos : r->used;
+			int keep = r->used - drop;
+			memmove (r->left, &r->left[drop], keep * sizeof(int16_t));
+			memmove (r->right, &r->right[drop], keep * sizeof(int16_t));
+			r->used = keep;
+			r->pos -= drop;
+		}
+
+		if ((produced >= maxOut)||(taken >= inFrames)) break;
+	}
+
+	*consumed = taken;
+	return produced;
+}
+
+int resamplerInRate (resampler_t *r){
+	return r->inRate;
+}
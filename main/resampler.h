@@ -0,0 +1,26 @@
+/********************************************************
+	resampler.h
+
+	Polyphase resampler for stereo 16 bit frames - see resampler.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+typedef struct resampler_s resampler_t;
+
+resampler_t *resamplerCreate (int inRate, int outRate);
+void resamplerDelete (resampler_t *r);
+void resamplerReset (resampler_t *r);
+int resamplerProcess (resampler_t *r, const uint32_t *in, int inFrames, int *consumed,
+	uint32_t *out, int maxOut);
+int resamplerInRate (resampler_t *r);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,154 @@
+/********************************************************
+	strArena.c
+
+	Growable store of strings, used for playlist and show names so
+	that their number and length are not fixed in advance
+
+	Strings are packed end to end into blocks of blockSize bytes and
+	found through an index of offsets. Blocks are never moved or
+	freed until strArenaDelete, so a pointer from strArenaGet stays
+	valid - after strArenaClear it may point at a newer string but
+	never at freed memory. Strings longer than blockSize - 1 are cut.
+
+	strArenaAdd returns the index of the new string or -1 if out of
+	memory. strArenaTruncate drops the strings from count on, to undo
+	adds that belong together when a later one fails. The arena is not locked, callers sharing one between
+	tasks must do that.
+
+	On the board the blocks and index are in PSRAM, counted as ui by
+	memTag.c. Only libc is used otherwise so this can be built and
+	tested on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#include "memTag.h"
+#define arenaMalloc(n) memTagMalloc (MEMUI, n, MALLOC_CAP_SPIRAM)
+#define arenaRealloc(p, n) memTagRealloc (MEMUI, p, n, MALLOC_CAP_SPIRAM)
+#define arenaFree(p) memTagFree (p)
+#else
+#define arenaMalloc(n) malloc (n)
+#define arenaRealloc(p, n) realloc (p, n)
+#define arenaFree(p) free (p)
+#endif
+
+#include "strArena.h"
+
+#define ARENAINDEXSTEP 256			// index entries added at a time
+#define ARENABLOCKSTEP 8
+
+typedef struct strArena_s {
+	int blockSize;
+	char **block;
+	int blocks;						// allocated
+	int blockCap;
+	int current;					// block being filled
+	int pos;						// in the current block
+	uint32_t *offset;				// block * blockSize + pos
+	int count;
+	int cap;
+} strArena_t;
+
+strArena_t *strArenaCreate (int blockSize){
+	strArena_t *a = arenaMalloc (sizeof(strArena_t));
+	if (!a) return NULL;
+	memset (a, 0, sizeof(strArena_t));
+	a->blockSize = blockSize;
+	return a;
+}
+
+void strArenaDelete (strArena_t *a){
+	if (!a) return;
+	for (int n = 0;n < a->blocks;n++) arenaFree (a->block[n]);
+	arenaFree (a->block);
+	arenaFree (a->offset);
+	arenaFree (a);
+}
+
+// makes sure block b exists
+
+static int strArenaBlock (strArena_t *a, int b){
+	if (b < a->blocks) return 0;
+	if (a->blocks == a->blockCap){
+		char **block = arenaRealloc (a->block, (a->blockCap + ARENABLOCKSTEP) * sizeof(char *));
+		if (!block) return -1;
+		a->block = block;
+		a->blockCap += ARENABLOCKSTEP;
+	}
+	a->block[a->blocks] = arenaMalloc (a->blockSize);
+	if (!a->block[a->blocks]) return -1;
+	memset (a->block[a->blocks], 0, a->blockSize);		// a stale pointer always finds a 0
+	a->blocks++;
+	return 0;
+}
+
+int strArenaAdd (strArena_t *a, const char *s){
+
+	int len = strlen (s);
+	if (len > a->blockSize - 1) len = a->blockSize - 1;
+
+	if (a->count == a->cap){
+		uint32_t *offset = arenaRealloc (a->offset, (a->cap + ARENAINDEXSTEP) * sizeof(uint32_t));
+		if (!offset) return -1;
+		a->offset = offset;
+		a->cap += ARENAINDEXSTEP;
+	}
+
+	int current = a->current;
+	int pos = a->pos;
+	if (!a->blocks || (pos + len + 1 > a->blockSize)){
+		if (a->blocks) current++;
+		pos = 0;
+	}
+	if (strArenaBlock (a, current)) return -1;
+
+	char *d = a->block[current] + pos;
+	memcpy (d, s, len);
+	d[len] = 0;
+
+	a->current = current;
+	a->pos = pos + len + 1;
+	a->offset[a->count] = current * a->blockSize + pos;
+	return a->count++;
+}
+
+char *strArenaGet (strArena_t *a, int index){
+	if ((index < 0)||(index >= a->count)) return NULL;
+	uint32_t o = a->offset[index];
+	return a->block[o / a->blockSize] + (o % a->blockSize);
+}
+
+int strArenaCount (strArena_t *a){
+	return a->count;
+}
+
+// forgets the strings but keeps the memory for reuse
+
+void strArenaClear (strArena_t *a){
+	a->count = 0;
+	a->current = 0;
+	a->pos = 0;
+}
+
+// forgets the strings from count on, their space is used again
+
+void strArenaTruncate (strArena_t *a, int count){
+	if (count >= a->count) return;
+	if (count <= 0){
+		strArenaClear (a);
+		return;
+	}
+	uint32_t o = a->offset[count - 1];
+	a->current = o / a->blockSize;
+	a->pos = o % a->blockSize + strlen (a->block[a->current] + o % a->blockSize) + 1;
+	a->count = count;
+}
+
+int strArenaBytes (strArena_t *a){
+	return a->blocks * a->blockSize + a->cap * sizeof(uint32_t);
+}
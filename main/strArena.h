@@ -0,0 +1,28 @@
+/********************************************************
+	strArena.h
+
+	Growable store of strings with an index - see strArena.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+typedef struct strArena_s strArena_t;
+
+strArena_t *strArenaCreate (int blockSize);
+void strArenaDelete (strArena_t *a);
+int strArenaAdd (strArena_t *a, const char *s);
+char *strArenaGet (strArena_t *a, int index);
+int strArenaCount (strArena_t *a);
+void strArenaClear (strArena_t *a);
+void strArenaTruncate (strArena_t *a, int count);
+int strArenaBytes (strArena_t *a);
+
+#ifdef __cplusplus
+}
+#endif
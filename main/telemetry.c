@@ -0,0 +1,351 @@
+/********************************************************
+	telemetry.c
+
+	Keeps the last TELEMWINDOW samples of every task's run time
+	counter and stack high water mark and the heap figures for
+	internal, SPIRAM and DMA capable memory, and works out from them
+
+		each task's CPU share over the window, as a part of one core,
+		and its busiest single sample period - a short burst that
+		starves the audio task shows there and not in the average
+		the least stack each task had left at any sample
+		free memory now and the lowest in the window, and how
+		fragmented it is (the part of free memory that is not in
+		the largest block)
+
+	telemetryAdd (t,sample)		adds a sample, dropping the oldest
+	telemetryReport (t,report)	the figures above
+	telemetryFormat (t,buf,len)	the report as Prometheus text for
+								/metrics
+	printTelemetry (t)			the report as a table for the console
+
+	Run time counters are 32 bits and wrap (about every 71 minutes
+	counting microseconds) so only differences between neighbouring
+	samples are used. Tasks are matched by task number as names can
+	repeat, a task only counts over the periods it was there for.
+
+	Samples are passed in so the figures can be checked on Linux,
+	telemetrySample fills one in from FreeRTOS and the heap on the
+	board. A mutex makes it safe to add from the main loop while the
+	web server reads
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#endif
+
+#include "telemetry.h"
+
+struct telemetry_s {
+	int window;
+	int count;
+	int next;							// where the next sample goes
+	telemetrySample_t *samples;
+	pthread_mutex_t mutex;
+};
+
+static const char *heapNames[TELEMHEAPS] = {"internal", "spiram", "dma"};
+
+telemetry_t *telemetryCreate (int window){
+	if (window < 2) window = 2;
+	telemetry_t *t = malloc (sizeof(telemetry_t));
+	if (!t) return NULL;
+	memset (t, 0, sizeof(telemetry_t));
+	t->samples = malloc (window * sizeof(telemetrySample_t));
+	if (!t->samples){
+		free (t);
+		return NULL;
+	}
+	t->window = window;
+	pthread_mutex_init (&t->mutex, NULL);
+	return t;
+}
+
+void telemetryFree (telemetry_t *t){
+	if (!t) return;
+	pthread_mutex_destroy (&t->mutex);
+	free (t->samples);
+	free (t);
+}
+
+void telemetryAdd (telemetry_t *t, const telemetrySample_t *s){
+	pthread_mutex_lock (&t->mutex);
+	t->samples[t->next] = *s;
+	if (t->samples[t->next].ntasks > TELEMTASKMAX) t->samples[t->next].ntasks = TELEMTASKMAX;
+	t->next = (t->next + 1) % t->window;
+	if (t->count < t->window) t->count++;
+	pthread_mutex_unlock (&t->mutex);
+}
+
+// sample n of the window, 0 is the oldest
+
+static telemetrySample_t *sampleAt (telemetry_t *t, int n){
+	return &t->samples[(t->next - t->count + n + t->window) % t->window];
+}
+
+static const telemetryTask_t *findTask (const telemetrySample_t *s, uint32_t id){
+	for (int i = 0;i < s->ntasks;i++){
+		if (s->task[i].id == id) return &s->task[i];
+	}
+	return NULL;
+}
+
+static int share (uint64_t part, uint64_t whole){
+	if (!whole) return 0;
+	uint64_t p = (part * 1000 + whole / 2) / whole;
+	return (p > 1000) ? 1000 : (int)p;
+}
+
+static int byCpu (const void *a, const void *b){
+	const telemetryTaskReport_t *x = a;
+	const telemetryTaskReport_t *y = b;
+	if (x->cpu != y->cpu) return y->cpu - x->cpu;
+	return (x->id < y->id) ? -1 : (x->id > y->id);
+}
+
+static void buildReport (telemetry_t *t, telemetryReport_t *r){
+
+	memset (r, 0, sizeof(telemetryReport_t));
+	r->samples = t->count;
+	if (!t->count) return;
+
+	telemetrySample_t *last = sampleAt (t, t->count - 1);
+	r->windowUs = last->timeUs - sampleAt (t, 0)->timeUs;
+	r->cores = last->cores ? last->cores : 1;
+
+	int idle = 0;
+	for (int i = 0;i < last->ntasks;i++){
+		const telemetryTask_t *task = &last->task[i];
+		telemetryTaskReport_t *tr = &r->task[r->ntasks++];
+		memcpy (tr->name, task->name, TELEMNAMELEN);
+		tr->name[TELEMNAMELEN - 1] = 0;
+		tr->id = task->id;
+		tr->priority = task->priority;
+		tr->stackFree = task->stackFree;
+
+		uint64_t ran = 0;
+		uint64_t elapsed = 0;
+		for (int n = 0;n < t->count;n++){
+			telemetrySample_t *s = sampleAt (t, n);
+			const telemetryTask_t *now = findTask (s, task->id);
+			if (!now) continue;
+			if (now->stackFree < tr->stackFree) tr->stackFree = now->stackFree;
+			if (!n) continue;
+			telemetrySample_t *prev = sampleAt (t, n - 1);
+			const telemetryTask_t *before = findTask (prev, task->id);
+			if (!before) continue;
+			uint32_t dt = s->runtime - prev->runtime;
+			uint32_t d = now->runtime - before->runtime;
+			ran += d;
+			elapsed += dt;
+			int peak = share (d, dt);
+			if (peak > tr->cpuPeak) tr->cpuPeak = peak;
+		}
+		tr->cpu = share (ran, elapsed);
+		if (!strncmp (tr->name, "IDLE", 4)) idle += tr->cpu;
+	}
+	int busy = r->cores * 1000 - idle;
+	r->cpuBusy = (busy < 0) ? 0 : busy / r->cores;
+	qsort (r->task, r->ntasks, sizeof(telemetryTaskReport_t), byCpu);
+
+	for (int h = 0;h < TELEMHEAPS;h++){
+		telemetryHeapReport_t *hr = &r->heap[h];
+		telemetryHeap_t *now = &last->heap[h];
+		hr->total = now->total;
+		hr->free = now->free;
+		hr->minFree = now->minFree;
+		hr->largest = now->largest;
+		hr->windowMinFree = now->free;
+		for (int n = 0;n < t->count;n++){
+			uint32_t f = sampleAt (t, n)->heap[h].free;
+			if (f < hr->windowMinFree) hr->windowMinFree = f;
+		}
+		hr->fragmentation = now->free ? 100 - (int)(((uint64_t)now->largest * 100) / now->free) : 0;
+	}
+}
+
+// returns the number of samples in the window
+
+int telemetryReport (telemetry_t *t, telemetryReport_t *r){
+	pthread_mutex_lock (&t->mutex);
+	buildReport (t, r);
+	pthread_mutex_unlock (&t->mutex);
+	return r->samples;
+}
+
+// Prometheus text format
+
+typedef struct {
+	char *buf;
+	int len;
+	int pos;							// may pass len, what it would have needed
+} textOut_t;
+
+static void out (textOut_t *o, const char *fmt, ...){
+	va_list args;
+	va_start (args, fmt);
+	int room = (o->pos < o->len) ? o->len - o->pos : 0;
+	int n = vsnprintf (room ? o->buf + o->pos : NULL, room, fmt, args);
+	va_end (args);
+	if (n > 0) o->pos += n;
+}
+
+static void metric (textOut_t *o, const char *name, const char *help){
+	out (o, "# HELP loco_%s %s\n# TYPE loco_%s gauge\n", name, help, name);
+}
+
+// label values escape \ and "
+
+static void labelValue (char *dst, const char *src){
+	while (*src){
+		if ((*src == '\\')||(*src == '"')) *dst++ = '\\';
+		*dst++ = *src++;
+	}
+	*dst = 0;
+}
+
+static void taskMetric (textOut_t *o, telemetryReport_t *r, const char *name, const char *help, int field){
+	char label[TELEMNAMELEN * 2];
+	metric (o, name, help);
+	for (int i = 0;i < r->ntasks;i++){
+		telemetryTaskReport_t *tr = &r->task[i];
+		labelValue (label, tr->name);
+		out (o, "loco_%s{task=\"%s\",id=\"%u\"} ", name, label, (unsigned)tr->id);
+		switch (field){
+			case 0: out (o, "%d.%d\n", tr->cpu / 10, tr->cpu % 10); break;
+			case 1: out (o, "%d.%d\n", tr->cpuPeak / 10, tr->cpuPeak % 10); break;
+			case 2: out (o, "%u\n", (unsigned)tr->stackFree); break;
+			case 3: out (o, "%d\n", tr->priority); break;
+		}
+	}
+}
+
+static void heapMetric (textOut_t *o, telemetryReport_t *r, const char *name, const char *help, int field){
+	metric (o, name, help);
+	for (int h = 0;h < TELEMHEAPS;h++){
+		telemetryHeapReport_t *hr = &r->heap[h];
+		uint32_t v = 0;
+		switch (field){
+			case 0: v = hr->total; break;
+			case 1: v = hr->free; break;
+			case 2: v = hr->windowMinFree; break;
+			case 3: v = hr->minFree; break;
+			case 4: v = hr->largest; break;
+			case 5: v = hr->fragmentation; break;
+		}
+		out (o, "loco_%s{caps=\"%s\"} %u\n", name, heapNames[h], (unsigned)v);
+	}
+}
+
+// returns the length of the text, if that is len or more it was cut short
+
+int telemetryFormat (telemetry_t *t, char *buf, int len){
+
+	telemetryReport_t *r = malloc (sizeof(telemetryReport_t));
+	if (!r) return -1;
+	telemetryReport (t, r);
+
+	textOut_t o = {buf, len, 0};
+	if (len) buf[0] = 0;
+
+	metric (&o, "telemetry_samples", "Samples in the window");
+	out (&o, "loco_telemetry_samples %d\n", r->samples);
+	metric (&o, "telemetry_window_seconds", "Time from the first sample in the window to the last");
+	out (&o, "loco_telemetry_window_seconds %d.%03d\n", (int)(r->windowUs / 1000000), (int)((r->windowUs / 1000) % 1000));
+	metric (&o, "cpu_busy_percent", "CPU use of all cores over the window, not counting the idle tasks");
+	out (&o, "loco_cpu_busy_percent %d.%d\n", r->cpuBusy / 10, r->cpuBusy % 10);
+
+	taskMetric (&o, r, "task_cpu_percent", "Task CPU use over the window, percent of one core", 0);
+	taskMetric (&o, r, "task_cpu_peak_percent", "Task CPU use in its busiest sample period, percent of one core", 1);
+	taskMetric (&o, r, "task_stack_free_bytes", "Least stack the task had left in the window", 2);
+	taskMetric (&o, r, "task_priority", "Task priority", 3);
+
+	heapMetric (&o, r, "heap_total_bytes", "Heap size", 0);
+	heapMetric (&o, r, "heap_free_bytes", "Free heap now", 1);
+	heapMetric (&o, r, "heap_window_min_free_bytes", "Least free heap in the window", 2);
+	heapMetric (&o, r, "heap_min_free_bytes", "Least free heap since boot", 3);
+	heapMetric (&o, r, "heap_largest_free_block_bytes", "Largest free block now", 4);
+	heapMetric (&o, r, "heap_fragmentation_percent", "Part of free heap not in the largest block", 5);
+
+	free (r);
+	return o.pos;
+}
+
+void printTelemetry (telemetry_t *t){
+
+	telemetryReport_t *r = malloc (sizeof(telemetryReport_t));
+	if (!r) return;
+	telemetryReport (t, r);
+
+	printf ("%d samples over %d s, %d cores %d.%d%% busy\n", r->samples,
+		(int)(r->windowUs / 1000000), r->cores, r->cpuBusy / 10, r->cpuBusy % 10);
+	printf ("  %-16s %4s %7s %7s %6s\n", "task", "prio", "cpu%", "peak%", "stack");
+	for (int i = 0;i < r->ntasks;i++){
+		telemetryTaskReport_t *tr = &r->task[i];
+		printf ("  %-16s %4d %5d.%d %5d.%d %6u\n", tr->name, tr->priority,
+			tr->cpu / 10, tr->cpu % 10, tr->cpuPeak / 10, tr->cpuPeak % 10, (unsigned)tr->stackFree);
+	}
+	printf ("  %-9s %9s %9s %9s %9s %9s %5s\n", "heap", "total", "free", "min(win)", "min", "largest", "frag%");
+	for (int h = 0;h < TELEMHEAPS;h++){
+		telemetryHeapReport_t *hr = &r->heap[h];
+		printf ("  %-9s %9u %9u %9u %9u %9u %5d\n", heapNames[h], (unsigned)hr->total,
+			(unsigned)hr->free, (unsigned)hr->windowMinFree, (unsigned)hr->minFree,
+			(unsigned)hr->largest, hr->fragmentation);
+	}
+	free (r);
+}
+
+#ifdef ESP_PLATFORM
+
+static const uint32_t heapCaps[TELEMHEAPS] = {
+	MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+	MALLOC_CAP_SPIRAM,
+	MALLOC_CAP_DMA,
+};
+
+// stack high water marks are in bytes as ESP-IDF stacks are
+
+void telemetrySample (telemetrySample_t *s){
+
+	memset (s, 0, sizeof(telemetrySample_t));
+	s->timeUs = esp_timer_get_time ();
+	s->cores = portNUM_PROCESSORS;
+
+	int n = uxTaskGetNumberOfTasks () + 4;			// room for a few starting meanwhile
+	TaskStatus_t *status = malloc (n * sizeof(TaskStatus_t));
+	if (status){
+		uint32_t total = 0;
+		n = uxTaskGetSystemState (status, n, &total);
+		s->runtime = total;
+		for (int i = 0;(i < n) && (s->ntasks < TELEMTASKMAX);i++){
+			telemetryTask_t *task = &s->task[s->ntasks++];
+			strncpy (task->name, status[i].pcTaskName, TELEMNAMELEN - 1);
+			task->id = status[i].xTaskNumber;
+			task->runtime = status[i].ulRunTimeCounter;
+			task->stackFree = status[i].usStackHighWaterMark;
+			task->priority = status[i].uxCurrentPriority;
+		}
+		free (status);
+	}
+
+	for (int h = 0;h < TELEMHEAPS;h++){
+		multi_heap_info_t info;
+		heap_caps_get_info (&info, heapCaps[h]);
+		s->heap[h].total = heap_caps_get_total_size (heapCaps[h]);
+		s->heap[h].free = info.total_free_bytes;
+		s->heap[h].minFree = info.minimum_free_bytes;
+		s->heap[h].largest = info.largest_free_block;
+	}
+}
+
+#endif
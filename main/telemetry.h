@@ -0,0 +1,94 @@
+/********************************************************
+	telemetry.h
+
+	Per task CPU and stack use and heap figures over a rolling window -
+	see telemetry.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define TELEMTASKMAX 32
+#define TELEMNAMELEN 16
+#define TELEMWINDOW 12					// samples kept
+#define TELEMPERIODMS 5000				// so about a minute
+
+// heap capabilities sampled
+#define TELEMINTERNAL 0
+#define TELEMSPIRAM 1
+#define TELEMDMA 2
+#define TELEMHEAPS 3
+
+typedef struct {
+	char name[TELEMNAMELEN];
+	uint32_t id;						// task number, names are not unique
+	uint32_t runtime;					// run time counter, may wrap
+	uint32_t stackFree;					// high water mark in bytes
+	int priority;
+} telemetryTask_t;
+
+typedef struct {
+	uint32_t total;
+	uint32_t free;
+	uint32_t minFree;					// since boot
+	uint32_t largest;					// largest free block
+} telemetryHeap_t;
+
+typedef struct {
+	int64_t timeUs;
+	uint32_t runtime;					// the run time counter's clock, same units
+	int cores;
+	int ntasks;
+	telemetryTask_t task[TELEMTASKMAX];
+	telemetryHeap_t heap[TELEMHEAPS];
+} telemetrySample_t;
+
+typedef struct {
+	char name[TELEMNAMELEN];
+	uint32_t id;
+	int priority;
+	int cpu;							// tenths of a percent of one core over the window
+	int cpuPeak;						// the busiest single sample period
+	uint32_t stackFree;					// lowest seen in the window
+} telemetryTaskReport_t;
+
+typedef struct {
+	uint32_t total;
+	uint32_t free;
+	uint32_t windowMinFree;				// lowest in the window
+	uint32_t minFree;					// since boot
+	uint32_t largest;
+	int fragmentation;					// percent of free memory not in the largest block
+} telemetryHeapReport_t;
+
+typedef struct {
+	int samples;
+	int64_t windowUs;
+	int cores;
+	int cpuBusy;						// tenths of a percent of all cores, not the idle tasks
+	int ntasks;
+	telemetryTaskReport_t task[TELEMTASKMAX];
+	telemetryHeapReport_t heap[TELEMHEAPS];
+} telemetryReport_t;
+
+typedef struct telemetry_s telemetry_t;
+
+telemetry_t *telemetryCreate (int window);
+void telemetryFree (telemetry_t *t);
+void telemetryAdd (telemetry_t *t, const telemetrySample_t *s);
+int telemetryReport (telemetry_t *t, telemetryReport_t *r);
+int telemetryFormat (telemetry_t *t, char *buf, int len);
+void printTelemetry (telemetry_t *t);
+
+#ifdef ESP_PLATFORM
+void telemetrySample (telemetrySample_t *s);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,125 @@
+/********************************************************
+	benchArtProbe.c
+
+	artThread used to decode every cover at 1/8 to find its size and
+	then decode it again at the scale it wanted. Now the scale is
+	picked from the header and the image is decoded once. This times
+	both over the covers in art/ and checks they give the same pixels
+
+		benchArtProbe <dir> [repeats]
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jpeg_decoder.h"
+#include "hostTest.h"
+
+#define OUTSIZE 100000					// IMAGESIZE in art.c
+
+static const char *covers[] = {"cover640.jpg", "cover300.jpg", "cover64.jpg"};
+
+// getArtScale in art.c
+
+static esp_jpeg_image_scale_t pickScale (uint16_t width, uint16_t height){
+	int h = height / 8;
+	if (h <= 37) return JPEG_IMAGE_SCALE_1_2;
+	if (h <= 75) return JPEG_IMAGE_SCALE_1_4;
+	return JPEG_IMAGE_SCALE_1_8;
+}
+
+static uint8_t *readFile (const char *dir, const char *name, int *len){
+	char path[512];
+	snprintf (path, sizeof(path), "%s/%s", dir, name);
+	FILE *f = fopen (path, "rb");
+	if (!f) return NULL;
+	fseek (f, 0, SEEK_END);
+	*len = ftell (f);
+	fseek (f, 0, SEEK_SET);
+	uint8_t *p = malloc (*len);
+	if (p && (fread (p, 1, *len, f) != (size_t)*len)){
+		free (p);
+		p = NULL;
+	}
+	fclose (f);
+	return p;
+}
+
+// the old artThread, decode at 1/8 then again if the image is small
+
+static int decodeTwice (uint8_t *jpg, int len, uint8_t *out, esp_jpeg_image_output_t *img){
+	esp_jpeg_image_cfg_t cfg = {
+		.indata = jpg,
+		.indata_size = len,
+		.outbuf = out,
+		.outbuf_size = OUTSIZE,
+		.out_format = JPEG_IMAGE_FORMAT_RGB565,
+		.out_scale = JPEG_IMAGE_SCALE_1_8,
+		.flags = {.swap_color_bytes = 1}};
+	int decodes = 1;
+	if (esp_jpeg_decode (&cfg, img)) return -1;
+	if (img->height <= 75){
+		cfg.out_scale = (img->height <= 37) ? JPEG_IMAGE_SCALE_1_2 : JPEG_IMAGE_SCALE_1_4;
+		if (esp_jpeg_decode (&cfg, img)) return -1;
+		decodes++;
+	}
+	return decodes;
+}
+
+static int decodeOnce (uint8_t *jpg, int len, uint8_t *out, esp_jpeg_image_output_t *img){
+	esp_jpeg_image_cfg_t cfg = {
+		.indata = jpg,
+		.indata_size = len,
+		.outbuf = out,
+		.outbuf_size = OUTSIZE,
+		.out_format = JPEG_IMAGE_FORMAT_RGB565,
+		.out_scale = JPEG_IMAGE_SCALE_1_8,
+		.scale_cb = pickScale,
+		.flags = {.swap_color_bytes = 1}};
+	return esp_jpeg_decode (&cfg, img) ? -1 : 1;
+}
+
+int main (int argc, char **argv){
+	const char *dir = (argc > 1) ? argv[1] : "art";
+	int repeats = (argc > 2) ? atoi (argv[2]) : 20;
+	static uint8_t twice[OUTSIZE], once[OUTSIZE];
+
+	printf ("%-14s %7s %9s %9s %9s %6s\n", "cover", "bytes", "probe us", "twice us", "once us", "saved");
+	for (int i = 0;i < (int)(sizeof(covers) / sizeof(covers[0]));i++){
+		int len;
+		uint8_t *jpg = readFile (dir, covers[i], &len);
+		CHECK (jpg != NULL);
+		if (!jpg) continue;
+
+		esp_jpeg_image_cfg_t cfg = {.indata = jpg, .indata_size = len};
+		esp_jpeg_image_output_t info, a, b;
+		int ok = 0, decodes = 0, decoded = 0;
+		int64_t t0 = testNs ();
+		for (int r = 0;r < repeats;r++) ok += (esp_jpeg_get_image_info (&cfg, &info) == ESP_OK);
+		int64_t t1 = testNs ();
+		for (int r = 0;r < repeats;r++) decodes = decodeTwice (jpg, len, twice, &a);
+		int64_t t2 = testNs ();
+		for (int r = 0;r < repeats;r++) decoded += (decodeOnce (jpg, len, once, &b) == 1);
+		int64_t t3 = testNs ();
+
+		CHECK (ok == repeats);
+		CHECK (decoded == repeats);
+		CHECK (decodes > 0);
+		CHECK (info.width && info.height);
+		CHECK ((a.width == b.width) && (a.height == b.height));
+		CHECK (a.subsampling == info.subsampling);
+		CHECK (!memcmp (twice, once, a.width * a.height * 2));
+
+		int64_t probe = (t1 - t0) / repeats / 1000;
+		int64_t two = (t2 - t1) / repeats / 1000;
+		int64_t one = (t3 - t2) / repeats / 1000;
+		printf ("%-14s %7d %9lld %9lld %9lld %5lld%%  %dx%d -> %dx%d, %d decodes before\n",
+			covers[i], len, (long long)probe, (long long)two, (long long)one,
+			two ? (long long)((two - one) * 100 / two) : 0LL,
+			info.width, info.height, b.width, b.height, decodes);
+		free (jpg);
+	}
+	return testResult ();
+}
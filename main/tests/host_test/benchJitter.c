@@ -0,0 +1,119 @@
+/********************************************************
+	benchJitter.c
+
+	The radio jitter buffer played against packet arrival traces
+	(jitterTraces.py makes them). Arrivals are written at their ms and
+	the player reads 10 ms every 10 ms, as pcmThread does, for a fixed
+	prebuffer and for the adaptive target over it, with the 1 MB ring
+	and 4 s cap locoBoard.c uses. For each it prints the time to the
+	first sound, the underruns, the silence while the stream still had
+	data to come and the target at the end
+
+		benchJitter trace.txt ...
+
+	With no stalls to cover the adaptive target must not start later
+	than the prebuffer alone, and over the traces it must leave fewer
+	underruns at prebuffer 0 than none at all
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jitterBuffer.h"
+#include "hostTest.h"
+
+#define RATE 176400						// 44.1k stereo 16 bit
+#define TICK (RATE / 100)				// bytes read every 10 ms
+#define RINGSIZE (1 << 20)				// RADIOBUFFERSIZE
+#define MAXMS 4000						// RADIOMAXMS
+#define ARRIVALSMAX 100000
+
+typedef struct {
+	int startupMs;
+	uint32_t underruns;
+	int silentMs;
+	int targetMs;
+} result_t;
+
+static int at[ARRIVALSMAX];
+static int len[ARRIVALSMAX];
+static int arrivals;
+
+static int readTrace (const char *path){
+	FILE *f = fopen (path, "r");
+	if (!f) return -1;
+	arrivals = 0;
+	while ((arrivals < ARRIVALSMAX) && (fscanf (f, "%d %d", &at[arrivals], &len[arrivals]) == 2)) arrivals++;
+	fclose (f);
+	return arrivals ? 0 : -1;
+}
+
+static result_t play (int prebufferMs, int maxMs){
+	static uint8_t ring[RINGSIZE];
+	static uint8_t piece[8192];
+	static uint8_t out[TICK];
+	result_t r = {-1, 0, 0, 0};
+
+	jitter_t *j = jitterCreate (ring, RINGSIZE, prebufferMs, maxMs);
+	jitterSetRate (j, RATE);
+	int next = 0;
+	int end = at[arrivals - 1] + 10000;
+	for (int ms = 0;ms < end;ms++){
+		while ((next < arrivals) && (at[next] <= ms)){
+			CHECK (jitterWrite (j, piece, len[next], ms * 1000LL) == len[next]);
+			next++;
+		}
+		if (ms % 10) continue;
+		int got = jitterRead (j, out, TICK, ms * 1000LL);
+		if (r.startupMs < 0){
+			if (got) r.startupMs = ms - at[0];
+			continue;
+		}
+		if ((got < TICK) && (next < arrivals)) r.silentMs += 10;
+	}
+
+	jitterStats_t st;
+	jitterGetStats (j, &st);
+	r.underruns = st.underruns;
+	r.targetMs = st.targetMs;
+	CHECK ((st.bytesOut <= st.bytesIn) && (st.targetMs <= MAXMS));
+	free (j);
+	return r;
+}
+
+int main (int argc, char **argv){
+	static const int prebuffers[] = {0, 250, 500, 1000, 2000};
+	int fixedUnderruns = 0, adaptiveUnderruns = 0;
+
+	CHECK (argc > 1);
+	for (int a = 1;a < argc;a++){
+		CHECK (readTrace (argv[a]) == 0);
+		if (arrivals <= 0) continue;
+		const char *name = strrchr (argv[a], '/') ? strrchr (argv[a], '/') + 1 : argv[a];
+		printf ("%-12s %9s %8s %9s %9s %8s %8s\n", name, "prebuffer", "mode", "startupMs", "underruns", "silentMs", "targetMs");
+		for (int p = 0;p < (int)(sizeof(prebuffers) / sizeof(prebuffers[0]));p++){
+			result_t fixed = play (prebuffers[p], prebuffers[p]);
+			result_t adaptive = play (prebuffers[p], MAXMS);
+			printf ("%-12s %9d %8s %9d %9u %8d %8d\n", "", prebuffers[p], "fixed",
+				fixed.startupMs, (unsigned)fixed.underruns, fixed.silentMs, fixed.targetMs);
+			printf ("%-12s %9d %8s %9d %9u %8d %8d\n", "", prebuffers[p], "adaptive",
+				adaptive.startupMs, (unsigned)adaptive.underruns, adaptive.silentMs, adaptive.targetMs);
+
+// the estimate has nothing to go on before the first arrivals, so the
+// start is the same and only what follows differs
+
+			CHECK ((fixed.startupMs >= 0) && (adaptive.startupMs == fixed.startupMs));
+			CHECK (adaptive.underruns <= fixed.underruns);
+			CHECK (adaptive.targetMs >= prebuffers[p]);
+			if (!p){
+				fixedUnderruns += fixed.underruns;
+				adaptiveUnderruns += adaptive.underruns;
+			}
+		}
+	}
+	printf ("prebuffer 0 over the traces: %d underruns fixed, %d adaptive\n", fixedUnderruns, adaptiveUnderruns);
+	CHECK (adaptiveUnderruns < fixedUnderruns);
+	return testResult ();
+}
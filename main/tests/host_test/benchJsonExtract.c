@@ -0,0 +1,145 @@
+/********************************************************
+	benchJsonExtract.c
+
+	Time and heap to pull name, uri and total out of a page of
+	Spotify playlists, 20 and 50 items as the API returns them, with
+	jsonExtract.c fed in 1 KB pieces as the http client hands them
+	over. malloc, realloc and free are counted (hostMalloc.c).
+
+	When cJSON is found in ESP-IDF (IDF_PATH) the same page is also
+	parsed whole with cJSON_Parse and the fields read from the tree,
+	as api.c did before, for the numbers to compare against
+
+		benchJsonExtract [repeats]
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsonExtract.h"
+#include "hostTest.h"
+#include "hostMalloc.h"
+#ifdef HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+#define PIECE 1024
+
+static char doc[128 * 1024];
+static int docLen;
+static int fields;
+
+// a page as /v1/me/playlists sends it, most of it never wanted
+
+static void makePage (int count){
+	int n = snprintf (doc, sizeof(doc), "{\n  \"href\" : \"https://api.spotify.com/v1/me/playlists?offset=0&limit=%d\",\n  \"items\" : [ ", count);
+	for (int i = 0;i < count;i++){
+		n += snprintf (doc + n, sizeof(doc) - n, "%s{\n    \"collaborative\" : false,\n"
+			"    \"description\" : \"A playlist of songs, number %d, with a description\",\n"
+			"    \"external_urls\" : {\n      \"spotify\" : \"https://open.spotify.com/playlist/37i9dQZF1DX%011d\"\n    },\n"
+			"    \"id\" : \"37i9dQZF1DX%011d\",\n"
+			"    \"images\" : [ {\n      \"height\" : 640,\n      \"url\" : \"https://i.scdn.co/image/ab67706f0000000%025d\",\n      \"width\" : 640\n    } ],\n"
+			"    \"name\" : \"Playlist %d\",\n"
+			"    \"owner\" : {\n      \"display_name\" : \"Spotify\",\n      \"id\" : \"spotify\",\n      \"type\" : \"user\"\n    },\n"
+			"    \"public\" : true,\n    \"snapshot_id\" : \"MTY5NjQ1NjAwMCwwMDAwMDAwMDAwMDAwMDAwMDAwMDAw\",\n"
+			"    \"tracks\" : {\n      \"href\" : \"https://api.spotify.com/v1/playlists/%d/tracks\",\n      \"total\" : %d\n    },\n"
+			"    \"type\" : \"playlist\",\n    \"uri\" : \"spotify:playlist:37i9dQZF1DX%011d\"\n  }",
+			i ? ", " : "", i, i, i, i, i, i, 20 + i, i);
+	}
+	n += snprintf (doc + n, sizeof(doc) - n, " ],\n  \"limit\" : %d,\n  \"next\" : null,\n  \"offset\" : 0,\n"
+		"  \"previous\" : null,\n  \"total\" : 200\n}", count);
+	docLen = n;
+}
+
+static void field (void *arg, int path, int item, int type, const char *value){
+	fields++;
+}
+
+static void extractPage (){
+	static const char *paths[] = {"total", "items[].name", "items[].uri"};
+	jsonExtract_t jx;
+	jsonExtractInit (&jx, paths, 3, field, NULL);
+	for (int i = 0;i < docLen;i += PIECE){
+		int n = (docLen - i < PIECE) ? docLen - i : PIECE;
+		jsonExtractFeed (&jx, doc + i, n);
+	}
+	CHECK (!jsonExtractEnd (&jx));
+}
+
+typedef struct {
+	int fields;
+	int calls;
+	int64_t peak;
+	double ns;
+} result_t;
+
+static result_t measure (void (*parse) (), int repeats){
+	result_t r;
+	hostMallocReset ();
+	int64_t live = hostMalloc.live;
+	fields = 0;
+	parse ();
+	r.fields = fields;
+	r.calls = hostMalloc.calls;
+	r.peak = hostMalloc.peak - live;
+	CHECK (hostMalloc.live == live);				// nothing leaked
+	int64_t t0 = testNs ();
+	for (int i = 0;i < repeats;i++) parse ();
+	r.ns = (double)(testNs () - t0) / repeats;
+	return r;
+}
+
+#ifdef HAVE_CJSON
+
+// as api.c was - the reply gathered whole, then a tree
+
+static void cJSONPage (){
+	char *reply = malloc (docLen + 1);
+	memcpy (reply, doc, docLen + 1);
+	cJSON *root = cJSON_Parse (reply);
+	cJSON *items = cJSON_GetObjectItem (root, "items");
+	cJSON *item;
+	cJSON_ArrayForEach (item, items){
+		if (cJSON_GetStringValue (cJSON_GetObjectItem (item, "name"))) fields++;
+		if (cJSON_GetStringValue (cJSON_GetObjectItem (item, "uri"))) fields++;
+	}
+	if (cJSON_IsNumber (cJSON_GetObjectItem (root, "total"))) fields++;
+	cJSON_Delete (root);
+	free (reply);
+}
+#endif
+
+int main (int argc, char **argv){
+	int repeats = (argc > 1) ? atoi (argv[1]) : 2000;
+	static const int counts[] = {20, 50};
+
+	hostMallocReset ();
+	void *volatile p = malloc (100);
+	free (p);
+	CHECK ((hostMalloc.calls == 1) && (hostMalloc.peak >= 100));	// the wrap is in place
+
+	printf ("%6s %6s %-12s %8s %10s %10s %8s  (jsonExtract_t %d bytes on the stack)\n", "items", "bytes", "", "mallocs",
+		"peak heap", "us", "MB/s", (int)sizeof(jsonExtract_t));
+	for (int i = 0;i < (int)(sizeof(counts) / sizeof(counts[0]));i++){
+		int n = counts[i];
+		makePage (n);
+		result_t x = measure (extractPage, repeats);
+		CHECK (x.fields == 2 * n + 1);
+		printf ("%6d %6d %-12s %8d %10lld %10.1f %8.1f\n", n, docLen, "jsonExtract", x.calls,
+			(long long)x.peak, x.ns / 1000, docLen * 1000.0 / x.ns);
+		CHECK ((x.calls == 0) && (x.peak == 0));
+#ifdef HAVE_CJSON
+		result_t c = measure (cJSONPage, repeats);
+		CHECK (c.fields == 2 * n + 1);
+		printf ("%6d %6d %-12s %8d %10lld %10.1f %8.1f\n", n, docLen, "cJSON", c.calls,
+			(long long)c.peak, c.ns / 1000, docLen * 1000.0 / c.ns);
+		CHECK (c.peak > docLen);
+#endif
+	}
+#ifndef HAVE_CJSON
+	printf ("cJSON not found, set IDF_PATH to compare\n");
+#endif
+	return testResult ();
+}
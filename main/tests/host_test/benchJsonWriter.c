@@ -0,0 +1,151 @@
+/********************************************************
+	benchJsonWriter.c
+
+	Heap and copying per response for a vTuner style list of
+	stations, at 10 to 1000 results, written by jsonWriter.c through
+	a JSONCHUNK buffer. malloc, realloc and free are wrapped at link
+	time so every allocation made on the way is counted (hostMalloc.c).
+
+	When cJSON is found in ESP-IDF (IDF_PATH) the same list is also
+	built as a tree and printed with cJSON_Print, as the handlers did
+	before, for the numbers to compare against
+
+		benchJsonWriter [repeats]
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsonWriter.h"
+#include "hostTest.h"
+#include "hostMalloc.h"
+#ifdef HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+#define CHUNK 512						// JSONCHUNK in web.c
+
+// the socket, httpd_resp_send copies what it is given
+
+static char sock[CHUNK];
+static int64_t sent;
+
+static int sendChunk (void *arg, const char *buf, int len){
+	while (len > 0){
+		int n = (len < CHUNK) ? len : CHUNK;
+		memcpy (sock, buf, n);
+		buf += n;
+		len -= n;
+		sent += n;
+	}
+	return 0;
+}
+
+static void station (int i, char *name, char *url, char *logo){
+	sprintf (name, "Station %d - the best music all day", i);
+	sprintf (url, "http://vtuner.example.com/setupapp/loco/asp/func/dynamOD.asp?id=%d", i);
+	sprintf (logo, "http://logos.example.com/%d.png", i);
+}
+
+typedef struct {
+	int calls;
+	int64_t peak;
+	int64_t copied;
+	int64_t bytes;
+	double ns;
+} result_t;
+
+static void writerList (int count){
+	char buf[CHUNK];
+	jsonWriter_t w;
+	jsonInit (&w, buf, CHUNK, sendChunk, NULL);
+	jsonArrayStart (&w, NULL);
+	for (int i = 0;i < count;i++){
+		char name[64], url[128], logo[64];
+		station (i, name, url, logo);
+		jsonObjectStart (&w, NULL);
+		jsonString (&w, "name", name);
+		jsonString (&w, "url", url);
+		jsonString (&w, "logo", logo);
+		jsonNumber (&w, "id", i);
+		jsonObjectEnd (&w);
+	}
+	jsonArrayEnd (&w);
+	CHECK (!jsonEnd (&w));
+}
+
+static result_t measure (void (*list) (int), int count, int repeats){
+	result_t r;
+	hostMallocReset ();
+	int64_t live = hostMalloc.live;
+	sent = 0;
+	list (count);
+	r.calls = hostMalloc.calls;
+	r.peak = hostMalloc.peak - live;
+	r.bytes = sent;
+	CHECK (hostMalloc.live == live);				// nothing leaked
+	int64_t t0 = testNs ();
+	for (int i = 0;i < repeats;i++) list (count);
+	r.ns = (double)(testNs () - t0) / repeats;
+	return r;
+}
+
+#ifdef HAVE_CJSON
+
+// as the handlers were - a tree, cJSON_Print, one send
+
+static int64_t printed;
+
+static void cJSONList (int count){
+	cJSON *list = cJSON_CreateArray ();
+	for (int i = 0;i < count;i++){
+		char name[64], url[128], logo[64];
+		station (i, name, url, logo);
+		cJSON *s = cJSON_CreateObject ();
+		cJSON_AddStringToObject (s, "name", name);
+		cJSON_AddStringToObject (s, "url", url);
+		cJSON_AddStringToObject (s, "logo", logo);
+		cJSON_AddNumberToObject (s, "id", i);
+		cJSON_AddItemToArray (list, s);
+	}
+	char *text = cJSON_Print (list);
+	int len = strlen (text);
+	printed = len;
+	sendChunk (NULL, text, len);
+	cJSON_free (text);
+	cJSON_Delete (list);
+}
+#endif
+
+int main (int argc, char **argv){
+	int repeats = (argc > 1) ? atoi (argv[1]) : 200;
+	static const int counts[] = {10, 100, 1000};
+
+	hostMallocReset ();
+	void *volatile p = malloc (100);
+	free (p);
+	CHECK ((hostMalloc.calls == 1) && (hostMalloc.peak >= 100));	// the wrap is in place
+
+	printf ("%6s %-10s %8s %10s %10s %10s %10s\n", "items", "", "mallocs", "peak heap", "bytes out", "copied", "us");
+	for (int i = 0;i < (int)(sizeof(counts) / sizeof(counts[0]));i++){
+		int n = counts[i];
+		result_t w = measure (writerList, n, repeats);
+		w.copied = 2 * w.bytes;						// into the buffer, then to the socket
+		printf ("%6d %-10s %8d %10lld %10lld %10lld %10.1f\n", n, "jsonWriter", w.calls,
+			(long long)w.peak, (long long)w.bytes, (long long)w.copied, w.ns / 1000);
+		CHECK ((w.calls == 0) && (w.peak == 0));
+#ifdef HAVE_CJSON
+		result_t c = measure (cJSONList, n, repeats);
+		c.copied = printed + c.bytes;				// printed into the string, then sent
+		printf ("%6d %-10s %8d %10lld %10lld %10lld %10.1f\n", n, "cJSON", c.calls,
+			(long long)c.peak, (long long)c.bytes, (long long)c.copied, c.ns / 1000);
+		CHECK (c.calls > n);
+#endif
+	}
+#ifndef HAVE_CJSON
+	printf ("cJSON not found, set IDF_PATH to compare\n");
+#endif
+	return testResult ();
+}
@@ -0,0 +1,158 @@
+/********************************************************
+	benchPage.c
+
+	Transfer size and handler time of a cold and a warm load of the
+	web page, from the assets pagePack.py makes of locoPage.cpp, as
+	against the single uncompressed page sent before. A browser is
+	played - it asks for /, then for the css and js the html names,
+	and on a warm load sends the ETags it has and takes the hashed
+	css and js from its cache
+
+	The handlers in web.c need esp_http_server, here a send is a copy
+	into a socket buffer, which is most of what httpd_resp_send costs
+
+		benchPage locoPage.cpp [loads]
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "webPage.h"
+#include "hostTest.h"
+
+#define SOCKETBUFFER (64 * 1024)
+
+static char sock[SOCKETBUFFER];
+static int sent;
+
+static void send (const void *data, int len){
+	while (len > 0){
+		int n = (len < SOCKETBUFFER) ? len : SOCKETBUFFER;
+		memcpy (sock, data, n);
+		data = (const char *)data + n;
+		len -= n;
+		sent += n;
+	}
+}
+
+// sendWebAsset less the headers, returns 1 for a 304
+
+static int serve (const char *uri, const char *ifNoneMatch){
+	const webAsset_t *a = findWebAsset (uri);
+	if (!a) return -1;
+	if (webAssetMatches (a, ifNoneMatch)) return 1;
+	send (a->data, a->len);
+	return 0;
+}
+
+static char *readPage (const char *path){
+	FILE *f = fopen (path, "rb");
+	if (!f) return NULL;
+	static char source[256 * 1024];
+	size_t n = fread (source, 1, sizeof(source) - 1, f);
+	fclose (f);
+	source[n] = 0;
+	char *start = strstr (source, "R\"***(");
+	char *end = strstr (source, ")***\"");
+	if (!start || !end) return NULL;
+	*end = 0;
+	return start + 6;
+}
+
+static int gunzip (const webAsset_t *a, char *out, int max){
+	z_stream z;
+	memset (&z, 0, sizeof(z));
+	if (inflateInit2 (&z, 16 + MAX_WBITS) != Z_OK) return -1;
+	z.next_in = (Bytef *)a->data;
+	z.avail_in = a->len;
+	z.next_out = (Bytef *)out;
+	z.avail_out = max - 1;
+	int r = inflate (&z, Z_FINISH);
+	int n = max - 1 - z.avail_out;
+	inflateEnd (&z);
+	if (r != Z_STREAM_END) return -1;
+	out[n] = 0;
+	return n;
+}
+
+// the href or src after key in html, into uri
+
+static int findRef (const char *html, const char *key, char *uri, int max){
+	const char *p = strstr (html, key);
+	if (!p) return 0;
+	p += strlen (key);
+	int n = strcspn (p, "\"");
+	if (n >= max) return 0;
+	memcpy (uri, p, n);
+	uri[n] = 0;
+	return 1;
+}
+
+int main (int argc, char **argv){
+	const char *path = (argc > 1) ? argv[1] : "../../locoPage.cpp";
+	int loads = (argc > 2) ? atoi (argv[2]) : 10000;
+	char *mainPage = readPage (path);
+	CHECK (mainPage != NULL);
+	if (!mainPage) return testResult ();
+
+	const webAsset_t *page = findWebAsset ("/");
+	CHECK (page != NULL);
+	CHECK (findWebAsset ("/?x=1") == page);
+	CHECK (findWebAsset ("/assets/none.js") == NULL);
+
+// the html names the css and js, which unpack to what they hash to
+
+	static char html[64 * 1024];
+	CHECK (gunzip (page, html, sizeof(html)) == page->rawLen);
+	char css[64], js[64];
+	CHECK (findRef (html, "<link rel=\"stylesheet\" href=\"", css, sizeof(css)));
+	CHECK (findRef (html, "<script src=\"", js, sizeof(js)));
+	CHECK (findWebAsset (css) && findWebAsset (js));
+	int total = 0, raw = 0;
+	for (int n = 0;n < webAssetCount;n++){
+		static char unpacked[256 * 1024];
+		CHECK (gunzip (&webAssets[n], unpacked, sizeof(unpacked)) == webAssets[n].rawLen);
+		total += webAssets[n].len;
+		raw += webAssets[n].rawLen;
+		printf ("%-34s %6d bytes %6d gzipped  %s\n", webAssets[n].uri, webAssets[n].rawLen,
+			webAssets[n].len, webAssets[n].cacheControl);
+	}
+
+// before - every load sent the whole page
+
+	sent = 0;
+	int64_t t0 = testNs ();
+	for (int i = 0;i < loads;i++) send (mainPage, strlen (mainPage));
+	int64_t t1 = testNs ();
+	int beforeBytes = sent / loads;
+
+	sent = 0;
+	int misses = 0;
+	for (int i = 0;i < loads;i++){
+		if (serve ("/", NULL)) misses++;
+		if (serve (css, NULL)) misses++;
+		if (serve (js, NULL)) misses++;
+	}
+	int64_t t2 = testNs ();
+	int coldBytes = sent / loads;
+
+	sent = 0;
+	int notModified = 0;
+	for (int i = 0;i < loads;i++) notModified += serve ("/", page->etag);
+	int64_t t3 = testNs ();
+	int warmBytes = sent / loads;
+
+	printf ("before: %d bytes, %.2f us per load\n", beforeBytes, (double)(t1 - t0) / loads / 1000);
+	printf ("cold:   %d bytes in 3 requests, %.2f us per load\n", coldBytes, (double)(t2 - t1) / loads / 1000);
+	printf ("warm:   %d bytes, one 304, %.2f us per load\n", warmBytes, (double)(t3 - t2) / loads / 1000);
+
+	CHECK (misses == 0);
+	CHECK (coldBytes == total);
+	CHECK (coldBytes * 3 < beforeBytes);
+	CHECK ((warmBytes == 0) && (notModified == loads));
+	CHECK (raw > total);
+	return testResult ();
+}
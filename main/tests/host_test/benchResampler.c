@@ -0,0 +1,70 @@
+/********************************************************
+	benchResampler.c
+
+	Time per output frame of the resampler from the rates streams
+	come in at to 44.1k, in ns and, on x86, TSC cycles
+
+		benchResampler [seconds of audio]
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define cycles() __rdtsc ()
+#else
+#define cycles() 0ULL
+#endif
+
+#include "resampler.h"
+#include "hostTest.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define OUTRATE 44100
+
+int main (int argc, char **argv){
+	static const int rates[] = {48000, 32000, 22050, 96000, 8000};
+	int seconds = (argc > 1) ? atoi (argv[1]) : 10;
+
+	printf ("%7s %10s %12s %10s\n", "in rate", "ns/frame", "cycles/frame", "x realtime");
+	for (int i = 0;i < (int)(sizeof(rates) / sizeof(rates[0]));i++){
+		int rate = rates[i];
+		int frames = rate;						// one second, played round
+		uint32_t *in = malloc (frames * sizeof(uint32_t));
+		for (int k = 0;k < frames;k++){
+			int16_t l = lrint (16000 * sin (2 * M_PI * 1000.0 * k / rate));
+			in[k] = (uint16_t)l | ((uint32_t)(uint16_t)l << 16);
+		}
+		uint32_t out[256];
+		resampler_t *r = resamplerCreate (rate, OUTRATE);
+
+		int64_t produced = 0;
+		int64_t t0 = testNs ();
+		uint64_t c0 = cycles ();
+		for (int s = 0;s < seconds;s++){
+			int offset = 0;
+			while (offset < frames){
+				int used;
+				int n = (frames - offset < 1152) ? frames - offset : 1152;
+				produced += resamplerProcess (r, in + offset, n, &used, out, 256);
+				offset += used;
+			}
+		}
+		uint64_t c1 = cycles ();
+		int64_t t1 = testNs ();
+
+		double ns = (double)(t1 - t0) / produced;
+		printf ("%7d %10.1f %12.1f %10.0f\n", rate, ns, (double)(c1 - c0) / produced,
+			1e9 / (ns * OUTRATE));
+		CHECK (produced >= ((int64_t)seconds * frames - 1100) * OUTRATE / rate);	// less the history
+		resamplerDelete (r);
+		free (in);
+	}
+	return testResult ();
+}
@@ -0,0 +1,303 @@
+/********************************************************
+	benchStatus.c
+
+	What the web page costs the board, before and after /getStatus
+	was versioned. web.c needs esp_http_server, cJSON and libloco so
+	it cannot be built here, this harness writes the same documents
+	with jsonWriter.c from a made up player and replays an hour of a
+	page left open
+
+		before	the page polls every second and gets the whole
+				status with every favourite and playlist name, pretty
+				printed as cJSON_Print did
+		after	the page long polls. The status is sent when its
+				version moves, a 304 when the wait times out, and the
+				lists only when their versions move
+
+	Bytes are response bodies, handler time is for building and
+	writing them (the old cJSON tree build and free is not counted,
+	so the before figure is low)
+
+		benchStatus [minutes]
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsonWriter.h"
+#include "hostTest.h"
+
+#define FAVOURITES 40
+#define PLAYLISTS 80
+#define TRACKSECONDS 210
+#define STATUSWAITS 20					// STATUSWAITMS
+#define CHUNK 1024						// JSONCHUNK
+
+typedef struct {
+	char track[64];
+	char album[64];
+	char artist[64];
+	char art[96];
+	int playing;
+	char breadcrumbs[64];
+	int statusVersion;
+	int favouritesVersion;
+	int playlistsVersion;
+} player_t;
+
+static player_t player;
+static char favourites[FAVOURITES][3][96];
+static char playlists[PLAYLISTS][48];
+
+static char out[256 * 1024];
+static int outLen;
+
+static int collect (void *arg, const char *buf, int len){
+	if (outLen + len > (int)sizeof(out)) return 1;
+	memcpy (out + outLen, buf, len);
+	outLen += len;
+	return 0;
+}
+
+static void fakeLists (){
+	for (int n = 0;n < FAVOURITES;n++){
+		snprintf (favourites[n][0], 96, "Favourite Radio Station %d", n);
+		snprintf (favourites[n][1], 96, "http://stream.example.com/radio/station%d/stream.mp3", n);
+		snprintf (favourites[n][2], 96, "http://logos.example.com/%d.png", n);
+	}
+	for (int n = 0;n < PLAYLISTS;n++) snprintf (playlists[n], 48, "Playlist number %d with a name", n);
+}
+
+static void newTrack (int n){
+	snprintf (player.track, 64, "Track %d from the album", n);
+	snprintf (player.album, 64, "An album of %d tracks", n / 10);
+	snprintf (player.artist, 64, "Artist %d", n / 10);
+	snprintf (player.art, 96, "https://i.scdn.co/image/ab67616d0000b273%024d", n / 10);
+	player.statusVersion++;
+}
+
+static void writeStatus (jsonWriter_t *w, int versions){
+	jsonString (w, "version", "Oct 17 2026 12:00:00");
+	if (versions){
+		jsonNumber (w, "statusVersion", player.statusVersion);
+		jsonNumber (w, "favouritesVersion", player.favouritesVersion);
+		jsonNumber (w, "playlistsVersion", player.playlistsVersion);
+	}
+	jsonString (w, "source", "Spotify");
+	jsonString (w, "track", player.track);
+	jsonString (w, "album", player.album);
+	jsonString (w, "artist", player.artist);
+	jsonString (w, "art", player.art);
+	jsonString (w, "playing", player.playing ? "true" : "false");
+	jsonString (w, "breadcrumbs", player.breadcrumbs);
+}
+
+static void writeFavourites (jsonWriter_t *w, const char *key){
+	jsonArrayStart (w, key);
+	for (int n = 0;n < FAVOURITES;n++){
+		jsonObjectStart (w, NULL);
+		jsonString (w, "name", favourites[n][0]);
+		jsonString (w, "url", favourites[n][1]);
+		jsonString (w, "logo", favourites[n][2]);
+		jsonObjectEnd (w);
+	}
+	jsonArrayEnd (w);
+}
+
+static void writePlaylists (jsonWriter_t *w, const char *key){
+	jsonArrayStart (w, key);
+	for (int n = 0;n < PLAYLISTS;n++) jsonString (w, NULL, playlists[n]);
+	jsonArrayEnd (w);
+}
+
+// compact json laid out as cJSON_Print does - objects a member a line
+// indented by tabs, a tab after the colon, array items after ", "
+
+static int pretty (const char *s, int len, char *p){
+	char stack[JSONMAXDEPTH];
+	int depth = 0, n = 0, inString = 0;
+	for (int i = 0;i < len;i++){
+		char c = s[i];
+		if (inString){
+			p[n++] = c;
+			if (c == '\\') p[n++] = s[++i];
+			else if (c == '"') inString = 0;
+			continue;
+		}
+		if (c == '"') inString = 1;
+		if ((c == '}')||(c == ']')){
+			depth--;
+			if (c == '}'){
+				p[n++] = '\n';
+				for (int d = 0;d < depth;d++) p[n++] = '\t';
+			}
+		}
+		p[n++] = c;
+		if ((c == '{')||(c == '[')){
+			stack[depth++] = c;
+			if (c == '{'){
+				p[n++] = '\n';
+				for (int d = 0;d < depth;d++) p[n++] = '\t';
+			}
+		}
+		else if (c == ':') p[n++] = '\t';
+		else if (c == ','){
+			if (stack[depth - 1] == '{'){
+				p[n++] = '\n';
+				for (int d = 0;d < depth;d++) p[n++] = '\t';
+			}
+			else p[n++] = ' ';
+		}
+	}
+	return n;
+}
+
+// one response of each kind, returns the body bytes
+
+static int beforeStatus (){
+	static char printed[512 * 1024];
+	char buf[CHUNK];
+	jsonWriter_t w;
+	outLen = 0;
+	jsonInit (&w, buf, CHUNK, collect, NULL);
+	jsonObjectStart (&w, NULL);
+	writeStatus (&w, 0);
+	writeFavourites (&w, "favourites");
+	writePlaylists (&w, "playlists");
+	jsonObjectEnd (&w);
+	CHECK (!jsonEnd (&w));
+	return pretty (out, outLen, printed);
+}
+
+static int afterStatus (){
+	char buf[CHUNK];
+	jsonWriter_t w;
+	outLen = 0;
+	jsonInit (&w, buf, CHUNK, collect, NULL);
+	jsonObjectStart (&w, NULL);
+	writeStatus (&w, 1);
+	jsonObjectEnd (&w);
+	CHECK (!jsonEnd (&w));
+	return w.total;
+}
+
+static int afterList (int favs){
+	char buf[CHUNK];
+	jsonWriter_t w;
+	outLen = 0;
+	jsonInit (&w, buf, CHUNK, collect, NULL);
+	if (favs) writeFavourites (&w, NULL);
+	else writePlaylists (&w, NULL);
+	CHECK (!jsonEnd (&w));
+	return w.total;
+}
+
+// the fingerprint every request and parked poll works out, as web.c
+
+static uint32_t statusHash (uint32_t h, char *s){
+	while (*s){
+		h ^= (uint8_t)*s++;
+		h *= 16777619;
+	}
+	h ^= 0xFF;
+	h *= 16777619;
+	return h;
+}
+
+static uint32_t fingerprint (){
+	uint32_t h = 2166136261;
+	h = statusHash (h, "Spotify");
+	h = statusHash (h, player.track);
+	h = statusHash (h, player.album);
+	h = statusHash (h, player.artist);
+	h = statusHash (h, player.art);
+	h = statusHash (h, player.playing ? "true" : "false");
+	return statusHash (h, player.breadcrumbs);
+}
+
+// an hour of listening - a new track every TRACKSECONDS, a pause, a
+// favourite added
+
+static void session (int seconds, int64_t *before, int64_t *after, int *responses){
+	player.statusVersion = player.favouritesVersion = player.playlistsVersion = 1;
+	player.playing = 1;
+	strcpy (player.breadcrumbs, "Home > Playlists");
+	newTrack (0);
+
+	int waitingSince = 0;
+	int seenVersion = 0;
+	*before = *after = 0;
+	responses[0] = responses[1] = 0;
+
+	*after += afterList (1) + afterList (0);			// page load
+	for (int t = 0;t < seconds;t++){
+		if (t && !(t % TRACKSECONDS)) newTrack (t / TRACKSECONDS);
+		if ((t == seconds / 3)||(t == seconds / 3 + 300)){
+			player.playing = !player.playing;
+			player.statusVersion++;
+		}
+		if (t == seconds / 2){
+			player.favouritesVersion++;
+			player.statusVersion++;
+			*after += afterList (1);
+		}
+
+		*before += beforeStatus ();
+		responses[0]++;
+
+		if (player.statusVersion != seenVersion){
+			*after += afterStatus ();
+			seenVersion = player.statusVersion;
+			waitingSince = t;
+			responses[1]++;
+		}
+		else if (t - waitingSince >= STATUSWAITS){		// 304, no body
+			waitingSince = t;
+			responses[1]++;
+		}
+	}
+}
+
+int main (int argc, char **argv){
+	int minutes = (argc > 1) ? atoi (argv[1]) : 60;
+	int seconds = minutes * 60;
+	fakeLists ();
+
+	int64_t before, after;
+	int responses[2];
+	session (seconds, &before, &after, responses);
+
+// handler time per response
+
+	int repeats = 2000;
+	int64_t t0 = testNs ();
+	for (int i = 0;i < repeats;i++) beforeStatus ();
+	int64_t t1 = testNs ();
+	for (int i = 0;i < repeats;i++){
+		fingerprint ();
+		afterStatus ();
+	}
+	int64_t t2 = testNs ();
+	for (int i = 0;i < repeats;i++) fingerprint ();
+	int64_t t3 = testNs ();
+
+	double nsBefore = (double)(t1 - t0) / repeats;
+	double nsAfter = (double)(t2 - t1) / repeats;
+	double nsCheck = (double)(t3 - t2) / repeats;
+	int changed = player.statusVersion;
+	double perSecondBefore = nsBefore * responses[0] / seconds;
+	double perSecondAfter = (nsAfter * changed + nsCheck * seconds * 1000 / 250) / seconds;	// STATUSPOLLMS
+
+	printf ("%d minutes, %d favourites, %d playlists\n", minutes, FAVOURITES, PLAYLISTS);
+	printf ("before: %d responses, %lld bytes, %.0f bytes/s, %.1f us per response, %.1f us/s\n",
+		responses[0], (long long)before, (double)before / seconds, nsBefore / 1000, perSecondBefore / 1000);
+	printf ("after:  %d responses, %lld bytes, %.0f bytes/s, %.1f us per status, %.2f us per check, %.1f us/s\n",
+		responses[1], (long long)after, (double)after / seconds, nsAfter / 1000, nsCheck / 1000, perSecondAfter / 1000);
+
+	CHECK (after * 20 < before);
+	CHECK (perSecondAfter < perSecondBefore);
+	CHECK (responses[1] < responses[0] / 10);
+	return testResult ();
+}
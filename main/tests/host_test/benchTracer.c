@@ -0,0 +1,45 @@
+/********************************************************
+	benchTracer.c
+
+	What a trace record costs, recording and paused. On Linux the
+	trace clock is clock_gettime, so its own cost is timed too and
+	taken off - on the board it is a read of the cycle counter and a
+	record is about the atomic add and an 8 byte store
+
+		benchTracer [records]
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracer.h"
+#include "hostTest.h"
+
+int main (int argc, char **argv){
+	int n = (argc > 1) ? atoi (argv[1]) : 10000000;
+	CHECK (tracerInit (TRACERECORDS) == 0);
+
+	volatile uint32_t sink = 0;
+	int64_t t0 = testNs ();
+	for (int i = 0;i < n;i++) sink += traceClock ();
+	int64_t t1 = testNs ();
+	for (int i = 0;i < n;i++) traceCounter (TRACEPCMFILL, i);
+	int64_t t2 = testNs ();
+	tracerPause ();
+	for (int i = 0;i < n;i++) traceCounter (TRACEPCMFILL, i);
+	int64_t t3 = testNs ();
+
+	double clock = (double)(t1 - t0) / n;
+	double record = (double)(t2 - t1) / n;
+	double paused = (double)(t3 - t2) / n;
+	printf ("%d records: clock %.1f ns, record %.1f ns (%.1f ns less the clock), paused %.2f ns\n",
+		n, clock, record, record - clock, paused);
+
+	uint32_t head = atomic_load (&traceRings[0].head);
+	CHECK (head == (uint32_t)n);						// none while paused
+	CHECK (traceRings[0].rec[(head - 1) & (TRACERECORDS - 1)].value == ((n - 1 > 32767) ? 32767 : n - 1));
+	CHECK (paused < record);
+	return testResult ();
+}
@@ -0,0 +1,57 @@
+/********************************************************
+	hostMalloc.c
+
+	The wrapped malloc, realloc and free for hostMalloc.h, each
+	block carries its size in front
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "hostMalloc.h"
+
+volatile hostMalloc_t hostMalloc;
+
+void *__real_malloc (size_t size);
+void *__real_realloc (void *p, size_t size);
+void __real_free (void *p);
+
+static void grow (int64_t bytes){
+	hostMalloc.calls++;
+	hostMalloc.live += bytes;
+	if (hostMalloc.live > hostMalloc.peak) hostMalloc.peak = hostMalloc.live;
+}
+
+void *__wrap_malloc (size_t size){
+	size_t *p = __real_malloc (size + sizeof(size_t));
+	if (!p) return NULL;
+	*p = size;
+	grow (size);
+	return p + 1;
+}
+
+void __wrap_free (void *q){
+	if (!q) return;
+	size_t *p = (size_t *)q - 1;
+	hostMalloc.live -= *p;
+	__real_free (p);
+}
+
+void *__wrap_realloc (void *q, size_t size){
+	if (!q) return __wrap_malloc (size);
+	size_t *p = (size_t *)q - 1;
+	int64_t old = *p;
+	p = __real_realloc (p, size + sizeof(size_t));
+	if (!p) return NULL;
+	*p = size;
+	grow ((int64_t)size - old);
+	return p + 1;
+}
+
+// peak is measured from here
+
+void hostMallocReset (){
+	hostMalloc.calls = 0;
+	hostMalloc.peak = hostMalloc.live;
+}
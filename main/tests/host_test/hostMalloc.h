@@ -0,0 +1,22 @@
+/********************************************************
+	hostMalloc.h
+
+	Counts malloc, realloc and free in a benchmark. CMake's
+	loco_count_malloc wraps them at link time with hostMalloc.c so
+	every allocation, libc's own aside, is seen
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+	int calls;							// malloc and realloc
+	int64_t live;						// bytes
+	int64_t peak;
+} hostMalloc_t;
+
+// volatile as the compiler assumes malloc leaves globals alone
+extern volatile hostMalloc_t hostMalloc;
+
+void hostMallocReset ();
@@ -0,0 +1,34 @@
+/********************************************************
+	hostTest.h
+
+	CHECK (condition) in a host test prints the line if it fails and
+	carries on, testResult () at the end of main gives ctest the exit
+	code. testNs () is a monotonic clock for the benchmarks
+
+*********************************************************/
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+static int testFailures = 0;
+
+#define CHECK(c) do { \
+		if (!(c)){ \
+			printf ("FAIL %s:%d %s\n", __FILE__, __LINE__, #c); \
+			testFailures++; \
+		} \
+	} while (0)
+
+static inline int testResult (){
+	if (testFailures) printf ("%d checks failed\n", testFailures);
+	else printf ("ok\n");
+	return testFailures ? 1 : 0;
+}
+
+static inline int64_t testNs (){
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
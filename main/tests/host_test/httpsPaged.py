@@ -0,0 +1,103 @@
+"""
+httpsPaged.py
+
+Stand-in for the Spotify API when timing httpPool on the host. Serves
+pages of a playlist list over HTTPS on localhost and fetches them as
+api.c does, first with a new connection and TLS handshake per page as
+before httpPool, then over one kept-alive connection
+
+	httpsPaged.py [pages]
+
+The certificate is made with openssl in a temporary directory. Only the
+handshake and round trips are measured, localhost has no latency so on
+the board, with 50-100 ms to the API, the gap is much larger
+"""
+
+import http.client
+import http.server
+import json
+import os
+import socket
+import ssl
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+
+class PagedHandler(http.server.BaseHTTPRequestHandler):
+	protocol_version = "HTTP/1.1"
+
+	def setup(self):
+		super().setup()
+		self.connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+	def do_GET(self):
+		body = json.dumps({"items": [{"name": "Playlist %d" % i, "uri": "spotify:playlist:%d" % i}
+			for i in range(20)], "total": 200}).encode()
+		self.send_response(200)
+		self.send_header("Content-Length", str(len(body)))
+		self.end_headers()
+		self.wfile.write(body)
+
+	def log_message(self, *args):
+		pass
+
+
+def makeCertificate(directory):
+	cert = os.path.join(directory, "c.pem")
+	key = os.path.join(directory, "k.pem")
+	subprocess.run(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "1",
+		"-subj", "/CN=localhost", "-keyout", key, "-out", cert],
+		check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+	return cert, key
+
+
+def fetch(connection, page):
+	connection.request("GET", "/v1/me/playlists?limit=20&offset=%d" % (page * 20))
+	response = connection.getresponse()
+	body = response.read()
+	return response.status == 200 and len(json.loads(body)["items"]) == 20
+
+
+def main():
+	pages = int(sys.argv[1]) if len(sys.argv) > 1 else 50
+
+	with tempfile.TemporaryDirectory() as directory:
+		cert, key = makeCertificate(directory)
+		server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), PagedHandler)
+		context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+		context.load_cert_chain(cert, key)
+		server.socket = context.wrap_socket(server.socket, server_side=True)
+		threading.Thread(target=server.serve_forever, daemon=True).start()
+
+	port = server.server_address[1]
+	client = ssl.create_default_context()
+	client.check_hostname = False
+	client.verify_mode = ssl.CERT_NONE
+
+	ok = True
+	t = time.time()
+	for page in range(pages):
+		connection = http.client.HTTPSConnection("127.0.0.1", port, context=client)
+		ok &= fetch(connection, page)
+		connection.close()
+	fresh = (time.time() - t) / pages
+
+	connection = http.client.HTTPSConnection("127.0.0.1", port, context=client)
+	t = time.time()
+	for page in range(pages):
+		ok &= fetch(connection, page)
+	kept = (time.time() - t) / pages
+	connection.close()
+	server.shutdown()
+
+	print("%d pages, new connection %.2f ms, kept alive %.2f ms per page" % (pages, fresh * 1000, kept * 1000))
+	if not ok or kept >= fresh:
+		sys.exit("httpsPaged: FAIL")
+	print("ok")
+
+
+if __name__ == "__main__":
+	main()
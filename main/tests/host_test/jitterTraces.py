@@ -0,0 +1,72 @@
+"""
+jitterTraces.py
+
+Packet arrival traces for benchJitter, a line of "ms bytes" for each
+4608 byte piece of a 300 s stream at 44.1 kHz stereo 16 bit
+
+	jitterTraces.py directory
+
+	clean	a server that sends 2 s at once then keeps that far ahead
+	stalls	0.3 s ahead, four stalls of 0.4 to 0.9 s
+	rough	no backlog, 60 ms jitter and stalls of up to 1.5 s
+	burst	2 s ahead with stalls of 2.5 and 1.5 s
+	live	a live relay, 80 ms jitter, what is due in a stall is lost
+
+In the first four a stall holds back everything due in it until it
+ends. The random generator is seeded with the trace name so the traces
+are the same every time
+"""
+
+import os
+import random
+import sys
+
+RATE = 176400
+PIECE = 4608
+SECONDS = 300
+
+
+def save(directory, name, arrivals):
+	arrivals.sort()
+	with open(os.path.join(directory, name + ".txt"), "w") as f:
+		f.write("".join("%d %d\n" % a for a in arrivals))
+
+
+def caughtUp(directory, name, stalls, sd, burst=2.0):
+	random.seed(name + ".txt")
+	media = 0.0
+	arrivals = []
+	while media < SECONDS:
+		t = max(0.0, (media - burst) * 1000) + abs(random.gauss(0, sd))
+		for (at, length) in stalls:
+			if at * 1000 <= t < (at + length) * 1000:
+				t = (at + length) * 1000 + random.uniform(0, 20)
+		arrivals.append((int(t), PIECE))
+		media += PIECE / RATE
+	save(directory, name, arrivals)
+
+
+def live(directory, name, stalls, sd):
+	random.seed(name + ".txt")
+	media = 0.0
+	arrivals = []
+	while media < SECONDS:
+		t = media * 1000 + abs(random.gauss(0, sd))
+		if not any(at * 1000 <= t < (at + length) * 1000 for (at, length) in stalls):
+			arrivals.append((int(t), PIECE))
+		media += PIECE / RATE
+	save(directory, name, arrivals)
+
+
+def main():
+	directory = sys.argv[1] if len(sys.argv) > 1 else "."
+	os.makedirs(directory, exist_ok=True)
+	caughtUp(directory, "clean", [], 3)
+	caughtUp(directory, "stalls", [(40, 0.6), (90, 0.4), (150, 0.9), (220, 0.5)], 10, burst=0.3)
+	caughtUp(directory, "rough", [(60, 1.5), (70, 0.8), (200, 1.2)], 60, burst=0)
+	caughtUp(directory, "burst", [(60, 2.5), (150, 1.5)], 20, burst=2.0)
+	live(directory, "live", [(30, 0.3), (80, 0.2), (120, 0.4), (200, 0.3)], 80)
+
+
+if __name__ == "__main__":
+	main()
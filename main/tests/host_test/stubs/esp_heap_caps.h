@@ -0,0 +1,23 @@
+#pragma once
+// allocations are counted so a test can see how much a piece of code
+// asked for, see hostHeap.c
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_DEFAULT (1 << 0)
+#define MALLOC_CAP_INTERNAL (1 << 1)
+#define MALLOC_CAP_SPIRAM (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_8BIT (1 << 4)
+
+typedef struct {
+	size_t bytes;						// asked for since hostHeapReset
+	size_t largest;
+	int calls;
+} hostHeap_t;
+
+extern hostHeap_t hostHeap;
+
+void hostHeapReset ();
+void *heap_caps_malloc (size_t size, uint32_t caps);
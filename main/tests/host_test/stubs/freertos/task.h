@@ -0,0 +1,9 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t) (void *);
+typedef void *TaskHandle_t;
+
+BaseType_t xTaskCreate (TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+	int priority, TaskHandle_t *handle);
@@ -0,0 +1,24 @@
+/********************************************************
+	hostHeap.c
+
+	heap_caps_malloc on Linux, malloc that adds up what it was asked
+	for
+
+*********************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+
+hostHeap_t hostHeap;
+
+void hostHeapReset (){
+	memset (&hostHeap, 0, sizeof(hostHeap));
+}
+
+void *heap_caps_malloc (size_t size, uint32_t caps){
+	hostHeap.bytes += size;
+	if (size > hostHeap.largest) hostHeap.largest = size;
+	hostHeap.calls++;
+	return malloc (size);
+}
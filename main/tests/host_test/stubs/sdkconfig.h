@@ -0,0 +1,11 @@
+#pragma once
+// esp_jpg's Kconfig defaults but with the decoder built from source,
+// the board uses the one in ROM. From source the 3100 byte work area
+// the other modes get is too small for a 4:2:0 cover with full
+// Huffman tables, the table mode has 64K
+
+#define CONFIG_JD_SZBUF 512
+#define CONFIG_JD_FORMAT 0
+#define CONFIG_JD_USE_SCALE 1
+#define CONFIG_JD_TBLCLIP 1
+#define CONFIG_JD_FASTDECODE 2
@@ -0,0 +1,139 @@
+/********************************************************
+	testArtCache.c
+
+	Replays track changes through the art cache the way art.c drives
+	it - getArt for the track now playing, a fetch on a miss and a
+	prefetch of the next track's art - and checks the hit, miss and
+	eviction counts. Then a long random run checks that the image on
+	screen and one being decoded into are never given out again
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "artCache.h"
+#include "hostTest.h"
+
+#define SLOTS 6
+
+static artSlot_t slots[SLOTS];
+static artCache_t cache;
+static int decodes;
+
+// artThread, decodes url unless it is already there
+
+static void fetch (const char *url){
+	uint64_t hash = artHash (url);
+	if (artCacheFind (&cache, hash) >= 0) return;
+	int i = artCacheClaim (&cache, hash);
+	CHECK (i >= 0);
+	if (i < 0) return;
+	decodes++;
+	artCacheFilled (&cache, i, 80, 80);
+}
+
+// the screen showing url, fetched on a miss
+
+static void show (const char *url){
+	if (artCacheShow (&cache, artHash (url)) >= 0) return;
+	fetch (url);
+	CHECK (artCacheShow (&cache, artHash (url)) >= 0);
+}
+
+static void reset (){
+	memset (slots, 0, sizeof(slots));
+	artCacheInit (&cache, slots, SLOTS);
+	decodes = 0;
+}
+
+// each line is the art now playing and the next track's, prefetched
+
+static const char *trace[][2] = {
+	{"album/a", "album/b"},
+	{"album/b", "album/c"},
+	{"album/c", "album/d"},
+	{"album/b", "album/c"},				// back
+	{"album/c", "album/d"},				// forward again
+	{"station/1", NULL},				// flipping between stations
+	{"station/2", NULL},
+	{"station/1", NULL},
+	{"station/2", NULL},
+	{"album/d", "album/e"},				// full, a evicted
+	{"album/e", "album/f"},				// then b
+	{"album/f", "album/g"},				// c
+	{"album/g", "album/h"},				// station 1
+	{"station/1", NULL},				// fetched again, station 2 evicted
+	{"album/a", "album/b"},				// and again, d and e evicted
+};
+
+static void replay (){
+	reset ();
+	for (int i = 0;i < (int)(sizeof(trace) / sizeof(trace[0]));i++){
+		show (trace[i][0]);
+		if (trace[i][1]) fetch (trace[i][1]);
+	}
+	printf ("trace hits %d misses %d evictions %d decodes %d\n",
+		cache.hits, cache.misses, cache.evictions, decodes);
+	CHECK (cache.misses == 5);			// a, the two stations, station 1 and a again
+	CHECK (cache.hits == 10 + 5);		// and each show after a miss
+	CHECK (decodes == 13);
+	CHECK (cache.evictions == 7);
+	CHECK (slots[cache.displayed].hash == artHash ("album/a"));
+	CHECK (artCacheFind (&cache, artHash ("album/b")) >= 0);
+}
+
+// the screen's slot and one being decoded are never claimed
+
+static void invariants (){
+	reset ();
+	unsigned seed = 3;
+	int decoding = -1;
+	for (int n = 0;n < 100000;n++){
+		char url[32];
+		snprintf (url, sizeof(url), "art/%d", rand_r (&seed) % 12);
+		uint64_t hash = artHash (url);
+		int op = rand_r (&seed) % 3;
+
+		if (op == 0){
+			int shown = cache.displayed;
+			if (artCacheShow (&cache, hash) >= 0){
+				CHECK (slots[cache.displayed].valid);
+				CHECK (slots[cache.displayed].hash == hash);
+			}
+			else CHECK (cache.displayed == shown);
+		}
+		else if ((op == 1)&&(decoding < 0)&&(artCacheFind (&cache, hash) < 0)){
+			int i = artCacheClaim (&cache, hash);
+			CHECK (i >= 0);
+			CHECK (i != cache.displayed);
+			decoding = i;
+		}
+		else if (decoding >= 0){
+			if (rand_r (&seed) % 8) artCacheFilled (&cache, decoding, 80, 80);
+			else artCacheRelease (&cache, decoding);
+			decoding = -1;
+		}
+
+		int refs = 0;
+		for (int i = 0;i < SLOTS;i++){
+			CHECK (slots[i].refs >= 0);
+			refs += slots[i].refs;
+		}
+		CHECK (refs == (cache.displayed >= 0) + (decoding >= 0));
+		if (cache.displayed >= 0) CHECK (slots[cache.displayed].refs == 1);
+	}
+
+// all referenced
+
+	reset ();
+	for (int i = 0;i < SLOTS;i++) CHECK (artCacheClaim (&cache, i) == i);
+	CHECK (artCacheClaim (&cache, SLOTS) == -1);
+}
+
+int main (){
+	replay ();
+	invariants ();
+	return testResult ();
+}
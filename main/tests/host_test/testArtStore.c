@@ -0,0 +1,94 @@
+/********************************************************
+	testArtStore.c
+
+	The art store in a temporary directory - images come back after
+	a restart, the least recently used go first when it is full, and
+	a hit does not write the index until artStorePoll says it has
+	waited long enough
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "artStore.h"
+#include "hostTest.h"
+
+#define W 70
+#define H 70
+#define SIZE (W * H * 2)
+#define MAXBYTES (3 * SIZE + 100)		// room for three
+
+static uint8_t image[SIZE], buf[SIZE];
+
+static int has (uint64_t hash){
+	int w, h;
+	return artStoreLoad (hash, buf, SIZE, &w, &h);
+}
+
+int main (){
+	char dir[] = "/tmp/artStoreXXXXXX";
+	CHECK (mkdtemp (dir) != NULL);
+
+	for (int i = 0;i < SIZE;i++) image[i] = i * 7;
+	artStoreInit (dir, MAXBYTES);
+	for (int i = 1;i <= 3;i++){
+		image[0] = i;
+		artStoreSave (i, image, W, H);
+	}
+	CHECK (artStoreIndexWrites == 3);
+
+// after a restart
+
+	artStoreInit (dir, MAXBYTES);
+	int w = 0, h = 0;
+	CHECK (artStoreLoad (2, buf, SIZE, &w, &h));
+	CHECK ((w == W) && (h == H));
+	CHECK ((buf[0] == 2) && !memcmp (buf + 1, image + 1, SIZE - 1));
+	CHECK (!artStoreLoad (2, buf, SIZE - 1, &w, &h));		// too big for buf
+	CHECK (!has (9));
+
+// hits only change RAM
+
+	int writes = artStoreIndexWrites;
+	for (int i = 0;i < 100;i++) CHECK (has (1));
+	CHECK (artStoreIndexWrites == writes);
+
+// a restart before the poll loses them, the poll writes them once they
+// have waited a minute
+
+	artStoreInit (dir, MAXBYTES);
+	CHECK (has (1));
+	artStorePoll (1000);
+	artStorePoll (1000 + 59999);
+	CHECK (artStoreIndexWrites == writes);
+	artStorePoll (1000 + 60000);
+	CHECK (artStoreIndexWrites == writes + 1);
+	artStorePoll (200000);
+	CHECK (artStoreIndexWrites == writes + 1);				// nothing new
+
+// the poll kept 1 as recent so 2 is evicted
+
+	artStoreInit (dir, MAXBYTES);
+	int evictions = artStoreEvictions;
+	artStoreSave (4, image, W, H);
+	CHECK (artStoreEvictions == evictions + 1);
+	CHECK (has (1) && !has (2) && has (3) && has (4));
+
+// a missing image file is a miss and is dropped
+
+	char path[128];
+	snprintf (path, sizeof(path), "%s/%016llx.565", dir, 3ULL);
+	CHECK (!remove (path));
+	CHECK (!has (3));
+	artStoreInit (dir, MAXBYTES);
+	CHECK (!has (3) && has (4));
+
+	printArtStoreStats ();
+	char cmd[160];
+	snprintf (cmd, sizeof(cmd), "rm -rf %s", dir);
+	CHECK (!system (cmd));
+	return testResult ();
+}
@@ -0,0 +1,191 @@
+/********************************************************
+	testArtStream.c
+
+	The art decoder pulls the jpeg through a small ring as it
+	downloads (art.c) instead of waiting for the whole file in a
+	300K buffer. This feeds esp_jpg from a simulated socket, chunks
+	of random size arriving at a set bandwidth after a round trip,
+	on a virtual clock, and compares the two ways for
+
+		time to first pixel		when the top left pixel is written
+		allocated				what was asked of heap_caps_malloc
+
+	The pixels must match and a socket that closes early must fail
+	the decode cleanly
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jpeg_decoder.h"
+#include "esp_heap_caps.h"
+#include "hostTest.h"
+
+#define OUTSIZE 100000					// IMAGESIZE in art.c
+#define STAGING 300000					// the old whole file buffer
+#define ARTRINGSIZE 16384				// art.c
+#define RTTMS 60
+#define BYTESPERMS 250					// 2Mbit/s
+
+static const char *covers[] = {"cover640.jpg", "cover300.jpg", "cover64.jpg"};
+
+typedef struct {
+	uint8_t *data;
+	int len;
+	int closeAt;						// the socket ends here
+	int arrived;						// bytes that have arrived
+	int pos;							// bytes taken
+	double nowMs;						// virtual clock
+	uint8_t *out;						// watched for the first pixel
+	double firstPixelMs;
+	unsigned seed;
+} socket_t;
+
+static const uint8_t sentinel[8] = {0xa5, 0x5a, 0xa5, 0x5a, 0xa5, 0x5a, 0xa5, 0x5a};
+
+static void watchFirstPixel (socket_t *s){
+	if (!s->firstPixelMs && memcmp (s->out, sentinel, sizeof(sentinel))) s->firstPixelMs = s->nowMs;
+}
+
+// the next chunk off the wire, 200 to 1460 bytes
+
+static void nextChunk (socket_t *s){
+	int n = 200 + rand_r (&s->seed) % 1261;
+	if (n > s->closeAt - s->arrived) n = s->closeAt - s->arrived;
+	s->arrived += n;
+	s->nowMs += (double)n / BYTESPERMS;
+}
+
+// like artStreamRead, blocks until len bytes or the end, NULL skips
+
+static uint32_t socketRead (void *arg, uint8_t *buf, uint32_t len){
+	socket_t *s = arg;
+	uint32_t got = 0;
+	watchFirstPixel (s);
+	while (got < len){
+		if (s->pos == s->arrived){
+			if (s->arrived == s->closeAt) break;
+			nextChunk (s);
+			continue;
+		}
+		uint32_t n = s->arrived - s->pos;
+		if (n > len - got) n = len - got;
+		if (buf) memcpy (buf + got, s->data + s->pos, n);
+		s->pos += n;
+		got += n;
+	}
+	return got;
+}
+
+static esp_jpeg_image_scale_t pickScale (uint16_t width, uint16_t height){
+	int h = height / 8;
+	if (h <= 37) return JPEG_IMAGE_SCALE_1_2;
+	if (h <= 75) return JPEG_IMAGE_SCALE_1_4;
+	return JPEG_IMAGE_SCALE_1_8;
+}
+
+static void socketOpen (socket_t *s, uint8_t *data, int len, uint8_t *out){
+	memset (s, 0, sizeof(socket_t));
+	s->data = data;
+	s->len = len;
+	s->closeAt = len;
+	s->out = out;
+	s->nowMs = RTTMS;
+	s->seed = 1;
+	for (int i = 0;i < OUTSIZE;i += sizeof(sentinel)) memcpy (out + i, sentinel, sizeof(sentinel));
+}
+
+// the old way, the whole file into the staging buffer then decode
+
+static int staged (socket_t *s, esp_jpeg_image_output_t *img){
+	uint8_t *jpg = heap_caps_malloc (STAGING, MALLOC_CAP_SPIRAM);
+	int n = socketRead (s, jpg, STAGING);
+	esp_jpeg_image_cfg_t cfg = {
+		.indata = jpg,
+		.indata_size = n,
+		.outbuf = s->out,
+		.outbuf_size = OUTSIZE,
+		.out_format = JPEG_IMAGE_FORMAT_RGB565,
+		.scale_cb = pickScale,
+		.flags = {.swap_color_bytes = 1}};
+	int r = esp_jpeg_decode (&cfg, img);
+	watchFirstPixel (s);
+	free (jpg);
+	return r;
+}
+
+static int streamed (socket_t *s, esp_jpeg_image_output_t *img){
+	uint8_t *ring = heap_caps_malloc (ARTRINGSIZE, MALLOC_CAP_SPIRAM);
+	esp_jpeg_image_cfg_t cfg = {
+		.outbuf = s->out,
+		.outbuf_size = OUTSIZE,
+		.out_format = JPEG_IMAGE_FORMAT_RGB565,
+		.scale_cb = pickScale,
+		.stream = {.read = socketRead, .arg = s},
+		.flags = {.swap_color_bytes = 1}};
+	int r = esp_jpeg_decode (&cfg, img);
+	watchFirstPixel (s);
+	free (ring);
+	return r;
+}
+
+static uint8_t *readFile (const char *name, int *len){
+	char path[256];
+	snprintf (path, sizeof(path), "art/%s", name);
+	FILE *f = fopen (path, "rb");
+	if (!f) return NULL;
+	fseek (f, 0, SEEK_END);
+	*len = ftell (f);
+	fseek (f, 0, SEEK_SET);
+	uint8_t *p = malloc (*len);
+	if (p && (fread (p, 1, *len, f) != (size_t)*len)){
+		free (p);
+		p = NULL;
+	}
+	fclose (f);
+	return p;
+}
+
+int main (){
+	static uint8_t outA[OUTSIZE], outB[OUTSIZE];
+
+	printf ("%-14s %7s %11s %11s %10s %10s\n", "cover", "bytes", "staged ms", "streamed ms", "staged K", "streamed K");
+	for (int i = 0;i < (int)(sizeof(covers) / sizeof(covers[0]));i++){
+		int len;
+		uint8_t *jpg = readFile (covers[i], &len);
+		CHECK (jpg != NULL);
+		if (!jpg) continue;
+
+		socket_t a, b;
+		esp_jpeg_image_output_t imgA, imgB;
+		socketOpen (&a, jpg, len, outA);
+		hostHeapReset ();
+		CHECK (staged (&a, &imgA) == ESP_OK);
+		hostHeap_t heapA = hostHeap;
+
+		socketOpen (&b, jpg, len, outB);
+		hostHeapReset ();
+		CHECK (streamed (&b, &imgB) == ESP_OK);
+		hostHeap_t heapB = hostHeap;
+
+		CHECK ((imgA.width == imgB.width) && (imgA.height == imgB.height));
+		CHECK (!memcmp (outA, outB, imgA.width * imgA.height * 2));
+		CHECK (b.firstPixelMs < a.firstPixelMs);
+		CHECK (heapB.bytes < heapA.bytes);
+		CHECK (b.pos <= len);
+
+		printf ("%-14s %7d %11.1f %11.1f %10zu %10zu\n", covers[i], len,
+			a.firstPixelMs, b.firstPixelMs, heapA.bytes / 1024, heapB.bytes / 1024);
+
+// cut off half way
+
+		socketOpen (&b, jpg, len, outB);
+		b.closeAt = len / 2;
+		CHECK (streamed (&b, &imgB) != ESP_OK);
+		CHECK (b.pos == len / 2);
+		free (jpg);
+	}
+	return testResult ();
+}
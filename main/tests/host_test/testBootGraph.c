@@ -0,0 +1,169 @@
+/********************************************************
+	testBootGraph.c
+
+	Stages standing in for the board's start up, sleeping for their
+	time. Each must start only after what it names has finished, the
+	slow independent ones must overlap, a failed stage must skip
+	what needs it and a stage naming an unknown one must fail. One
+	worker runs the stages in the order added, and a random graph is
+	run many times on 4 workers looking for races
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#include "bootGraph.h"
+#include "hostTest.h"
+
+typedef struct {
+	int ms;
+	int fail;
+	int order;							// when it finished, from 1
+} stageArg_t;
+
+static atomic_int finished, live, maxLive;
+
+static int stage (void *p){
+	stageArg_t *a = p;
+	int l = atomic_fetch_add (&live, 1) + 1;
+	int m = atomic_load (&maxLive);
+	while ((l > m) && !atomic_compare_exchange_weak (&maxLive, &m, l));
+	usleep (a->ms * 1000);
+	atomic_fetch_sub (&live, 1);
+	a->order = atomic_fetch_add (&finished, 1) + 1;
+	return a->fail;
+}
+
+static int calls;
+
+static void call (){
+	usleep (1000);
+	atomic_fetch_add (&finished, 1);
+	calls++;
+}
+
+static void reset (){
+	atomic_store (&finished, 0);
+	atomic_store (&live, 0);
+	atomic_store (&maxLive, 0);
+}
+
+// every stage that ran started after the ones it needs finished
+
+static int ordered (bootGraph_t *b){
+	for (int i = 0;i < bootCount (b);i++){
+		const bootStage_t *s = bootGetStage (b, i);
+		if (s->state != BOOTDONE) continue;
+		for (int d = 0;d < s->ndeps;d++){
+			const bootStage_t *p = bootGetStage (b, s->deps[d]);
+			if ((p->state != BOOTDONE)||(p->endUs > s->startUs)) return 0;
+		}
+	}
+	return 1;
+}
+
+static void board (){
+	stageArg_t a[8] = {{100}, {100}, {10}, {10}, {10}, {10, 1}, {10}, {10}};
+	reset ();
+	calls = 0;
+	bootGraph_t *b = bootCreate ();
+	bootStage (b, "lcd", stage, &a[0], NULL);
+	bootStage (b, "audio", stage, &a[1], NULL);
+	bootStage (b, "splash", stage, &a[2], "lcd");
+	bootStage (b, "spiffs", stage, &a[3], NULL);
+	bootStage (b, "ui", stage, &a[4], "splash spiffs");
+	bootStage (b, "nvs", stage, &a[5], NULL);				// fails
+	bootStage (b, "wifi", stage, &a[6], "nvs spiffs");		// skipped
+	bootStage (b, "loco", stage, &a[7], "wifi audio");		// skipped
+	bootStageCall (b, "led", call, "spiffs");
+	bootStageCall (b, "unknown", call, "nosuch");
+	CHECK (bootCount (b) == 10);
+	int bad = bootRun (b, 3, 0);
+	printBootTrace (b);
+
+	CHECK (bad == 4);
+	CHECK ((a[2].order > a[0].order) && (a[4].order > a[2].order) && (a[4].order > a[3].order));
+	CHECK (bootGetStage (b, 5)->state == BOOTFAILED);
+	CHECK ((bootGetStage (b, 6)->state == BOOTSKIPPED) && (bootGetStage (b, 7)->state == BOOTSKIPPED));
+	CHECK ((a[6].order == 0) && (a[7].order == 0));			// never ran
+	CHECK ((bootGetStage (b, 8)->state == BOOTDONE) && (calls == 1));
+	CHECK (bootGetStage (b, 9)->state == BOOTFAILED);
+	CHECK ((maxLive >= 2) && (maxLive <= 3));
+	CHECK (bootElapsedUs (b) < 180000);						// lcd and audio overlapped
+	CHECK (ordered (b));
+	CHECK (bootGetStage (b, 10) == NULL);
+	bootFree (b);
+}
+
+static void oneWorker (){
+	stageArg_t a[4] = {{1}, {1}, {1}, {1}};
+	reset ();
+	bootGraph_t *b = bootCreate ();
+	bootStage (b, "a", stage, &a[0], NULL);
+	bootStage (b, "b", stage, &a[1], "a");
+	bootStage (b, "c", stage, &a[2], NULL);
+	bootStage (b, "d", stage, &a[3], "b  c ");
+	CHECK (bootRun (b, 1, 0) == 0);
+	CHECK (maxLive == 1);
+	for (int i = 0;i < 4;i++) CHECK (a[i].order == i + 1);
+	CHECK (ordered (b));
+	bootFree (b);
+}
+
+static void limits (){
+	static stageArg_t a = {0};
+	bootGraph_t *b = bootCreate ();
+	for (int i = 0;i < BOOTMAX;i++) CHECK (bootStage (b, "s", stage, &a, NULL) == i);
+	CHECK (bootStage (b, "more", stage, &a, NULL) < 0);
+	bootFree (b);
+
+	b = bootCreate ();
+	bootStage (b, "x", stage, &a, NULL);
+	bootStage (b, "deep", stage, &a, "x x x x x x x");	// more than BOOTDEPSMAX
+	CHECK (bootRun (b, 2, 0) == 1);
+	CHECK (bootGetStage (b, 1)->state == BOOTFAILED);
+	bootFree (b);
+}
+
+static void stress (){
+	static const char *names[20] = {"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9",
+		"s10", "s11", "s12", "s13", "s14", "s15", "s16", "s17", "s18", "s19"};
+	int wrong = 0;
+	srand (1);
+	for (int r = 0;r < 200;r++){
+		stageArg_t a[20];
+		char after[20][64];
+		bootGraph_t *b = bootCreate ();
+		for (int i = 0;i < 20;i++){
+			a[i] = (stageArg_t){0, !(rand () % 15)};
+			after[i][0] = 0;
+			for (int d = 0;d < i;d++){
+				if (!(rand () % 4)) snprintf (after[i] + strlen (after[i]), 64 - strlen (after[i]), "%s ", names[d]);
+				if (strlen (after[i]) > 12) break;
+			}
+			bootStage (b, names[i], stage, &a[i], after[i]);
+		}
+		int bad = bootRun (b, 4, 0);
+		int count = 0;
+		for (int i = 0;i < 20;i++){
+			int s = bootGetStage (b, i)->state;
+			if (s != BOOTDONE) count++;
+			if ((s == BOOTWAITING)||(s == BOOTRUNNING)) wrong++;
+		}
+		if ((count != bad) || !ordered (b)) wrong++;
+		bootFree (b);
+	}
+	CHECK (wrong == 0);
+}
+
+int main (){
+	board ();
+	oneWorker ();
+	limits ();
+	stress ();
+	return testResult ();
+}
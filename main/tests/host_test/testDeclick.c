@@ -0,0 +1,137 @@
+/********************************************************
+	testDeclick.c
+
+	Two decoded tracks are joined through the PCM ring by a copy of
+	the audio thread's read loop, and the output checked at the join.
+	Track A ends on a full scale peak and track B starts on one, the
+	worst case for a click.
+
+		gapless		B is queued before the ring runs dry, the output
+					must be A then B sample for sample
+		late		B arrives after some silence blocks, no step at
+					the join may be bigger than the tracks' own and
+					B must start within one silence block of arriving
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "pcmRing.h"
+#include "declick.h"
+#include "hostTest.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define TRACKFRAMES 20000
+#define READFRAMES 512					// AUDIOBUFFERSIZE / 2
+#define RINGFRAMES 4096
+#define AMPLITUDE 32000
+
+static uint32_t a[TRACKFRAMES], b[TRACKFRAMES];
+static uint32_t out[4 * TRACKFRAMES];
+static int outFrames;
+
+static int16_t left (uint32_t f){
+	return (int16_t)(f & 0xFFFF);
+}
+
+// a 1kHz sine ending (or starting) on its peak
+
+static void track (uint32_t *t, int endsOnPeak){
+	for (int i = 0;i < TRACKFRAMES;i++){
+		int n = endsOnPeak ? i - (TRACKFRAMES - 1) : i;
+		int16_t v = lrint (AMPLITUDE * cos (2 * M_PI * 1000.0 * n / 44100));
+		t[i] = (uint16_t)v | ((uint32_t)(uint16_t)v << 16);
+	}
+}
+
+// the audio thread, one read of the ring or one silence block
+
+static void audioStep (pcmRing_t *r, declick_t *d){
+	uint32_t *block;
+	uint32_t silence[SILENCEFRAMES];
+	int n = pcmRingReadBegin (r, &block, READFRAMES);
+	if (n){
+		declickPlay (d, block, n);
+		memcpy (out + outFrames, block, n * sizeof(uint32_t));
+		pcmRingReadEnd (r, n);
+	}
+	else {
+		n = declickSilence (d, silence);
+		memcpy (out + outFrames, silence, n * sizeof(uint32_t));
+	}
+	outFrames += n;
+}
+
+static void queue (pcmRing_t *r, uint32_t *t, int n, declick_t *d){
+	while (n){
+		int w = pcmRingWrite (r, t, n);
+		t += w;
+		n -= w;
+		if (n) audioStep (r, d);
+	}
+}
+
+static int biggestStep (int from, int to){
+	int worst = 0;
+	for (int i = from + 1;i < to;i++){
+		int s = abs (left (out[i]) - left (out[i - 1]));
+		if (s > worst) worst = s;
+	}
+	return worst;
+}
+
+static void join (int silences){
+	static uint32_t buffer[RINGFRAMES];
+	pcmRing_t *r = pcmRingCreate (buffer, RINGFRAMES, 0, RINGFRAMES);
+	declick_t d;
+	declickInit (&d);
+	outFrames = 0;
+
+	queue (r, a, TRACKFRAMES, &d);
+	if (silences){
+		while (pcmRingFill (r)) audioStep (r, &d);
+		for (int i = 0;i < silences;i++) audioStep (r, &d);
+	}
+	int arrived = outFrames;
+	queue (r, b, TRACKFRAMES, &d);
+	while (pcmRingFill (r)) audioStep (r, &d);
+
+	int natural = biggestStep (READFRAMES, TRACKFRAMES - 1);
+	int atJoin = biggestStep (TRACKFRAMES - READFRAMES, outFrames - TRACKFRAMES + READFRAMES);
+	printf ("%d silences, %d frames out, biggest step %d at the join, %d in the track\n",
+		silences, outFrames, atJoin, natural);
+
+	if (!silences){
+		CHECK (outFrames == 2 * TRACKFRAMES);
+		CHECK (!memcmp (out + READFRAMES, a + READFRAMES, (TRACKFRAMES - READFRAMES) * sizeof(uint32_t)));
+		CHECK (!memcmp (out + TRACKFRAMES, b, TRACKFRAMES * sizeof(uint32_t)));
+	}
+	else {
+		CHECK (outFrames == 2 * TRACKFRAMES + silences * SILENCEFRAMES);
+		CHECK (outFrames - TRACKFRAMES - arrived <= SILENCEFRAMES);		// B starts promptly
+		CHECK (!memcmp (out + outFrames - TRACKFRAMES + DECLICKFRAMES, b + DECLICKFRAMES,
+			(TRACKFRAMES - DECLICKFRAMES) * sizeof(uint32_t)));
+	}
+	CHECK (atJoin <= natural);
+	free (r);
+}
+
+int main (){
+	track (a, 1);
+	track (b, 0);
+	join (0);
+	join (1);
+	join (5);
+
+// without the ramps the join would step by the full amplitude
+
+	CHECK (abs (left (a[TRACKFRAMES - 1])) > AMPLITUDE - 10);
+	CHECK (abs (left (b[0])) > AMPLITUDE - 10);
+	return testResult ();
+}
@@ -0,0 +1,136 @@
+/********************************************************
+	testFlushPipe.c
+
+	flushPipe.c driving a stand-in panel which sends one band at a
+	time in the order they were queued, T us each, and a stand-in
+	LVGL which renders bands of R us into the two slots and waits in
+	the flush callback when flushPipeNext has no buffer.
+
+	Every buffer the panel finishes must be the one flushPipeDone
+	hands back, and must not have been rendered into while it was
+	queued. With 2 to 4 buffers the frame must take less than
+	rendering and sending each band in turn, and with one slow band
+	in four more buffers must take up more of the slack
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flushPipe.h"
+#include "hostTest.h"
+
+#define BANDS 17						// a 320 x 240 frame in 15 line bands
+#define FRAMES 5
+#define IDLEUS 5000
+#define SLOWUS 7000
+
+typedef struct {
+	int64_t at;
+	int buf;
+	int content;
+} transfer_t;
+
+static transfer_t transfers[BANDS * FRAMES];
+static int queued, sent;
+static int64_t panelFree;
+static char bufs[FLUSHPIPEMAX][1];
+static int content[FLUSHPIPEMAX];			// what was rendered last into each
+static int errors;
+static flushPipe_t *fp;
+
+static int bufIndex (void *p){
+	return (char (*)[1])p - bufs;
+}
+
+static void panelSend (int b, int64_t now, int T){
+	int64_t start = (now > panelFree) ? now : panelFree;
+	panelFree = start + T;
+	transfers[queued++] = (transfer_t){panelFree, b, content[b]};
+}
+
+// transfers finished by now, each must still hold what was queued
+
+static void panelRun (int64_t now){
+	while ((sent < queued) && (transfers[sent].at <= now)){
+		transfer_t *t = &transfers[sent++];
+		void *b = flushPipeDone (fp, t->at);
+		if (b != bufs[t->buf]) errors++;
+		if (content[t->buf] != t->content) errors++;
+	}
+}
+
+// R < 0 renders one band in four in SLOWUS and the rest in 300
+
+static void run (int n, int R, int T, flushPipeStats_t *st){
+	void *b[FLUSHPIPEMAX] = {bufs[0], bufs[1], bufs[2], bufs[3]};
+	fp = flushPipeCreate (b, n);
+	CHECK (fp != NULL);
+	queued = sent = errors = 0;
+	panelFree = 0;
+
+	void *slot[2] = {bufs[0], bufs[1]};
+	int active = 0, id = 0;
+	int64_t t = 0;
+	for (int f = 0;f < FRAMES;f++){
+		flushPipeFrameStart (fp, t);
+		for (int k = 0;k < BANDS;k++){
+			t += (R >= 0) ? R : (k % 4) ? 300 : SLOWUS;
+			panelRun (t);
+			content[bufIndex (slot[active])] = ++id;
+			flushPipeRendered (fp, slot[active], k == BANDS - 1, t);
+			panelSend (bufIndex (slot[active]), t, T);
+			void *next;
+			while (!(next = flushPipeNext (fp, slot[!active]))){
+				t = transfers[sent].at;			// the callback waits for the DMA
+				panelRun (t);
+			}
+			slot[!active] = next;
+			flushPipeResume (fp, t);
+			active = !active;
+		}
+		t += IDLEUS;
+		panelRun (t);
+	}
+	panelRun (INT64_MAX);
+	flushPipeGetStats (fp, st);
+	printf ("%d buffers, render %5d transfer %d: frame %5d us (render %5d wait %5d transfer %5d) %2d waits, %d queued\n",
+		n, R, T, st->lastFrameUs, st->lastRenderUs, st->lastWaitUs, st->lastTransferUs, st->waits, st->maxQueued);
+
+	CHECK (errors == 0);
+	CHECK (flushPipeQueued (fp) == 0);
+	CHECK (flushPipeDone (fp, t) == NULL);
+	CHECK ((st->frames == FRAMES) && (st->bands == FRAMES * BANDS) && (st->lastBands == BANDS));
+	CHECK (st->maxQueued <= n);
+	CHECK (st->lastTransferUs == BANDS * T);
+	free (fp);
+}
+
+int main (){
+	void *b[FLUSHPIPEMAX + 1] = {0};
+	CHECK (flushPipeCreate (b, 1) == NULL);
+	CHECK (flushPipeCreate (b, FLUSHPIPEMAX + 1) == NULL);
+
+	static const int renders[] = {1500, 3000};
+	int T = 2560;
+	flushPipeStats_t st;
+	for (int n = 2;n <= FLUSHPIPEMAX;n++){
+		for (int r = 0;r < 2;r++){
+			int R = renders[r];
+			run (n, R, T, &st);
+			CHECK (st.lastFrameUs < BANDS * (R + T));		// better than one band at a time
+			CHECK (st.lastRenderUs + st.lastTransferUs > st.lastFrameUs);
+			if (R > T) CHECK ((st.lastFrameUs == BANDS * R + T) && (st.waits == 0));
+			else CHECK (st.lastFrameUs <= BANDS * T + 2 * R);
+		}
+	}
+
+	int frame[FLUSHPIPEMAX + 1];
+	for (int n = 2;n <= FLUSHPIPEMAX;n++){
+		run (n, -1, T, &st);
+		frame[n] = st.lastFrameUs;
+	}
+	CHECK ((frame[4] < frame[3]) && (frame[3] < frame[2]));
+	return testResult ();
+}
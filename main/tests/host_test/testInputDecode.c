@@ -0,0 +1,187 @@
+/********************************************************
+	testInputDecode.c
+
+	Recorded style traces replayed through the decoders - clean and
+	bouncing rotary steps, turning back, skipped steps and chatter,
+	then button presses with contact bounce, a long press, a spike
+	and a release whose bounce lands in the lockout.
+
+	Then the event ring: rotary and button events must come out in
+	the order they went in, a full ring drops and counts, the free
+	running indexes wrap, and a producer and consumer thread pass a
+	numbered stream through it without loss or reordering
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "inputDecode.h"
+#include "uiQueue.h"
+#include "hostTest.h"
+
+// a trace is levels written "ba", rest at 11, e.g. "11 10 00 01 11"
+
+static int rotary (const char *trace){
+	quadrature_t q;
+	quadratureInit (&q, (trace[0] - '0') * 2 + (trace[1] - '0'));
+	int sum = 0;
+	for (const char *p = trace;*p;p++){
+		if (*p == ' ') continue;
+		sum += quadratureFeed (&q, (p[0] - '0') * 2 + (p[1] - '0'));
+		p++;
+	}
+	return sum;
+}
+
+static void rotaryTraces (){
+	CHECK (rotary ("11 10 00 01 11") == 1);
+	CHECK (rotary ("11 01 00 10 11") == -1);
+	CHECK (rotary ("11 10 11 10 00 01 00 01 11 01 11 01 11") == 1);		// bouncing
+	CHECK (rotary ("11 01 11 01 00 10 00 10 11 10 11") == -1);
+	CHECK (rotary ("11 10 00 01 11 10 00 01 11 10 00 01 11") == 3);
+	CHECK (rotary ("11 10 00 10 11") == 0);						// turned back
+	CHECK (rotary ("11 10 00 11") == 1);						// a skipped step keeps the direction
+	CHECK (rotary ("11 00 11") == 0);							// only skips
+	CHECK (rotary ("11 10 00 01 11 01 00 10 11") == 0);			// up then down
+	CHECK (rotary ("11 10 11 10 11 10 11") == 0);				// chatter on one line
+	CHECK (rotary ("11 10 00 00 01 11") == 1);					// half detent encoder
+}
+
+// edges at ms with the line's level, ticks every 0.1 ms at the deadlines
+
+typedef struct {
+	int ms;
+	int level;
+} edge_t;
+
+typedef struct {
+	int shorts;
+	int longs;
+	int lastMs;
+	int glitches;
+} press_t;
+
+static press_t button (const edge_t *e, int n, int endMs){
+	debounce_t b;
+	press_t r = {0};
+	buttonInit (&b, 0);
+	int level = 0, i = 0;
+	for (int64_t t = 0;t <= endMs * 1000LL;t += 100){
+		int ev = 0;
+		while ((i < n) && (e[i].ms * 1000LL <= t)){
+			level = e[i++].level;
+			ev |= buttonEdge (&b, level, t);
+		}
+		int64_t d = buttonDeadline (&b);
+		if (d && (d <= t)) ev |= buttonTick (&b, level, t);
+		if (ev & BUTTONSHORT) r.shorts++;
+		if (ev & BUTTONLONG) r.longs++;
+		if (ev) r.lastMs = t / 1000;
+	}
+	r.glitches = b.glitches;
+	return r;
+}
+
+#define EDGES(a) a, (int)(sizeof(a) / sizeof(a[0]))
+
+static void buttonTraces (){
+	static const edge_t clean[] = {{100, 1}, {300, 0}};
+	press_t p = button (EDGES (clean), 2000);
+	CHECK ((p.shorts == 1) && (p.longs == 0) && (p.lastMs == 300));
+
+	static const edge_t bouncy[] = {{100, 1}, {101, 0}, {102, 1}, {104, 0}, {105, 1},
+		{400, 0}, {401, 1}, {403, 0}, {406, 1}, {407, 0}};
+	p = button (EDGES (bouncy), 2000);
+	CHECK ((p.shorts == 1) && (p.longs == 0) && (p.lastMs == 400));
+
+	static const edge_t held[] = {{100, 1}, {102, 0}, {103, 1}, {2500, 0}, {2502, 1}, {2503, 0}};
+	p = button (EDGES (held), 4000);
+	CHECK ((p.shorts == 0) && (p.longs == 1) && (p.lastMs == 1600));
+
+	static const edge_t spike[] = {{500, 1}, {501, 0}};
+	p = button (EDGES (spike), 2000);
+	CHECK ((p.shorts == 0) && (p.longs == 0) && (p.glitches == 1));
+
+	static const edge_t lateRelease[] = {{100, 1}, {150, 0}, {151, 1}, {152, 0}};	// bounce in the lockout
+	p = button (EDGES (lateRelease), 2000);
+	CHECK ((p.shorts == 1) && (p.lastMs == 150));
+
+	static const edge_t twice[] = {{100, 1}, {180, 0}, {260, 1}, {340, 0}};
+	p = button (EDGES (twice), 2000);
+	CHECK ((p.shorts == 2) && (p.longs == 0));
+}
+
+static void ringOrder (){
+	static inputRing_t r;
+	inputRingInit (&r);
+	static const int in[] = {ROTARYUP, ROTARYUP, NEXTBUTTON, ROTARYDOWN, KNOBPUSH, ROTARYUP, BACKBUTTONHELD};
+	int n = sizeof(in) / sizeof(in[0]);
+	for (int i = 0;i < n;i++) CHECK (inputRingPut (&r, in[i], 1000 + i));
+	int64_t at;
+	for (int i = 0;i < n;i++){
+		CHECK (inputRingGet (&r, &at) == in[i]);
+		CHECK (at == 1000 + i);
+	}
+	CHECK (inputRingGet (&r, &at) == 0);
+
+// full, then the indexes wrap
+
+	for (int i = 0;i < INPUTRINGLEN;i++) CHECK (inputRingPut (&r, ROTARYUP, i));
+	CHECK (!inputRingPut (&r, NEXTBUTTON, 0));
+	CHECK (r.dropped == 1);
+	for (int i = 0;i < INPUTRINGLEN;i++) CHECK (inputRingGet (&r, NULL) == ROTARYUP);
+	CHECK (inputRingGet (&r, NULL) == 0);
+
+	r.in = r.out = UINT32_MAX - 3;
+	for (int i = 0;i < 10;i++) CHECK (inputRingPut (&r, 1 + i, i));
+	for (int i = 0;i < 10;i++) CHECK (inputRingGet (&r, &at) == 1 + i);
+	CHECK (inputRingGet (&r, NULL) == 0);
+}
+
+// the producer numbers its events 1..255 in turn, the consumer must see
+// every one in sequence
+
+#define STREAM 500000
+
+static inputRing_t shared;
+
+static void *producer (void *arg){
+	for (int i = 0;i < STREAM;){
+		if (inputRingPut (&shared, 1 + i % 255, i)) i++;
+		else sched_yield ();						// full, try again
+	}
+	return NULL;
+}
+
+static void ringThreads (){
+	inputRingInit (&shared);
+	pthread_t t;
+	pthread_create (&t, NULL, producer, NULL);
+	int seen = 0, wrong = 0;
+	while (seen < STREAM){
+		int64_t at;
+		int e = inputRingGet (&shared, &at);
+		if (!e){
+			sched_yield ();
+			continue;
+		}
+		if ((e != 1 + seen % 255)||(at != seen)) wrong++;
+		seen++;
+	}
+	pthread_join (t, NULL);
+	printf ("%d events through the ring, %u times full\n", seen, shared.dropped);
+	CHECK (wrong == 0);
+	CHECK (inputRingGet (&shared, NULL) == 0);
+}
+
+int main (){
+	rotaryTraces ();
+	buttonTraces ();
+	ringOrder ();
+	ringThreads ();
+	return testResult ();
+}
@@ -0,0 +1,212 @@
+/********************************************************
+	testJsonExtract.c
+
+	The extractor against a Spotify style page - fed whole, a byte
+	at a time and in random pieces, which must all give the same
+	callbacks with the same types. Then the number grammar, null and
+	the literals, escapes and surrogates, values cut on a UTF-8
+	boundary and nesting too deep
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsonExtract.h"
+#include "hostTest.h"
+
+#define MAXCALLS 256
+
+typedef struct {
+	int path;
+	int item;
+	int type;
+	char value[JXVALUELEN];
+} call_t;
+
+static call_t calls[MAXCALLS];
+static int ncalls;
+
+static void collect (void *arg, int path, int item, int type, const char *value){
+	CHECK (strlen (value) < JXVALUELEN);
+	if (ncalls >= MAXCALLS) return;
+	call_t *c = &calls[ncalls++];
+	c->path = path;
+	c->item = item;
+	c->type = type;
+	snprintf (c->value, JXVALUELEN, "%s", value);
+}
+
+// feeds doc in pieces of step bytes, or random sizes when step is 0
+
+static int extract (const char **paths, int npaths, const char *doc, int step){
+	jsonExtract_t jx;
+	ncalls = 0;
+	CHECK (!jsonExtractInit (&jx, paths, npaths, collect, NULL));
+	int len = strlen (doc);
+	for (int i = 0;i < len;){
+		int n = step ? step : 1 + rand () % 17;
+		if (n > len - i) n = len - i;
+		if (jsonExtractFeed (&jx, doc + i, n)) return -1;
+		i += n;
+	}
+	return jsonExtractEnd (&jx);
+}
+
+static const char *page =
+	"{\"href\":\"https://api.spotify.com/v1/me/playlists?offset=0&limit=3\",\n"
+	" \"items\":[\n"
+	"  {\"collaborative\":false,\"name\":\"Caf\\u00e9 \\\"jazz\\\"\",\"images\":[{\"url\":\"x\",\"height\":null}],"
+		"\"owner\":{\"name\":\"not this\"},\"uri\":\"spotify:playlist:1\"},\n"
+	"  {\"name\":null,\"uri\":\"spotify:playlist:2\",\"tracks\":{\"total\":12}},\n"
+	"  {\"uri\":\"spotify:playlist:3\",\"name\":\"\\ud83c\\udfb5 tunes\",\"public\":true}\n"
+	" ],\n"
+	" \"limit\":3,\"next\":null,\"offset\":0,\"previous\":null,\n"
+	" \"total\":-0.5e+3}";
+
+static const char *pagePaths[] = {"total", "items[].name", "items[].uri", "next", "items[].public"};
+
+static const call_t pageCalls[] = {
+	{1, 0, JXTYPESTRING, "Caf\xc3\xa9 \"jazz\""},
+	{2, 0, JXTYPESTRING, "spotify:playlist:1"},
+	{1, 1, JXTYPENULL, ""},
+	{2, 1, JXTYPESTRING, "spotify:playlist:2"},
+	{2, 2, JXTYPESTRING, "spotify:playlist:3"},
+	{1, 2, JXTYPESTRING, "\xf0\x9f\x8e\xb5 tunes"},
+	{4, 2, JXTYPEBOOL, "true"},
+	{3, -1, JXTYPENULL, ""},
+	{0, -1, JXTYPENUMBER, "-0.5e+3"},
+};
+
+static void pieces (){
+	static const int steps[] = {0, 1, 2, 3, 7, 4096};
+	int expect = sizeof(pageCalls) / sizeof(pageCalls[0]);
+	for (int s = 0;s < (int)(sizeof(steps) / sizeof(steps[0]));s++){
+		for (int repeat = 0;repeat < (steps[s] ? 1 : 50);repeat++){
+			CHECK (!extract (pagePaths, 5, page, steps[s]));
+			CHECK (ncalls == expect);
+			for (int n = 0;(n < ncalls) && (n < expect);n++){
+				const call_t *e = &pageCalls[n];
+				CHECK ((calls[n].path == e->path) && (calls[n].item == e->item) && (calls[n].type == e->type));
+				CHECK (!strcmp (calls[n].value, e->value));
+			}
+		}
+	}
+}
+
+// a document that is only a number, and the same number in an array
+
+static int number (const char *text, int step){
+	static const char *paths[] = {"[]"};
+	char doc[64];
+	snprintf (doc, sizeof(doc), "[%s]", text);
+	if (extract (paths, 1, doc, step)) return -1;
+	if ((ncalls != 1) || (calls[0].type != JXTYPENUMBER) || strcmp (calls[0].value, text)) return -1;
+	static const char *top[] = {""};
+	return extract (top, 0, text, step);
+}
+
+static void numbers (){
+	static const char *good[] = {"0", "-0", "10", "-12.75", "1E5", "1e+5", "-0.5e-3", "0.0", "123456789"};
+	static const char *bad[] = {"01", "-", "-01", "1.", "1e", "1e+", ".5", "+1", "1.2.3", "--1", "1.e5",
+		"0x1", "1e5.0", "00", "-a"};
+	for (int step = 0;step < 2;step++){
+		for (int n = 0;n < (int)(sizeof(good) / sizeof(good[0]));n++){
+			int r = number (good[n], step);
+			CHECK (!r);
+			if (r) printf ("rejected %s\n", good[n]);
+		}
+		for (int n = 0;n < (int)(sizeof(bad) / sizeof(bad[0]));n++){
+			int r = number (bad[n], step);
+			CHECK (r);
+			if (!r) printf ("accepted %s\n", bad[n]);
+		}
+	}
+}
+
+static void literals (){
+	static const char *paths[] = {"a"};
+	static const char *good[] = {"{\"a\":null}", "{\"a\":true}", "{\"a\":false}", "{\"a\" : null }", "null", "true"};
+	static const int types[] = {JXTYPENULL, JXTYPEBOOL, JXTYPEBOOL, JXTYPENULL};
+	for (int n = 0;n < (int)(sizeof(good) / sizeof(good[0]));n++) CHECK (!extract (paths, 1, good[n], 1));
+	for (int n = 0;n < 4;n++){
+		CHECK (!extract (paths, 1, good[n], 0));
+		CHECK ((ncalls == 1) && (calls[0].type == types[n]));
+		CHECK (!strcmp (calls[0].value, (types[n] == JXTYPENULL) ? "" : (n == 1) ? "true" : "false"));
+	}
+	static const char *bad[] = {"{\"a\":nul}", "{\"a\":nulll}", "{\"a\":True}", "{\"a\":truefalse}", "nan", "{\"a\":}",
+		"{\"a\":1,}", "[1,]", "{\"a\" 1}", "{1:2}", "[1 2]", "{\"a\":\"\\x\"}", "{\"a\":\"\\u12g4\"}",
+		"{\"a\":\"tab\there\"}", "[]]", "{\"a\":1", "[1] 2", ""};
+	for (int n = 0;n < (int)(sizeof(bad) / sizeof(bad[0]));n++){
+		int r = extract (paths, 1, bad[n], 1);
+		CHECK (r);
+		if (!r) printf ("accepted %s\n", bad[n]);
+	}
+}
+
+static void strings (){
+	static const char *paths[] = {"s"};
+	CHECK (!extract (paths, 1, "{\"s\":\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u0041\"}", 1));
+	CHECK ((ncalls == 1) && !strcmp (calls[0].value, "\"\\/\b\f\n\r\tA"));
+	CHECK (!extract (paths, 1, "{\"s\":\"\\ud83c x \\udfb5\"}", 1));		// lone surrogates
+	CHECK ((ncalls == 1) && !strcmp (calls[0].value, "\xef\xbf\xbd x \xef\xbf\xbd"));
+
+// a value longer than JXVALUELEN is cut before a whole character
+
+	char doc[512];
+	for (int pad = 0;pad < 4;pad++){
+		int n = snprintf (doc, sizeof(doc), "{\"s\":\"%.*s", pad, "xxx");
+		for (int i = 0;i < 80;i++) n += snprintf (doc + n, sizeof(doc) - n, "\xe2\x82\xac");	// euro, 3 bytes
+		snprintf (doc + n, sizeof(doc) - n, "\"}");
+		CHECK (!extract (paths, 1, doc, 0));
+		int l = strlen (calls[0].value);
+		CHECK ((ncalls == 1) && (l <= JXVALUELEN - 1) && (l > JXVALUELEN - 4));
+		CHECK ((l - pad) % 3 == 0);
+		CHECK (!memcmp (calls[0].value + pad, "\xe2\x82\xac", 3));
+	}
+
+// a long key never matches a short path it starts with
+
+	CHECK (!extract (paths, 1, "{\"ssssssssssssssssssssssssssssssssssssssss\":1,\"s\":2}", 1));
+	CHECK ((ncalls == 1) && !strcmp (calls[0].value, "2"));
+}
+
+static void nesting (){
+	static const char *paths[] = {"a"};
+	char doc[2 * JXMAXDEPTH + 8];
+	for (int depth = JXMAXDEPTH;depth <= JXMAXDEPTH + 1;depth++){
+		memset (doc, '[', depth);
+		memset (doc + depth, ']', depth);
+		doc[2 * depth] = 0;
+		int r = extract (paths, 1, doc, 0);
+		CHECK ((depth <= JXMAXDEPTH) ? !r : r);
+	}
+
+	jsonExtract_t jx;
+	const char *many[JXMAXPATHS + 1];
+	for (int n = 0;n <= JXMAXPATHS;n++) many[n] = "a";
+	CHECK (jsonExtractInit (&jx, many, JXMAXPATHS + 1, collect, NULL));
+	static const char *tooLong[] = {"a.b.c.d.e.f.g.h.i"};
+	CHECK (jsonExtractInit (&jx, tooLong, 1, collect, NULL));
+
+// an error sticks until reset, then the same jx parses again
+
+	CHECK (!jsonExtractInit (&jx, paths, 1, collect, NULL));
+	CHECK (jsonExtractFeed (&jx, "{x", 2));
+	CHECK (jsonExtractFeed (&jx, "}", 1));
+	jsonExtractReset (&jx);
+	ncalls = 0;
+	CHECK (!jsonExtractFeed (&jx, "{\"a\":7}", 7) && !jsonExtractEnd (&jx));
+	CHECK ((ncalls == 1) && !strcmp (calls[0].value, "7"));
+}
+
+int main (){
+	srand (1);
+	pieces ();
+	numbers ();
+	literals ();
+	strings ();
+	nesting ();
+	return testResult ();
+}
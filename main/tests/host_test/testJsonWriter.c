@@ -0,0 +1,154 @@
+/********************************************************
+	testJsonWriter.c
+
+	The JSON writer against known output - escaping, numbers as cJSON
+	prints them, nesting and empty containers - then a large document
+	written through buffers from 1 byte to 512, which must all give
+	the same bytes with one flush per full buffer. A failing flush,
+	unbalanced nesting and nesting too deep must all show in jsonEnd
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "jsonWriter.h"
+#include "hostTest.h"
+
+static char out[256 * 1024];
+static int outLen;
+static int biggest;
+
+static int collect (void *arg, const char *buf, int len){
+	if (outLen + len > (int)sizeof(out)) return 1;
+	memcpy (out + outLen, buf, len);
+	outLen += len;
+	if (len > biggest) biggest = len;
+	return 0;
+}
+
+static int fail (void *arg, const char *buf, int len){
+	return 1;
+}
+
+static void begin (jsonWriter_t *w, char *buf, int size){
+	outLen = 0;
+	biggest = 0;
+	jsonInit (w, buf, size, collect, NULL);
+}
+
+static void known (){
+	char buf[16];
+	jsonWriter_t w;
+	begin (&w, buf, sizeof(buf));
+	jsonObjectStart (&w, NULL);
+	jsonString (&w, "a\"b", "line\nbreak\t\x01 \\ /\xc3\xa9");
+	jsonNumber (&w, "i", 42);
+	jsonNumber (&w, "neg", -7);
+	jsonNumber (&w, "f", 0.1);
+	jsonNumber (&w, "third", 1.0 / 3);
+	jsonNumber (&w, "big", 1e20);
+	jsonNumber (&w, "inf", INFINITY);
+	jsonNumber (&w, "nan", NAN);
+	jsonBool (&w, "t", 1);
+	jsonBool (&w, "f", 0);
+	jsonNull (&w, "n");
+	jsonString (&w, "ns", NULL);
+	jsonArrayStart (&w, "list");
+	jsonNumber (&w, NULL, 1);
+	jsonObjectStart (&w, NULL);
+	jsonObjectEnd (&w);
+	jsonArrayStart (&w, NULL);
+	jsonArrayEnd (&w);
+	jsonString (&w, NULL, "");
+	jsonArrayEnd (&w);
+	jsonObjectEnd (&w);
+	CHECK (!jsonEnd (&w));
+
+	const char *expect = "{\"a\\\"b\":\"line\\nbreak\\t\\u0001 \\\\ /\xc3\xa9\","
+		"\"i\":42,\"neg\":-7,\"f\":0.1,\"third\":0.33333333333333331,\"big\":1e+20,"
+		"\"inf\":null,\"nan\":null,\"t\":true,\"f\":false,\"n\":null,\"ns\":null,"
+		"\"list\":[1,{},[],\"\"]}";
+	out[outLen] = 0;
+	CHECK (!strcmp (out, expect));
+	CHECK (w.total == (int)strlen (expect));
+	CHECK (biggest <= (int)sizeof(buf));
+}
+
+static void document (jsonWriter_t *w){
+	jsonObjectStart (w, NULL);
+	jsonString (w, "title", "Stations");
+	jsonArrayStart (w, "list");
+	for (int i = 0;i < 2000;i++){
+		char name[64];
+		snprintf (name, sizeof(name), "Station %d \"%c\"\tcaf\xc3\xa9", i, 'A' + i % 26);
+		jsonObjectStart (w, NULL);
+		jsonString (w, "name", name);
+		jsonNumber (w, "id", i);
+		jsonNumber (w, "bitrate", 128.5 + i);
+		jsonArrayStart (w, "e");
+		jsonArrayEnd (w);
+		jsonObjectEnd (w);
+	}
+	jsonArrayEnd (w);
+	jsonObjectEnd (w);
+}
+
+static void bufferSizes (){
+	static char first[256 * 1024];
+	int firstLen = 0;
+	static const int sizes[] = {512, 1, 7, 64, 100};
+	for (int i = 0;i < (int)(sizeof(sizes) / sizeof(sizes[0]));i++){
+		char buf[512];
+		jsonWriter_t w;
+		begin (&w, buf, sizes[i]);
+		document (&w);
+		CHECK (!jsonEnd (&w));
+		CHECK (w.total == outLen);
+		CHECK (biggest <= sizes[i]);
+		CHECK (w.flushes == (outLen + sizes[i] - 1) / sizes[i]);
+		if (!i){
+			memcpy (first, out, outLen);
+			firstLen = outLen;
+			printf ("%d bytes, %d flushes of %d\n", outLen, w.flushes, sizes[i]);
+		}
+		else CHECK ((outLen == firstLen) && !memcmp (out, first, outLen));
+	}
+}
+
+static void errors (){
+	char buf[32];
+	jsonWriter_t w;
+
+	jsonInit (&w, buf, sizeof(buf), fail, NULL);
+	document (&w);
+	CHECK (jsonEnd (&w));
+	CHECK (w.flushes == 1);							// dropped after the first failure
+
+	begin (&w, buf, sizeof(buf));
+	jsonArrayStart (&w, NULL);
+	CHECK (jsonEnd (&w));							// not closed
+
+	begin (&w, buf, sizeof(buf));
+	jsonArrayEnd (&w);
+	CHECK (jsonEnd (&w));							// closed too often
+
+	begin (&w, buf, sizeof(buf));
+	for (int i = 0;i < JSONMAXDEPTH + 2;i++) jsonArrayStart (&w, NULL);
+	for (int i = 0;i < JSONMAXDEPTH + 2;i++) jsonArrayEnd (&w);
+	CHECK (jsonEnd (&w));							// too deep
+
+	begin (&w, buf, sizeof(buf));
+	for (int i = 0;i < JSONMAXDEPTH - 1;i++) jsonArrayStart (&w, NULL);
+	for (int i = 0;i < JSONMAXDEPTH - 1;i++) jsonArrayEnd (&w);
+	CHECK (!jsonEnd (&w));							// as deep as allowed
+}
+
+int main (){
+	known ();
+	bufferSizes ();
+	errors ();
+	return testResult ();
+}
@@ -0,0 +1,183 @@
+/********************************************************
+	testKvStore.c
+
+	kvStore on a flash file of 4 KB sectors, counting erases. A
+	volume knob turned in bursts must cost a few records, not one per
+	step. Values that together would not fit in a bank are refused
+	rather than compacted over and over, and a flash whose writes
+	fail is retried with a growing wait. What was written must come
+	back after a reopen, and a torn record must be recovered from
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "kvStore.h"
+#include "kvFlash.h"
+#include "hostTest.h"
+
+static char path[256];
+
+static kvFlash_t *openFlash (int sectors, int fresh){
+	if (fresh) remove (path);
+	return kvFlashFile (path, 4096, sectors);
+}
+
+// 1000 volume steps 20 ms apart, in bursts of 50 with 3 s pauses
+
+static void volume (){
+	kvFlash_t *f = openFlash (4, 1);
+	kvStore_t *kv = kvOpen (f);
+	int formatErases = f->erases;
+	uint32_t ms = 0;
+	int flushes = 0;
+	for (int b = 0;b < 20;b++){
+		for (int i = 0;i < 50;i++){
+			CHECK (!kvSetInt (kv, "volume", (b * 50 + i) % 100));
+			ms += 20;
+			flushes += kvPoll (kv, ms);
+		}
+		for (int i = 0;i < 30;i++){
+			ms += 100;
+			flushes += kvPoll (kv, ms);
+		}
+	}
+	kvStats_t st;
+	kvGetStats (kv, &st);
+	printf ("1000 volume steps: %d flushes, %d records, %d erases\n", flushes, st.records, f->erases - formatErases);
+	CHECK ((flushes == 20) && (st.records == 20));
+	CHECK (f->erases == formatErases);
+
+	kvSet (kv, "gone", "1");
+	kvFlush (kv);
+	kvDelete (kv, "gone");
+	kvClose (kv);
+	kvFlashClose (f);
+
+	f = openFlash (4, 0);
+	kv = kvOpen (f);
+	CHECK (kvGetInt (kv, "volume", -1) == 99);
+	CHECK (kvGet (kv, "gone") == NULL);
+
+// a record torn by a power cut ends the replay and is compacted away
+
+	kvGetStats (kv, &st);
+	uint8_t torn[12] = {5, 0, 1, 0, 0x12, 0x34, 0x56, 0x78, 'v', 'o', 'l', 'u'};
+	kvFlashWrite (f, st.bank * st.bankSize + st.used, torn, sizeof(torn));
+	kvClose (kv);
+	kvFlashClose (f);
+	f = openFlash (4, 0);
+	kv = kvOpen (f);
+	kvGetStats (kv, &st);
+	CHECK ((st.recovered == 1) && (kvGetInt (kv, "volume", -1) == 99));
+	kvSetInt (kv, "volume", 7);
+	kvClose (kv);
+	kvFlashClose (f);
+	f = openFlash (4, 0);
+	kv = kvOpen (f);
+	kvGetStats (kv, &st);
+	CHECK ((st.recovered == 0) && (kvGetInt (kv, "volume", -1) == 7));
+	kvClose (kv);
+	kvFlashClose (f);
+}
+
+// six 3000 byte values in 8 sectors, a bank holds five
+
+static void tooBig (){
+	kvFlash_t *f = openFlash (8, 1);
+	kvStore_t *kv = kvOpen (f);
+	int formatErases = f->erases;
+	char v[3000], k[16];
+	memset (v, 'x', sizeof(v) - 1);
+	v[sizeof(v) - 1] = 0;
+	int refused = 0;
+	for (int i = 0;i < 6;i++){
+		snprintf (k, sizeof(k), "k%d", i);
+		v[0] = '0' + i;
+		if (kvSet (kv, k, v)) refused++;
+	}
+	CHECK (refused == 1);
+	CHECK (kvGet (kv, "k5") == NULL);
+
+	for (uint32_t ms = 0;ms < 60000;ms += 100) kvPoll (kv, ms);
+	int erases = f->erases - formatErases;
+
+// replacing a value counts only the new one, a delete makes room
+
+	v[0] = 'a';
+	CHECK (!kvSet (kv, "k4", v));
+	CHECK (!kvDelete (kv, "k0"));
+	CHECK (!kvSet (kv, "k5", v));
+	CHECK (kvSet (kv, "k6", v));
+	for (uint32_t ms = 60000;ms < 120000;ms += 100) kvPoll (kv, ms);
+
+	kvStats_t st;
+	kvGetStats (kv, &st);
+	printf ("six 3000 byte values in 8 sectors: %d refused, %d erases in the first minute, %d in two\n",
+		st.refused, erases, f->erases - formatErases);
+	CHECK ((st.refused == 2) && (st.failures == 0));
+	CHECK (erases == 0);
+	CHECK (f->erases - formatErases <= 2 * f->sectors / 2);		// a compaction or two
+	kvClose (kv);
+	kvFlashClose (f);
+
+	f = openFlash (8, 0);
+	kv = kvOpen (f);
+	char *s = kvGet (kv, "k5");
+	CHECK (s && (s[0] == 'a') && (strlen (s) == sizeof(v) - 1));
+	free (s);
+	CHECK (kvGet (kv, "k0") == NULL);
+	kvClose (kv);
+	kvFlashClose (f);
+}
+
+// writes fail until the flash is mended
+
+static int (*goodWrite) (kvFlash_t *f, int offset, const void *buf, int len);
+static int attempts;
+
+static int badWrite (kvFlash_t *f, int offset, const void *buf, int len){
+	attempts++;
+	return -1;
+}
+
+static void failing (){
+	kvFlash_t *f = openFlash (8, 1);
+	kvStore_t *kv = kvOpen (f);
+	int formatErases = f->erases;
+	goodWrite = f->write;
+	f->write = badWrite;
+
+	kvSetInt (kv, "volume", 30);
+	uint32_t ms = 0;
+	for (;ms < 600000;ms += 100) kvPoll (kv, ms);
+	int erases = f->erases - formatErases;
+	printf ("10 minutes of a flash that fails writes: %d attempts, %d erases\n", attempts, erases);
+	CHECK ((attempts > 3) && (attempts < 15));
+	CHECK (erases < 50);
+
+	f->write = goodWrite;
+	for (;ms < 1000000;ms += 100) kvPoll (kv, ms);	// within KVRETRYMAXMS
+	kvStats_t st;
+	kvGetStats (kv, &st);
+	CHECK (st.dirty == 0);
+	kvClose (kv);
+	kvFlashClose (f);
+	f = openFlash (8, 0);
+	kv = kvOpen (f);
+	CHECK (kvGetInt (kv, "volume", -1) == 30);
+	kvClose (kv);
+	kvFlashClose (f);
+}
+
+int main (){
+	snprintf (path, sizeof(path), "%s/testKvStore-%d.bin", P_tmpdir, (int)getpid ());
+	volume ();
+	tooBig ();
+	failing ();
+	remove (path);
+	return testResult ();
+}
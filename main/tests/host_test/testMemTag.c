@@ -0,0 +1,265 @@
+/********************************************************
+	testMemTag.c
+
+	Heap counts by tag. Blocks allocated before memTagInit, counted
+	allocs, frees and reallocs, failed allocations, blocks too big to
+	track, foreign frees and a block freed with plain free whose
+	address comes back. Then a small table driven at 3/4 full with
+	random allocs, frees and reallocs against a model of what each tag
+	holds, so entries moved back on delete are checked as the table
+	wraps, and threads each using a tag at once
+
+	The sanitizer's quarantine is off and allocations too large return
+	NULL, so freed addresses are handed out again and failures can be
+	made
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "memTag.h"
+#include "hostTest.h"
+
+#define SLOTS 64
+#define LIVEMAX ((SLOTS / 4) * 3)		// tracked until the table is this full
+
+const char *__asan_default_options (){
+	return "quarantine_size_mb=0:thread_local_quarantine_size_kb=0:allocator_may_return_null=1";
+}
+
+static memTagStats_t tagStats (int tag){
+	memTagStats_t st;
+	memTagGetStats (tag, &st);
+	return st;
+}
+
+static memTagTableStats_t tableStats (){
+	memTagTableStats_t ts;
+	memTagGetTableStats (&ts);
+	return ts;
+}
+
+static void beforeInit (){
+	void *p = memTagMalloc (MEMART, 100, MEMTAGDEFAULT);
+	CHECK (p != NULL);
+	CHECK ((tagStats (MEMART).allocs == 1) && (tagStats (MEMART).bytes == 0));
+	CHECK (tableStats ().untracked == 1);
+	memTagFree (p);
+	CHECK (tableStats ().foreignFrees == 1);
+
+	CHECK (memTagInit (1000) == -1);					// not a power of 2
+	CHECK (memTagInit (SLOTS) == 0);
+	CHECK (memTagInit (SLOTS) == 0);					// once only
+	memTagTableStats_t ts = tableStats ();
+	CHECK ((ts.slots == SLOTS) && (ts.used == 0) && (ts.untracked == 0));
+	CHECK (tagStats (MEMART).allocs == 0);
+}
+
+static void counts (){
+	void *a = memTagMalloc (MEMART, 1000, MEMTAGDEFAULT);
+	void *b = memTagMalloc (MEMART, 500, MEMTAGDEFAULT);
+	void *c = memTagCalloc (MEMJSON, 10, 4, MEMTAGDEFAULT);
+	memTagStats_t art = tagStats (MEMART);
+	CHECK ((art.bytes == 1500) && (art.live == 2) && (art.peak == 1500) && (art.allocs == 2));
+	CHECK ((tagStats (MEMJSON).bytes == 40) && !strcmp (tagStats (MEMJSON).name, "json"));
+	int zero = 1;
+	for (int i = 0;i < 40;i++) zero &= !((char *)c)[i];
+	CHECK (zero);
+
+	memTagFree (b);
+	art = tagStats (MEMART);
+	CHECK ((art.bytes == 1000) && (art.peak == 1500) && (art.frees == 1) && (art.live == 1));
+
+// a realloc keeps the block's tag and is neither an alloc nor a free
+
+	a = memTagRealloc (MEMUI, a, 3000, MEMTAGDEFAULT);
+	art = tagStats (MEMART);
+	CHECK ((art.bytes == 3000) && (art.peak == 3000) && (art.allocs == 2) && (art.frees == 1));
+	CHECK (tagStats (MEMUI).allocs == 0);
+
+// a block from plain malloc is counted from its realloc
+
+	void *g = memTagRealloc (MEMWEB, malloc (10), 20, MEMTAGDEFAULT);
+	CHECK ((tagStats (MEMWEB).bytes == 20) && (tagStats (MEMWEB).allocs == 1));
+	void *h = memTagRealloc (MEMWEB, NULL, 30, MEMTAGDEFAULT);
+	CHECK ((tagStats (MEMWEB).bytes == 50) && (tagStats (MEMWEB).allocs == 2));
+	CHECK (memTagRealloc (MEMWEB, h, 0, MEMTAGDEFAULT) == NULL);
+	CHECK ((tagStats (MEMWEB).bytes == 20) && (tagStats (MEMWEB).frees == 1));
+
+	void *f = malloc (77);
+	memTagFree (f);
+	CHECK (tableStats ().foreignFrees == 1);
+	memTagFree (NULL);
+	CHECK (tableStats ().foreignFrees == 1);
+
+// out of range tags count as other
+
+	void *o = memTagMalloc (MEMTAGS + 3, 8, MEMTAGDEFAULT);
+	CHECK ((tagStats (MEMOTHER).bytes == 8) && !strcmp (memTagName (MEMTAGS), "?"));
+	memTagFree (o);
+
+// failures - the block a realloc failed on is held as it was
+
+	CHECK (memTagMalloc (MEMAUDIO, SIZE_MAX / 2, MEMTAGDEFAULT) == NULL);
+	CHECK ((tagStats (MEMAUDIO).failures == 1) && (tagStats (MEMAUDIO).allocs == 0));
+	CHECK (memTagCalloc (MEMAUDIO, SIZE_MAX / 2, 4, MEMTAGDEFAULT) == NULL);
+	CHECK (memTagRealloc (MEMUI, a, SIZE_MAX / 2, MEMTAGDEFAULT) == NULL);
+	art = tagStats (MEMART);
+	CHECK ((art.failures == 1) && (art.bytes == 3000) && (art.live == 1));
+
+// too big for the 24 bit size - allocated but not counted
+
+	void *big = memTagMalloc (MEMART, 0x01000000 + 1, MEMTAGDEFAULT);
+	CHECK (big != NULL);
+	CHECK ((tableStats ().untracked == 1) && (tagStats (MEMART).bytes == 3000));
+	memTagFree (big);
+	CHECK (tableStats ().foreignFrees == 2);
+
+	memTagBlock_t top[4];
+	CHECK (memTagTop (top, 4) == 3);
+	CHECK ((top[0].ptr == a) && (top[0].size == 3000) && (top[0].tag == MEMART));
+	CHECK ((top[1].size == 40) && (top[1].tag == MEMJSON) && (top[2].size == 20));
+	CHECK ((memTagTop (top, 1) == 1) && (top[0].ptr == a));
+
+// freed with plain free, then the same address handed out again
+
+	void *d = memTagMalloc (MEMAPI, 64, MEMTAGDEFAULT);
+	free (d);
+	void *e = memTagMalloc (MEMDECODER, 64, MEMTAGDEFAULT);
+	CHECK (e == d);
+	if (e == d){
+		CHECK (tableStats ().stale == 1);
+		CHECK ((tagStats (MEMAPI).bytes == 0) && (tagStats (MEMAPI).frees == 1));
+		CHECK ((tagStats (MEMDECODER).bytes == 64) && (tagStats (MEMDECODER).live == 1));
+	}
+
+	memTagFree (a);
+	memTagFree (c);
+	memTagFree (g);
+	memTagFree (e);
+	printMemTags ();
+	for (int t = 0;t < MEMTAGS;t++) CHECK ((tagStats (t).bytes == 0) && (tagStats (t).live == 0));
+	CHECK (tableStats ().used == 0);
+}
+
+// random use of a small table against a model, filling it and emptying
+// it in turns
+
+static void model (){
+	static void *held[LIVEMAX + 8];
+	static int size[LIVEMAX + 8];
+	static int tag[LIVEMAX + 8];
+	int64_t bytes[MEMTAGS] = {0};
+	int live[MEMTAGS] = {0};
+	int untracked = tableStats ().untracked;
+	int full = 0;
+	unsigned seed = 1;
+
+	for (int step = 0;step < 200000;step++){
+		int k = rand_r (&seed) % (LIVEMAX + 8);
+		int r = rand_r (&seed) % 4;
+		int draining = (step / 10000) & 1;				// fills up, then empties
+		if (!held[k]){
+			if (draining && r) continue;
+			int n = 0;
+			for (int i = 0;i < LIVEMAX + 8;i++) n += (held[i] != NULL);
+			size[k] = 1 + rand_r (&seed) % 300;
+			tag[k] = rand_r (&seed) % MEMTAGS;
+			held[k] = memTagMalloc (tag[k], size[k], MEMTAGDEFAULT);
+			if (n >= LIVEMAX){							// not counted, let it go
+				full++;
+				memTagFree (held[k]);
+				held[k] = NULL;
+				continue;
+			}
+			bytes[tag[k]] += size[k];
+			live[tag[k]]++;
+		}
+		else if (r < (draining ? 3 : 1)){
+			memTagFree (held[k]);
+			held[k] = NULL;
+			bytes[tag[k]] -= size[k];
+			live[tag[k]]--;
+		}
+		else {
+			int n = 1 + rand_r (&seed) % 300;
+			held[k] = memTagRealloc (MEMOTHER, held[k], n, MEMTAGDEFAULT);
+			bytes[tag[k]] += n - size[k];
+			size[k] = n;
+		}
+		if (!(step % 97)||(step > 199000)){
+			int same = 1;
+			for (int t = 0;t < MEMTAGS;t++){
+				memTagStats_t st = tagStats (t);
+				same &= (st.bytes == bytes[t]) && (st.live == live[t]);
+			}
+			CHECK (same);
+			if (!same) break;
+
+			memTagBlock_t top[LIVEMAX];
+			int found = memTagTop (top, LIVEMAX);
+			int n = 0, biggest = 0;
+			for (int i = 0;i < LIVEMAX + 8;i++){
+				if (!held[i]) continue;
+				n++;
+				if (size[i] > biggest) biggest = size[i];
+			}
+			CHECK ((found == n) && (tableStats ().used == n));
+			CHECK (!n || ((int)top[0].size == biggest));
+			for (int i = 1;i < found;i++) CHECK (top[i - 1].size >= top[i].size);
+		}
+	}
+	for (int i = 0;i < LIVEMAX + 8;i++) memTagFree (held[i]);
+	memTagTableStats_t ts = tableStats ();
+	CHECK ((ts.used == 0) && (ts.peakUsed == LIVEMAX));
+	CHECK ((full > 0) && (ts.untracked - untracked == full));
+	for (int t = 0;t < MEMTAGS;t++) CHECK ((tagStats (t).bytes == 0) && (tagStats (t).live == 0));
+}
+
+// threads each with a tag and at most 8 blocks, so the table never fills
+
+static void *worker (void *arg){
+	int t = (int)(intptr_t)arg;
+	unsigned seed = t;
+	void *p[8] = {0};
+	for (int i = 0;i < 50000;i++){
+		int k = rand_r (&seed) & 7;
+		if (!p[k]) p[k] = memTagMalloc (t, 1 + i % 500, MEMTAGDEFAULT);
+		else if (i % 3){
+			memTagFree (p[k]);
+			p[k] = NULL;
+		}
+		else p[k] = memTagRealloc (MEMOTHER, p[k], 1 + i % 200, MEMTAGDEFAULT);
+	}
+	for (int k = 0;k < 8;k++) memTagFree (p[k]);
+	return NULL;
+}
+
+static void threads (){
+	memTagTableStats_t before = tableStats ();
+	memTagStats_t was[MEMTAGS];
+	for (int t = 0;t < MEMTAGS;t++) was[t] = tagStats (t);
+	pthread_t th[4];
+	for (int i = 0;i < 4;i++) pthread_create (&th[i], NULL, worker, (void *)(intptr_t)(MEMART + i));
+	for (int i = 0;i < 4;i++) pthread_join (th[i], NULL);
+	memTagTableStats_t ts = tableStats ();
+	CHECK ((ts.used == 0) && (ts.untracked == before.untracked) && (ts.foreignFrees == before.foreignFrees));
+	for (int t = 0;t < MEMTAGS;t++){
+		memTagStats_t st = tagStats (t);
+		CHECK ((st.bytes == 0) && (st.live == 0));
+		CHECK (st.allocs - was[t].allocs == st.frees - was[t].frees);
+		if ((t >= MEMART) && (t < MEMART + 4)) CHECK (st.allocs > was[t].allocs);
+	}
+}
+
+int main (){
+	beforeInit ();
+	counts ();
+	model ();
+	threads ();
+	printMemTags ();
+	return testResult ();
+}
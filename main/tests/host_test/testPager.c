@@ -0,0 +1,244 @@
+/********************************************************
+	testPager.c
+
+	pager.c with the pager task played by the test - pages are
+	loaded by calling pagerLoadPage while pagerNeedsPage says so.
+	Prefetch, load all, a failed page and its retry, a reset while
+	a page is in flight, items without a uri, and running out of
+	memory at every allocation in turn, after which what is loaded
+	must still pair each name with its uri. pagerCreate must give
+	NULL when there is no memory for the page buffer.
+
+	strArena.c is built for the board here (ESP_PLATFORM) so its
+	memory comes through memTagMalloc, which this test can fail
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "memTag.h"
+#include "pager.h"
+#include "hostTest.h"
+
+// not in pager.h, the pager task calls them
+
+void pagerLoadPage (pager_t *p);
+int pagerNeedsPage (pager_t *p, int64_t now);
+
+// FreeRTOS and esp_timer - the mutex counts so an unbalanced lock shows
+
+static int mutex, wake, locked, tasks;
+static int64_t now;
+
+SemaphoreHandle_t xSemaphoreCreateMutex (){
+	return &mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary (){
+	return &wake;
+}
+
+BaseType_t xSemaphoreTake (SemaphoreHandle_t s, TickType_t wait){
+	if (s == &mutex) CHECK (++locked == 1);
+	return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive (SemaphoreHandle_t s){
+	if (s == &mutex) CHECK (--locked == 0);
+	return pdTRUE;
+}
+
+BaseType_t xTaskCreate (TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+	int priority, TaskHandle_t *handle){
+	tasks++;
+	return pdTRUE;
+}
+
+int64_t esp_timer_get_time (){
+	return now;
+}
+
+// memTag, failing every allocation from failFrom on
+
+static int allocs, failFrom = -1;
+
+static int memFails (){
+	return (failFrom >= 0) && (allocs++ >= failFrom);
+}
+
+void *memTagMalloc (int tag, size_t size, uint32_t caps){
+	return memFails () ? NULL : malloc (size);
+}
+
+void *memTagRealloc (int tag, void *p, size_t size, uint32_t caps){
+	return memFails () ? NULL : realloc (p, size);
+}
+
+void memTagFree (void *p){
+	free (p);
+}
+
+static void noFailures (){
+	failFrom = -1;
+	allocs = 0;
+}
+
+// the API - total items, every seventh without a uri when gaps is set
+
+static int total, gaps, failNext, fetches, loads;
+static pager_t *resetDuring;
+
+static int fetch (int offset, int limit, const char **paths, int npaths, jsonExtractCb_t cb, void *arg){
+	fetches++;
+	if (failNext){
+		failNext = 0;
+		return -1;
+	}
+	if (resetDuring){
+		pagerReset (resetDuring);
+		resetDuring = NULL;
+	}
+	char s[64];
+	snprintf (s, sizeof(s), "%d", total);
+	cb (arg, 0, -1, JXTYPENUMBER, s);
+	for (int i = 0;(i < limit) && (offset + i < total);i++){
+		snprintf (s, sizeof(s), "Playlist number %d", offset + i);
+		cb (arg, 1, i, JXTYPESTRING, s);
+		if (gaps && !((offset + i) % 7)) continue;
+		snprintf (s, sizeof(s), "spotify:playlist:%d", offset + i);
+		cb (arg, 2, i, JXTYPESTRING, s);
+	}
+	return 0;
+}
+
+static void loaded (){
+	loads++;
+}
+
+static const char *paths[] = {"total", "items[].name", "items[].uri"};
+
+static void runTask (pager_t *p){
+	while (pagerNeedsPage (p, now)) pagerLoadPage (p);
+}
+
+// every loaded item has its own name and uri
+
+static int itemsMatch (pager_t *p){
+	for (int i = 0;i < pagerCount (p);i++){
+		char name[64], uri[64];
+		snprintf (name, sizeof(name), "Playlist number %d", i);
+		snprintf (uri, sizeof(uri), "spotify:playlist:%d", i);
+		if (strcmp (pagerLoadedName (p, i), name)) return 0;
+		if (gaps && !(i % 7)) uri[0] = 0;
+		if (strcmp (pagerUri (p, i), uri)) return 0;
+	}
+	return 1;
+}
+
+static void noMemory (){
+	failFrom = 0;
+	pager_t *p = pagerCreate ("none", fetch, paths, loaded);
+	CHECK (p == NULL);
+	CHECK (tasks == 0);
+	CHECK (!strcmp (pagerName (p, 0), "") && (pagerTotal (p) == 0) && (pagerCount (p) == 0));
+	pagerReset (p);
+	pagerLoadAll (p);
+	noFailures ();
+}
+
+static void loading (pager_t *p){
+	total = 137;
+	pagerReset (p);
+	CHECK (pagerTotal (p) == -1);
+	runTask (p);
+	CHECK ((pagerCount (p) == 20) && (pagerTotal (p) == 137) && (fetches == 1));
+
+	CHECK (!strcmp (pagerName (p, 30), ""));		// not loaded yet, asks for 51
+	runTask (p);
+	CHECK ((pagerCount (p) == 60) && (fetches == 3));
+	CHECK (!strcmp (pagerLoadedName (p, 70), ""));	// does not ask
+	CHECK (!pagerNeedsPage (p, now));
+
+	pagerLoadAll (p);
+	runTask (p);
+	CHECK ((pagerCount (p) == 137) && (fetches == 7));
+	CHECK (itemsMatch (p));
+	CHECK (!strcmp (pagerName (p, 137), "") && !strcmp (pagerName (p, -1), ""));
+	CHECK (loads == 8);								// the reset and every page
+}
+
+static void failures (pager_t *p){
+	fetches = 0;
+	pagerReset (p);
+	failNext = 1;
+	runTask (p);
+	CHECK ((fetches == 1) && (pagerCount (p) == 0));
+	now += 4999 * 1000;
+	CHECK (!pagerNeedsPage (p, now));				// waits PAGERRETRYMS
+	now += 1000;
+	runTask (p);
+	CHECK ((fetches == 2) && (pagerCount (p) == 20));
+
+// a reset while a page is in flight throws the page away
+
+	fetches = 0;
+	resetDuring = p;
+	pagerName (p, 30);
+	runTask (p);
+	CHECK ((pagerCount (p) == 20) && (fetches == 2));
+	CHECK (itemsMatch (p));
+
+// an item without a uri gets ""
+
+	gaps = 1;
+	pagerReset (p);
+	pagerLoadAll (p);
+	runTask (p);
+	CHECK ((pagerCount (p) == 137) && itemsMatch (p));
+	gaps = 0;
+
+// no items when the total says there are more
+
+	total = 0;
+	pagerReset (p);
+	runTask (p);
+	CHECK ((pagerCount (p) == 0) && (pagerTotal (p) == 0));
+}
+
+static void outOfMemory (pager_t *p){
+	total = 400;
+	int stopped = 0;
+	for (int from = 0;from < 40;from++){
+		pagerReset (p);
+		pagerLoadAll (p);
+		allocs = 0;
+		failFrom = from;
+		runTask (p);
+		noFailures ();
+		CHECK (pagerTotal (p) == pagerCount (p));
+		CHECK (itemsMatch (p));
+		if (pagerCount (p) < total) stopped++;
+	}
+	CHECK (stopped > 0);
+
+	pagerReset (p);
+	pagerLoadAll (p);
+	runTask (p);
+	CHECK ((pagerCount (p) == 400) && itemsMatch (p));
+}
+
+int main (){
+	noMemory ();
+	pager_t *p = pagerCreate ("playlists", fetch, paths, loaded);
+	CHECK ((p != NULL) && (tasks == 1));
+	if (!p) return testResult ();
+	loading (p);
+	failures (p);
+	outOfMemory (p);
+	CHECK (locked == 0);
+	return testResult ();
+}
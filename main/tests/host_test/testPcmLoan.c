@@ -0,0 +1,233 @@
+/********************************************************
+	testPcmLoan.c
+
+	The audio path of locoBoard.c on the loan calls, with its sizes.
+	A stand-in decoder writes a running count straight into blocks
+	from audioLoanBlock, as getAdfSamples does, and often less than
+	it was loaned. A stand-in for i2s_channel_write is handed the
+	blocks from pcmRingReadBegin and makes the driver's one copy into
+	its DMA buffer - it counts every frame it is handed from anywhere
+	but the ring as an intermediate copy, there must be none.
+
+	Then the watermarks with audioThread's 2048 frame reads - a read
+	that empties the ring exactly or gets less than it asked for is
+	not an underrun, only finding it empty is. Then blocks split at
+	the end of the ring and head and tail wrapping past 2^32
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pcmRing.h"
+#include "hostTest.h"
+
+#define PCMRINGSIZE 4096
+#define PCMLOWWATER 1024
+#define PCMHIGHWATER 3072
+#define PCMCHUNK 1024
+#define READFRAMES 2048					// AUDIOBUFFERSIZE / 2
+
+static uint32_t ring[PCMRINGSIZE];
+static pcmRing_t *pcmRing;
+
+static int audioLoanBlock (uint32_t **frames, int maxFrames){
+	return pcmRingWriteBegin (pcmRing, frames, maxFrames);
+}
+
+static void audioQueueBlock (int frames){
+	pcmRingWriteEnd (pcmRing, frames);
+}
+
+// the decoder, up to bytes of the count into buf
+
+static uint32_t decoded;
+static unsigned seed;
+
+static int decode (uint8_t *buf, int bytes){
+	uint32_t *f = (uint32_t *)buf;
+	int n = bytes / 4;
+	if (!(rand_r (&seed) % 4)) n = rand_r (&seed) % (n + 1);
+	for (int i = 0;i < n;i++) f[i] = decoded++;
+	return n * 4;
+}
+
+// the I2S driver
+
+static struct {
+	uint32_t dma[READFRAMES];
+	uint32_t expect;
+	int64_t frames;
+	int64_t copied;					// frames not sent from the ring
+	int bad;
+} sink;
+
+static int sinkWrite (const void *src, size_t bytes, size_t *written){
+	const uint32_t *f = src;
+	int n = bytes / 4;
+	CHECK (n <= READFRAMES);
+	if ((f < ring) || (f + n > ring + PCMRINGSIZE)) sink.copied += n;
+	memcpy (sink.dma, src, bytes);
+	for (int i = 0;i < n;i++){
+		if (sink.dma[i] != sink.expect) sink.bad++;
+		sink.expect = sink.dma[i] + 1;
+	}
+	sink.frames += n;
+	*written = bytes;
+	return 0;
+}
+
+// pcmThread, a pass fills up to PCMHIGHWATER
+
+static void pcmPass (){
+	while (pcmRingFill (pcmRing) < PCMHIGHWATER){
+		uint32_t *block;
+		int frames = audioLoanBlock (&block, PCMCHUNK);
+		if (!frames) break;
+		int count = decode ((uint8_t *)block, frames * 4);
+		audioQueueBlock (count / 4);
+	}
+}
+
+// audioThread, one read
+
+static int audioPass (){
+	uint32_t *block;
+	int frames = pcmRingReadBegin (pcmRing, &block, READFRAMES);
+	size_t len = 0;
+	if (frames) sinkWrite (block, frames * 4, &len);
+	pcmRingReadEnd (pcmRing, frames);
+	return len / 4;
+}
+
+static void newRing (){
+	free (pcmRing);
+	pcmRing = pcmRingCreate (ring, PCMRINGSIZE, PCMLOWWATER, PCMHIGHWATER);
+	CHECK (pcmRing != NULL);
+	memset (&sink, 0, sizeof(sink));
+	decoded = 0;
+}
+
+static void streaming (){
+	newRing ();
+	seed = 3;
+	for (int i = 0;i < 20000;i++){
+		pcmPass ();
+		audioPass ();
+	}
+	pcmRingDrain (pcmRing);
+	while (audioPass ());
+
+	pcmStats_t s;
+	pcmRingStats (pcmRing, &s);
+	printf ("%lld frames, %lld copied, underruns %u, fill %d..%d\n",
+		(long long)sink.frames, (long long)sink.copied, s.underruns, s.minFill, s.maxFill);
+	CHECK ((sink.copied == 0) && (sink.bad == 0));
+	CHECK ((sink.frames == decoded) && (s.read == decoded) && (pcmRingFill (pcmRing) == 0));
+	CHECK ((s.underruns == 0) && (s.overflows == 0));
+}
+
+// writes n more of the count, whatever the loans are
+
+static void put (int n){
+	while (n){
+		uint32_t *block;
+		int frames = audioLoanBlock (&block, n);
+		CHECK (frames > 0);
+		if (frames <= 0) return;
+		for (int i = 0;i < frames;i++) block[i] = decoded++;
+		audioQueueBlock (frames);
+		n -= frames;
+	}
+}
+
+static uint32_t underruns (){
+	pcmStats_t s;
+	pcmRingStats (pcmRing, &s);
+	return s.underruns;
+}
+
+static void watermarks (){
+	newRing ();
+	put (1000);
+	CHECK (audioPass () == 0);					// waiting for PCMLOWWATER
+	put (1048);
+	CHECK (audioPass () == READFRAMES);			// empties it exactly
+	CHECK (underruns () == 0);
+
+	put (100);
+	CHECK (audioPass () == 100);				// short, still running
+	CHECK (underruns () == 0);
+	CHECK (audioPass () == 0);					// dry
+	CHECK (underruns () == 1);
+
+	put (500);
+	CHECK (audioPass () == 0);					// waits again
+	put (524);
+	CHECK (audioPass () == 1024);
+	CHECK (underruns () == 1);
+
+// dry while draining is not an underrun and what is left plays at once
+
+	pcmRingDrain (pcmRing);
+	CHECK (audioPass () == 0);
+	put (10);
+	pcmRingDrain (pcmRing);
+	CHECK (audioPass () == 10);
+	CHECK (underruns () == 1);
+
+	uint32_t *block;
+	CHECK (audioLoanBlock (&block, 5000) == PCMRINGSIZE - (int)(decoded % PCMRINGSIZE));
+	CHECK (audioLoanBlock (&block, 0) == 0);
+	pcmStats_t s;
+	pcmRingStats (pcmRing, &s);
+	CHECK (s.overflows == 1);
+	CHECK ((sink.copied == 0) && (sink.bad == 0));
+}
+
+static void wrapAround (){
+	newRing ();
+	put (3000);
+	while (audioPass ());
+	uint32_t *block;
+
+// loans stop at the end of the ring and go on from the start
+
+	CHECK ((audioLoanBlock (&block, 2000) == 1096) && (block == ring + 3000));
+	CHECK ((audioLoanBlock (&block, 2000) == 1096) && (block == ring + 3000));
+	put (2000);
+	CHECK ((pcmRingReadBegin (pcmRing, &block, READFRAMES) == 1096) && (block == ring + 3000));
+	pcmRingReadEnd (pcmRing, 0);
+	CHECK (audioPass () == 1096);
+	CHECK (audioPass () == 904);
+	CHECK (underruns () == 1);					// the first pass ran it dry
+
+// head and tail past 2^32
+
+	uint32_t start = sink.expect;
+	for (int64_t i = 0;i < (1LL << 32) / READFRAMES;i++){
+		audioLoanBlock (&block, READFRAMES);
+		audioQueueBlock (READFRAMES);
+		pcmRingReadBegin (pcmRing, &block, READFRAMES);
+		pcmRingReadEnd (pcmRing, READFRAMES);
+	}
+	pcmStats_t s;
+	pcmRingStats (pcmRing, &s);
+	CHECK ((s.written == 5000) && (s.read == 5000) && (pcmRingFill (pcmRing) == 0));
+
+	decoded = start;
+	sink.expect = start;
+	put (3000);
+	CHECK (pcmRingFill (pcmRing) == 3000);
+	while (audioPass ());
+	CHECK ((sink.expect == start + 3000) && (sink.copied == 0) && (sink.bad == 0));
+}
+
+int main (){
+	streaming ();
+	watermarks ();
+	wrapAround ();
+	free (pcmRing);
+	return testResult ();
+}
@@ -0,0 +1,112 @@
+/********************************************************
+	testPcmRing.c
+
+	A producer and a consumer pthread pass a running count through
+	the ring in random sized pieces with random pauses, as the decoder
+	and the I2S writer do. Every frame must come out once and in
+	order, through the copying calls and through the loaned ones
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pcmRing.h"
+#include "hostTest.h"
+
+#define FRAMES 1000000
+#define SIZE 1024
+
+typedef struct {
+	pcmRing_t *r;
+	int loaned;							// use the Begin/End calls
+	unsigned seed;
+} side_t;
+
+static void jitter (unsigned *seed){
+	int n = rand_r (seed) % 100;
+	if (n == 0) usleep (rand_r (seed) % 500);
+	else if (n < 5) usleep (rand_r (seed) % 50);
+}
+
+static void *producer (void *arg){
+	side_t *p = arg;
+	uint32_t seq = 0;
+	uint32_t chunk[300];
+
+	while (seq < FRAMES){
+		int n = 1 + rand_r (&p->seed) % 300;
+		if (n > FRAMES - (int)seq) n = FRAMES - seq;
+
+		if (p->loaned){
+			uint32_t *f;
+			n = pcmRingWriteBegin (p->r, &f, n);
+			for (int i = 0;i < n;i++) f[i] = seq + i;
+			pcmRingWriteEnd (p->r, n);
+			seq += n;
+			if (!n) usleep (1);
+		}
+		else {
+			for (int i = 0;i < n;i++) chunk[i] = seq + i;
+			uint32_t *f = chunk;
+			while (n){
+				int w = pcmRingWrite (p->r, f, n);
+				f += w;
+				n -= w;
+				seq += w;
+				if (n) usleep (1);
+			}
+		}
+		jitter (&p->seed);
+	}
+	pcmRingDrain (p->r);
+	return NULL;
+}
+
+static void run (int loaned){
+	static uint32_t buffer[SIZE];
+	pcmRing_t *r = pcmRingCreate (buffer, SIZE, SIZE / 4, SIZE * 3 / 4);
+	CHECK (r != NULL);
+	side_t p = {r, loaned, 1};
+	pthread_t t;
+	pthread_create (&t, NULL, producer, &p);
+
+	uint32_t expect = 0, out[200];
+	int bad = 0;
+	unsigned seed = 7;
+	while (expect < FRAMES){
+		int want = 1 + rand_r (&seed) % 200;
+		uint32_t *f = out;
+		int n;
+		if (loaned) n = pcmRingReadBegin (r, &f, want);
+		else n = pcmRingRead (r, out, want);
+		for (int i = 0;i < n;i++){
+			if (f[i] != expect) bad++;
+			expect = f[i] + 1;
+		}
+		if (loaned) pcmRingReadEnd (r, n);
+		if (!n) usleep (1);
+		jitter (&seed);
+	}
+	pthread_join (t, NULL);
+
+	pcmStats_t s;
+	pcmRingStats (r, &s);
+	printf ("%s bad %d written %u read %u underruns %u overflows %u fill %d..%d\n",
+		loaned ? "loaned " : "copying", bad, s.written, s.read, s.underruns, s.overflows, s.minFill, s.maxFill);
+	CHECK (bad == 0);
+	CHECK (s.written == FRAMES);
+	CHECK (s.read == FRAMES);
+	CHECK (pcmRingFill (r) == 0);
+	CHECK ((s.maxFill <= SIZE) && (s.minFill >= 0));
+	free (r);
+}
+
+int main (){
+	run (0);
+	run (1);
+	return testResult ();
+}
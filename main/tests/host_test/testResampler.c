@@ -0,0 +1,168 @@
+/********************************************************
+	testResampler.c
+
+	Sines at the stream rates the radio sees are resampled to 44.1k
+	and compared with the ideal sine at the output rate. The sine,
+	its quadrature and DC are fitted by least squares, everything
+	left over is THD+N. The right channel carries the cosine so the
+	channels must stay apart. Also checked are how many frames come
+	out, DC gain, and that a tone above the output Nyquist does not
+	alias back in when downsampling
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "resampler.h"
+#include "hostTest.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define OUTRATE 44100
+#define AMPLITUDE 16000
+#define SECONDS 1
+#define SKIP 200						// filter start up at each end
+#define THDNLIMIT -75.0					// dB, about 13 bits
+
+static uint32_t frame (int16_t l, int16_t r){
+	return (uint16_t)l | ((uint32_t)(uint16_t)r << 16);
+}
+
+static int16_t channel (uint32_t f, int right){
+	return (int16_t)(right ? f >> 16 : f & 0xffff);
+}
+
+// residual power over the fitted sine's, in dB
+
+static double thdn (const uint32_t *x, int n, int right, double f, double fs, double *level){
+	double a[3][3] = {{0}}, b[3] = {0}, c[3];
+	for (int i = 0;i < n;i++){
+		double v[3] = {sin (2 * M_PI * f * i / fs), cos (2 * M_PI * f * i / fs), 1};
+		for (int j = 0;j < 3;j++){
+			b[j] += v[j] * channel (x[i], right);
+			for (int k = 0;k < 3;k++) a[j][k] += v[j] * v[k];
+		}
+	}
+	for (int i = 0;i < 3;i++){
+		for (int j = i + 1;j < 3;j++){
+			double m = a[j][i] / a[i][i];
+			for (int k = 0;k < 3;k++) a[j][k] -= m * a[i][k];
+			b[j] -= m * b[i];
+		}
+	}
+	for (int i = 2;i >= 0;i--){
+		double t = b[i];
+		for (int k = i + 1;k < 3;k++) t -= a[i][k] * c[k];
+		c[i] = t / a[i][i];
+	}
+	double signal = 0, residual = 0;
+	for (int i = 0;i < n;i++){
+		double fit = c[0] * sin (2 * M_PI * f * i / fs) + c[1] * cos (2 * M_PI * f * i / fs) + c[2];
+		signal += fit * fit;
+		residual += (channel (x[i], right) - fit) * (channel (x[i], right) - fit);
+	}
+	*level = sqrt (2 * signal / n);
+	return 10 * log10 (residual / signal);
+}
+
+// in pieces as the radio decoder delivers them, then drained
+
+static int resample (int inRate, const uint32_t *in, int frames, uint32_t *out, int max){
+	resampler_t *r = resamplerCreate (inRate, OUTRATE);
+	int produced = 0, offset = 0;
+	while (offset < frames){
+		int used;
+		int n = (frames - offset < 1152) ? frames - offset : 1152;
+		produced += resamplerProcess (r, in + offset, n, &used, out + produced, 256);
+		offset += used;
+	}
+	while (1){
+		int used;
+		int p = resamplerProcess (r, in, 0, &used, out + produced, 256);
+		if (!p) break;
+		produced += p;
+	}
+	resamplerDelete (r);
+	return produced;
+}
+
+static uint32_t *tone (int rate, double f, int frames){
+	uint32_t *x = malloc (frames * sizeof(uint32_t));
+	for (int i = 0;i < frames;i++){
+		x[i] = frame (lrint (AMPLITUDE * sin (2 * M_PI * f * i / rate)),
+			lrint (AMPLITUDE * cos (2 * M_PI * f * i / rate)));
+	}
+	return x;
+}
+
+int main (){
+	static const int rates[] = {48000, 32000, 22050, 96000, 16000, 8000};
+	static const double freqs[] = {440, 1000, 5000, 10000, 15000};
+	int max = OUTRATE * SECONDS * 2;
+	uint32_t *out = malloc (max * sizeof(uint32_t));
+
+	for (int i = 0;i < (int)(sizeof(rates) / sizeof(rates[0]));i++){
+		for (int j = 0;j < (int)(sizeof(freqs) / sizeof(freqs[0]));j++){
+			int rate = rates[i];
+			double f = freqs[j];
+			if ((f > 0.4 * rate)||(f > 0.4 * OUTRATE)) continue;
+
+			int frames = rate * SECONDS;
+			uint32_t *in = tone (rate, f, frames);
+			int n = resample (rate, in, frames, out, max);
+			int expect = (int)((int64_t)frames * OUTRATE / rate);
+			int tail = 17 * OUTRATE / rate + 2;		// the last half filter of input is not played
+			double levelL, levelR;
+			double l = thdn (out + SKIP, n - 2 * SKIP, 0, f, OUTRATE, &levelL);
+			double r = thdn (out + SKIP, n - 2 * SKIP, 1, f, OUTRATE, &levelR);
+			printf ("%5d -> %d %5.0fHz out %d/%d THD+N %.1f %.1f dB level %.0f %.0f\n",
+				rate, OUTRATE, f, n, expect, l, r, levelL, levelR);
+			CHECK ((n <= expect) && (n >= expect - tail));
+			CHECK ((l < THDNLIMIT) && (r < THDNLIMIT));
+			CHECK (fabs (levelL - AMPLITUDE) < AMPLITUDE * 0.06);	// flat to 0.5dB
+			CHECK (fabs (levelR - AMPLITUDE) < AMPLITUDE * 0.06);
+			free (in);
+		}
+	}
+
+// DC comes through to within a few LSB
+
+	{
+		int frames = 48000 / 10;
+		uint32_t *in = malloc (frames * sizeof(uint32_t));
+		for (int i = 0;i < frames;i++) in[i] = frame (12345, -23456);
+		int n = resample (48000, in, frames, out, max);
+		int worst = 0;
+		for (int i = SKIP;i < n - SKIP;i++){
+			int e = abs (channel (out[i], 0) - 12345);
+			if (e > worst) worst = e;
+			e = abs (channel (out[i], 1) + 23456);
+			if (e > worst) worst = e;
+		}
+		printf ("DC worst error %d\n", worst);
+		CHECK (worst <= 4);
+		free (in);
+	}
+
+// 30kHz at 96k would alias to 14.1kHz at 44.1k
+
+	{
+		int frames = 96000 * SECONDS;
+		uint32_t *in = tone (96000, 30000, frames);
+		int n = resample (96000, in, frames, out, max);
+		double level;
+		thdn (out + SKIP, n - 2 * SKIP, 0, OUTRATE - 30000, OUTRATE, &level);
+		double db = 20 * log10 (level / AMPLITUDE + 1e-9);
+		printf ("96000 -> %d 30kHz alias at %.1f dB\n", OUTRATE, db);
+		CHECK (db < -60);
+		free (in);
+	}
+
+	free (out);
+	return testResult ();
+}
@@ -0,0 +1,79 @@
+/********************************************************
+	testStrArena.c
+
+	Strings of random length added in rounds with a clear between,
+	each must read back as added (cut to blockSize - 1) and an old
+	pointer must stay readable. Truncating then adding again must
+	reuse the space and leave the strings before untouched
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "strArena.h"
+#include "hostTest.h"
+
+#define BLOCK 64
+#define STRINGS 3000
+
+static void make (char *buf, int i, int len){
+	for (int k = 0;k < len;k++) buf[k] = 'a' + (i + k) % 26;
+	buf[len] = 0;
+}
+
+static void rounds (strArena_t *a){
+	static char *keep[STRINGS];
+	char buf[200];
+	for (int round = 0;round < 3;round++){
+		strArenaClear (a);
+		for (int i = 0;i < STRINGS;i++){
+			make (buf, i, rand () % 100);
+			CHECK (strArenaAdd (a, buf) == i);
+			keep[i] = strArenaGet (a, i);
+			buf[BLOCK - 1] = 0;
+			CHECK (!strcmp (keep[i], buf));
+		}
+		for (int i = 0;i < STRINGS;i++) CHECK (strlen (keep[i]) < BLOCK);
+	}
+	CHECK (strArenaCount (a) == STRINGS);
+	CHECK (!strArenaGet (a, STRINGS) && !strArenaGet (a, -1));
+}
+
+static void truncation (strArena_t *a){
+	char buf[200];
+	strArenaClear (a);
+	for (int i = 0;i < 100;i++){
+		make (buf, i, 5 + i % 40);
+		strArenaAdd (a, buf);
+	}
+	int bytes = strArenaBytes (a);
+	for (int cut = 100;cut >= 0;cut -= 7){
+		strArenaTruncate (a, cut);
+		CHECK (strArenaCount (a) == cut);
+		for (int i = cut;i < 100;i++){
+			make (buf, i, 5 + i % 40);
+			CHECK (strArenaAdd (a, buf) == i);
+		}
+		for (int i = 0;i < 100;i++){
+			make (buf, i, 5 + i % 40);
+			CHECK (!strcmp (strArenaGet (a, i), buf));
+		}
+		CHECK (strArenaBytes (a) == bytes);			// the space was reused
+	}
+	strArenaTruncate (a, 200);
+	CHECK (strArenaCount (a) == 100);
+	strArenaTruncate (a, -1);
+	CHECK (strArenaCount (a) == 0);
+}
+
+int main (){
+	strArena_t *a = strArenaCreate (BLOCK);
+	CHECK (a != NULL);
+	rounds (a);
+	truncation (a);
+	printf ("%d bytes\n", strArenaBytes (a));
+	strArenaDelete (a);
+	return testResult ();
+}
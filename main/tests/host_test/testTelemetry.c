@@ -0,0 +1,205 @@
+/********************************************************
+	testTelemetry.c
+
+	The telemetry figures from made up samples - CPU shares and the
+	busiest period while the run time counters wrap, a task that starts
+	part way through the window and one that goes, two tasks with the
+	same name, the idle tasks against busy, stack and heap lows and
+	fragmentation. Then the Prometheus text, escaped labels and what
+	telemetryFormat does with a buffer too small for it
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry.h"
+#include "hostTest.h"
+
+#define SECOND 1000000u
+
+static void addTask (telemetrySample_t *s, const char *name, uint32_t id, uint32_t runtime, uint32_t stackFree, int priority){
+	telemetryTask_t *task = &s->task[s->ntasks++];
+	strncpy (task->name, name, TELEMNAMELEN - 1);
+	task->id = id;
+	task->runtime = runtime;
+	task->stackFree = stackFree;
+	task->priority = priority;
+}
+
+static const telemetryTaskReport_t *reportTask (const telemetryReport_t *r, uint32_t id){
+	for (int i = 0;i < r->ntasks;i++){
+		if (r->task[i].id == id) return &r->task[i];
+	}
+	return NULL;
+}
+
+static void empty (){
+	telemetry_t *t = telemetryCreate (4);
+	telemetryReport_t r;
+	CHECK (telemetryReport (t, &r) == 0);
+	CHECK ((r.ntasks == 0) && (r.cpuBusy == 0) && (r.heap[0].fragmentation == 0));
+	char buf[4096];
+	int n = telemetryFormat (t, buf, sizeof(buf));
+	CHECK ((n > 0) && (n == (int)strlen (buf)));
+	CHECK (strstr (buf, "loco_telemetry_samples 0\n") != NULL);
+	telemetryFree (t);
+}
+
+// six one second samples into a window of four, two cores. Inside the
+// window the audio task's counter wraps in period 3 and the clock in
+// period 4
+
+static telemetry_t *session (){
+	telemetry_t *t = telemetryCreate (4);
+	uint32_t clock = 0xFFFFFFFFu - 7 * SECOND / 2;
+	uint32_t audio = 0xFFFFFFFFu - 700000, idle0 = 0, idle1 = 0, art = 0, web = 0, same = 0;
+	for (int i = 0;i < 6;i++){
+		telemetrySample_t s;
+		memset (&s, 0, sizeof(s));
+		s.timeUs = i * (int64_t)SECOND;
+		s.runtime = clock + i * SECOND;
+		s.cores = 2;
+		uint32_t a = (i == 3) ? 800000 : 100000;		// a burst in period 3
+		audio += a;
+		idle0 += SECOND - a;
+		idle1 += 900000;
+		addTask (&s, "audioThread", 5, audio, 1000 - i * 10, 7);
+		addTask (&s, "IDLE0", 1, idle0, 500, 0);
+		addTask (&s, "IDLE1", 2, idle1, 500, 0);
+		if (i < 4){
+			web += 300000;
+			addTask (&s, "httpd", 7, web, 2000, 5);		// gone by the last sample
+		}
+		if (i >= 4){
+			art += (i == 4) ? 0 : 500000;
+			addTask (&s, "Art \"T\"\\", 9, art, 3000, 5);	// started part way
+		}
+		same += 100000;
+		addTask (&s, "audioThread", 11, same, 800, 3);	// same name, another task
+		s.heap[TELEMINTERNAL] = (telemetryHeap_t){300000, 100000 - i * 1000, 50000, 40000};
+		s.heap[TELEMSPIRAM] = (telemetryHeap_t){8000000, 4000000 + i, 3000000, 4000000 + i};
+		s.heap[TELEMDMA] = (telemetryHeap_t){200000, (i == 2) ? 10000 : 60000, 9000, 30000};
+		telemetryAdd (t, &s);
+	}
+	return t;
+}
+
+static void figures (telemetry_t *t){
+	telemetryReport_t r;
+	CHECK (telemetryReport (t, &r) == 4);
+	CHECK ((r.windowUs == 3 * SECOND) && (r.cores == 2));
+	CHECK (r.ntasks == 5);
+
+// the window is samples 2 to 5, periods 3, 4 and 5 - 800 + 100 + 100 ms
+// in 3 s, across both wraps
+
+	const telemetryTaskReport_t *audio = reportTask (&r, 5);
+	CHECK (audio && (audio->cpu == 333) && (audio->cpuPeak == 800));
+	CHECK (audio && (audio->stackFree == 950) && (audio->priority == 7));
+	CHECK (audio && !strcmp (audio->name, "audioThread"));
+
+// only the one period the art task was there for
+
+	const telemetryTaskReport_t *art = reportTask (&r, 9);
+	CHECK (art && (art->cpu == 500) && (art->cpuPeak == 500) && (art->stackFree == 3000));
+
+	const telemetryTaskReport_t *same = reportTask (&r, 11);
+	CHECK (same && (same->cpu == 100) && (same->stackFree == 800));
+	CHECK (reportTask (&r, 7) == NULL);
+
+// idle0 (200 + 900 + 900) / 3000 = 667, idle1 900, busy (2000 - 1567) / 2
+
+	CHECK (r.cpuBusy == 216);
+	for (int i = 1;i < r.ntasks;i++) CHECK (r.task[i - 1].cpu >= r.task[i].cpu);
+
+	const telemetryHeapReport_t *internal = &r.heap[TELEMINTERNAL];
+	CHECK ((internal->free == 95000) && (internal->windowMinFree == 95000));
+	CHECK ((internal->minFree == 50000) && (internal->largest == 40000));
+	CHECK (internal->fragmentation == 58);
+	CHECK (r.heap[TELEMSPIRAM].fragmentation == 0);
+	CHECK ((r.heap[TELEMDMA].free == 60000) && (r.heap[TELEMDMA].windowMinFree == 10000));
+	CHECK (r.heap[TELEMDMA].fragmentation == 50);
+
+	printTelemetry (t);
+}
+
+// more tasks than a sample holds are cut at TELEMTASKMAX
+
+static void manyTasks (){
+	telemetry_t *t = telemetryCreate (1);
+	telemetrySample_t s;
+	for (int i = 0;i < 2;i++){
+		memset (&s, 0, sizeof(s));
+		s.runtime = i * SECOND;
+		for (int n = 0;n < TELEMTASKMAX;n++){
+			char name[TELEMNAMELEN];
+			snprintf (name, sizeof(name), "task%d", n);
+			addTask (&s, name, n + 1, i * SECOND / TELEMTASKMAX, 100, 1);
+		}
+		s.ntasks = TELEMTASKMAX + 5;
+		telemetryAdd (t, &s);
+	}
+	telemetryReport_t r;
+	CHECK (telemetryReport (t, &r) == 2);				// a window is at least two
+	CHECK ((r.ntasks == TELEMTASKMAX) && (r.cores == 1));
+	CHECK (reportTask (&r, 1) && (reportTask (&r, 1)->cpu == 31));
+	telemetryFree (t);
+}
+
+static void text (telemetry_t *t){
+	static char buf[16 * 1024];
+	int n = telemetryFormat (t, buf, sizeof(buf));
+	CHECK ((n > 0) && (n < (int)sizeof(buf)) && (n == (int)strlen (buf)));
+	CHECK (strstr (buf, "loco_telemetry_samples 4\n") != NULL);
+	CHECK (strstr (buf, "loco_telemetry_window_seconds 3.000\n") != NULL);
+	CHECK (strstr (buf, "loco_cpu_busy_percent 21.6\n") != NULL);
+	CHECK (strstr (buf, "loco_task_cpu_percent{task=\"audioThread\",id=\"5\"} 33.3\n") != NULL);
+	CHECK (strstr (buf, "loco_task_cpu_peak_percent{task=\"audioThread\",id=\"5\"} 80.0\n") != NULL);
+	CHECK (strstr (buf, "loco_task_cpu_percent{task=\"audioThread\",id=\"11\"} 10.0\n") != NULL);
+	CHECK (strstr (buf, "{task=\"Art \\\"T\\\"\\\\\",id=\"9\"} 3000\n") != NULL);
+	CHECK (strstr (buf, "loco_heap_fragmentation_percent{caps=\"internal\"} 58\n") != NULL);
+	CHECK (strstr (buf, "loco_heap_window_min_free_bytes{caps=\"dma\"} 10000\n") != NULL);
+	CHECK (strstr (buf, "# TYPE loco_heap_free_bytes gauge\n") != NULL);
+
+// every line is a comment or a metric with a value
+
+	int lines = 0;
+	for (char *p = buf;*p;lines++){
+		char *end = strchr (p, '\n');
+		CHECK (end != NULL);
+		if (!end) break;
+		if (*p != '#') CHECK (!strncmp (p, "loco_", 5) && (memchr (p, ' ', end - p) != NULL));
+		p = end + 1;
+	}
+	CHECK (lines > 50);
+
+// too small - cut short, terminated, and the length it needed
+
+	static char small[16 * 1024];
+	static const int sizes[] = {100, 1, 2};
+	for (int i = 0;i < (int)(sizeof(sizes) / sizeof(sizes[0]));i++){
+		memset (small, 'x', sizeof(small));
+		CHECK (telemetryFormat (t, small, sizes[i]) == n);
+		CHECK ((int)strlen (small) == sizes[i] - 1);
+		CHECK (!memcmp (small, buf, sizes[i] - 1));
+		CHECK (small[sizes[i]] == 'x');
+	}
+	memset (small, 'x', sizeof(small));
+	CHECK (telemetryFormat (t, small, n) == n);			// one short for the terminator
+	CHECK (((int)strlen (small) == n - 1) && (small[n] == 'x'));
+	CHECK (telemetryFormat (t, small, n + 1) == n);
+	CHECK (!strcmp (small, buf));
+	CHECK (telemetryFormat (t, NULL, 0) == n);
+}
+
+int main (){
+	empty ();
+	telemetry_t *t = session ();
+	figures (t);
+	text (t);
+	telemetryFree (t);
+	manyTasks ();
+	return testResult ();
+}
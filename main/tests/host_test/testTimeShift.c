@@ -0,0 +1,265 @@
+/********************************************************
+	testTimeShift.c
+
+	The tape with every byte a function of its stream position, so
+	whatever is played back can be checked. The recorder scribbles on
+	all of each loan, as a decoder using it for scratch would, and
+	often records less than it was loaned.
+
+	The ring wrapping many times with reads at live and behind, a pause
+	longer than the ring, short records with and without a spill, a
+	spill in memory larger than the ring that wraps too, skipping back
+	into it, a spill that fails, tapeReset (also with a loan out) and
+	odd sizes staying frame aligned
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timeShift.h"
+#include "hostTest.h"
+
+#define ALIGN 4
+
+static uint8_t val (int64_t pos){
+	return (uint8_t)((pos * 7) ^ (pos >> 9));
+}
+
+// the spill, in memory
+
+static uint8_t *spillData;
+static int64_t spillSize;
+static int failWrites = -1;				// writes before they start failing
+
+static int spillWrite (void *arg, int64_t offset, const uint8_t *buf, int len){
+	CHECK ((offset >= 0) && (offset + len <= spillSize));
+	if (!failWrites) return 1;
+	if (failWrites > 0) failWrites--;
+	memcpy (spillData + offset, buf, len);
+	return 0;
+}
+
+static int spillRead (void *arg, int64_t offset, uint8_t *buf, int len){
+	CHECK ((offset >= 0) && (offset + len <= spillSize));
+	memcpy (buf, spillData + offset, len);
+	return 0;
+}
+
+static tapeSpill_t newSpill (int64_t size){
+	free (spillData);
+	spillData = malloc (size);
+	spillSize = size;
+	failWrites = -1;
+	return (tapeSpill_t){spillWrite, spillRead, NULL, size};
+}
+
+static int64_t live;					// what the tape has been given
+
+// records up to len from a loan of max, scribbling on all of it
+
+static int recordShort (tape_t *t, int max, int len){
+	uint8_t *p;
+	int n = tapeRecordBegin (t, &p, max);
+	CHECK ((n >= 0) && (n <= max) && !(n % ALIGN));
+	memset (p, 0xEE, n);
+	if (len > n) len = n;
+	for (int i = 0;i < len;i++) p[i] = val (live + i);
+	tapeRecordEnd (t, len);
+	len -= len % ALIGN;
+	live += len;
+	return len;
+}
+
+static void record (tape_t *t, int len){
+	while (len > 0) len -= recordShort (t, len, len);
+}
+
+// reads len and checks every byte against where the tape says it read
+// from, returns the bytes read
+
+static int bad;
+
+static int play (tape_t *t, int len){
+	static uint8_t buf[1 << 16];
+	if (len > (int)sizeof(buf)) len = sizeof(buf);
+	int n = tapeRead (t, buf, len);
+	tapeStats_t s;
+	tapeGetStats (t, &s);
+	int64_t from = live - s.behind - n;
+	for (int i = 0;i < n;i++){
+		if (buf[i] != val (from + i)){
+			if (!bad++) printf ("byte %lld played back wrong\n", (long long)(from + i));
+			break;
+		}
+	}
+	CHECK (!(n % ALIGN) && (n <= len));
+	return n;
+}
+
+static void wrapAround (){
+	static uint8_t ring[40000];
+	CHECK (tapeCreate (ring, 40002, ALIGN) == NULL);
+	tape_t *t = tapeCreate (ring, sizeof(ring), ALIGN);
+	live = 0;
+	bad = 0;
+	unsigned seed = 1;
+	for (int i = 0;i < 2000;i++){
+		record (t, ALIGN * (1 + rand_r (&seed) % 900));
+		if (rand_r (&seed) % 3) play (t, ALIGN * (rand_r (&seed) % 1200));
+	}
+	tapeStats_t s;
+	tapeGetStats (t, &s);
+	CHECK ((s.recorded == live) && (s.held <= (int64_t)sizeof(ring)) && (s.held == s.inRing));
+
+// paused for longer than the ring holds, playing drops to the oldest
+
+	tapeSeek (t, 1 << 30);
+	int64_t was = s.dropped;
+	record (t, 100000);
+	CHECK (play (t, 8) == 8);
+	tapeGetStats (t, &s);
+	CHECK (s.dropped - was == 100000 - (int64_t)sizeof(ring));
+	CHECK (s.behind == (int64_t)sizeof(ring) - 8);
+	CHECK (!bad);
+	free (t);
+}
+
+// a short record leaves the rest of its loan scribbled on, what the ring
+// held there is gone
+
+static void shortRecords (){
+	static uint8_t ring[4000];
+	tape_t *t = tapeCreate (ring, sizeof(ring), ALIGN);
+	live = 0;
+	bad = 0;
+	tapeStats_t s;
+
+	record (t, 4000);
+	CHECK (tapeSeek (t, -4000) == 4000);
+	CHECK (recordShort (t, 1000, 200) == 200);		// loaned stream 0 to 1000
+	tapeGetStats (t, &s);
+	CHECK ((s.inRing == 3200) && (s.held == 3200));
+	while (play (t, 512));
+	tapeGetStats (t, &s);
+	CHECK ((s.dropped == 1000) && (s.behind == 0));
+
+// loaned again from where the last short record ended
+
+	CHECK (recordShort (t, 1000, 0) == 0);			// loaned to 5200
+	CHECK (recordShort (t, 100, 100) == 100);
+	tapeGetStats (t, &s);
+	CHECK ((s.recorded == 4300) && (s.inRing == 3100));
+	CHECK (!bad);
+
+// with a spill it was copied out before the loan, and plays from there
+
+	tapeSpill_t spill = newSpill (16000);
+	tapeReset (t);
+	tapeAttachSpill (t, &spill);
+	record (t, 4000);
+	tapeSeek (t, -4000);
+	CHECK (recordShort (t, 1000, 200) == 200);
+	tapeGetStats (t, &s);
+	CHECK ((s.held == 4200) && (s.inRing == 3200) && (s.onSpill == 1000));
+	int64_t dropped = s.dropped;
+	while (play (t, 512));
+	tapeGetStats (t, &s);
+	CHECK ((s.dropped == dropped) && (s.spillReads == 1000));
+	CHECK (!bad);
+
+// a reset with a loan out - the old stream is not recorded
+
+	uint8_t *p;
+	CHECK (tapeRecordBegin (t, &p, 400) == 400);
+	tapeReset (t);
+	tapeRecordEnd (t, 400);
+	tapeGetStats (t, &s);
+	CHECK ((s.recorded == 0) && (s.held == 0));
+	record (t, 100);
+	CHECK ((play (t, 400) == 100) && !bad);
+	free (t);
+}
+
+// a spill much larger than the ring, wrapping too, with short records
+
+static void spillOver (){
+	static uint8_t ring[40000];
+	tape_t *t = tapeCreate (ring, sizeof(ring), ALIGN);
+	tapeSpill_t spill = newSpill (1 << 20);
+	live = 0;
+	bad = 0;
+	unsigned seed = 2;
+	tapeStats_t s;
+
+	tapeAttachSpill (t, &spill);
+	for (int i = 0;i < 20000;i++){
+		int loan = ALIGN * (1 + rand_r (&seed) % 2000);
+		int len = (rand_r (&seed) % 4) ? loan : rand_r (&seed) % (loan + 1);
+		recordShort (t, loan, len);
+		int r = rand_r (&seed) % 8;
+		if (r < 2) play (t, ALIGN * (rand_r (&seed) % 3000));
+		else if (r == 2) tapeSeek (t, ((rand_r (&seed) & 1) ? -1 : 1) * (int64_t)(rand_r (&seed) % 400000));
+		tapeGetStats (t, &s);
+		CHECK ((s.held == s.inRing + s.onSpill) && (s.inRing <= (int64_t)sizeof(ring)));
+		if (bad) break;
+	}
+	tapeGetStats (t, &s);
+	printf ("spill: recorded %lld held %lld (%lld in the ring) spilled %lld read back %lld dropped %lld\n",
+		(long long)s.recorded, (long long)s.held, (long long)s.inRing, (long long)s.spilled,
+		(long long)s.spillReads, (long long)s.dropped);
+	CHECK (s.spilling && (s.held > (1 << 20) - TAPESPILLMAX) && (s.spillReads > 0));
+	CHECK (!bad);
+
+// back from live into the spill, then through to live
+
+	tapeSeek (t, 1 << 30);
+	CHECK (tapeSeek (t, -700002) == 700000);
+	int64_t got = 0;
+	while ((got < 700000) && !bad){
+		int n = play (t, 4096);
+		if (!n) break;
+		got += n;
+	}
+	CHECK ((got == 700000) && !bad);
+	CHECK (tapeRead (t, (uint8_t[8]){0}, 8) == 0);
+
+// a write failure detaches the spill, what it alone held is dropped
+
+	tapeSeek (t, -(1 << 30));
+	failWrites = 0;
+	record (t, 300000);
+	play (t, 4000);
+	tapeGetStats (t, &s);
+	CHECK (!s.spilling && (s.spillErrors == 1) && (s.held <= (int64_t)sizeof(ring)));
+	CHECK (!bad);
+
+// reset, nothing before it plays back
+
+	failWrites = -1;
+	tapeReset (t);
+	tapeAttachSpill (t, &spill);
+	record (t, 5000);
+	CHECK (tapeSeek (t, -100000) == 5000);
+	CHECK ((play (t, 5000) == 5000) && (tapeSeek (t, 0) == 0));
+
+// odd sizes stay frame aligned
+
+	record (t, 4000);
+	CHECK (tapeSeek (t, 1 << 30) == 0);
+	CHECK (tapeSeek (t, -1001) == 1000);
+	CHECK (play (t, 999) == 996);
+	CHECK (recordShort (t, 1001, 7) == 4);
+	CHECK (tapeSeek (t, 0) % ALIGN == 0);
+	CHECK (!bad);
+	free (t);
+}
+
+int main (){
+	wrapAround ();
+	shortRecords ();
+	spillOver ();
+	free (spillData);
+	return testResult ();
+}
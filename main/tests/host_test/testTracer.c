@@ -0,0 +1,214 @@
+/********************************************************
+	testTracer.c
+
+	Records go to the ring of the core the time was read on, with a
+	stand-in traceCore that moves the task between cores part way
+	through a record. Counters are clamped to 16 bits, nothing is
+	recorded while paused, and a full ring keeps the newest records
+	and counts the rest as lost.
+
+	Then the converter - made up rings for two cores with their own
+	clocks, one going back more than a whole 32 bit wrap from its
+	anchor with a record just after it, the other with a gap of more
+	than half a wrap, are written as JSON through a small buffer,
+	parsed back with jsonExtract and checked for the times, the merge
+	order, the tracks and the lost count
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the core each call of traceCore returns, the last repeats
+
+static int coreScript[8];
+static int coreScriptLen;
+static int coreCalls;
+
+static int fakeCore (){
+	int n = coreCalls++;
+	return coreScript[(n < coreScriptLen) ? n : coreScriptLen - 1];
+}
+
+#define traceCore() fakeCore ()
+
+#include "tracer.h"
+#include "jsonExtract.h"
+#include "hostTest.h"
+
+static void cores (const int *script, int n){
+	memcpy (coreScript, script, n * sizeof(int));
+	coreScriptLen = n;
+	coreCalls = 0;
+}
+
+static uint32_t heads (int c){
+	return atomic_load (&traceRings[c].head);
+}
+
+static void recording (){
+	CHECK (tracerInit (1000) == -1);
+	CHECK (tracerInit (TRACERECORDS) == 0);
+
+	static const int still[] = {0};
+	cores (still, 1);
+	traceBegin (TRACEDECODE);
+	CHECK ((heads (0) == 1) && (heads (1) == 0) && (coreCalls == 2));
+
+// moved to core 1 after the core was read, the time is core 1's so
+// it is read again there
+
+	static const int moved[] = {0, 1, 1, 1};
+	cores (moved, 4);
+	traceEnd (TRACEDECODE);
+	CHECK ((heads (0) == 1) && (heads (1) == 1) && (coreCalls == 4));
+	CHECK ((traceRings[1].rec[0].id == TRACEDECODE) && (traceRings[1].rec[0].type == TRACEE));
+
+	cores (still, 1);
+	traceCounter (TRACEPCMFILL, 40000);
+	traceCounter (TRACEPCMFILL, -40000);
+	traceCounter (TRACEPCMFILL, 1234);
+	CHECK ((traceRings[0].rec[1].value == 32767) && (traceRings[0].rec[2].value == -32768));
+	CHECK ((traceRings[0].rec[3].value == 1234) && (traceRings[0].rec[3].type == TRACEC));
+
+	tracerPause ();
+	traceInstant (TRACEUNDERRUN);
+	CHECK (heads (0) == 4);
+	tracerResume ();
+
+	traceAnchor_t anchors[TRACECORES] = {{0, 0}, {0, 0}};
+	traceSnapshot_t s;
+	tracerClear ();
+	for (int i = 0;i < TRACERECORDS + 952;i++) traceCounter (TRACEPCMFILL, i);
+	CHECK (traceSnapshotTake (&s, anchors, 1000) == 0);
+	CHECK ((s.count[0] == TRACERECORDS) && (s.count[1] == 0) && (s.lost == 952));
+	CHECK ((s.rec[0][0].value == 952) && (s.rec[0][TRACERECORDS - 1].value == TRACERECORDS + 951));
+	traceSnapshotFree (&s);
+	tracerClear ();
+}
+
+// the JSON back as events - ts is -1 for the metadata
+
+#define EVENTSMAX 64
+
+typedef struct {
+	double ts;
+	char ph[4];
+	int tid;
+	char name[32];
+	int value;
+} event_t;
+
+static event_t events[EVENTSMAX];
+static int nevents;
+static double lost;
+
+static const char *paths[] = {"traceEvents[].ts", "traceEvents[].ph", "traceEvents[].tid",
+	"traceEvents[].name", "traceEvents[].args.value", "otherData.lost"};
+
+static void field (void *arg, int path, int item, int type, const char *value){
+	if (path == 5){
+		lost = strtod (value, NULL);
+		return;
+	}
+	if ((item < 0)||(item >= EVENTSMAX)) return;
+	if (item >= nevents){
+		for (int i = nevents;i <= item;i++) events[i].ts = -1;
+		nevents = item + 1;
+	}
+	event_t *e = &events[item];
+	switch (path){
+		case 0: e->ts = strtod (value, NULL); break;
+		case 1: snprintf (e->ph, sizeof(e->ph), "%s", value); break;
+		case 2: e->tid = atoi (value); break;
+		case 3: snprintf (e->name, sizeof(e->name), "%s", value); break;
+		case 4: e->value = atoi (value); break;
+	}
+}
+
+static jsonExtract_t jx;
+
+static int toExtract (void *arg, const char *buf, int len){
+	return jsonExtractFeed (&jx, buf, len) < 0;
+}
+
+static void put (int c, uint32_t time, int id, int type, int value){
+	traceRing_t *r = &traceRings[c];
+	uint32_t i = atomic_fetch_add (&r->head, 1) & r->mask;
+	r->rec[i] = (traceRecord_t){time, id, type, value};
+}
+
+#define US 10000000000LL				// anchor time, 10000 s
+
+static void converter (){
+	tracerClear ();
+
+// core 0 at 1 tick a us, from 5e9 ticks before its anchor - the
+// counter has wrapped once - to 5 ticks after it
+
+	uint32_t a0 = 0x100;
+	static const int64_t ages[] = {5000000000LL, 4000000000LL, 3000000000LL, 2000000000LL, 1000000000LL, 300, 100};
+	for (int i = 0;i < 7;i++) put (0, a0 - (uint32_t)ages[i], TRACEDECODE, i & 1, 0);
+	put (0, a0 + 5, TRACEUNDERRUN, TRACEI, 0);
+
+// core 1 has its own counter and anchor
+
+	uint32_t a1 = 7;
+	put (1, a1 - 2500000000u, TRACEPCMFILL, TRACEC, 32767);
+	put (1, a1 - 200, TRACEI2SWRITE, TRACEB, 0);
+	put (1, a1, TRACEI2SWRITE, TRACEE, 0);
+
+	traceAnchor_t anchors[TRACECORES] = {{a0, US}, {a1, US + 50}};
+	traceSnapshot_t s;
+	CHECK (traceSnapshotTake (&s, anchors, 1) == 0);
+	CHECK ((s.count[0] == 8) && (s.count[1] == 3) && (s.lost == 0));
+	s.lost = 3;										// as if some were overwritten
+
+	nevents = 0;
+	lost = -1;
+	CHECK (jsonExtractInit (&jx, paths, 6, field, NULL) == 0);
+	char buf[37];
+	jsonWriter_t w;
+	jsonInit (&w, buf, sizeof(buf), toExtract, NULL);
+	CHECK (traceWriteJson (&s, &w) == 11);
+	CHECK (!jsonEnd (&w));
+	CHECK (jsonExtractEnd (&jx) == 0);
+	traceSnapshotFree (&s);
+
+	static const struct {
+		double ts;
+		const char *ph;
+		int tid;
+	} expect[] = {
+		{US - 5000000000LL, "B", 0}, {US - 4000000000LL, "E", 0}, {US - 3000000000LL, "B", 0},
+		{US + 50 - 2500000000LL, "C", 1}, {US - 2000000000LL, "E", 0}, {US - 1000000000LL, "B", 0},
+		{US - 300, "E", 0}, {US - 150, "B", 1}, {US - 100, "B", 0}, {US, "i", 1}, {US + 50, "E", 1},
+	};
+	int meta = 0, n = 0;
+	for (int i = 0;i < nevents;i++){
+		event_t *e = &events[i];
+		if (!strcmp (e->ph, "M")){
+			meta++;
+			continue;
+		}
+		if (n >= 11) break;
+		CHECK (e->ts == expect[n].ts);
+		CHECK (!strcmp (e->ph, expect[n].ph) && (e->tid == expect[n].tid));
+		if (e->ts != expect[n].ts) printf ("event %d at %.0f, expected %.0f\n", n, e->ts, expect[n].ts);
+		n++;
+	}
+	CHECK ((n == 11) && (meta == 9));					// the process and 8 tracks
+	CHECK (!strcmp (events[meta].name, "decode"));
+	for (int i = meta;i < nevents;i++){
+		if (!strcmp (events[i].ph, "C")) CHECK (!strcmp (events[i].name, "pcm fill") && (events[i].value == 32767));
+		if (!strcmp (events[i].ph, "i")) CHECK (!strcmp (events[i].name, "underrun"));
+	}
+	CHECK (lost == 3);
+}
+
+int main (){
+	recording ();
+	converter ();
+	return testResult ();
+}
@@ -0,0 +1,182 @@
+/********************************************************
+	testUiQueue.c
+
+	The UI event queue on its own - input before background, rotary
+	merging and cancelling, a full queue, the latency histogram - and
+	then a producer thread queueing thousands of random events under a
+	mutex, as the input task and the web server do through addEvent,
+	while the main loop takes them. The net rotary count and every
+	button must come out
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "uiQueue.h"
+#include "hostTest.h"
+
+#define EVENTS 20000
+
+static uiEvents_t u;
+
+static int drain (int *out, int max){
+	int n = 0, e;
+	while ((n < max) && (e = uiQueueGet (&u, 1000))) out[n++] = e;
+	return n;
+}
+
+static void ordering (){
+	int out[64];
+	uiQueueReset (&u);
+	uiQueuePut (&u, UITIMER, 1);
+	uiQueuePut (&u, ROTARYUP, 1);
+	uiQueuePut (&u, ROTARYUP, 1);
+	uiQueuePut (&u, ROTARYUP, 1);
+	uiQueuePut (&u, KNOBPUSH, 1);
+	uiQueuePut (&u, ROTARYDOWN, 1);
+	uiQueuePut (&u, ROTARYUP, 1);					// cancels the down
+	uiQueuePut (&u, UIREFRESH, 1);
+	uiQueuePut (&u, NEXTBUTTON, 1);
+	uiQueuePut (&u, EJECTHELD, 1);
+	CHECK (u.queued == 10);
+	CHECK (u.merged == 3);
+	CHECK (uiQueueFind (&u, UIREFRESH) && uiQueueFind (&u, KNOBPUSH) && !uiQueueFind (&u, UIALERT));
+
+	static const int expect[] = {ROTARYUP, ROTARYUP, ROTARYUP, KNOBPUSH, NEXTBUTTON, EJECTHELD, UITIMER, UIREFRESH};
+	int n = drain (out, 64);
+	CHECK (n == 8);
+	CHECK (!memcmp (out, expect, sizeof(expect)));
+
+// the handler can take the whole delta after the first step
+
+	uiQueuePut (&u, ROTARYDOWN, 1);
+	uiQueuePut (&u, ROTARYDOWN, 1);
+	uiQueuePut (&u, ROTARYDOWN, 1);
+	uiQueuePut (&u, KNOBPUSH, 1);
+	CHECK (uiQueueGet (&u, 1) == ROTARYDOWN);
+	CHECK (uiQueueTakeRotary (&u) == -2);
+	CHECK (uiQueueTakeRotary (&u) == 0);			// a button is at the head
+	CHECK (uiQueueGet (&u, 1) == KNOBPUSH);
+	CHECK (uiQueueGet (&u, 1) == 0);
+}
+
+static void full (){
+	uiQueueReset (&u);
+	for (int i = 0;i < UIQLEN;i++) CHECK (uiQueuePut (&u, (i & 1) ? ROTARYUP : NEXTBUTTON, 1));
+	CHECK (!uiQueuePut (&u, KNOBPUSH, 1));
+	CHECK (uiQueuePut (&u, ROTARYUP, 1));			// merges with the tail
+	CHECK (uiQueuePut (&u, UIREFRESH, 1));			// other priority
+	CHECK (u.dropped == 1);
+	CHECK (u.queues[0].len == UIQLEN);
+	int out[2 * UIQLEN];
+	CHECK (drain (out, 2 * UIQLEN) == UIQLEN + 2);
+	CHECK ((out[UIQLEN - 1] == ROTARYUP) && (out[UIQLEN] == ROTARYUP) && (out[UIQLEN + 1] == UIREFRESH));
+}
+
+static void latency (){
+	uiQueueReset (&u);
+	uiQueuePut (&u, KNOBPUSH, 1000);
+	uiQueuePut (&u, UITIMER, 1000);
+	uiQueuePut (&u, UIREFRESH, 1000);
+	uiQueueGet (&u, 1500);							// 0.5ms
+	uiQueueGet (&u, 4000);							// 3ms
+	uiQueueGet (&u, 5000000);						// 5s
+	CHECK (u.latency[0][0] == 1);
+	CHECK (u.latency[1][2] == 1);
+	CHECK (u.latency[1][UIHISTBUCKETS - 1] == 1);
+	uiQueuePrint (&u);
+}
+
+// addEvent and getEvent from ui.c, less the input collection
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static int64_t clockUs = 1;
+
+static void addEvent (int e){
+	pthread_mutex_lock (&lock);
+	if ((uiEventPriority (e) == 0)||!uiQueueFind (&u, e)) uiQueuePut (&u, e, clockUs);
+	pthread_cond_signal (&wake);
+	pthread_mutex_unlock (&lock);
+}
+
+static int getEvent (){
+	pthread_mutex_lock (&lock);
+	int e = uiQueueGet (&u, ++clockUs);
+	pthread_mutex_unlock (&lock);
+	return e;
+}
+
+static int waiting (){
+	pthread_mutex_lock (&lock);
+	int n = u.queues[0].len;
+	pthread_mutex_unlock (&lock);
+	return n;
+}
+
+static int randomEvent (unsigned *seed){
+	int r = rand_r (seed) % 10;
+	return (r < 4) ? ROTARYUP : (r < 7) ? ROTARYDOWN : (r < 8) ? KNOBPUSH : (r < 9) ? NEXTBUTTON : UITIMER;
+}
+
+static void *producer (void *arg){
+	unsigned seed = 5;
+	for (int i = 0;i < EVENTS;i++){
+		addEvent (randomEvent (&seed));
+		if (!(rand_r (&seed) % 16)) usleep (rand_r (&seed) % 100);
+		while (waiting () > UIQLEN / 2) usleep (10);			// the main loop keeps up
+	}
+	addEvent (EJECTHELD);
+	return NULL;
+}
+
+static void threaded (){
+	uiQueueReset (&u);
+	pthread_t t;
+	pthread_create (&t, NULL, producer, NULL);
+
+	int net = 0, buttons[2] = {0}, done = 0;
+	while (!done){
+		pthread_mutex_lock (&lock);
+		if (!u.queues[0].len && !u.queues[1].len) pthread_cond_wait (&wake, &lock);
+		pthread_mutex_unlock (&lock);
+		int e;
+		while ((e = getEvent ())){
+			if (e == ROTARYUP) net++;
+			else if (e == ROTARYDOWN) net--;
+			else if (e == KNOBPUSH) buttons[0]++;
+			else if (e == NEXTBUTTON) buttons[1]++;
+			else if (e == EJECTHELD) done = 1;
+		}
+	}
+	pthread_join (t, NULL);
+
+	unsigned seed = 5;
+	int expectNet = 0, expectButtons[2] = {0};
+	for (int i = 0;i < EVENTS;i++){
+		int e = randomEvent (&seed);
+		if (!(rand_r (&seed) % 16)) rand_r (&seed);
+		if (e == ROTARYUP) expectNet++;
+		else if (e == ROTARYDOWN) expectNet--;
+		else if (e == KNOBPUSH) expectButtons[0]++;
+		else if (e == NEXTBUTTON) expectButtons[1]++;
+	}
+	printf ("net rotary %d/%d knob %d/%d next %d/%d\n",
+		net, expectNet, buttons[0], expectButtons[0], buttons[1], expectButtons[1]);
+	uiQueuePrint (&u);
+	CHECK (net == expectNet);
+	CHECK ((buttons[0] == expectButtons[0]) && (buttons[1] == expectButtons[1]));
+	CHECK (u.dropped == 0);
+}
+
+int main (){
+	ordering ();
+	full ();
+	latency ();
+	threaded ();
+	return testResult ();
+}
@@ -0,0 +1,245 @@
+/********************************************************
+	timeShift.c
+
+	A tape for a live stream. Everything recorded goes into a ring
+	and, if a spill is attached (a file on the SD), is copied on to
+	it before the ring overwrites it. Playback reads from a position
+	that can fall behind live while paused or be moved back, from the
+	ring if it is still there, else from the spill.
+
+	Positions are byte offsets in the stream since tapeReset and are
+	always a multiple of align (one stereo frame for PCM), so a read
+	or a seek never lands in the middle of a frame.
+
+		ring	holds the last size bytes recorded
+		spill	holds the last spill.size bytes spilled, it is written
+				in TAPESPILLCHUNK pieces as recording goes on and
+				always reaches at least as far as the ring's oldest
+				byte, so the two together hold one unbroken stretch
+
+	Ring space loaned to record into counts as overwritten from then
+	on, even if less is recorded - the decoder may have used all of
+	it - so what was there is only played back from the spill.
+
+	If the play position is older than anything still held it moves
+	forward to the oldest byte held and the gap is counted as dropped.
+	A spill that fails to read or write is detached and what only it
+	held is lost the same way.
+
+		tapeRecordBegin (t,&p,max)	loans the ring to record into,
+									spilling first what it overwrites
+		tapeRecordEnd (t,len)
+		tapeRead (t,buf,len)		plays, returns 0 at live
+		tapeSeek (t,delta)			moves the play position, held
+									to what is recorded
+
+	Not thread safe, the caller locks. Only libc is used so this can
+	be tested on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timeShift.h"
+
+typedef struct tape_s {
+	uint8_t *ring;
+	int64_t size;
+	int align;
+	int64_t base;						// where the stream started, at tapeReset
+	int64_t live;						// recorded up to here
+	int64_t play;
+	int loan;							// bytes loaned to record into
+	int64_t loanedTo;					// the furthest any loan has reached
+
+	tapeSpill_t spill;
+	int spilling;
+	int64_t spillStart;					// first byte spilled since attaching
+	int64_t spilledTo;
+
+	int64_t spilled;
+	int64_t spillReads;
+	int spillErrors;
+	int64_t dropped;
+} tape_t;
+
+static int64_t max64 (int64_t a, int64_t b){
+	return (a > b) ? a : b;
+}
+
+static int64_t min64 (int64_t a, int64_t b){
+	return (a < b) ? a : b;
+}
+
+// size must be a multiple of align
+
+tape_t *tapeCreate (uint8_t *ring, int size, int align){
+
+	if ((align <= 0)||(size < align)||(size % align)){
+		printf ("ERROR tapeCreate size %d not a multiple of %d\n", size, align);
+		return NULL;
+	}
+
+	tape_t *t = malloc (sizeof(tape_t));
+	if (!t) return NULL;
+	memset (t, 0, sizeof(tape_t));
+	t->ring = ring;
+	t->size = size;
+	t->align = align;
+	return t;
+}
+
+// the oldest byte still in the ring, anything loaned has been
+// overwritten
+
+static int64_t ringStart (tape_t *t){
+	return max64 (t->base, t->loanedTo - t->size);
+}
+
+static int64_t oldest (tape_t *t){
+	int64_t o = ringStart (t);
+	if (t->spilling) o = min64 (o, max64 (t->base, max64 (t->spillStart, t->spilledTo - t->spill.size)));
+	return o;
+}
+
+static void spillFailed (tape_t *t){
+	t->spilling = 0;
+	t->spillErrors++;
+}
+
+// copies the ring up to to onto the spill, returns 0 if it failed
+
+static int spillUpTo (tape_t *t, int64_t to){
+	while (t->spilling && (t->spilledTo < to)){
+		int64_t at = t->spilledTo % t->spill.size;
+		int64_t from = t->spilledTo % t->size;
+		int64_t n = min64 (to - t->spilledTo, min64 (t->spill.size - at, t->size - from));
+		if (t->spill.write (t->spill.arg, at, t->ring + from, (int)n)){
+			spillFailed (t);
+			return 0;
+		}
+		t->spilledTo += n;
+		t->spilled += n;
+	}
+	return t->spilling;
+}
+
+// returns the bytes loaned at p, at most max and a whole number of
+// frames
+
+int tapeRecordBegin (tape_t *t, uint8_t **p, int max){
+	int64_t at = t->live % t->size;
+	int64_t n = min64 (max, t->size - at);
+	n -= n % t->align;
+
+	if (t->spilling){
+		int64_t need = t->live + n - t->size;			// the ring overwrites up to here
+		int64_t waiting = t->live - t->spilledTo;
+		if (t->spilledTo < need) spillUpTo (t, min64 (t->live, max64 (need, t->spilledTo + TAPESPILLMAX)));
+		else if (waiting >= TAPESPILLCHUNK) spillUpTo (t, min64 (t->live, t->spilledTo + TAPESPILLMAX));
+	}
+
+	t->loan = (int)n;
+	t->loanedTo = max64 (t->loanedTo, t->live + n);
+	*p = t->ring + at;
+	return (int)n;
+}
+
+// len may be less than was loaned, the rest is not played back from
+// the ring
+
+void tapeRecordEnd (tape_t *t, int len){
+	if (len > t->loan) len = t->loan;
+	len -= len % t->align;
+	t->live += len;
+	t->loan = 0;
+}
+
+// returns the bytes read from the play position, 0 at live
+
+int tapeRead (tape_t *t, uint8_t *buf, int len){
+	int done = 0;
+	len -= len % t->align;
+
+	while (done < len){
+		int64_t o = oldest (t);
+		if (t->play < o){
+			t->dropped += o - t->play;
+			t->play = o;
+		}
+		int64_t n = min64 (len - done, t->live - t->play);
+		if (n <= 0) break;
+
+		int64_t start = ringStart (t);
+		if (t->play >= start){
+			int64_t from = t->play % t->size;
+			n = min64 (n, t->size - from);
+			memcpy (buf + done, t->ring + from, n);
+		}
+		else {
+			int64_t at = t->play % t->spill.size;
+			n = min64 (n, min64 (start - t->play, t->spill.size - at));
+			if (t->spill.read (t->spill.arg, at, buf + done, (int)n)){
+				spillFailed (t);
+				continue;									// drops to what the ring has
+			}
+			t->spillReads += n;
+		}
+		t->play += n;
+		done += n;
+	}
+	return done;
+}
+
+// moves the play position by delta bytes, within what is held. Returns
+// how far it then is behind live
+
+int64_t tapeSeek (tape_t *t, int64_t delta){
+	delta -= delta % t->align;
+	t->play = max64 (oldest (t), min64 (t->live, t->play + delta));
+	return t->live - t->play;
+}
+
+// a new stream, nothing before it can be played back. A loan still
+// out belongs to the old stream, it is not recorded
+
+void tapeReset (tape_t *t){
+	t->loan = 0;
+	t->base = t->live;
+	t->play = t->live;
+	t->spillStart = t->live;
+	t->spilledTo = t->live;
+}
+
+// the spill starts with what the ring holds now
+
+void tapeAttachSpill (tape_t *t, const tapeSpill_t *spill){
+	if ((spill->size < t->align)||(spill->size % t->align)) return;
+	t->spill = *spill;
+	t->spilling = 1;
+	t->spillStart = ringStart (t);
+	t->spilledTo = t->spillStart;
+}
+
+// call before closing the spill's file
+
+void tapeDetachSpill (tape_t *t){
+	t->spilling = 0;
+}
+
+void tapeGetStats (tape_t *t, tapeStats_t *s){
+	int64_t o = oldest (t);
+	int64_t start = ringStart (t);
+	s->recorded = t->live - t->base;
+	s->behind = t->live - t->play;
+	s->held = t->live - o;
+	s->inRing = t->live - start;
+	s->onSpill = start - o;
+	s->spilling = t->spilling;
+	s->spilled = t->spilled;
+	s->spillReads = t->spillReads;
+	s->spillErrors = t->spillErrors;
+	s->dropped = t->dropped;
+}
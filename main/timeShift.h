@@ -0,0 +1,55 @@
+/********************************************************
+	timeShift.h
+
+	Records a stream into a ring with an optional spill file so it can
+	be paused and played back behind live - see timeShift.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define TAPESPILLCHUNK (32 * 1024)		// spilled at a time once this much is waiting
+#define TAPESPILLMAX (256 * 1024)		// most spilled by one tapeRecordBegin unless needed
+
+typedef struct tape_s tape_t;
+
+// a file or other store reached by offset, offset + len never passes size
+
+typedef struct {
+	int (*write) (void *arg, int64_t offset, const uint8_t *buf, int len);	// 0 on success
+	int (*read) (void *arg, int64_t offset, uint8_t *buf, int len);
+	void *arg;
+	int64_t size;						// a multiple of align
+} tapeSpill_t;
+
+typedef struct {
+	int64_t recorded;					// since tapeReset
+	int64_t behind;						// from the play position to live
+	int64_t held;						// that can be played back
+	int64_t inRing;
+	int64_t onSpill;					// held only in the spill
+	int spilling;
+	int64_t spilled;					// bytes written to the spill
+	int64_t spillReads;					// and read back
+	int spillErrors;
+	int64_t dropped;					// overwritten before they were played
+} tapeStats_t;
+
+tape_t *tapeCreate (uint8_t *ring, int size, int align);
+int tapeRecordBegin (tape_t *t, uint8_t **p, int max);
+void tapeRecordEnd (tape_t *t, int len);
+int tapeRead (tape_t *t, uint8_t *buf, int len);
+int64_t tapeSeek (tape_t *t, int64_t delta);
+void tapeReset (tape_t *t);
+void tapeAttachSpill (tape_t *t, const tapeSpill_t *spill);
+void tapeDetachSpill (tape_t *t);
+void tapeGetStats (tape_t *t, tapeStats_t *s);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,273 @@
+/********************************************************
+	tracer.c
+
+	A record per begin, end, instant or counter, 8 bytes each, kept
+	in a ring for each core so the trace calls in tracer.h never wait
+	for each other. A slot is claimed with one atomic add, tasks on
+	the same core preempting each other just take different slots.
+	The time is the CPU cycle counter on the board so a record costs
+	a few tens of cycles, there is no printf to upset the timing.
+
+	Cycle counters are 32 bits (wrapping every 17.9s at 240MHz) and
+	each core has its own, so a snapshot also takes an anchor per core
+	- the counter and esp_timer at the same moment. Walking back from
+	the anchor through the ring the ages are unwrapped, a jump back
+	means the counter wrapped. This goes wrong only if a core records
+	nothing for a whole wrap. The time is read before the slot is
+	claimed, a record preempted in between lands after later ones and
+	up to 1 ms of that is taken as out of order rather than a wrap.
+
+		tracerInit (records)		allocates the rings and starts
+		traceSnapshotTake (s,...)	copies the rings, oldest first
+		traceWriteJson (s,w)		Chrome trace event JSON, load it
+									in chrome://tracing or Perfetto
+		traceCapture (s)			on the board, pauses, takes the
+									anchors and a snapshot
+
+	Each event has a track, shown as a thread in the viewer, so the
+	decoder, audio output, art, LVGL and web work line up one above
+	the other. A track's begins and ends come from one task at a time
+	or they would nest wrongly - pcmThread's reads have their own, the
+	decode inside them (not radio) or in radioThread is on decoder.
+
+	The rings are in internal RAM if there is room, a PSRAM cache miss
+	would cost more than the rest of a record. Snapshots go in PSRAM.
+	Only libc is used otherwise so this can be built, timed and tested
+	on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_ipc.h"
+#include "esp_private/esp_clk.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#define traceAlloc(n) heap_caps_malloc (n, MALLOC_CAP_SPIRAM)
+#define ringAlloc(n) heap_caps_malloc_prefer (n, 2, MALLOC_CAP_INTERNAL, MALLOC_CAP_SPIRAM)
+#else
+#define traceAlloc(n) malloc (n)
+#define ringAlloc(n) malloc (n)
+#endif
+
+#include "tracer.h"
+
+traceRing_t traceRings[TRACECORES];
+atomic_int traceEnabled = 0;
+
+static const char *trackNames[] = {"decoder", "audio", "art", "lvgl", "ui", "input", "web", "pcm"};
+#define TRACKS (sizeof(trackNames) / sizeof(trackNames[0]))
+
+static const struct {
+	const char *name;
+	int track;							// index in trackNames
+} traceEvents[TRACEEVENTS] = {
+	[TRACEI2SWRITE] = {"i2s write", 1},
+	[TRACEPCMFILL] = {"pcm fill", 1},
+	[TRACEUNDERRUN] = {"underrun", 1},
+	[TRACEDECODE] = {"decode", 0},
+	[TRACEPCMREAD] = {"read samples", 7},
+	[TRACERESAMPLE] = {"resample", 0},
+	[TRACEARTFETCH] = {"art fetch", 2},
+	[TRACEARTDECODE] = {"art decode", 2},
+	[TRACELVGL] = {"lv_timer_handler", 3},
+	[TRACEFLUSH] = {"flush band", 3},
+	[TRACEUI] = {"doUI", 4},
+	[TRACEINPUT] = {"input", 5},
+	[TRACESTATUS] = {"getStatus", 6},
+};
+
+// returns 0 if the rings were allocated
+
+int tracerInit (int records){
+	if (records & (records - 1)) return -1;
+	for (int c = 0;c < TRACECORES;c++){
+		traceRing_t *r = &traceRings[c];
+		if (r->rec) continue;
+		r->rec = ringAlloc (records * sizeof(traceRecord_t));
+		if (!r->rec) return -1;
+		memset (r->rec, 0, records * sizeof(traceRecord_t));
+		r->mask = records - 1;
+		atomic_store (&r->head, 0);
+	}
+	atomic_store (&traceEnabled, 1);
+	return 0;
+}
+
+void tracerPause (){
+	atomic_store (&traceEnabled, 0);
+}
+
+void tracerResume (){
+	if (traceRings[0].rec) atomic_store (&traceEnabled, 1);
+}
+
+void tracerClear (){
+	for (int c = 0;c < TRACECORES;c++) atomic_store (&traceRings[c].head, 0);
+}
+
+// copy the rings, records being written now may be half there so
+// pause first. Returns 0 if the copies were allocated
+
+int traceSnapshotTake (traceSnapshot_t *s, const traceAnchor_t *anchors, uint32_t ticksPerUs){
+
+	memset (s, 0, sizeof(traceSnapshot_t));
+	s->cores = TRACECORES;
+	s->ticksPerUs = ticksPerUs ? ticksPerUs : 1;
+	for (int c = 0;c < TRACECORES;c++){
+		traceRing_t *r = &traceRings[c];
+		s->anchor[c] = anchors[c];
+		if (!r->rec) continue;
+		uint32_t head = atomic_load (&r->head);
+		uint32_t size = r->mask + 1;
+		uint32_t n = (head < size) ? head : size;
+		s->lost += head - n;
+		s->rec[c] = traceAlloc (n ? n * sizeof(traceRecord_t) : 1);
+		if (!s->rec[c]){
+			traceSnapshotFree (s);
+			return -1;
+		}
+		for (uint32_t i = 0;i < n;i++) s->rec[c][i] = r->rec[(head - n + i) & r->mask];
+		s->count[c] = n;
+	}
+	return 0;
+}
+
+void traceSnapshotFree (traceSnapshot_t *s){
+	for (int c = 0;c < TRACECORES;c++){
+		free (s->rec[c]);
+		s->rec[c] = NULL;
+		s->count[c] = 0;
+	}
+}
+
+// each record's time in tenths of a us, from the newest back
+
+static void unwrap (traceSnapshot_t *s, int c, int64_t *t){
+	uint64_t wraps = 0;
+	uint64_t prevAge = 0;
+	uint64_t slack = (uint64_t)s->ticksPerUs * 1000;	// records can be a little out of order
+	traceAnchor_t *a = &s->anchor[c];
+
+	for (int i = s->count[c] - 1;i >= 0;i--){
+		uint32_t d = a->ticks - s->rec[c][i].time;
+		uint64_t age = d + wraps;
+		if (!wraps && (prevAge < slack) && ((int32_t)d < 0) && (0u - d < slack)) age = 0;	// just after the anchor
+		else if (age + slack < prevAge){
+			wraps += 1ull << 32;
+			age += 1ull << 32;
+		}
+		prevAge = age;
+		t[i] = a->us * 10 - (int64_t)((age * 10) / s->ticksPerUs);
+	}
+}
+
+static void jsonTime (jsonWriter_t *w, int64_t tenths){
+	jsonNumber (w, "ts", (double)tenths / 10);
+}
+
+static void writeRecord (jsonWriter_t *w, traceRecord_t *r, int64_t t){
+	static const char *phases[] = {"B", "E", "i", "C"};
+	if (r->id >= TRACEEVENTS) return;
+	jsonObjectStart (w, NULL);
+	jsonString (w, "name", traceEvents[r->id].name);
+	jsonString (w, "ph", phases[r->type & 3]);
+	jsonTime (w, t);
+	jsonNumber (w, "pid", 1);
+	jsonNumber (w, "tid", traceEvents[r->id].track);
+	if (r->type == TRACEI) jsonString (w, "s", "t");
+	if (r->type == TRACEC){
+		jsonObjectStart (w, "args");
+		jsonNumber (w, "value", r->value);
+		jsonObjectEnd (w);
+	}
+	jsonObjectEnd (w);
+}
+
+static void writeName (jsonWriter_t *w, const char *kind, int tid, const char *name){
+	jsonObjectStart (w, NULL);
+	jsonString (w, "name", kind);
+	jsonString (w, "ph", "M");
+	jsonNumber (w, "pid", 1);
+	if (tid >= 0) jsonNumber (w, "tid", tid);
+	jsonObjectStart (w, "args");
+	jsonString (w, "name", name);
+	jsonObjectEnd (w);
+	jsonObjectEnd (w);
+}
+
+// the cores' records merged in time order, returns the number written
+// or -1 if out of memory
+
+int traceWriteJson (traceSnapshot_t *s, jsonWriter_t *w){
+
+	int64_t *t[TRACECORES] = {NULL};
+	int next[TRACECORES] = {0};
+	int written = 0;
+
+	for (int c = 0;c < s->cores;c++){
+		if (!s->count[c]) continue;
+		t[c] = traceAlloc (s->count[c] * sizeof(int64_t));
+		if (!t[c]){
+			for (int i = 0;i < c;i++) free (t[i]);
+			return -1;
+		}
+		unwrap (s, c, t[c]);
+	}
+
+	jsonObjectStart (w, NULL);
+	jsonArrayStart (w, "traceEvents");
+	writeName (w, "process_name", -1, "loco");
+	for (int i = 0;i < (int)TRACKS;i++) writeName (w, "thread_name", i, trackNames[i]);
+
+	while (1){
+		int pick = -1;
+		for (int c = 0;c < s->cores;c++){
+			if (next[c] >= s->count[c]) continue;
+			if ((pick < 0)||(t[c][next[c]] < t[pick][next[pick]])) pick = c;
+		}
+		if (pick < 0) break;
+		writeRecord (w, &s->rec[pick][next[pick]], t[pick][next[pick]]);
+		next[pick]++;
+		written++;
+	}
+
+	jsonArrayEnd (w);
+	jsonString (w, "displayTimeUnit", "ms");
+	jsonObjectStart (w, "otherData");
+	jsonNumber (w, "lost", s->lost);
+	jsonObjectEnd (w);
+	jsonObjectEnd (w);
+
+	for (int c = 0;c < s->cores;c++) free (t[c]);
+	return written;
+}
+
+#ifdef ESP_PLATFORM
+
+static void takeAnchor (void *arg){
+	traceAnchor_t *a = arg;
+	a->ticks = traceClock ();
+	a->us = esp_timer_get_time ();
+}
+
+// pauses recording while the rings are copied, a task preempted in the
+// middle of a record has a tick to finish it
+
+int traceCapture (traceSnapshot_t *s){
+	traceAnchor_t anchors[TRACECORES];
+	int was = atomic_load (&traceEnabled);
+	tracerPause ();
+	vTaskDelay (1);
+	for (int c = 0;c < TRACECORES;c++) esp_ipc_call_blocking (c, takeAnchor, &anchors[c]);
+	int r = traceSnapshotTake (s, anchors, esp_clk_cpu_freq () / 1000000);
+	if (was) tracerResume ();
+	return r;
+}
+
+#endif
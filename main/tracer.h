@@ -0,0 +1,143 @@
+/********************************************************
+	tracer.h
+
+	Timestamped begin, end, instant and counter records in a ring
+	per core, dumped as Chrome trace JSON - see tracer.c
+
+	traceBegin (TRACEDECODE) and traceEnd (TRACEDECODE) around a
+	piece of work, traceInstant for a single point, traceCounter for
+	a value. They are inline and take no lock
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_cpu.h"
+#else
+#include <time.h>
+#endif
+
+#include "jsonWriter.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define TRACECORES 2
+#define TRACERECORDS 2048				// per core, a power of 2
+
+// record types
+#define TRACEB 0
+#define TRACEE 1
+#define TRACEI 2
+#define TRACEC 3
+
+// events, names and tracks are in tracer.c
+enum {
+	TRACEI2SWRITE,
+	TRACEPCMFILL,
+	TRACEUNDERRUN,
+	TRACEDECODE,
+	TRACEPCMREAD,
+	TRACERESAMPLE,
+	TRACEARTFETCH,
+	TRACEARTDECODE,
+	TRACELVGL,
+	TRACEFLUSH,
+	TRACEUI,
+	TRACEINPUT,
+	TRACESTATUS,
+	TRACEEVENTS
+};
+
+typedef struct {
+	uint32_t time;						// trace clock ticks, wraps
+	uint8_t id;
+	uint8_t type;
+	int16_t value;						// counters, clamped
+} traceRecord_t;
+
+typedef struct {
+	traceRecord_t *rec;
+	uint32_t mask;
+	atomic_uint head;					// records ever written
+} traceRing_t;
+
+// a trace clock reading and the time in us at the same moment
+
+typedef struct {
+	uint32_t ticks;
+	int64_t us;
+} traceAnchor_t;
+
+typedef struct {
+	int cores;
+	int count[TRACECORES];
+	traceRecord_t *rec[TRACECORES];		// oldest first
+	traceAnchor_t anchor[TRACECORES];
+	uint32_t ticksPerUs;
+	uint32_t lost;						// overwritten before this snapshot
+} traceSnapshot_t;
+
+extern traceRing_t traceRings[TRACECORES];
+extern atomic_int traceEnabled;
+
+#ifdef ESP_PLATFORM
+#define traceClock() esp_cpu_get_cycle_count ()
+#define traceCore() esp_cpu_get_core_id ()
+#else
+static inline uint32_t traceClock (){
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000000000ull + ts.tv_nsec);
+}
+#ifndef traceCore
+#define traceCore() 0
+#endif
+#endif
+
+// a task moved to the other core between reading the core and the
+// clock would put one core's time in the other's ring, so the core is
+// read again and it tries again. Moved after that it only claims the
+// slot from the other core, the time still belongs to the ring
+
+static inline void trace (int id, int type, int value){
+	if (!atomic_load_explicit (&traceEnabled, memory_order_relaxed)) return;
+	int core;
+	uint32_t time;
+	do {
+		core = traceCore ();
+		time = traceClock ();
+	} while (core != traceCore ());
+	traceRing_t *r = &traceRings[core];
+	uint32_t i = atomic_fetch_add_explicit (&r->head, 1, memory_order_relaxed) & r->mask;
+	traceRecord_t *t = &r->rec[i];
+	t->time = time;
+	t->id = id;
+	t->type = type;
+	t->value = (value > 32767) ? 32767 : (value < -32768) ? -32768 : value;
+}
+
+#define traceBegin(id) trace (id, TRACEB, 0)
+#define traceEnd(id) trace (id, TRACEE, 0)
+#define traceInstant(id) trace (id, TRACEI, 0)
+#define traceCounter(id, v) trace (id, TRACEC, v)
+
+int tracerInit (int records);
+void tracerPause ();
+void tracerResume ();
+void tracerClear ();
+int traceSnapshotTake (traceSnapshot_t *s, const traceAnchor_t *anchors, uint32_t ticksPerUs);
+void traceSnapshotFree (traceSnapshot_t *s);
+int traceWriteJson (traceSnapshot_t *s, jsonWriter_t *w);
+
+#ifdef ESP_PLATFORM
+int traceCapture (traceSnapshot_t *s);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
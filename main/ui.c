@@ -10,6 +10,8 @@
 	The idle state is used to display what is currently playing
 	This module also contains code for Wifi because wifi setup is part of the UI
 	
+	uiEventsInit - the event queue, before anything can post events
+	showSplash - something on the display while the rest starts up
 	uiInit - initialises the display and UI 
 	initialiseWifi - initialises Wifi - may use credentials stored in spiffs
 	doUI - handles events from the event Queue
@@ -30,15 +32,20 @@
 #include "esp_wifi.h"
 #include "esp_system.h"
 #include "time.h"
+#include "esp_timer.h"
 
 #include "lvgl.h"
 #include <loco.h>
 #include "locoBoard.h"
+#include "pager.h"
+#include "memTag.h"
 
 
 char *getLocalIp ();
 int fileExists(char *path);
 void waitlock_init (waitlock_t *wl);
+void waitlock_signal (waitlock_t *wl);
+int waitlock_wait (waitlock_t *wl, int msdelay);
 int loadFavourites();
 void displayFavourites ();
 
@@ -460,29 +467,23 @@ void locoCallback(int e) {
   }
   else if (e == NEWART){
 		newArt ();
+		bumpStatusVersion ();
   }	  
   else if (e == REFRESH){
 	  refreshUI ();
+	  bumpStatusVersion ();
+	}
+  else if (e == TRANSPORT){
+	  bumpStatusVersion ();
 	}
 }
 
 
-#define STATETRACKURILEN 50
-#define MAXPLAYLISTS 50
-#define MAXNAMELEN 100
-int myPlaylistsCount = 0;
-int myPlaylistsTotal = 0;
-
-char (*myPlaylistUri)[STATETRACKURILEN];
-char (*myPlaylistName)[MAXNAMELEN];	
-
-#define MAXSHOWS 50
-int myShowsCount = 0;
-int myShowsTotal = 0;
+// My Playlists and My Shows load in the background, see pager.c
 
-char (*myShowUri)[STATETRACKURILEN];
-char (*myShowName)[MAXNAMELEN];
-	
+pager_t *playlistPager;
+pager_t *showPager;
+extern int uiState;
 
 #define MENUHEIGHT 120
 #define MENUPITCH 40
@@ -563,15 +564,11 @@ lv_obj_t *alphaScreen;
 lv_obj_t *letterBox[MENUITEMSFULLYVISIBLE*LETTERSPERROW];
 lv_obj_t *letterText[MENUITEMSFULLYVISIBLE*LETTERSPERROW];
 
-// these variables implement the UI event queue
-
-#define UIQLEN 10
+// the UI event queue, see uiQueue.c. uiLock.mutex is held round every
+// call on uiEvents
 
 waitlock_t uiLock;
-int uiQ[UIQLEN];
-int uiQLen;				// number of events in queue
-int uiQIn;				// next insertion
-int uiQOut;				// next removal
+uiEvents_t uiEvents;
 
 
 #define KNOWNUTFS 7
@@ -1076,29 +1073,34 @@ void createConfirmScreen () {
 
 struct timespec lastTimeout;
 
-void uiInit (){
+// buttons, Wi-Fi and loco can post events before uiInit has run so the
+// queue is set up first
+
+void uiEventsInit (){
 	waitlock_init (&uiLock);
-	uiQLen = 0;
-	uiQIn = 0;
-	uiQOut = 0;
-	
-	myPlaylistUri = heap_caps_malloc (MAXPLAYLISTS*STATETRACKURILEN,MALLOC_CAP_SPIRAM);	
-	myPlaylistName = heap_caps_malloc (MAXPLAYLISTS*MAXNAMELEN,MALLOC_CAP_SPIRAM);
+	uiQueueReset (&uiEvents);
+}
 
-	myShowUri = heap_caps_malloc (MAXSHOWS*STATETRACKURILEN,MALLOC_CAP_SPIRAM);	
-	myShowName = heap_caps_malloc (MAXSHOWS*MAXNAMELEN,MALLOC_CAP_SPIRAM);		
+// drawn at once on the default screen, uiInit loads its own screens
 
-	int n;
-	for (n=0;n<MAXPLAYLISTS;n++){
-		myPlaylistName[n][0] = 0;
-		myPlaylistUri[n][0] = 0;		
-	}
-	for (n=0;n<MAXSHOWS;n++){
-		myShowName[n][0] = 0;
-		myShowUri[n][0] = 0;		
-	}
+void showSplash (){
+	lockLVGL ();
+	lv_obj_t *scr = lv_scr_act ();
+	lv_obj_set_style_bg_color (scr, lv_color_make (0x00, 0x00, 0x00), LV_STATE_DEFAULT);
+	lv_obj_t *title = lv_label_create (scr);
+	lv_obj_set_style_text_color (title, lv_color_make (0xFF, 0xFF, 0xFF), LV_STATE_DEFAULT);
+	lv_obj_set_style_text_font (title, &lv_font_montserrat_48, LV_STATE_DEFAULT);
+	lv_label_set_text (title, "loco");
+	lv_obj_center (title);
+	lv_refr_now (NULL);
+	unlockLVGL ();
+}
+
+void uiInit (){
+	playlistPager = pagerCreate ("playlists", getMyPlaylistsFields, playlistPaths, playlistsLoaded);
+	showPager = pagerCreate ("shows", getMyShowsFields, showPaths, showsLoaded);
 	
-	ap_info = (wifi_ap_record_t *) heap_caps_malloc (DEFAULT_SCAN_LIST_SIZE*sizeof(wifi_ap_record_t),MALLOC_CAP_SPIRAM);	
+	ap_info = (wifi_ap_record_t *) memTagMalloc (MEMUI, DEFAULT_SCAN_LIST_SIZE*sizeof(wifi_ap_record_t),MALLOC_CAP_SPIRAM);	
 
 	clock_gettime(CLOCK_REALTIME, &lastTimeout);
 	
@@ -1125,15 +1127,23 @@ void uiInit (){
 
 
 
+// queues the input events in the order they happened, timed from the
+// interrupt, see locoBoard.c. call with uiLock.mutex held
+
+void collectInput (){
+	int e;
+	int64_t at;
+	while ((e = takeInputEvent (&at))) uiQueuePut (&uiEvents,e,at);
+}
+
 void addEvent (int e){
 	pthread_mutex_lock (&uiLock.mutex);			// lock the variables
 	
-	if (uiQLen < UIQLEN){						// insert in queue
-		uiQ[uiQIn++] = e;
-		uiQLen++;
-		if (uiQIn >= UIQLEN) uiQIn = 0;
+	if ((uiEventPriority (e) == 0)||!uiQueueFind (&uiEvents,e)){	// background events only need to be queued once
+		uiQueuePut (&uiEvents,e,esp_timer_get_time ());
 	}
-	
+
+	uiLock.flag = 1;
 	pthread_cond_signal (&uiLock.condition);
 	pthread_mutex_unlock (&uiLock.mutex);
 }
@@ -1142,24 +1152,12 @@ void addEvent (int e){
 void orEvent (int e){
 	pthread_mutex_lock (&uiLock.mutex);			// lock the variables
 
-	// search queue for the event
-
-	int n,o;
-	for (o=uiQOut,n=0;n<uiQLen;n++){
-		if (uiQ[o++] == e) {
-			pthread_mutex_unlock (&uiLock.mutex);
-			return;
-		}
-		if (o >= UIQLEN) o = 0;
-	}							
+	// add the event if not there already
 	
-	// add the event of not there already
-	
-	if (uiQLen < UIQLEN){						// insert in queue
-		uiQ[uiQIn++] = e;
-		uiQLen++;
-		if (uiQIn >= UIQLEN) uiQIn = 0;
+	if (!uiQueueFind (&uiEvents,e)){
+		uiQueuePut (&uiEvents,e,esp_timer_get_time ());
 	}
+	uiLock.flag = 1;
 	pthread_cond_signal (&uiLock.condition);
 	pthread_mutex_unlock (&uiLock.mutex);
 }
@@ -1174,37 +1172,38 @@ void refreshUI (){
 
 int getUpDownEvents (){
 	
-	int u = 0;
-	int e;
 	waitlock_t *wl = &uiLock;
 	
 	pthread_mutex_lock(&wl->mutex);	
-	
-	while (uiQLen){
-		e = uiQ[uiQOut];
-		if (e == ROTARYUP){
-			u++;
-			uiQLen--;
-			uiQOut++;
-		}
-		else if (e == ROTARYDOWN){
-			u--;
-			uiQLen--;
-			uiQOut++;
-		}
-		else break;
-		if (uiQOut >= UIQLEN) uiQOut = 0;				
-	}	
-
+	collectInput ();
+	int u = uiQueueTakeRotary (&uiEvents);
 	pthread_mutex_unlock(&wl->mutex);
 	return u;
 	
 }
 
+// wake the main loop without queueing an event
+
+void wakeMainLoop (){
+	waitlock_signal (&uiLock);
+}
+
+// sleeps until an event is queued, wakeMainLoop is called or ms has passed
+
+void waitEvent (int ms){
+	waitlock_wait (&uiLock, ms);
+}
+
+void printEventStats (){
+	pthread_mutex_lock (&uiLock.mutex);
+	uiQueuePrint (&uiEvents);
+	pthread_mutex_unlock (&uiLock.mutex);
+}
 
 
 void waitlock_init (waitlock_t *wl){
 	pthread_mutex_init (&wl->mutex,NULL);
+	pthread_cond_init (&wl->condition,NULL);
 	wl->flag = 0;
 }
 
@@ -1227,7 +1226,7 @@ int waitlock_wait (waitlock_t *wl, int msdelay)
 	clock_gettime(CLOCK_REALTIME, &timeout);
 	timeout.tv_sec += msdelay / 1000;
 	timeout.tv_nsec += (msdelay % 1000) * 1000000;
-	if (timeout.tv_nsec > 1000000000) {
+	if (timeout.tv_nsec >= 1000000000) {
 		timeout.tv_sec++;
 		timeout.tv_nsec %= 1000000000;
 	}
@@ -1250,17 +1249,16 @@ int waitlock_wait (waitlock_t *wl, int msdelay)
 }
 
 
+// returns the next event, input events first, 0 if none
+// a merged rotary entry is delivered one step at a time unless
+// the handler takes the rest with getUpDownEvents
+
 int getEvent (){
 
-	int e = 0;
 	waitlock_t *wl = &uiLock;	
 	pthread_mutex_lock(&wl->mutex);
-		
-	if (uiQLen) {
-		e = uiQ[uiQOut++];							// get event from queue
-		uiQLen--;
-		if (uiQOut >= UIQLEN) uiQOut = 0;
-	}		
+	collectInput ();
+	int e = uiQueueGet (&uiEvents,esp_timer_get_time ());
 	pthread_mutex_unlock(&wl->mutex);
 	return e;
 }
@@ -1520,87 +1518,39 @@ int mainMenuHandler (int e){
 /************************* MyPlaylists Menu *************************/
 
 
-// for this to work as intended index should equal the 
-// current value of myPlaylistsCount
+const char *playlistPaths[] = {"total", "items[].name", "items[].uri"};
+const char *showPaths[] = {"total", "items[].show.name", "items[].show.uri"};
 
+// called from the pager task after each page
 
-void getMyPlaylistsPage (int index){
-	
-	printf ("getMyPlaylistsPage %d\n",index);
-	
-	cJSON *response = getMyPlaylists (index,10);
-	if (!response) return;
-
-	cJSON *total = cJSON_GetObjectItemCaseSensitive(response, "total");
-	if (!total) goto gmppx;
-	myPlaylistsTotal = total->valueint;
-	cJSON *items = cJSON_GetObjectItemCaseSensitive(response, "items");
-	int count = cJSON_GetArraySize (items);
-	printf ("getMyPlaylistsPage got %d items\n",count);
-	if ((index + count)>MAXPLAYLISTS){
-		printf ("getMyPlaylistsPage () too many playlists\n");
-		goto gmppx;
-	}
-	int n;
-	for (n=0;n<count;n++){	
-		cJSON *item = cJSON_GetArrayItem (items,n);
-		cJSON *name = cJSON_GetObjectItemCaseSensitive(item, "name");
-		cJSON *uri = cJSON_GetObjectItemCaseSensitive(item, "uri");			
-		if (name) strcpy (myPlaylistName[index+n],name->valuestring);
-		else *myPlaylistName[index+n] = 0;
-		printf ("Got name %s\n",myPlaylistName[index+n]);
-//		cdump ((unsigned char *)myPlaylistName[index+n],8);		
-		if (uri) strcpy (myPlaylistUri[index+n],uri->valuestring);
-		else *myPlaylistUri[index+n] = 0;
-	}
-	myPlaylistsCount += count;
-	
-gmppx:
-	cJSON_Delete (response);	
-	return;
+void playlistsLoaded (){
+	bumpPlaylistsVersion ();
+	if (uiState == MYPLAYLISTS) addEvent (UIREFRESH);
 }
 
 char *getLoadedPlaylistName (int index){
-	
-	if (index >= MAXPLAYLISTS) return "";
-	if (index >= myPlaylistsTotal) return "";
-	return myPlaylistName[index];		
+	return pagerLoadedName (playlistPager, index);
 }
 
-
 char *getPlaylistName (int index){
-	
-	if (index >= MAXPLAYLISTS) return "";
-	if (index >= myPlaylistsTotal) return "";
-	while (index >= myPlaylistsCount){
-		getMyPlaylistsPage (myPlaylistsCount);
-	}
-	return myPlaylistName[index];		
+	return pagerName (playlistPager, index);
 }
 
 char *getPlaylistUri (int index){
-	
-	if (index >= MAXPLAYLISTS) return "";
-	if (index >= myPlaylistsTotal) return "";
-	while (index >= myPlaylistsCount){
-		getMyPlaylistsPage (myPlaylistsCount);
-	}
-	return myPlaylistUri[index];		
+	return pagerUri (playlistPager, index);
 }
 
 void initMyPlaylists (){
-	
-	myPlaylistsCount = 0;
-	myPlaylistsTotal = 0;
-	getMyPlaylistsPage (0);
+	pagerReset (playlistPager);
 }
 
 int getMyPlaylistsTotal (){
-	return myPlaylistsTotal;
+	int total = pagerTotal (playlistPager);
+	return (total < 0) ? 0 : total;
 }
 
 int getMyPlaylistsCount (){
-	return myPlaylistsCount;
+	return pagerCount (playlistPager);
 }
 
 int myPlaylistsMenuIndex = 0;
@@ -1631,12 +1581,7 @@ void gotoMyPlaylists (){
 void loadMyPlaylists2 (){
 	printf ("loadMyPlaylists2 ()\n"); 
 	initMyPlaylists ();
-	char *title;
-	int index = 0;
-	do {
-		title = getPlaylistName (index++);
-	} while (title[0]);	
-	printf ("loadMyPlaylists2 got %d items\n",index-1);
+	pagerLoadAll (playlistPager);
 	goBack (); 
 }	
 
@@ -1648,8 +1593,12 @@ void loadMyPlaylists (){
 	else loadMyPlaylists2 ();		
 }	
 
+// items not loaded yet show as ... until their page arrives
+
 char *getCleanPlaylistName (int index){
-	return (cleanName(getPlaylistName(index)));
+	char *name = getPlaylistName (index);
+	if (!name[0] && (index < getMyPlaylistsTotal ())) return "...";
+	return (cleanName(name));
 }	
 
 
@@ -1707,6 +1656,7 @@ int myPlaylistsHandler (int e){
 	else if ((e == KNOBPUSH) || (e == PLAYSTOPBUTTON)){
 		char *uri = getPlaylistUri(myPlaylistsMenuIndex);
 		printf ("Play uri = %s\n",uri);		
+		if (!uri[0]) return 1;				// not loaded yet
 		playUri (uri);
 		gotoIdle ();		
 		return 1;
@@ -1722,90 +1672,29 @@ int myPlaylistsHandler (int e){
 int myShowsMenuIndex = 0;
 int myShowsMenuOffset = 0;
 
-// for this to work as intended index should equal the 
-// current value of myShowsCount
-
-
-void getMyShowsPage (int index){
-	
-	cJSON *response = getMyShows (index,10);
-	
-	
-	if (!response) return;
-	cJSON *total = cJSON_GetObjectItemCaseSensitive(response, "total");
-	if (!total) goto gmppx;
-	myShowsTotal = total->valueint;
-
-	printf ("Total = %d\n",myShowsTotal);
-
-	cJSON *items = cJSON_GetObjectItemCaseSensitive(response, "items");
-	int count = cJSON_GetArraySize (items);
-	
-	printf ("Count = %d\n",count);	
-	
-	if ((index + count)>MAXSHOWS){
-		printf ("getMyShowsPage () too many shows\n");
-		goto gmppx;
-	}
-	int n;
-	for (n=0;n<count;n++){
-		cJSON *item = cJSON_GetArrayItem (items,n);
-		cJSON *show = cJSON_GetObjectItemCaseSensitive(item, "show");
-		cJSON *name = cJSON_GetObjectItemCaseSensitive(show, "name");
-		cJSON *uri = cJSON_GetObjectItemCaseSensitive(show, "uri");	
-		
-		printf ("Name = %s\n",name->valuestring);
-		printf ("Uri = %s\n",uri->valuestring);
-		printf ("Index = %d\n",index+n);
-				
-		if (name) strcpy (myShowName[index+n],name->valuestring);
-		else *myShowName[index+n] = 0;
-		if (uri) strcpy (myShowUri[index+n],uri->valuestring);
-		else *myShowUri[index+n] = 0;
-	}
-	myShowsCount += count;
-	
-gmppx:
-	cJSON_Delete (response);
-	return;
+void showsLoaded (){
+	if (uiState == MYSHOWS) addEvent (UIREFRESH);
 }
 
 char *getShowName (int index){
-	
-	if (index >= MAXSHOWS) return "";
-	if (index >= myShowsTotal) return "";
-	while (index >= myShowsCount){
-		getMyShowsPage (myShowsCount);
-	}
-	return myShowName[index];		
+	char *name = pagerName (showPager, index);
+	if (!name[0] && (index < getMyShowsTotal ())) return "...";
+	return name;
 }
 
 char *getShowUri (int index){
-
-	printf ("getShowUri %d, %s\n",index,myShowUri[0]);
-	
-	if (index >= MAXSHOWS) return "";
-	if (index >= myShowsTotal) return "";
-	while (index >= myShowsCount){
-		getMyShowsPage (myShowsCount);
-	}
-	return myShowUri[index];		
+	return pagerUri (showPager, index);
 }
 
 void initMyShows (){
-	
-	myShowsCount = 0;
-	myShowsTotal = 0;
-	getMyShowsPage (0);
+	pagerReset (showPager);
 }
 
 int getMyShowsTotal (){
-	return myShowsTotal;
+	int total = pagerTotal (showPager);
+	return (total < 0) ? 0 : total;
 }
 
-
-
-
 void gotoMyShows (){	
     callState(MYSHOWS);
 	initMyShows ();
@@ -1866,6 +1755,7 @@ int myShowsHandler (int e){
 	else if (e == PLAYSTOPBUTTON){	
 		char *uri = getShowUri(myShowsMenuIndex);
 		printf ("Play %d uri = %s\n",myShowsMenuIndex,uri);		
+		if (!uri[0]) return 1;				// not loaded yet
 		playUri (uri);		
 		gotoIdle ();		
 		return 1;
@@ -1923,47 +1813,52 @@ int getFavouritesTotal (){
 	else return 0;
 }	
 
+// in the settings store, or if the list is too big for it in the
+// /spiffs/Favourites file used before the store
+
 void saveFavourites() {
 
   if (!favourites)
     return;
 
-  char *jsonString = cJSON_Print(favourites);
+  char *jsonString = cJSON_PrintUnformatted(favourites);
+  if (!jsonString)
+    return;
 
   //  printf("saveFavourites %s\n", jsonString);
 
-  FILE *f = fopen("/spiffs/Favourites", "wb");
-  fprintf(f, "%s", jsonString);
-  fclose(f);
+  if (setSetting("favourites", jsonString)) {
+    FILE *f = fopen("/spiffs/Favourites", "wb");
+    if (f) {
+      fputs(jsonString, f);
+      fclose(f);
+    } else
+      printf("saveFavourites failed\n");
+    setSetting("favourites", NULL); // the file has the newer list
+  }
   cJSON_free(jsonString);
+  bumpFavouritesVersion();
 }
 
-int loadFavourites() {
-
-  if (!fileExists("/spiffs/Favourites"))
-    return 0;
+// from the settings store, or the /spiffs/Favourites file. A list from
+// the file is moved to the store if it fits, else it stays in the file
 
-  FILE *f = fopen("/spiffs/Favourites", "r");
-  if (!f)
-    return 0;
-
-  fseeko(f, 0, SEEK_END);
-  int size = ftello(f);
-  fseeko(f, 0, SEEK_SET);
+int loadFavourites() {
 
-  //  printf("Favourites file length %d\n", size);
-  char *buf = (char *) malloc(size + 1);
+  char *buf = getSetting("favourites");
+  int imported = 0;
   if (!buf) {
-    fclose(f);
-    return 0;
+    buf = readFile("/spiffs/Favourites");
+    imported = 1;
   }
-  memset(buf, 0, size + 1);
-  fread(buf, 1, size, f);
-  fclose(f);
+  if (!buf)
+    return 0;
 
   printf("favourites = %s\n", buf);
 
   favourites = cJSON_Parse(buf);
+  if (imported && favourites)
+    setSetting("favourites", buf);
 
   free(buf);
   return (int)favourites;
@@ -2144,7 +2039,9 @@ void paintBottomLeftStatus() {
 
     lv_label_set_text(menuLeftStatus, msg);
   } else if (isRadioSource()) {
-    if (isRadioPlaying())
+    if (isRadioPaused())
+      lv_label_set_text(menuLeftStatus, LV_SYMBOL_PAUSE);
+    else if (isRadioPlaying())
       lv_label_set_text(menuLeftStatus, LV_SYMBOL_PLAY);
     else
       lv_label_set_text(menuLeftStatus, LV_SYMBOL_STOP);
@@ -2360,12 +2257,8 @@ int idleHandler(int e) {
     printf("idleHandler Play/Stop\n");
     if (isSpotifySource())
       playPause();
-    else if (isRadioSource()) {
-      if (isRadioPlaying())
-        stopPlay();
-      else
-		restartCurrentRadio();
-    }
+    else if (isRadioSource())
+      radioPlayStop();
     displayIdle();
     return 1;
   } else if (e == NEXTBUTTON) {
@@ -2374,7 +2267,10 @@ int idleHandler(int e) {
     return 1;
   } else if (e == BACKBUTTON) {
     printf("idleHandler Back\n");
-    startPrev();
+    if (isRadioSource())
+      skipRadio(-RADIOSKIPBACKMS);
+    else
+      startPrev();
     return 1;
   } else if (e == ROTARYUP) {
     v = getSettingsVolume();
@@ -2534,6 +2430,7 @@ int doUI(int e) {
 	int tn = getTrackCount ();
 	if ((tn < 0)||(tn > 200)){
 		printf ("Invalid trackCount\n");
+		flushSettings ();
 		esp_restart ();
 	}	
 
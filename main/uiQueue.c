@@ -0,0 +1,150 @@
+/********************************************************
+	uiQueue.c
+
+	The UI event queue. There is one queue per priority, buttons and
+	the knob share the high priority queue so their order is kept,
+	refresh and timer events wait behind them. Rotary events are merged
+	into a net delta as they are queued and an up followed by a down
+	cancels out
+
+		uiQueuePut (u,e,now)	queue e, 0 if the queue was full
+		uiQueueFind (u,e)		1 if e is already queued
+		uiQueueGet (u,now)		the next event, input first, 0 if none.
+								a merged rotary entry comes out one
+								step at a time
+		uiQueueTakeRotary (u)	the net rotary delta at the head of the
+								input queue, taken all at once
+
+	The enqueue to dequeue latency is kept per priority as a log2
+	millisecond histogram. Times are in us from esp_timer_get_time on
+	the board. There is no locking here, ui.c holds uiLock.mutex round
+	every call. Only libc is used so the queue can be tested on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "uiQueue.h"
+
+int uiEventPriority (int e){
+	if ((e >= NEXTBUTTON)&&(e <= ROTARYDOWN)) return 0;
+	if ((e == EJECTHELD)||(e == BACKBUTTONHELD)) return 0;
+	return 1;
+}
+
+static int isRotary (int e){
+	return (e == ROTARYUP)||(e == ROTARYDOWN);
+}
+
+void uiQueueReset (uiEvents_t *u){
+	memset (u,0,sizeof(uiEvents_t));
+}
+
+int uiQueuePut (uiEvents_t *u, int e, int64_t now){
+
+	uiQueue_t *q = &u->queues[uiEventPriority (e)];
+	int d = (e == ROTARYUP) ? 1 : (e == ROTARYDOWN) ? -1 : 0;
+
+	u->queued++;
+
+// merge with a rotary event at the tail
+
+	if (d && q->len){
+		int last = q->in ? q->in - 1 : UIQLEN - 1;
+		uiEvent_t *t = &q->q[last];
+		if (isRotary (t->e)){
+			t->delta += d;
+			u->merged++;
+			if (t->delta == 0){					// cancelled out
+				q->in = last;
+				q->len--;
+			}
+			else t->e = (t->delta > 0) ? ROTARYUP : ROTARYDOWN;
+			return 1;
+		}
+	}
+
+	if (q->len >= UIQLEN){
+		u->dropped++;
+		printf ("ERROR UI queue full - dropped event %d\n",e);
+		return 0;
+	}
+
+	q->q[q->in].e = e;
+	q->q[q->in].delta = d;
+	q->q[q->in].time = now;
+	q->len++;
+	if (++q->in >= UIQLEN) q->in = 0;
+	return 1;
+}
+
+int uiQueueFind (uiEvents_t *u, int e){
+	uiQueue_t *q = &u->queues[uiEventPriority (e)];
+	int o = q->out;
+	for (int n = 0;n < q->len;n++){
+		if (q->q[o].e == e) return 1;
+		if (++o >= UIQLEN) o = 0;
+	}
+	return 0;
+}
+
+static void recordLatency (uiEvents_t *u, int p, int64_t us){
+	int64_t ms = us / 1000;
+	int b = 0;
+	while ((b < UIHISTBUCKETS - 1) && (ms >= (1 << b))) b++;
+	u->latency[p][b]++;
+}
+
+int uiQueueGet (uiEvents_t *u, int64_t now){
+
+	for (int p = 0;p < UIPRIORITIES;p++){
+		uiQueue_t *q = &u->queues[p];
+		if (!q->len) continue;
+		uiEvent_t *h = &q->q[q->out];
+		int e = h->e;
+		if (h->time){
+			recordLatency (u,p,now - h->time);
+			h->time = 0;						// count each entry once
+		}
+		if (isRotary (e)){
+			int step = (h->delta > 0) ? 1 : -1;
+			e = (step > 0) ? ROTARYUP : ROTARYDOWN;
+			h->delta -= step;
+			if (h->delta){						// rest stays at the head
+				h->e = (h->delta > 0) ? ROTARYUP : ROTARYDOWN;
+				return e;
+			}
+		}
+		q->len--;
+		if (++q->out >= UIQLEN) q->out = 0;
+		return e;
+	}
+	return 0;
+}
+
+// returns the net up count, taken from the head of the input queue
+
+int uiQueueTakeRotary (uiEvents_t *u){
+	uiQueue_t *q = &u->queues[0];
+	int r = 0;
+	while (q->len && isRotary (q->q[q->out].e)){
+		r += q->q[q->out].delta;
+		q->len--;
+		if (++q->out >= UIQLEN) q->out = 0;
+	}
+	return r;
+}
+
+void uiQueuePrint (uiEvents_t *u){
+	printf ("ui events queued %d merged %d dropped %d waiting %d/%d\n",u->queued,
+		u->merged,u->dropped,u->queues[0].len,u->queues[1].len);
+	for (int p = 0;p < UIPRIORITIES;p++){
+		printf ("%s latency ms:",p ? "background" : "input");
+		for (int b = 0;b < UIHISTBUCKETS;b++){
+			printf (" %s%d:%d",(b == UIHISTBUCKETS - 1) ? ">=" : "<",
+				(b == UIHISTBUCKETS - 1) ? 1 << (b - 1) : 1 << b,u->latency[p][b]);
+		}
+		printf ("\n");
+	}
+}
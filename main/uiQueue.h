@@ -0,0 +1,76 @@
+/********************************************************
+	uiQueue.h
+
+	UI event codes and the priority queue that holds them until the
+	main loop takes them - see uiQueue.c
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// UI Events
+
+typedef enum {
+	NOTHING,					// 0
+	NEXTBUTTON,
+	PLAYSTOPBUTTON,
+	BACKBUTTON,
+	EJECTBUTTON,
+	KNOBPUSH,
+	ROTARYUP,
+	ROTARYDOWN,
+	UITIMEOUT,
+
+	UIREFRESH,
+	UIALERT,
+	UITIMER,
+
+	EJECTHELD,
+	BACKBUTTONHELD,
+
+	ENDOFTRACK,
+	INITPLAYLISTS
+
+} uievent;
+
+#define UIQLEN 32
+#define UIPRIORITIES 2
+#define UIHISTBUCKETS 12		// event latency, <1ms <2ms <4ms ... >=1024ms
+
+typedef struct {
+	int e;
+	int delta;				// rotary steps still to deliver
+	int64_t time;			// when queued, us
+} uiEvent_t;
+
+typedef struct {
+	uiEvent_t q[UIQLEN];
+	int len;				// number of events in queue
+	int in;					// next insertion
+	int out;				// next removal
+} uiQueue_t;
+
+typedef struct {
+	uiQueue_t queues[UIPRIORITIES];
+	int queued;
+	int merged;
+	int dropped;
+	int latency[UIPRIORITIES][UIHISTBUCKETS];
+} uiEvents_t;
+
+int uiEventPriority (int e);
+void uiQueueReset (uiEvents_t *u);
+int uiQueuePut (uiEvents_t *u, int e, int64_t now);
+int uiQueueFind (uiEvents_t *u, int e);
+int uiQueueGet (uiEvents_t *u, int64_t now);
+int uiQueueTakeRotary (uiEvents_t *u);
+void uiQueuePrint (uiEvents_t *u);
+
+#ifdef __cplusplus
+}
+#endif
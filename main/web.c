@@ -13,6 +13,12 @@ in response to a request for / or /index.html
 The web Ui has been used for development so web.c
 supports endpoints reconnect, blob and connect that will be deprecated
 
+The page follows the player with a long poll on /getStatus and fetches
+favourites and playlists from their own endpoints only when their
+version changes - see Status versions below
+
+/metrics returns task CPU and stack use and heap figures for Prometheus
+
 
 *********************************************************/
 
@@ -41,7 +47,17 @@ supports endpoints reconnect, blob and connect that will be deprecated
 #include <time.h>
 #include <unistd.h>
 
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "jsonWriter.h"
+#include "memTag.h"
+#include "tracer.h"
 #include "locoBoard.h"
+#include "webPage.h"
 #include <loco.h>
 
 extern const char *mainPage;
@@ -55,15 +71,85 @@ char postBufferW[1000];
 
 int min(int a, int b) { return a > b ? b : a; }
 
+// The page is served from webAssets - locoPage.cpp gzipped and split
+// into html, css and js at build time by pagePack.py. The css and js are
+// named by their hash so they are cached for ever, the html is
+// revalidated with its ETag. Clients that do not take gzip get the
+// original single page from locoPage.cpp
+
+int pageRequests = 0;
+int pageNotModified = 0;
+int pagePlain = 0;
+int64_t pageBytes = 0;
+int64_t pageTime = 0;
+
+int acceptsGzip(httpd_req_t *req) {
+  char accept[64];
+  if (httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept,
+                                  sizeof(accept)) != ESP_OK)
+    return 0;
+  return strstr(accept, "gzip") != NULL;
+}
+
+esp_err_t sendWebAsset(httpd_req_t *req, const webAsset_t *a) {
+
+  int64_t t = esp_timer_get_time();
+  pageRequests++;
+
+  char match[40];
+  httpd_resp_set_hdr(req, "ETag", a->etag);
+  httpd_resp_set_hdr(req, "Cache-Control", a->cacheControl);
+  httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+  if ((httpd_req_get_hdr_value_str(req, "If-None-Match", match,
+                                   sizeof(match)) == ESP_OK) &&
+      webAssetMatches(a, match)) {
+    httpd_resp_set_status(req, "304 Not Modified");
+    httpd_resp_send(req, NULL, 0);
+    pageNotModified++;
+  } else {
+    httpd_resp_set_type(req, a->type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    httpd_resp_send(req, (const char *)a->data, a->len);
+    pageBytes += a->len;
+  }
+
+  pageTime += esp_timer_get_time() - t;
+  return ESP_OK;
+}
+
 esp_err_t mainHandler(httpd_req_t *req) {
 
-  httpd_resp_send(req, mainPage, HTTPD_RESP_USE_STRLEN);
+  const webAsset_t *page = findWebAsset("/");
+
+  if (page && acceptsGzip(req))
+    sendWebAsset(req, page);
+  else {
+    pagePlain++;
+    httpd_resp_send(req, mainPage, HTTPD_RESP_USE_STRLEN);
+  }
 
   keepAwake();
 
   return ESP_OK;
 }
 
+esp_err_t assetHandler(httpd_req_t *req) {
+
+  const webAsset_t *a = findWebAsset(req->uri);
+
+  if (!a || !strcmp(a->uri, "/")) {
+    httpd_resp_send_404(req);
+    return ESP_OK;
+  }
+  return sendWebAsset(req, a);
+}
+
+httpd_uri_t uriAssets = {.uri = "/assets/*",
+                         .method = HTTP_GET,
+                         .handler = assetHandler,
+                         .user_ctx = NULL};
+
 httpd_uri_t uriIndex = {.uri = "/index.html",
                         .method = HTTP_GET,
                         .handler = mainHandler,
@@ -152,80 +238,439 @@ int isPlaying() {
   if (isSpotifySource())
     return getStateIsPlaying() && !getStateIsPaused();
   else if (isRadioSource())
-    return isRadioPlaying();
+    return isRadioPlaying() && !isRadioPaused();
   return 0;
 }
 
-// creates a cJSON object - caller must free
+// JSON responses are streamed with jsonWriter through a JSONCHUNK buffer
+// on the stack, so the memory a response takes does not grow with its
+// length. Trees that come from libloco are walked by writeCJSON rather
+// than printed into a string first
 
-cJSON *getPlaylists() {
+#define JSONCHUNK 512
 
-  int n;
+int jsonResponses = 0;
+int64_t jsonBytes = 0;
+int jsonChunks = 0;
 
-  int pc = getMyPlaylistsCount();
+int httpFlush(void *arg, const char *buf, int len) {
+  return httpd_resp_send_chunk((httpd_req_t *)arg, buf, len) != ESP_OK;
+}
 
-  if (!pc)
-    return NULL;
+void startJsonResponse(httpd_req_t *req, jsonWriter_t *w, char *buf) {
+  httpd_resp_set_type(req, "application/json");
+  jsonInit(w, buf, JSONCHUNK, httpFlush, req);
+}
+
+// returns the bytes sent
+
+int endJsonResponse(httpd_req_t *req, jsonWriter_t *w) {
+  if (jsonEnd(w))
+    printf("endJsonResponse %s failed after %d bytes\n", req->uri, w->total);
+  else
+    httpd_resp_send_chunk(req, NULL, 0);
+  jsonResponses++;
+  jsonBytes += w->total;
+  jsonChunks += w->flushes;
+  return w->total;
+}
+
+void writeCJSON(jsonWriter_t *w, const char *key, cJSON *item) {
+
+  if (cJSON_IsObject(item) || cJSON_IsArray(item)) {
+    int object = cJSON_IsObject(item);
+    if (object)
+      jsonObjectStart(w, key);
+    else
+      jsonArrayStart(w, key);
+    cJSON *child;
+    cJSON_ArrayForEach(child, item) {
+      writeCJSON(w, object ? child->string : NULL, child);
+    }
+    if (object)
+      jsonObjectEnd(w);
+    else
+      jsonArrayEnd(w);
+  } else if (cJSON_IsString(item))
+    jsonString(w, key, item->valuestring);
+  else if (cJSON_IsNumber(item))
+    jsonNumber(w, key, item->valuedouble);
+  else if (cJSON_IsBool(item))
+    jsonBool(w, key, cJSON_IsTrue(item));
+  else
+    jsonNull(w, key);
+}
+
+// a cJSON array, or [] if there is none
+
+void sendCJSON(httpd_req_t *req, cJSON *item) {
+  char buf[JSONCHUNK];
+  jsonWriter_t w;
+  startJsonResponse(req, &w, buf);
+  if (item)
+    writeCJSON(&w, NULL, item);
+  else {
+    jsonArrayStart(&w, NULL);
+    jsonArrayEnd(&w);
+  }
+  endJsonResponse(req, &w);
+}
+
+// Status versions
+//
+// statusVersion changes whenever anything reported by /getStatus changes.
+// Favourites and playlists have versions of their own and are served by
+// /getFavourites and /getPlaylists so that the status itself stays small.
+// Each version is also the ETag of its endpoint, prefixed with a boot id
+// so that a copy cached before a reboot is never matched.
+//
+// /getStatus?wait=<version> is a long poll. If version is still current
+// the request is parked with the Status Waiter task and answered when the
+// version changes, or with 304 after STATUSWAITMS. The httpd task is never
+// blocked so the other endpoints stay responsive.
+//
+// Not everything in the status is signalled by libloco so a fingerprint
+// of the status fields is also checked on each request and while any
+// request is parked.
+
+#define STATUSWAITMS 20000
+#define STATUSPOLLMS 250
+#define MAXSTATUSWAITERS 2
+#define ETAGLEN 32
+
+typedef struct {
+  httpd_req_t *req;
+  uint32_t version;
+  int64_t deadline;
+} statusWaiter_t;
+
+portMUX_TYPE statusMux = portMUX_INITIALIZER_UNLOCKED;
+SemaphoreHandle_t statusWakeSemaphore = NULL;
+SemaphoreHandle_t statusAnswerSemaphore = NULL; // held while answering
+statusWaiter_t statusWaiters[MAXSTATUSWAITERS];
+int statusAccepting = 0; // cleared while the server stops
+
+uint32_t bootId = 0;
+volatile uint32_t statusVersion = 1;
+volatile uint32_t favouritesVersion = 1;
+volatile uint32_t playlistsVersion = 1;
+uint32_t statusPrint = 0;
+
+int statusRequests = 0;
+int statusNotModified = 0;
+int statusParked = 0;
+int statusBusy = 0;
+int64_t statusBytes = 0;
+int64_t statusTime = 0;
+int64_t webStartTime = 0;
+
+void wakeStatusWaiters() {
+  if (statusWakeSemaphore)
+    xSemaphoreGive(statusWakeSemaphore);
+}
 
-  //  printf("getPlaylists got count %d\n", pc);
+void bumpStatusVersion() {
+  taskENTER_CRITICAL(&statusMux);
+  statusVersion++;
+  taskEXIT_CRITICAL(&statusMux);
+  wakeStatusWaiters();
+}
+
+// the status carries the list versions so a list change is a status change
+
+void bumpFavouritesVersion() {
+  taskENTER_CRITICAL(&statusMux);
+  favouritesVersion++;
+  statusVersion++;
+  taskEXIT_CRITICAL(&statusMux);
+  wakeStatusWaiters();
+}
 
-  cJSON *playlists = cJSON_CreateArray();
+void bumpPlaylistsVersion() {
+  taskENTER_CRITICAL(&statusMux);
+  playlistsVersion++;
+  statusVersion++;
+  taskEXIT_CRITICAL(&statusMux);
+  wakeStatusWaiters();
+}
 
-  for (n = 0; n < pc; n++) {
-    char *name = getLoadedPlaylistName(n);
-    //    printf("got name %d %s\n", n, name);
-    cJSON *playlist = cJSON_CreateString(name);
+// 32 bit FNV-1a, s may be NULL
 
-    cJSON_AddItemToArray(playlists, playlist);
+uint32_t statusHash(uint32_t h, char *s) {
+  if (s) {
+    while (*s) {
+      h ^= (uint8_t)*s++;
+      h *= 16777619;
+    }
   }
-  return playlists;
+  h ^= 0xFF; // separator so "ab","c" differs from "a","bc"
+  h *= 16777619;
+  return h;
 }
 
-esp_err_t getStatusHandler(httpd_req_t *req) {
+uint32_t statusFingerprint() {
+  uint32_t h = 2166136261;
+
+  if (isSpotifySource()) {
+    h = statusHash(h, "Spotify");
+    h = statusHash(h, getPlayingTrackName());
+    h = statusHash(h, getPlayingAlbumName());
+    h = statusHash(h, getPlayingArtistName());
+    h = statusHash(h, getPlayingArtUrl());
+  } else if (isRadioSource()) {
+    h = statusHash(h, "Radio");
+    h = statusHash(h, getCurrentStationName());
+    h = statusHash(h, getCurrentStationLogo());
+    jitterStats_t st;
+    if (getRadioBufferStats(&st)) { // the state and underruns, not the fill
+      char health[32];
+      snprintf(health, sizeof(health), "%d %lu", st.state, (unsigned long)st.underruns);
+      h = statusHash(h, health);
+    }
+  }
+  h = statusHash(h, isPlaying() ? "true" : "false");
+  h = statusHash(h, getBreadcrumbs());
+  return h;
+}
+
+// bumps statusVersion if the fingerprint has moved, returns the version
+
+uint32_t updateStatusVersion() {
+  uint32_t print = statusFingerprint();
+  taskENTER_CRITICAL(&statusMux);
+  if (print != statusPrint) {
+    statusPrint = print;
+    statusVersion++;
+  }
+  uint32_t v = statusVersion;
+  taskEXIT_CRITICAL(&statusMux);
+  return v;
+}
+
+void makeEtag(char *etag, char kind, uint32_t version) {
+  snprintf(etag, ETAGLEN, "\"%08lx-%c%lu\"", (unsigned long)bootId, kind,
+           (unsigned long)version);
+}
+
+int etagMatches(httpd_req_t *req, char *etag) {
+  char match[ETAGLEN * 2];
+  if (httpd_req_get_hdr_value_str(req, "If-None-Match", match,
+                                  sizeof(match)) != ESP_OK)
+    return 0;
+  return strstr(match, etag) != NULL;
+}
 
-  cJSON *status = cJSON_CreateObject();
+void setVersionHeaders(httpd_req_t *req, char *etag) {
+  httpd_resp_set_hdr(req, "ETag", etag);
+  httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+}
+
+void sendNotModified(httpd_req_t *req, char *etag) {
+  setVersionHeaders(req, etag);
+  httpd_resp_set_status(req, "304 Not Modified");
+  httpd_resp_send(req, NULL, 0);
+  statusNotModified++;
+}
+
+void sendStatus(httpd_req_t *req, uint32_t v) {
+
+  char etag[ETAGLEN];
+  makeEtag(etag, 's', v);
+  setVersionHeaders(req, etag);
+
+  char buf[JSONCHUNK];
+  jsonWriter_t w;
+  startJsonResponse(req, &w, buf);
+
+  jsonObjectStart(&w, NULL);
   char version[30];
   sprintf(version, "%s %s", __DATE__, __TIME__);
-  cJSON_AddStringToObject(status, "version", version);
+  jsonString(&w, "version", version);
+  jsonNumber(&w, "statusVersion", v);
+  jsonNumber(&w, "favouritesVersion", favouritesVersion);
+  jsonNumber(&w, "playlistsVersion", playlistsVersion);
 
   if (isSpotifySource()) {
-    cJSON_AddStringToObject(status, "source", "Spotify");
-    cJSON_AddStringToObject(status, "track", cleanName(getPlayingTrackName()));
-    cJSON_AddStringToObject(status, "album", cleanName(getPlayingAlbumName()));
-    cJSON_AddStringToObject(status, "artist",
-                            cleanName(getPlayingArtistName()));
-    cJSON_AddStringToObject(status, "art", getPlayingArtUrl());
+    jsonString(&w, "source", "Spotify");
+    jsonString(&w, "track", cleanName(getPlayingTrackName()));
+    jsonString(&w, "album", cleanName(getPlayingAlbumName()));
+    jsonString(&w, "artist", cleanName(getPlayingArtistName()));
+    jsonString(&w, "art", getPlayingArtUrl());
   } else if (isRadioSource()) {
-    cJSON_AddStringToObject(status, "source", "Radio");
-    cJSON_AddStringToObject(status, "station", getCurrentStationName());
-    cJSON_AddStringToObject(status, "art", getCurrentStationLogo());
+    jsonString(&w, "source", "Radio");
+    jsonString(&w, "station", getCurrentStationName());
+    jsonString(&w, "art", getCurrentStationLogo());
+    jitterStats_t st;
+    if (getRadioBufferStats(&st)) {
+      jsonObjectStart(&w, "buffer");
+      jsonString(&w, "state", jitterStateName(st.state));
+      jsonNumber(&w, "fillMs", st.fillMs);
+      jsonNumber(&w, "targetMs", st.targetMs);
+      jsonNumber(&w, "prebufferMs", st.prebufferMs);
+      jsonNumber(&w, "jitterMs", st.jitterMs);
+      jsonNumber(&w, "lateMs", st.lateMs);
+      jsonNumber(&w, "startupMs", st.startupMs);
+      jsonNumber(&w, "underruns", st.underruns);
+      jsonNumber(&w, "starts", st.starts);
+      jsonObjectEnd(&w);
+    }
+    tapeStats_t ts;
+    int behindMs;
+    if (getTimeShiftStats(&ts, &behindMs)) {
+      jsonObjectStart(&w, "timeShift");
+      jsonBool(&w, "paused", isRadioPaused());
+      jsonNumber(&w, "behindMs", behindMs);
+      jsonNumber(&w, "heldMs", streamBytesToMs(ts.held));
+      jsonNumber(&w, "maxMs", getTimeShiftMaxMs());
+      jsonBool(&w, "spill", ts.spilling);
+      jsonObjectEnd(&w);
+    }
+  }
+
+  jsonString(&w, "playing", isPlaying() ? "true" : "false");
+  jsonString(&w, "breadcrumbs", getBreadcrumbs());
+  jsonObjectEnd(&w);
+
+  statusBytes += endJsonResponse(req, &w);
+}
+
+// answers a parked request, with the status if it has moved on
+
+void answerStatusWaiter(httpd_req_t *req, uint32_t waitVersion) {
+  uint32_t v = statusVersion;
+  if (v != waitVersion)
+    sendStatus(req, v);
+  else {
+    char etag[ETAGLEN];
+    makeEtag(etag, 's', v);
+    sendNotModified(req, etag);
+  }
+  httpd_req_async_handler_complete(req);
+}
+
+// returns 0 if all waiter slots are in use
+
+int parkStatusRequest(httpd_req_t *req, uint32_t version) {
+
+  httpd_req_t *copy = NULL;
+  int slot = -1;
+
+  taskENTER_CRITICAL(&statusMux);
+  for (int n = 0; n < MAXSTATUSWAITERS; n++) {
+    if (!statusWaiters[n].req) {
+      slot = n;
+      statusWaiters[n].req = req; // reserve
+      break;
+    }
+  }
+  taskEXIT_CRITICAL(&statusMux);
+
+  if (slot < 0)
+    return 0;
+
+  if (!statusAccepting || httpd_req_async_handler_begin(req, &copy) != ESP_OK) {
+    statusWaiters[slot].req = NULL;
+    return 0;
+  }
+
+  taskENTER_CRITICAL(&statusMux);
+  statusWaiters[slot].version = version;
+  statusWaiters[slot].deadline = esp_timer_get_time() + STATUSWAITMS * 1000LL;
+  statusWaiters[slot].req = copy;
+  taskEXIT_CRITICAL(&statusMux);
+
+  statusParked++;
+  wakeStatusWaiters();
+  return 1;
+}
+
+// answers parked requests whose version has changed or that have timed
+// out, or all of them if all is set
+
+void releaseStatusWaiters(int all) {
+
+  if (!statusAnswerSemaphore)
+    return;
+  xSemaphoreTake(statusAnswerSemaphore, portMAX_DELAY);
+  int64_t now = esp_timer_get_time();
+
+  for (int n = 0; n < MAXSTATUSWAITERS; n++) {
+    httpd_req_t *req = NULL;
+    uint32_t version = 0;
+
+    taskENTER_CRITICAL(&statusMux);
+    statusWaiter_t *w = &statusWaiters[n];
+    if (w->req && w->deadline &&
+        (all || (w->version != statusVersion) || (now >= w->deadline))) {
+      req = w->req;
+      version = w->version;
+      w->req = NULL;
+      w->deadline = 0;
+    }
+    taskEXIT_CRITICAL(&statusMux);
+
+    if (req)
+      answerStatusWaiter(req, version);
+  }
+  xSemaphoreGive(statusAnswerSemaphore);
+}
+
+int statusWaitersParked() {
+  for (int n = 0; n < MAXSTATUSWAITERS; n++) {
+    if (statusWaiters[n].req)
+      return 1;
+  }
+  return 0;
+}
+
+void statusWaiterThread(void *p) {
+  while (1) {
+    xSemaphoreTake(statusWakeSemaphore, pdMS_TO_TICKS(STATUSPOLLMS));
+    if (!statusWaitersParked())
+      continue;
+    updateStatusVersion();
+    releaseStatusWaiters(0);
   }
+}
 
-  cJSON_AddStringToObject(status, "playing", isPlaying() ? "true" : "false");
-  cJSON_AddStringToObject(status, "breadcrumbs", getBreadcrumbs());
+void initStatus() {
+  statusAccepting = 1;
+  if (statusWakeSemaphore)
+    return;
+  bootId = esp_random();
+  webStartTime = esp_timer_get_time();
+  statusWakeSemaphore = xSemaphoreCreateBinary();
+  statusAnswerSemaphore = xSemaphoreCreateMutex();
+  xTaskCreate(statusWaiterThread, "Status Waiter", 4096, NULL, 5, NULL);
+}
+
+esp_err_t getStatusHandler(httpd_req_t *req) {
 
-  cJSON *fav = getFavourites();
-  if (fav)
-    cJSON_AddItemToObject(status, "favourites", fav);
+  int64_t t = esp_timer_get_time();
+  statusRequests++;
+  traceBegin(TRACESTATUS);
 
-  cJSON *plists = getPlaylists();
-  if (plists)
-    cJSON_AddItemToObject(status, "playlists", plists);
+  uint32_t v = updateStatusVersion();
 
-  char *jsonString = cJSON_Print(status);
-  httpd_resp_send(req, jsonString, HTTPD_RESP_USE_STRLEN);
+  char etag[ETAGLEN];
+  makeEtag(etag, 's', v);
 
-  if (fav)
-    cJSON_DetachItemFromObject(status, "favourites");
-  /*
-    if (plists) {
-      cJSON_DetachItemFromObject(status, "playlists");
-      cJSON_Delete(plists);
+  char wait[12];
+  if (getQueryParameter(req->uri, "wait", wait, sizeof(wait)) &&
+      (strtoul(wait, NULL, 10) == v)) {
+    if (!parkStatusRequest(req, v)) {
+      statusBusy++;
+      httpd_resp_set_status(req, "503 Service Unavailable");
+      httpd_resp_set_hdr(req, "Retry-After", "1");
+      httpd_resp_send(req, NULL, 0);
     }
-  */
-  cJSON_Delete(status);
-  cJSON_free(jsonString);
+  } else if (etagMatches(req, etag))
+    sendNotModified(req, etag);
+  else
+    sendStatus(req, v);
 
+  traceEnd(TRACESTATUS);
+  statusTime += esp_timer_get_time() - t;
   return ESP_OK;
 }
 
@@ -234,6 +679,137 @@ httpd_uri_t uriGetStatus = {.uri = "/getStatus",
                             .handler = getStatusHandler,
                             .user_ctx = NULL};
 
+esp_err_t getFavouritesHandler(httpd_req_t *req) {
+
+  char etag[ETAGLEN];
+  makeEtag(etag, 'f', favouritesVersion);
+
+  if (etagMatches(req, etag)) {
+    sendNotModified(req, etag);
+    return ESP_OK;
+  }
+
+  setVersionHeaders(req, etag);
+  sendCJSON(req, getFavourites());
+
+  return ESP_OK;
+}
+
+httpd_uri_t uriGetFavourites = {.uri = "/getFavourites",
+                                .method = HTTP_GET,
+                                .handler = getFavouritesHandler,
+                                .user_ctx = NULL};
+
+// names are written straight from ui.c without building a tree
+
+esp_err_t getPlaylistsHandler(httpd_req_t *req) {
+
+  char etag[ETAGLEN];
+  makeEtag(etag, 'p', playlistsVersion);
+
+  if (etagMatches(req, etag)) {
+    sendNotModified(req, etag);
+    return ESP_OK;
+  }
+
+  setVersionHeaders(req, etag);
+
+  char buf[JSONCHUNK];
+  jsonWriter_t w;
+  startJsonResponse(req, &w, buf);
+  jsonArrayStart(&w, NULL);
+  int pc = getMyPlaylistsCount();
+  for (int n = 0; n < pc; n++)
+    jsonString(&w, NULL, getLoadedPlaylistName(n));
+  jsonArrayEnd(&w);
+  endJsonResponse(req, &w);
+
+  return ESP_OK;
+}
+
+httpd_uri_t uriGetPlaylists = {.uri = "/getPlaylists",
+                               .method = HTTP_GET,
+                               .handler = getPlaylistsHandler,
+                               .user_ctx = NULL};
+
+// task and heap telemetry as Prometheus text, see telemetry.c
+
+#define METRICSMAX 16384
+
+esp_err_t metricsHandler(httpd_req_t *req) {
+
+  int len = METRICSMAX;
+  char *buf = memTagMalloc(MEMWEB, len, MALLOC_CAP_SPIRAM);
+  int n = buf ? formatMetrics(buf, len) : -1;
+  if (n >= len) { // more tasks than expected
+    memTagFree(buf);
+    len = n + 1;
+    buf = memTagMalloc(MEMWEB, len, MALLOC_CAP_SPIRAM);
+    n = buf ? formatMetrics(buf, len) : -1;
+  }
+  if (n < 0) {
+    memTagFree(buf);
+    httpd_resp_send_500(req);
+    return ESP_OK;
+  }
+
+  httpd_resp_set_type(req, "text/plain; version=0.0.4");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  httpd_resp_send(req, buf, n);
+  memTagFree(buf);
+  return ESP_OK;
+}
+
+httpd_uri_t uriMetrics = {.uri = "/metrics",
+                          .method = HTTP_GET,
+                          .handler = metricsHandler,
+                          .user_ctx = NULL};
+
+// the trace rings as Chrome trace JSON, load in chrome://tracing or
+// ui.perfetto.dev. Recording pauses while the rings are copied
+
+esp_err_t traceHandler(httpd_req_t *req) {
+
+  traceSnapshot_t s;
+  if (traceCapture(&s)) {
+    httpd_resp_send_500(req);
+    return ESP_OK;
+  }
+
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  char buf[JSONCHUNK];
+  jsonWriter_t w;
+  startJsonResponse(req, &w, buf);
+  traceWriteJson(&s, &w);
+  endJsonResponse(req, &w);
+  traceSnapshotFree(&s);
+  return ESP_OK;
+}
+
+httpd_uri_t uriTrace = {.uri = "/trace",
+                        .method = HTTP_GET,
+                        .handler = traceHandler,
+                        .user_ctx = NULL};
+
+void printWebStats() {
+  int64_t secs = (esp_timer_get_time() - webStartTime) / 1000000;
+  if (secs < 1)
+    secs = 1;
+  printf("status version %lu favourites %lu playlists %lu\n",
+         (unsigned long)statusVersion, (unsigned long)favouritesVersion,
+         (unsigned long)playlistsVersion);
+  printf("status requests %d not modified %d parked %d busy %d\n",
+         statusRequests, statusNotModified, statusParked, statusBusy);
+  printf("status bytes %lld (%lld/s) handler %lld us total %lld us avg\n",
+         statusBytes, statusBytes / secs, statusTime,
+         statusRequests ? statusTime / statusRequests : 0);
+  printf("json responses %d bytes %lld chunks %d\n", jsonResponses, jsonBytes,
+         jsonChunks);
+  printf("page requests %d not modified %d plain %d bytes %lld handler %lld us avg\n",
+         pageRequests, pageNotModified, pagePlain, pageBytes,
+         pageRequests ? pageTime / pageRequests : 0);
+}
+
 esp_err_t setPresetsHandler(httpd_req_t *req) {
 
   int size = min(req->content_len, sizeof(postBufferW) - 1);
@@ -321,12 +897,7 @@ esp_err_t vTunerSearchHandler(httpd_req_t *req) {
 
   if ((r > 0) && new) {
     cJSON *stations = vTunerSearch(text);
-    if (stations) {
-      char *jsonString = cJSON_Print(stations);
-      httpd_resp_send(req, jsonString, HTTPD_RESP_USE_STRLEN);
-      free(jsonString);
-    } else
-      httpd_resp_send(req, "[]", HTTPD_RESP_USE_STRLEN);
+    sendCJSON(req, stations);
   } else
     httpd_resp_send(req, "[]", HTTPD_RESP_USE_STRLEN);
 
@@ -340,13 +911,8 @@ esp_err_t vTunerTopHandler(httpd_req_t *req) {
   printf("vTunerTopHandler\n");
 
   cJSON *stations = vTunerTop();
-  if (stations) {
-    char *jsonString = cJSON_Print(stations);
-    httpd_resp_send(req, jsonString, HTTPD_RESP_USE_STRLEN);
-    free(jsonString);
-    cJSON_Delete(stations);
-  } else
-    httpd_resp_send(req, "[]", HTTPD_RESP_USE_STRLEN);
+  sendCJSON(req, stations);
+  cJSON_Delete(stations);
 
   keepAwake();
 
@@ -366,13 +932,8 @@ esp_err_t vTunerItemHandler(httpd_req_t *req) {
   sscanf(index, "%d", &i);
 
   cJSON *stations = vTunerItem(i);
-  if (stations) {
-    char *jsonString = cJSON_Print(stations);
-    httpd_resp_send(req, jsonString, HTTPD_RESP_USE_STRLEN);
-    free(jsonString);
-    cJSON_Delete(stations);
-  } else
-    httpd_resp_send(req, "[]", HTTPD_RESP_USE_STRLEN);
+  sendCJSON(req, stations);
+  cJSON_Delete(stations);
 
   keepAwake();
 
@@ -384,13 +945,8 @@ esp_err_t vTunerBackHandler(httpd_req_t *req) {
   printf("vTunerBackHandler \n");
 
   cJSON *stations = vTunerBack();
-  if (stations) {
-    char *jsonString = cJSON_Print(stations);
-    httpd_resp_send(req, jsonString, HTTPD_RESP_USE_STRLEN);
-    free(jsonString);
-    cJSON_Delete(stations);
-  } else
-    httpd_resp_send(req, "[]", HTTPD_RESP_USE_STRLEN);
+  sendCJSON(req, stations);
+  cJSON_Delete(stations);
 
   keepAwake();
 
@@ -693,12 +1249,51 @@ void printTime() {
 
 char *printBuffer;
 
+// every handler, the wildcard 404 last as they are matched in order
+
+static httpd_uri_t *webHandlers[] = {
+  &uriGetStatus,
+  &uriGetFavourites,
+  &uriGetPlaylists,
+  &uriMetrics,
+  &uriTrace,
+
+  &urivTunerSearch,
+  &urivTunerTop,
+  &urivTunerItem,
+  &urivTunerBack,
+  &uriPlayResult,
+  &uriPlayFavourite,
+  &uriPlayPlaylist,
+
+  &uriSpeed,
+
+  &uriIndex,
+  &uriMain,
+  &uriAssets,
+
+  &uriStop,
+  &uriNext,
+  &uriPrev,
+  &uriPause,
+
+  &uriReconnect,
+  &uriBlob,
+  &uriDisconnect,
+
+  &initPlaylists,
+
+  &uri404,
+};
+
+#define WEBHANDLERS (int)(sizeof(webHandlers) / sizeof(webHandlers[0]))
+
 static httpd_handle_t start_webserver2(void) {
   printf("start_webserver2 ()\n");
   httpd_handle_t server = NULL;
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
   config.lru_purge_enable = true;
-  config.max_uri_handlers = 23;
+  config.max_uri_handlers = WEBHANDLERS;
   config.ctrl_port = 40000; // not sure what this does
 
   config.uri_match_fn = httpd_uri_match_wildcard;
@@ -710,33 +1305,8 @@ static httpd_handle_t start_webserver2(void) {
   printf("Starting server on port: %d\n", config.server_port);
   if (httpd_start(&server, &config) == ESP_OK) {
     ESP_LOGI(TAG, "Registering URI handlers");
-    httpd_register_uri_handler(server, &uriGetStatus);
-
-    httpd_register_uri_handler(server, &urivTunerSearch);
-    httpd_register_uri_handler(server, &urivTunerTop);
-    httpd_register_uri_handler(server, &urivTunerItem);
-    httpd_register_uri_handler(server, &urivTunerBack);
-    httpd_register_uri_handler(server, &uriPlayResult);
-    httpd_register_uri_handler(server, &uriPlayFavourite);
-    httpd_register_uri_handler(server, &uriPlayPlaylist);
-
-    httpd_register_uri_handler(server, &uriSpeed);
-
-    httpd_register_uri_handler(server, &uriIndex);
-    httpd_register_uri_handler(server, &uriMain);
-
-    httpd_register_uri_handler(server, &uriStop);
-    httpd_register_uri_handler(server, &uriNext);
-    httpd_register_uri_handler(server, &uriPrev);
-    httpd_register_uri_handler(server, &uriPause);
-
-    httpd_register_uri_handler(server, &uriReconnect);
-    httpd_register_uri_handler(server, &uriBlob);
-    httpd_register_uri_handler(server, &uriDisconnect);
-
-    httpd_register_uri_handler(server, &initPlaylists);
-
-    httpd_register_uri_handler(server, &uri404);
+    for (int i = 0; i < WEBHANDLERS; i++)
+      httpd_register_uri_handler(server, webHandlers[i]);
 
     return server;
   }
@@ -748,6 +1318,8 @@ static httpd_handle_t start_webserver2(void) {
 void stopWebserver() {
   unsigned long t = millis();
   printf("stopWebserver ()\n");
+  statusAccepting = 0; // parked requests must not outlive their sessions
+  releaseStatusWaiters(1);
   httpd_stop(server2);
   printf("stopWebserver done after %lld\n", millis() - t);
   server2 = NULL;
@@ -756,6 +1328,7 @@ void stopWebserver() {
 void startWebserver() {
   unsigned long t = millis();
   printf("startWebserver ()\n");
+  initStatus();
   server2 = start_webserver2();
   printf("startWebserver result %d after %lld\n", (int)server2, millis() - t);
 }
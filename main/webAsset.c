@@ -0,0 +1,34 @@
+/********************************************************
+	webAsset.c
+
+	Looks up the gzipped page assets generated by pagePack.py (see
+	webPage.h) for the handlers in web.c
+
+		findWebAsset (uri)				the asset for uri, any query
+										is ignored, NULL if none
+		webAssetMatches (a,ifNoneMatch)	1 if the browser's copy is
+										current and a 304 will do
+
+	Only libc is used so loads can be timed on Linux
+
+*********************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "webPage.h"
+
+const webAsset_t *findWebAsset (const char *uri){
+	size_t len = strcspn (uri,"?");
+	for (int n = 0;n < webAssetCount;n++){
+		if ((strlen (webAssets[n].uri) == len) && !strncmp (webAssets[n].uri,uri,len))
+			return &webAssets[n];
+	}
+	return NULL;
+}
+
+// ifNoneMatch is the header value, which may list several tags, or NULL
+
+int webAssetMatches (const webAsset_t *a, const char *ifNoneMatch){
+	return ifNoneMatch && strstr (ifNoneMatch,a->etag);
+}
@@ -0,0 +1,37 @@
+/********************************************************
+	webPage.h
+
+	The web page as gzipped assets, generated at build time from
+	locoPage.cpp by pagePack.py - see webAsset.c and web.c for how
+	they are served
+
+*********************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+typedef struct {
+	const char *uri;				// "/" for the page itself
+	const char *type;
+	const char *cacheControl;
+	const char *etag;				// hash of the uncompressed content
+	const uint8_t *data;			// gzipped
+	int len;
+	int rawLen;
+} webAsset_t;
+
+extern const webAsset_t webAssets[];
+extern const int webAssetCount;
+
+// webAsset.c
+
+const webAsset_t *findWebAsset (const char *uri);
+int webAssetMatches (const webAsset_t *a, const char *ifNoneMatch);
+
+#ifdef __cplusplus
+}
+#endif